@@ -1,3 +0,0 @@
-Import("env")
-
-env.Append(CXXFLAGS=["-frtti"])
\ No newline at end of file
@@ -1,17 +1,22 @@
 #pragma once
 #include <mbed.h>
 #include <Peripheral.hpp>
+#include <Calibration.hpp>
 
 namespace ventctl
 {
+    // Fraction of 3.3 V at an ADC123 pin, VREFINT compensated through AdcScan, then calibrated
     class AIn : public Peripheral<float>
     {
     public:
         AIn(const char* name, PinName pin);
 
+        VC_PERIPHERAL_DESCRIPTOR(float, "AIn", "", PeripheralDescriptor::ANALOG, PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(float&);
         virtual void print(file_t, bool sh = false);
         virtual float read_value();
+        virtual void initialize();
 
         AIn& operator=(float b)
         {
@@ -20,7 +25,9 @@ namespace ventctl
         }
 
     private:
-        AnalogIn m_in;
+        int8_t m_channel;
+        int8_t m_slot;
+        Calibration m_cal;
     };
 
-}
\ No newline at end of file
+}
@@ -1,20 +1,47 @@
 #pragma once
 
 #include <Peripheral.hpp>
+#include <Ramp.hpp>
 #include <mbed.h>
 
+// DAC update rate while ramping, TIM6 triggers both channels
+#ifndef VC_AOUT_RAMP_RATE
+    #define VC_AOUT_RAMP_RATE 1000
+#endif
+
+// Samples in the circular DMA buffer, refilled half at a time
+#ifndef VC_AOUT_RAMP_BUFFER
+    #define VC_AOUT_RAMP_BUFFER 64
+#endif
 
 namespace ventctl
 {
+    /*
+        DAC output (PA4 or PA5). By default a write takes effect at once.
+        After ramp() a write starts a slew limited ramp from the current
+        level instead: the samples are played by DMA on the TIM6 trigger
+        and rendered half a buffer at a time in the DMA interrupt, which
+        stops the stream once the target is reached. A new target takes
+        over at the next unrendered sample, within half a buffer (see
+        Ramp::retarget); writing the current target again changes nothing,
+        so control loops can write every tick.
+    */
     class AOut : public Peripheral<float>
     {
     public:
         AOut(const char* name, PinName pin);
 
+        VC_PERIPHERAL_DESCRIPTOR(float, "AOut", "", PeripheralDescriptor::OUTPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(float&);
         virtual void print(file_t, bool sh = false);
         virtual float read_value();
 
+        // Slew in full scale per second, 0 switches back to immediate writes
+        void ramp(float slew, Ramp::Shape shape = Ramp::Shape::S_CURVE);
+
+        bool ramping() const { return m_running; }
+
         AOut& operator=(float b)
         {
             accept_value(b);
@@ -23,8 +50,24 @@ namespace ventctl
 
     
     private:
-        AnalogOut m_out;
+        static void dma1_irq();
+        static void dma2_irq();
+
+        void on_dma(bool half);
+        void start();
+        void refill(uint16_t* half);
+        void stop();
 
+        static AOut* s_channels[2];
+
+        AnalogOut m_out;
+        uint8_t m_channel;
+        float m_slew;
+        Ramp::Shape m_shape;
+        Ramp m_ramp;
+        uint32_t m_next;            // Next sample of m_ramp to render
+        volatile bool m_running;
+        uint16_t m_buffer[VC_AOUT_RAMP_BUFFER];
     };
 
-}
\ No newline at end of file
+}
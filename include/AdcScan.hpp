@@ -0,0 +1,73 @@
+#pragma once
+
+#include <mbed.h>
+#include <atomic>
+#include <cstdint>
+
+// Inputs in the scan, one ADC2 sequence slot each
+#ifndef VC_ADC_CHANNELS
+    #define VC_ADC_CHANNELS 8
+#endif
+
+// Scans averaged per reading, each half of the DMA buffer holds this many
+#ifndef VC_ADC_OVERSAMPLE
+    #define VC_ADC_OVERSAMPLE 32
+#endif
+
+// Factory VREFINT reading at VDDA = 3.3 V (RM0090, device electronic signature)
+#define VC_VREFINT_CAL (*(const uint16_t*)0x1FFF7A2AU)
+
+namespace ventctl
+{
+    /*
+        Continuous acquisition of every analog input in dual regular
+        simultaneous mode. ADC2 scans the registered channels while ADC1
+        converts VREFINT in lockstep, so every sample has a reference
+        taken at the same instant. DMA2 stream 0 moves the packed pairs
+        into a circular buffer; the half and full transfer interrupts sum
+        VC_ADC_OVERSAMPLE scans per channel (the F4 ADC has no hardware
+        oversampler) and publish the sums behind a sequence counter.
+        Readings are lock-free, ratiometric and calibrated with
+        VREFINT_CAL.
+
+        VREFINT needs at least 10 us of sampling, both ADCs sample for
+        480 cycles of the 21 MHz ADC clock on every slot.
+
+        Channels are added before start(). convert() is a polled single
+        conversion for use before the scan runs.
+    */
+    class AdcScan
+    {
+    public:
+        // Returns the slot, -1 when full or already running
+        static int add(uint8_t channel);
+        // ADC123 channel of a pin (0..15), -1 if the pin has none
+        static int channel(PinName pin);
+        // Switches the pin of a channel to analog mode
+        static void configure_pin(uint8_t channel);
+
+        static void start();
+        static bool running() { return s_running; }
+
+        // Volts at the input, averaged over the last block
+        static float voltage(int slot);
+        static float vdda();
+        static uint32_t blocks() { return s_blocks.load(std::memory_order_relaxed); }
+
+        // Single polled pair VREFINT/channel in volts, while the scan is not running
+        static float convert(uint8_t channel, uint8_t sampling_time);
+
+    private:
+        static void dma_irq();
+        static void process(const uint32_t* words);
+
+        static uint8_t s_channels[VC_ADC_CHANNELS];
+        static uint8_t s_count;
+        static bool s_running;
+
+        static uint32_t s_buffer[2 * VC_ADC_OVERSAMPLE * VC_ADC_CHANNELS];
+
+        static std::atomic<uint32_t> s_seq, s_blocks;
+        static std::atomic<uint32_t> s_raw[VC_ADC_CHANNELS], s_ref[VC_ADC_CHANNELS];
+    };
+}
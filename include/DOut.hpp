@@ -10,6 +10,8 @@ namespace ventctl
     public:
         DOut(const char* name, PinName pin);
 
+        VC_PERIPHERAL_DESCRIPTOR(bool, "DOut", "", PeripheralDescriptor::OUTPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(bool&);
         virtual void print(file_t, bool s = false);
         virtual bool read_value();
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Peripheral.hpp>
+#include <Unit.hpp>
+#include <etl/vector.h>
+#include <initializer_list>
+#include <mbed.h>
+
+#ifndef VC_DOUT_BANK_SIZE
+    #define VC_DOUT_BANK_SIZE 16
+#endif
+
+namespace ventctl
+{
+    /*
+        Digital outputs on one GPIO port, switched together with a single
+        BSRR write. The bank is an int peripheral holding the stage
+        pattern (bit i is stage i), every stage is also registered as a
+        bool peripheral of its own. Stage state is read back from ODR, so
+        there is no shadow copy to race between the heater ticker and the
+        main loop.
+    */
+    class DOutBank : public Peripheral<int>, public StageBank
+    {
+    public:
+        struct Pin
+        {
+            const char* name;
+            PinName pin;
+        };
+
+        class Stage : public Peripheral<bool>
+        {
+        public:
+            Stage(const char* name, DOutBank& bank, uint8_t index);
+
+            VC_PERIPHERAL_DESCRIPTOR(bool, "DOut", "", PeripheralDescriptor::OUTPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::HARDWARE)
+
+            virtual bool accept_value(bool&);
+            virtual void print(file_t, bool s = false);
+            virtual bool read_value();
+
+            Stage& operator=(bool b)
+            {
+                accept_value(b);
+                return *this;
+            }
+
+        private:
+            DOutBank& m_bank;
+            uint8_t m_index;
+        };
+
+        // All pins must be on the same port
+        DOutBank(const char* name, std::initializer_list<Pin> pins);
+
+        VC_PERIPHERAL_DESCRIPTOR(int, "DOutBank", "", PeripheralDescriptor::OUTPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::HARDWARE)
+
+        virtual bool accept_value(int&);
+        virtual void print(file_t, bool s = false);
+        virtual int read_value();
+
+        virtual size_t stages() const { return m_stages.size(); }
+        virtual void write_stages(uint32_t mask, uint32_t pattern);
+        uint32_t read_stages() const;
+
+        Stage& operator[](size_t i) { return m_stages[i]; }
+
+    private:
+        GPIO_TypeDef* m_port;
+        uint16_t m_pins[VC_DOUT_BANK_SIZE];
+        etl::vector<Stage, VC_DOUT_BANK_SIZE> m_stages;
+    };
+}
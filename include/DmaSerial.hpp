@@ -0,0 +1,82 @@
+#pragma once
+
+#include <mbed.h>
+#include <atomic>
+
+#ifndef VC_SERIAL_RX_SIZE
+    #define VC_SERIAL_RX_SIZE 2048
+#endif
+
+#ifndef VC_SERIAL_TX_SIZE
+    #define VC_SERIAL_TX_SIZE 2048
+#endif
+
+namespace ventctl
+{
+    /*
+        UART5 (PC12/PD2) console driven by DMA1: RX runs circularly on
+        stream 0 into a ring, woken by the half/full transfer and idle line
+        interrupts; TX is a ring drained by stream 7 one contiguous chunk at
+        a time. Nothing is polled per character.
+
+        write() only copies into the TX ring. From a thread it waits for
+        room when the ring is full; from an interrupt or the control
+        thread (set_control_thread) the excess is dropped and counted, so
+        a long command response never stalls a control step. Usable as
+        the stdio console (FileHandle).
+    */
+    class DmaSerial : public FileHandle
+    {
+    public:
+        constexpr const static uint32_t RX_FLAG = 1;
+        constexpr const static uint32_t TX_FLAG = 2;
+
+        DmaSerial(PinName tx, PinName rx, int baud = MBED_CONF_PLATFORM_STDIO_BAUD_RATE);
+
+        // Copies up to size received bytes, never blocks
+        size_t receive(char* data, size_t size);
+
+        // Blocks the calling thread until there is unread input
+        void wait_readable();
+
+        // Writes from this thread never wait for the UART
+        void set_control_thread(osThreadId_t thread)
+        {
+            m_control_thread = thread;
+        }
+
+        // FileHandle
+        virtual ssize_t read(void* buffer, size_t size) override;
+        virtual ssize_t write(const void* buffer, size_t size) override;
+        virtual off_t seek(off_t, int) override { return -ESPIPE; }
+        virtual int close() override { return 0; }
+        virtual int isatty() override { return 1; }
+        virtual int sync() override;
+        virtual short poll(short events) const override;
+
+    private:
+        static void uart_irq();
+        static void rx_dma_irq();
+        static void tx_dma_irq();
+
+        void rx_advance();
+        void tx_start();
+        bool may_wait() const;
+
+        static DmaSerial* s_instance;
+
+        serial_t m_serial;
+        rtos::EventFlags m_flags;
+
+        char m_rx[VC_SERIAL_RX_SIZE];
+        uint32_t m_rx_pos;                 // DMA position seen by the last interrupt
+        std::atomic<uint32_t> m_rx_total;  // Bytes received, free running
+        uint32_t m_rx_read;                // Bytes consumed, free running
+
+        char m_tx[VC_SERIAL_TX_SIZE];
+        volatile uint32_t m_tx_head, m_tx_tail; // Free running
+        volatile uint32_t m_tx_busy;            // Length of the transfer in flight
+
+        osThreadId_t m_control_thread;
+    };
+}
@@ -1,10 +1,19 @@
 #pragma once
 #include <Peripheral.hpp>
+#include <Plausibility.hpp>
+#include <Calibration.hpp>
 #include <mbed.h>
-#include <stm32f4xx_hal_adc.h>
 
 namespace ventctl
 {
+    /*
+        PT1000 on an ADC123 channel, sampled by AdcScan with VREFINT
+        compensation. Voltage to resistance goes through a Calibration
+        named like the sensor. Until AdcScan::start() every update() does a
+        polled conversion with the given sampling time; in the scan all
+        channels sample for 480 cycles. A sensor that found the scan full
+        at initialize() says so and reads NO_DATA once the scan runs.
+    */
     class HiFiThermalSensor : public Peripheral<float>
     {
     public:
@@ -22,6 +31,9 @@ namespace ventctl
 
         HiFiThermalSensor(const char* name, uint8_t channel, SamplingTime time = S15_CYCLES);
 
+        VC_PERIPHERAL_DESCRIPTOR(float, "HiFiThermalSensor", "degC", PeripheralDescriptor::ANALOG,
+            PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE | PeripheralDescriptor::UPDATES)
+
         virtual bool accept_value(float&) { return false; } // This thing doesn't accept values to output
 
         // SUDDENLY, returns Celsius
@@ -42,6 +54,10 @@ namespace ventctl
 
         virtual void print(file_t file, bool s = false);
 
+        // Of the last update(), see Plausibility
+        virtual Quality quality() const override { return m_check.quality(); }
+        void set_limits(const PlausibilityLimits& limits) { m_check.set_limits(limits); }
+
         virtual void initialize();
         virtual void update();
 
@@ -49,5 +65,8 @@ namespace ventctl
         uint8_t m_channel;
         float m_voltage;
         SamplingTime m_samplingTime;
+        int8_t m_slot;
+        Plausibility m_check;
+        Calibration m_cal;
     };
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <Peripheral.hpp>
 #include <type_traits>
 #include <ModbusMaster.h>
+#include <MBMetrics.hpp>
 
 namespace ventctl
 {
@@ -14,9 +15,12 @@ namespace ventctl
             m_coil(coil)
             {}
 
+        VC_PERIPHERAL_DESCRIPTOR(bool, "MBCoil", "", PeripheralDescriptor::MODBUS, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(bool& value)
         {
-            return m_mb.writeSingleCoil(m_coil, value) == ModbusMaster::ku8MBSuccess;
+            VC_TRACE_ZONE("Modbus::writeSingleCoil");
+            return modbus_status(m_mb.writeSingleCoil(m_coil, value)) == ModbusMaster::ku8MBSuccess;
         }
 
         virtual void print(file_t f, bool s = false)
@@ -30,7 +34,8 @@ namespace ventctl
 
         virtual bool read_value()
         {
-            auto result = m_mb.readCoils(m_coil, 1) == ModbusMaster::ku8MBSuccess;
+            VC_TRACE_ZONE("Modbus::readCoils");
+            auto result = modbus_status(m_mb.readCoils(m_coil, 1)) == ModbusMaster::ku8MBSuccess;
 
             return  result && (m_mb.getResponseBuffer(0) != 0);
         }
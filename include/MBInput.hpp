@@ -2,6 +2,7 @@
 #include <Peripheral.hpp>
 #include <type_traits>
 #include <ModbusMaster.h>
+#include <MBMetrics.hpp>
 
 namespace ventctl
 {
@@ -14,6 +15,8 @@ namespace ventctl
             m_addr(addr)
             {}
 
+        VC_PERIPHERAL_DESCRIPTOR(bool, "MBInput", "", PeripheralDescriptor::MODBUS, PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(T& value)
         {
             return false;
@@ -27,7 +30,8 @@ namespace ventctl
 
         virtual bool read_value()
         {
-            auto result = m_mb.readDiscreteInputs(m_addr, 1) == ModbusMaster::ku8MBSuccess;
+            VC_TRACE_ZONE("Modbus::readDiscreteInputs");
+            auto result = modbus_status(m_mb.readDiscreteInputs(m_addr, 1)) == ModbusMaster::ku8MBSuccess;
 
             if constexpr(std::is_floating_point_v<T>)
             {
@@ -2,6 +2,7 @@
 #include <Peripheral.hpp>
 #include <type_traits>
 #include <ModbusMaster.h>
+#include <MBMetrics.hpp>
 
 namespace ventctl
 {
@@ -15,6 +16,8 @@ namespace ventctl
             m_addr(addr)
             {}
 
+        VC_PERIPHERAL_DESCRIPTOR(T, "MBInputRegister", "", PeripheralDescriptor::MODBUS, PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(T& value)
         {
             return false;
@@ -28,7 +31,8 @@ namespace ventctl
 
         virtual T read_value()
         {
-            auto result = m_mb.readInputRegisters(m_addr, 1) == ModbusMaster::ku8MBSuccess;
+            VC_TRACE_ZONE("Modbus::readInputRegisters");
+            auto result = modbus_status(m_mb.readInputRegisters(m_addr, 1)) == ModbusMaster::ku8MBSuccess;
 
             if constexpr(std::is_floating_point_v<T>)
             {
@@ -0,0 +1,19 @@
+#pragma once
+#include <Metrics.hpp>
+#include <ModbusMaster.h>
+
+namespace ventctl
+{
+    inline Counter modbus_timeouts("modbus.timeouts");
+    inline Counter modbus_errors("modbus.errors");
+
+    // Counts failed transactions and passes the status through
+    inline uint8_t modbus_status(uint8_t status)
+    {
+        if(status == ModbusMaster::ku8MBResponseTimedOut)
+            ++modbus_timeouts;
+        else if(status != ModbusMaster::ku8MBSuccess)
+            ++modbus_errors;
+        return status;
+    }
+}
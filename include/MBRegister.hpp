@@ -2,6 +2,7 @@
 #include <Peripheral.hpp>
 #include <type_traits>
 #include <ModbusMaster.h>
+#include <MBMetrics.hpp>
 
 namespace ventctl
 {
@@ -15,6 +16,8 @@ namespace ventctl
             m_addr(addr)
             {}
 
+        VC_PERIPHERAL_DESCRIPTOR(T, "MBRegister", "", PeripheralDescriptor::MODBUS, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(T& value)
         {
             int16_t ivalue = 0;
@@ -26,7 +29,8 @@ namespace ventctl
             {
                 ivalue = static_cast<int16_t>(value);
             }
-            return m_mb.writeSingleRegister(m_coil, static_cast<uint16_t>(ivalue)) == ModbusMaster::ku8MBSuccess;
+            VC_TRACE_ZONE("Modbus::writeSingleRegister");
+            return modbus_status(m_mb.writeSingleRegister(m_coil, static_cast<uint16_t>(ivalue))) == ModbusMaster::ku8MBSuccess;
         }
 
         virtual void print(file_t f, bool s = false)
@@ -37,7 +41,8 @@ namespace ventctl
 
         virtual T read_value()
         {
-            auto result = m_mb.readHoldingRegisters(m_addr, 1) == ModbusMaster::ku8MBSuccess;
+            VC_TRACE_ZONE("Modbus::readHoldingRegisters");
+            auto result = modbus_status(m_mb.readHoldingRegisters(m_addr, 1)) == ModbusMaster::ku8MBSuccess;
 
             if constexpr(std::is_floating_point_v<T>)
             {
@@ -10,6 +10,8 @@ namespace ventctl
     public:
         PWMOut(const char* name, PinName pin);
 
+        VC_PERIPHERAL_DESCRIPTOR(float, "PWMOut", "", PeripheralDescriptor::OUTPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::HARDWARE)
+
         virtual bool accept_value(float&);
         virtual void print(file_t, bool sh = false);
         virtual float read_value();
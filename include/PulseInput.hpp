@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Peripheral.hpp>
+#include <Pulse.hpp>
+#include <mbed.h>
+
+namespace ventctl
+{
+    /*
+        Pulse train on an EXTI pin. The interrupt only timestamps the edge
+        (PulseCapture::edge), frequency, period and count are derived from
+        lock-free snapshots when read, so there is no per-loop update.
+
+        PulseInput reads the frequency in Hz, Tachometer the speed in rpm
+        and PulseCounter the accumulated count times a per-pulse quantity
+        (e.g. kWh of an S0 energy meter).
+    */
+    class PulseInput : public Peripheral<float>
+    {
+    public:
+        enum class Edge : uint8_t
+        {
+            RISE,
+            FALL,
+            BOTH
+        };
+
+        PulseInput(const char* name, PinName pin, uint32_t debounce_us = 100, uint32_t timeout_us = 2000000,
+            Edge edge = Edge::FALL, PinMode mode = PullUp);
+
+        VC_PERIPHERAL_DESCRIPTOR(float, "PulseInput", "Hz", PeripheralDescriptor::INPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE)
+
+        virtual bool accept_value(float&) { return false; }
+        virtual float read_value();
+        virtual void print(file_t, bool s = false);
+        virtual void initialize();
+
+        float frequency();
+        // Microseconds, 0 while stopped
+        float period();
+        uint32_t count() const { return m_capture.count(); }
+        PulseCapture::Reading reading() const { return m_capture.read(); }
+
+    private:
+        void on_edge();
+
+        InterruptIn m_in;
+        PulseCapture m_capture;
+        Edge m_edge;
+    };
+
+    class Tachometer : public PulseInput
+    {
+    public:
+        // Typical PC and EC fans: two pulses per revolution, open collector
+        Tachometer(const char* name, PinName pin, uint8_t pulses_per_revolution = 2, uint32_t debounce_us = 100);
+
+        VC_PERIPHERAL_DESCRIPTOR(float, "Tachometer", "rpm", PeripheralDescriptor::INPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE)
+
+        virtual float read_value();
+
+    private:
+        uint8_t m_pulses_per_revolution;
+    };
+
+    class PulseCounter : public PulseInput
+    {
+    public:
+        // S0 outputs pulse for at least 30 ms, contacts may bounce
+        PulseCounter(const char* name, PinName pin, float per_pulse = 1.0f, uint32_t debounce_us = 5000);
+
+        VC_PERIPHERAL_DESCRIPTOR(float, "PulseCounter", "", PeripheralDescriptor::INPUT, PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE)
+
+        virtual float read_value();
+
+        // Quantity per second, e.g. kW for a kWh meter with 3600 as the scale
+        float rate(float scale = 1.0f);
+
+    private:
+        float m_per_pulse;
+    };
+}
@@ -1,189 +1,598 @@
-#include "mbed.h"
-#include <etl/string_view.h>
-#include <utility>
-#include <charconv>
-#include <type_traits>
-#include <etl/vector.h> // ETL
-#include <PT1000.hpp>
-#include <cstring>
-#include <cstdlib>
-#include <charconv.hpp>
-#include <Peripheral.hpp>
-#include <ventctl.hpp>
-#include <settings.hpp>
-
-using Serial = mbed::Serial;
-namespace ventctl
-{
-    class Term
-    {
-    public:
-
-        bool match_cmd(etl::string_view& v, char* cmd)
-        {
-            if(v.starts_with(cmd))
-            {
-                v.remove_prefix(strlen(cmd));
-                return true;
-            }
-
-            return false;
-            
-        }
-
-        void parse_cmd()
-        {
-            etl::string_view view(m_cmdbuf);
-            etl::exception exc("None", __FILE__, __LINE__);
-
-            if(match_cmd(view, "set "))
-            {
-                VC_TRY
-                {
-                    auto number = parse_arg<int>(view, &exc);
-                    if(exc.what() != "None") break;
-                    if(number >= PeripheralBase::get_peripherals().size())
-                    {
-                        VC_THROW("Incorrect index");
-                    }
-
-                    auto output = PeripheralBase::get_peripherals().at(number);
-
-                    bool result = false;
-
-                    if(output->accepts_type<float>())
-                    {
-                        auto value = parse_arg<float>(view, &exc);
-                        if(exc.what() != "None") break;
-                        result = output->set_value(&value);
-                    }
-                    else if(output->accepts_type<int>())
-                    {
-                        auto value = parse_arg<int>(view, &exc);
-                        if(exc.what() != "None") break;
-                        result = output->set_value(&value);
-                    }
-                    else if(output->accepts_type<bool>())
-                    {
-                        auto value = parse_arg<bool>(view, &exc);
-                        if(exc.what() != "None") break;
-                        result = output->set_value(&value);
-                    }
-                    else
-                    {
-                        printf("Warning: couldn't determine value type\n");
-                    }
-
-                    if(!result)
-                        printf("Couldn't set output\n");
-                }
-                VC_CATCH(exc)
-                {
-                    printf("Exception : %s at %s:%d\n", exc.what(), exc.file_name(), exc.line_number());
-                }
-            }
-            else if(match_cmd(view, "v"))
-            {
-                printf("ventctl v%s\n", VC_VERSION);
-            }
-            else if(match_cmd(view, "state"))
-            {
-                int counter = 0;
-                for(auto& periph : PeripheralBase::get_peripherals())
-                {
-                    printf("[%2d] ", counter);
-                    periph->print(stdout);
-                    printf("\n");
-                    counter++;
-                }
-            }
-            else if(match_cmd(view, "s "))
-            {
-                if(match_cmd(view, "ip "))
-                {
-                    printf("Not impl\n");
-                }
-                else if(match_cmd(view, "api "))
-                {
-                    auto size = std::min({view.size(), sizeof(application_settings.api_addr) - 1}); 
-                    std::memcpy(application_settings.api_addr, view.data(), view.size());
-                    application_settings.api_addr[size] = 0;
-                    printf("OK\n"); 
-                }
-                else if(match_cmd(view, "user "))
-                {
-
-                }
-                else if(match_cmd(view, "pass "))
-                {
-
-                }
-                else if(match_cmd(view, "cal"))
-                {
-                    auto number = parse_arg<int>(view, &exc);
-                    
-                }
-            }
-            else if(match_cmd(view, "save"))
-            {
-                auto result = save_settings();
-                if(result)
-                    printf("OK!\n");
-                else
-                    printf("Oops!\n");
-            }
-            else if(match_cmd(view, "ps"))
-            {
-                printf("api addr: %s\n", application_settings.api_addr);
-            }
-            else if(match_cmd(view, "erase"))
-            {
-                auto result = ventctl::flash.erase(ventctl::SETTINGS_START, ventctl::SETTINGS_SIZE);
-                if(result == 0)
-                    printf("OK\n");
-                else
-                    printf("Oops! %d\n", (int)result);
-            }
-            else
-            {
-                printf("Cannot parse command\n");
-            }
-        }
-
-        Term(Serial& s) :
-            m_idx(0),
-            m_cmdbuf{0},
-            m_serial(s)
-            {}
-
-        void try_command()
-        {
-            if(m_serial.readable())
-            {
-                char ch;
-                auto r = m_serial.read(&ch, 1);
-                VC_ASSERT(r >= 0, ETL_ERROR_TEXT("IOE", "1O"));
-                if(r == 0) return;
-                
-                if(ch == '\n')
-                {
-                    m_cmdbuf[m_idx] = 0;
-                    parse_cmd();
-                    m_idx = 0;
-
-                }
-                else if(ch != '\r')
-                {
-                    m_cmdbuf[m_idx] = ch;
-                    m_idx++;
-                }
-                
-            }
-        }
-
-    private:
-        Serial& m_serial;
-        char m_cmdbuf[256];
-        uint8_t m_idx;
-    };
-}
+#include "mbed.h"
+#include <etl/string_view.h>
+#include <utility>
+#include <charconv>
+#include <type_traits>
+#include <etl/vector.h> // ETL
+#include <PT1000.hpp>
+#include <Calibration.hpp>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <charconv.hpp>
+#include <Peripheral.hpp>
+#include <ventctl.hpp>
+#include <settings.hpp>
+#include <Graph.hpp>
+#include <Metrics.hpp>
+#include <Command.hpp>
+#include <LineEditor.hpp>
+#include <DmaSerial.hpp>
+#include <atomic>
+
+#ifndef VC_TERM_LINE_SIZE
+    #define VC_TERM_LINE_SIZE 256
+#endif
+
+// Complete lines waiting for the main loop
+#ifndef VC_TERM_QUEUE
+    #define VC_TERM_QUEUE 8
+#endif
+
+// Settings a batch can hold, 8 bytes each
+#ifndef VC_TERM_BATCH
+    #define VC_TERM_BATCH 256
+#endif
+
+#ifndef VC_TERM_STACK
+    #define VC_TERM_STACK 1536
+#endif
+
+namespace ventctl
+{
+    class Term
+    {
+    public:
+        // A parsed "set" operation, applied immediately or queued in a batch
+        struct Setting
+        {
+            uint16_t index;
+            PeripheralValue value;
+        };
+
+        // Runs every ';' separated command of the line in m_cmdbuf
+        void parse_cmd()
+        {
+            split_commands(etl::string_view(m_cmdbuf), [this](etl::string_view line)
+            {
+                Args args(line);
+                auto name = args.word();
+                auto command = find_command(s_commands, name);
+
+                if(command)
+                    command->run(*this, args);
+                else
+                    printf("Cannot parse command\n");
+            });
+        }
+
+        // Applies a committed batch at once, called by the main loop before the control step
+        void apply_batch()
+        {
+            if(!m_batch_ready) return;
+
+            size_t failed = 0;
+            for(auto& setting : m_batch)
+            {
+                if(!apply_setting(setting)) failed++;
+            }
+
+            printf("Batch: %d applied, %d failed\n", (int)(m_batch.size() - failed), (int)failed);
+            m_batch.clear();
+            m_batch_ready = false;
+        }
+
+    private:
+        template<typename T>
+        static bool parse_as(Args& args, PeripheralValue& value)
+        {
+            T parsed;
+            if(!args.get(parsed)) return false;
+            value = PeripheralValue(parsed);
+            return true;
+        }
+
+        // The value is parsed as the type of the peripheral it is meant for
+        static bool parse_value(Args& args, ValueType type, PeripheralValue& value)
+        {
+            switch(type)
+            {
+            case ValueType::BOOL: return parse_as<bool>(args, value);
+            case ValueType::INT: return parse_as<int>(args, value);
+            case ValueType::FLOAT: return parse_as<float>(args, value);
+            case ValueType::FIXED:
+            {
+                float parsed;
+                if(!args.get(parsed)) return false;
+                value = PeripheralValue(Fixed(parsed));
+                return true;
+            }
+            default: return false;
+            }
+        }
+
+        static bool parse_setting(Args& args, Setting& setting)
+        {
+            int index;
+            if(!args.get(index) || index < 0 || (size_t)index >= PeripheralBase::get_peripherals().size())
+            {
+                printf("Incorrect index\n");
+                return false;
+            }
+
+            auto output = PeripheralBase::get_peripherals().at(index);
+            if(output->type() == ValueType::NONE)
+            {
+                printf("Warning: couldn't determine value type\n");
+                return false;
+            }
+
+            if(!parse_value(args, output->type(), setting.value) || !args.empty())
+            {
+                printf("Invalid value\n");
+                return false;
+            }
+
+            setting.index = index;
+            return true;
+        }
+
+        static bool apply_setting(const Setting& setting)
+        {
+            return PeripheralBase::get_peripherals().at(setting.index)->write(setting.value);
+        }
+
+        static void cmd_batch(Term& term, Args& args)
+        {
+            auto action = args.word();
+
+            if(action.empty())
+            {
+                printf("Batch %s, %d settings\n", term.m_batch_open ? "open" : "closed", (int)term.m_batch.size());
+            }
+            else if(equals(action, "begin"))
+            {
+                term.m_batch.clear();
+                term.m_batch_open = true;
+                term.m_batch_ready = false;
+                printf("OK\n");
+            }
+            else if(equals(action, "commit") && term.m_batch_open)
+            {
+                term.m_batch_open = false;
+                term.m_batch_ready = true;
+            }
+            else if(equals(action, "abort"))
+            {
+                term.m_batch.clear();
+                term.m_batch_open = false;
+                term.m_batch_ready = false;
+                printf("OK\n");
+            }
+            else
+            {
+                printf("Usage: batch [begin|commit|abort]\n");
+            }
+        }
+
+        static void cmd_erase(Term&, Args&)
+        {
+            if(format_settings())
+                printf("OK\n");
+            else
+                printf("Oops!\n");
+        }
+
+        static int hex_digit(char c)
+        {
+            if(c >= '0' && c <= '9') return c - '0';
+            if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        static void cmd_graph(Term& term, Args& args)
+        {
+            auto graph = term.m_graph;
+            auto action = args.word();
+
+            if(!graph)
+            {
+                printf("Graph upload is not available\n");
+            }
+            else if(equals(action, "begin"))
+            {
+                graph->begin();
+                printf("OK\n");
+            }
+            else if(equals(action, "data"))
+            {
+                auto hex = args.word();
+                uint8_t chunk[64];
+                size_t size = 0;
+
+                while(hex.size() >= 2 && size < sizeof(chunk))
+                {
+                    auto hi = hex_digit(hex[0]), lo = hex_digit(hex[1]);
+                    if(hi < 0 || lo < 0) break;
+                    chunk[size++] = (hi << 4) | lo;
+                    hex.remove_prefix(2);
+                }
+
+                if(!hex.empty() || !args.empty())
+                    printf("Invalid hex data\n");
+                else if(!graph->append(chunk, size))
+                    printf("Graph upload is not started or too large\n");
+            }
+            else if(equals(action, "commit"))
+            {
+                auto err = graph->finish();
+                if(err != GraphError::NONE)
+                    printf("Invalid graph: error %d\n", (int)err);
+                else if(!save_graph(graph->data(), graph->size()))
+                    printf("Cannot save graph\n");
+                else
+                    printf("OK, %d bytes saved, reset to apply\n", (int)graph->size());
+            }
+            else
+            {
+                printf("Usage: graph begin|data <hex>|commit\n");
+            }
+        }
+
+        static void cmd_help(Term&, Args&)
+        {
+            for(auto& command : s_commands)
+                printf("%-8s %s\n", command.name, command.usage);
+        }
+
+        static void cmd_metrics(Term&, Args&)
+        {
+            Metrics::print([](const char* line) { printf("%s", line); });
+        }
+
+        static void cmd_ps(Term&, Args&)
+        {
+            printf("api addr: %s\n", application_settings.api_addr);
+        }
+
+        // "input -> value" to four decimals, through to_chars
+        static void print_point(float input, float value)
+        {
+            char a[24], b[24];
+            auto ra = to_chars(a, a + sizeof(a), input, 4);
+            auto rb = to_chars(b, b + sizeof(b), value, 4);
+            printf("%.*s -> %.*s", (int)(ra.ptr - a), a, (int)(rb.ptr - b), b);
+        }
+
+        static void print_calibration(Calibration& cal)
+        {
+            auto input = cal.last_input();
+            printf("%-10s %d points, ", cal.name(), (int)cal.size());
+            print_point(input, cal.apply(input));
+            printf("\n");
+        }
+
+        /*
+            Guided capture: "begin", then for every reference applied to
+            the input "point <value>" (or "temp <degC>" for PT1000
+            channels) takes the channel's current raw input with it, and
+            "commit" applies and saves the points. "gain <g> <o>" sets a
+            plain gain and offset instead, "reset" goes back to the default.
+        */
+        static void cmd_calibration(Term& term, Args& args)
+        {
+            auto name = args.word();
+            if(name.empty())
+            {
+                for(auto cal : Calibration::channels())
+                    print_calibration(*cal);
+                return;
+            }
+
+            auto cal = Calibration::find(name.data(), name.size());
+            if(!cal)
+            {
+                printf("No such channel\n");
+                return;
+            }
+
+            auto action = args.word();
+            bool capturing = term.m_cal == cal;
+
+            if(action.empty())
+            {
+                print_calibration(*cal);
+                for(size_t i = 0; i < cal->size(); ++i)
+                {
+                    printf("  ");
+                    print_point(cal->points()[i].input, cal->points()[i].value);
+                    printf("\n");
+                }
+                if(capturing)
+                    printf("  %d points captured\n", (int)term.m_cal_points.size());
+            }
+            else if(equals(action, "begin"))
+            {
+                term.m_cal = cal;
+                term.m_cal_points.clear();
+                printf("Apply a reference, then: s cal %s point <value>|temp <degC>\n", cal->name());
+            }
+            else if(equals(action, "point") || equals(action, "temp"))
+            {
+                float value;
+                auto input = cal->last_input();
+
+                if(!capturing)
+                    printf("Not capturing, s cal %s begin\n", cal->name());
+                else if(!args.get(value) || !args.empty())
+                    printf("Invalid value\n");
+                else if(std::isnan(input))
+                    printf("No reading on the channel\n");
+                else if(term.m_cal_points.full())
+                    printf("Too many points\n");
+                else
+                {
+                    if(equals(action, "temp")) value = pt1000_resistance_at(value);
+                    term.m_cal_points.push_back({input, value});
+                    printf("Point %d: ", (int)term.m_cal_points.size());
+                    print_point(input, value);
+                    printf(", next reference or commit\n");
+                }
+            }
+            else if(equals(action, "gain"))
+            {
+                float gain, offset;
+                if(!args.get(gain) || !args.get(offset) || !args.empty())
+                {
+                    printf("Usage: s cal <name> gain <gain> <offset>\n");
+                    return;
+                }
+
+                term.m_cal = cal;
+                term.m_cal_points.clear();
+                term.m_cal_points.push_back({0, offset});
+                term.m_cal_points.push_back({1, gain + offset});
+                commit_calibration(term);
+            }
+            else if(equals(action, "commit") && capturing)
+            {
+                commit_calibration(term);
+            }
+            else if(equals(action, "abort"))
+            {
+                term.m_cal = nullptr;
+                term.m_cal_points.clear();
+                printf("OK\n");
+            }
+            else if(equals(action, "reset"))
+            {
+                if(capturing) term.m_cal = nullptr;
+                cal->reset();
+                printf(save_calibration(*cal) ? "OK\n" : "Cannot save calibration\n");
+            }
+            else
+            {
+                printf("Usage: s cal [<name> [begin|point <value>|temp <degC>|commit|abort|gain <g> <o>|reset]]\n");
+            }
+        }
+
+        static void commit_calibration(Term& term)
+        {
+            auto cal = term.m_cal;
+            term.m_cal = nullptr;
+
+            if(!cal->set(term.m_cal_points.data(), term.m_cal_points.size()))
+                printf("Invalid points\n");
+            else if(!save_calibration(*cal))
+                printf("Cannot save calibration\n");
+            else
+                printf("OK, %d points\n", (int)cal->size());
+        }
+
+        static void cmd_settings(Term& term, Args& args)
+        {
+            auto field = args.word();
+
+            if(equals(field, "cal"))
+            {
+                cmd_calibration(term, args);
+            }
+            else if(equals(field, "api"))
+            {
+                auto value = args.rest();
+                auto size = std::min({value.size(), sizeof(application_settings.api_addr) - 1});
+                std::memcpy(application_settings.api_addr, value.data(), size);
+                application_settings.api_addr[size] = 0;
+                printf("OK\n");
+            }
+            else
+            {
+                printf("Not impl\n");
+            }
+        }
+
+        static void cmd_save(Term&, Args&)
+        {
+            if(save_settings())
+                printf("OK!\n");
+            else
+                printf("Oops!\n");
+        }
+
+        static void cmd_set(Term& term, Args& args)
+        {
+            Setting setting;
+            if(!parse_setting(args, setting)) return;
+
+            if(!term.m_batch_open)
+            {
+                if(!apply_setting(setting))
+                    printf("Couldn't set output\n");
+            }
+            else if(term.m_batch.full())
+            {
+                printf("Batch is full\n");
+            }
+            else
+            {
+                term.m_batch.push_back(setting);
+            }
+        }
+
+        static void cmd_state(Term&, Args&)
+        {
+            int counter = 0;
+            for(auto& periph : PeripheralBase::get_peripherals())
+            {
+                printf("[%2d] ", counter);
+                periph->print(stdout);
+                printf("\n");
+                counter++;
+            }
+        }
+
+        static void cmd_trace(Term&, Args& args)
+        {
+            auto action = args.word();
+
+            if(equals(action, "on"))
+                Trace::enable(true);
+            else if(equals(action, "off"))
+                Trace::enable(false);
+            else if(equals(action, "clear"))
+                Trace::clear();
+            else if(equals(action, "dump"))
+                Trace::dump([](const char* line) { printf("%s", line); });
+            else
+                printf("Usage: trace on|off|clear|dump\n");
+        }
+
+        static void cmd_version(Term&, Args&)
+        {
+            printf("ventctl v%s\n", VC_VERSION);
+        }
+
+        // Sorted by name for the binary search
+        inline static constexpr Command<Term> s_commands[] = {
+            {"batch", &cmd_batch, "batch [begin|commit|abort]"},
+            {"erase", &cmd_erase, "erase"},
+            {"graph", &cmd_graph, "graph begin|data <hex>|commit"},
+            {"help", &cmd_help, "help"},
+            {"metrics", &cmd_metrics, "metrics"},
+            {"ps", &cmd_ps, "ps"},
+            {"s", &cmd_settings, "s api <address>|cal [<name> ...]"},
+            {"save", &cmd_save, "save"},
+            {"set", &cmd_set, "set <index> <value>"},
+            {"state", &cmd_state, "state"},
+            {"trace", &cmd_trace, "trace on|off|clear|dump"},
+            {"v", &cmd_version, "v"}
+        };
+
+        static_assert(is_sorted(s_commands), "Terminal commands must be sorted by name");
+
+    public:
+        Term(DmaSerial& s, GraphUploader* graph = nullptr) :
+            m_cmdbuf{0},
+            m_serial(s),
+            m_graph(graph),
+            m_thread(osPriorityBelowNormal, VC_TERM_STACK, nullptr, "term"),
+            m_queue_head(0),
+            m_queue_tail(0),
+            m_batch_open(false),
+            m_batch_ready(false),
+            m_cal(nullptr)
+            {}
+
+        // Starts the input thread: echo and line editing happen there, off the control loop
+        void start()
+        {
+            m_thread.start(callback(this, &Term::input_loop));
+        }
+
+        // Runs a line from elsewhere (MQTT) as if typed, only from the main loop
+        void execute(const char* line)
+        {
+            std::strncpy(m_cmdbuf, line, VC_TERM_LINE_SIZE - 1);
+            m_cmdbuf[VC_TERM_LINE_SIZE - 1] = 0;
+            parse_cmd();
+        }
+
+        // Runs at most one complete command line, called from the main loop
+        void try_command()
+        {
+            auto tail = m_queue_tail.load(std::memory_order_relaxed);
+            if(tail == m_queue_head.load(std::memory_order_acquire)) return;
+
+            VC_TRACE_ZONE("Term::try_command");
+            std::memcpy(m_cmdbuf, m_queue[tail % VC_TERM_QUEUE], VC_TERM_LINE_SIZE);
+            m_queue_tail.store(tail + 1, std::memory_order_release);
+
+            parse_cmd();
+        }
+
+    private:
+        void echo(const char* data, size_t size)
+        {
+            m_serial.write(data, size);
+        }
+
+        void input_loop()
+        {
+            char buffer[64];
+            auto echo = [this](const char* data, size_t size) { this->echo(data, size); };
+
+            for(;;)
+            {
+                m_serial.wait_readable();
+
+                while(auto count = m_serial.receive(buffer, sizeof(buffer)))
+                {
+                    for(size_t i = 0; i < count; ++i)
+                    {
+                        switch(m_editor.feed(buffer[i], echo))
+                        {
+                        case LineEditor<VC_TERM_LINE_SIZE>::Result::LINE:
+                            enqueue(m_editor.line(), strlen(m_editor.line()));
+                            break;
+                        case LineEditor<VC_TERM_LINE_SIZE>::Result::TOO_LONG:
+                            printf("Line too long\n");
+                            break;
+                        default:
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        // Waits for the main loop when the queue is full, RX DMA keeps buffering meanwhile
+        void enqueue(const char* line, size_t size)
+        {
+            auto head = m_queue_head.load(std::memory_order_relaxed);
+            while(head - m_queue_tail.load(std::memory_order_acquire) >= VC_TERM_QUEUE)
+                ThisThread::sleep_for(1);
+
+            auto slot = m_queue[head % VC_TERM_QUEUE];
+            std::memcpy(slot, line, size);
+            slot[size] = 0;
+            m_queue_head.store(head + 1, std::memory_order_release);
+        }
+
+        char m_cmdbuf[VC_TERM_LINE_SIZE];
+        DmaSerial& m_serial;
+        GraphUploader* m_graph;
+        LineEditor<VC_TERM_LINE_SIZE> m_editor;
+        Thread m_thread;
+
+        char m_queue[VC_TERM_QUEUE][VC_TERM_LINE_SIZE];
+        std::atomic<uint32_t> m_queue_head, m_queue_tail;
+
+        etl::vector<Setting, VC_TERM_BATCH> m_batch;
+        bool m_batch_open, m_batch_ready;
+
+        // Calibration capture in progress, see cmd_calibration
+        Calibration* m_cal;
+        etl::vector<CalibrationPoint, VC_CAL_POINTS> m_cal_points;
+    };
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <Peripheral.hpp>
+#include <Plausibility.hpp>
+#include <Calibration.hpp>
 #include <mbed.h>
 
 #define VC_TS_F 64
@@ -11,6 +13,9 @@ namespace ventctl
     public:
         ThermalSensor(const char* name, PinName pin);
 
+        VC_PERIPHERAL_DESCRIPTOR(float, "ThermalSensor", "degC", PeripheralDescriptor::ANALOG,
+            PeripheralDescriptor::READABLE | PeripheralDescriptor::HARDWARE | PeripheralDescriptor::UPDATES)
+
         virtual bool accept_value(float&) { return false; } // This thing doesn't accept values to output
 
         // SUDDENLY, returns Celsius
@@ -30,6 +35,10 @@ namespace ventctl
         static float read_temperature(float resistance);
 
         virtual void print(file_t file, bool s = false);
+
+        // Of the last update(), see Plausibility
+        virtual Quality quality() const override { return m_check.quality(); }
+        void set_limits(const PlausibilityLimits& limits) { m_check.set_limits(limits); }
         
         virtual void update() override;
 
@@ -37,6 +46,11 @@ namespace ventctl
         AnalogIn m_input;
 
         float m_values[VC_TS_F];
+        float m_sum;
         uint8_t m_value_cnt;
+        bool m_filled;
+        uint32_t m_sample_time;
+        Plausibility m_check;
+        Calibration m_cal;
     };
 }
\ No newline at end of file
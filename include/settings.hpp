@@ -1,6 +1,9 @@
 #pragma once
 #include <cstdint>
 #include <FlashIAP.h>
+#include <KVStore.hpp>
+#include <Checkpoint.hpp>
+#include <Calibration.hpp>
 
 namespace ventctl
 {
@@ -14,6 +17,7 @@ namespace ventctl
     #endif
     constexpr const static size_t SETTINGS_STRIDE = 0x200;
 
+    /* Legacy single struct format, only read to migrate old devices */
     constexpr const static uint16_t SETTINGS_VALID_MASK = 0x8000;
     constexpr const static uint16_t SETTINGS_OVERWRITTEN_MASK = 0x4000;
 
@@ -29,25 +33,118 @@ namespace ventctl
         constexpr const static size_t SETTINGS_SIZE = 0x20000;
     #endif
 
+    /* Key/value store sectors (10 and 11 on the F407) */
+    #ifdef VC_KV_SECTOR_A
+        constexpr const static uint32_t KV_SECTOR_A = VC_KV_SECTOR_A;
+    #else
+        constexpr const static uint32_t KV_SECTOR_A = 0x080C0000;
+    #endif
+
+    #ifdef VC_KV_SECTOR_B
+        constexpr const static uint32_t KV_SECTOR_B = VC_KV_SECTOR_B;
+    #else
+        constexpr const static uint32_t KV_SECTOR_B = 0x080E0000;
+    #endif
+
+    #ifdef VC_KV_SECTOR_SIZE
+        constexpr const static size_t KV_SECTOR_SIZE = VC_KV_SECTOR_SIZE;
+    #else
+        constexpr const static size_t KV_SECTOR_SIZE = 0x20000;
+    #endif
+
+    enum settings_key : uint16_t
+    {
+        KEY_IP_ADDR = 1,
+        KEY_API_ADDR,
+        KEY_CLIENT_ID,
+        KEY_PASSWORD,
+        KEY_CALIBRATION,
+        KEY_GRAPH,
+        KEY_CHECKPOINT,
+        KEY_PID = 0x100, // + slot
+        KEY_CAL = 0x200 // + slot
+    };
+
+    #ifdef VC_PID_SLOTS
+        constexpr const static size_t PID_SLOTS = VC_PID_SLOTS;
+    #else
+        constexpr const static size_t PID_SLOTS = 4;
+    #endif
+
+    /* Controller state checkpoints go to the 4K backup SRAM, or to the key/value store with VC_CHECKPOINT_FLASH */
+    #ifdef VC_CHECKPOINT_INTERVAL
+        constexpr const static uint32_t CHECKPOINT_INTERVAL = VC_CHECKPOINT_INTERVAL;
+    #elif defined(VC_CHECKPOINT_FLASH)
+        constexpr const static uint32_t CHECKPOINT_INTERVAL = 600;
+    #else
+        constexpr const static uint32_t CHECKPOINT_INTERVAL = 30;
+    #endif
+
+    #ifdef VC_CHECKPOINT_MAX_AGE
+        constexpr const static uint32_t CHECKPOINT_MAX_AGE = VC_CHECKPOINT_MAX_AGE;
+    #else
+        constexpr const static uint32_t CHECKPOINT_MAX_AGE = 900;
+    #endif
+
+    constexpr const static size_t CHECKPOINT_MAX_SIZE = 1024;
+
+    constexpr const static uint32_t PID_GAINS_VALID = 0x50494447; // "PIDG"
+
+    struct alignas(4) pid_settings
+    {
+        uint32_t valid;
+        float kp, ki, kd;
+    };
+
+    /* Stored calibration points, matched to a Calibration by channel name */
+    constexpr const static size_t CAL_SLOTS = VC_CAL_CHANNELS;
+    constexpr const static size_t CAL_NAME_SIZE = 16;
+    constexpr const static uint32_t CAL_VALID = 0x43414C42; // "CALB"
+
+    struct alignas(4) cal_settings
+    {
+        uint32_t valid;
+        char name[CAL_NAME_SIZE];
+        uint32_t count;
+        CalibrationPoint points[VC_CAL_POINTS];
+    };
+
     struct alignas(4) settings
     {
-        uint16_t flags;
-        uint16_t size;
         uint8_t ip_addr[4];
         uint8_t api_addr[40];
         uint8_t client_id[40];
         uint8_t password[40];
-        float calibration[6];
+        float calibration[6]; // Unused, superseded by cal
+        pid_settings pid[PID_SLOTS];
+        cal_settings cal[CAL_SLOTS];
     };
 
     extern settings application_settings;
 
     extern bool load_settings();
+    // Only the fields that changed since the last save are written
     extern bool save_settings();
     extern bool settings_loaded();
+    extern bool format_settings();
+    // Deferred sector erase and compaction, called from the main loop
+    extern void maintain_settings();
     bool is_valid_settings(uint16_t);
+
+    // Stores the points of a channel (none restores its default) and saves the settings
+    extern bool save_calibration(const Calibration& calibration);
+
+    // Control graph blob, see Graph.hpp. Validation is up to the caller
+    extern const uint8_t* stored_graph(size_t& size);
+    extern bool save_graph(const uint8_t* data, size_t size);
+
     bool is_overwritten(uint16_t);
 
+    // Timestamps are wall clock (RTC) seconds, which survive a reset
+    extern bool save_checkpoint(Checkpoint& checkpoint);
+    extern Checkpoint::Result restore_checkpoint(Checkpoint& checkpoint);
+
     extern mbed::FlashIAP flash;
+    extern KVStore<mbed::FlashIAP> kv_store;
 
 }
\ No newline at end of file
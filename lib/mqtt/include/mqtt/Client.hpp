@@ -76,6 +76,8 @@ namespace mqtt
 
 
     private:
+        bool send_connect(Message<MessageType::CONNECT>& msg);
+
         socket_t* m_socket;
         mutex_t m_mutex;
         rx_cb_t<MessageType::PUBLISH> m_rx_cb;
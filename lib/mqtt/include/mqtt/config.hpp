@@ -109,30 +109,142 @@
     #define MQTT_TIMEOUT 5.0
 #endif
 
-#ifdef MQTT_USE_PMR_ALLOCATOR
+// Messages are leased from a fixed pool unless MQTT_DISABLE_PMR_ALLOCATOR is defined (heap then)
+#ifndef MQTT_DISABLE_PMR_ALLOCATOR
+    #define MQTT_USE_PMR_ALLOCATOR
+#endif
+
+#ifndef MQTT_POOL_SIZE
+    #define MQTT_POOL_SIZE 8192
+#endif
+
+#ifndef MQTT_MAX_PERSISTENT_MESSAGES
+    #define MQTT_MAX_PERSISTENT_MESSAGES 16
+#endif
 
 #include <memory_resource>
+#include <new>
+#include <utility>
 
 namespace mqtt
 {
     extern std::pmr::memory_resource* memory_resource;
 
+    // nullptr when there is no memory left, without throwing
+    void* try_allocate(size_t size, size_t alignment);
+
+    /*
+        Size-class pool over a caller provided arena. Blocks of 32 << n
+        bytes are carved from the arena on first use and recycled through
+        one free list per class; the arena itself is never compacted.
+        allocate() keeps the memory_resource contract and fails like
+        null_memory_resource() when the pool is exhausted; try_allocate()
+        returns nullptr instead, which is what leases use.
+    */
     class fixed_pool_resource : public std::pmr::memory_resource
     {
     public:
+        static constexpr size_t MIN_BLOCK = 32;
+        static constexpr size_t CLASS_COUNT = 8; // 32 .. 4096 bytes
+
+        fixed_pool_resource(unsigned char* buffer, size_t size);
+
+        void* try_allocate(size_t size, size_t alignment);
+
+        // Bytes in blocks handed out now and at most so far
+        size_t used() const { return m_used; }
+        size_t peak() const { return m_peak; }
+        // Arena bytes carved into blocks, in use or free
+        size_t reserved() const { return m_offset; }
+        size_t capacity() const { return m_size; }
+        size_t failures() const { return m_failures; }
+
+        static size_t block_size(size_t size);
+
+    protected:
+        virtual void* do_allocate(size_t size, size_t alignment) override;
+        virtual void do_deallocate(void* p, size_t size, size_t alignment) override;
+        virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    private:
+        struct free_block
+        {
+            free_block* next;
+        };
+
+        static int size_class(size_t size);
+
+        unsigned char* m_buffer;
+        size_t m_size, m_offset;
+        free_block* m_free[CLASS_COUNT];
+        size_t m_used, m_peak, m_failures;
+    };
+
+    #ifdef MQTT_USE_PMR_ALLOCATOR
+        extern fixed_pool_resource pool;
+    #endif
+
+    // Sole owner of an object constructed in memory_resource, empty when it was exhausted
+    template<typename T>
+    class lease
+    {
+    public:
+        lease() : m_ptr(nullptr) {}
+        explicit lease(T* ptr) : m_ptr(ptr) {}
 
-        fixed_pool_resource(unsigned char* buffer, size_t size) :
-            m_buffer(buffer),
-            m_size(size)
-            {}
+        lease(lease&& other) : m_ptr(other.release()) {}
 
-        virtual void* do_allocate(size_t sz, size_t alignment)
+        lease& operator=(lease&& other)
         {
+            if(this != &other)
+            {
+                reset();
+                m_ptr = other.release();
+            }
+            return *this;
+        }
 
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+
+        ~lease() { reset(); }
+
+        static lease make()
+        {
+            auto p = try_allocate(sizeof(T), alignof(T));
+            return lease(p ? new(p) T() : nullptr);
         }
 
+        // Destroys an object previously released from a lease
+        static void destroy(T* ptr)
+        {
+            if(!ptr) return;
+            ptr->~T();
+            memory_resource->deallocate(ptr, sizeof(T), alignof(T));
+        }
+
+        T* release()
+        {
+            auto ptr = m_ptr;
+            m_ptr = nullptr;
+            return ptr;
+        }
+
+        void reset()
+        {
+            destroy(m_ptr);
+            m_ptr = nullptr;
+        }
+
+        T* get() const { return m_ptr; }
+        T& operator*() const { return *m_ptr; }
+        T* operator->() const { return m_ptr; }
+        explicit operator bool() const { return m_ptr != nullptr; }
+
     private:
+        T* m_ptr;
     };
 }
-
-#endif
\ No newline at end of file
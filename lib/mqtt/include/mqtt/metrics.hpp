@@ -0,0 +1,17 @@
+#pragma once
+#include <Metrics.hpp>
+
+namespace mqtt
+{
+    namespace metrics
+    {
+        inline ventctl::Counter timeouts("mqtt.timeouts");
+        inline ventctl::Counter socket_errors("mqtt.socket_errors");
+        inline ventctl::Counter read_errors("mqtt.read_errors");
+        inline ventctl::Counter send_errors("mqtt.send_errors");
+        inline ventctl::Counter delivery_errors("mqtt.delivery_errors");
+        inline ventctl::Counter pool_failures("mqtt.pool_failures");
+        inline ventctl::Gauge pool_used("mqtt.pool_used");
+        inline ventctl::Gauge pool_peak("mqtt.pool_peak");
+    }
+}
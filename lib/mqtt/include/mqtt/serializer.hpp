@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <ulog.hpp>
 #include <util.hpp>
+#include <mqtt/metrics.hpp>
 
 namespace mqtt
 {
@@ -33,6 +34,7 @@ namespace mqtt
             {
                 if(util::time() > stop_time)
                 {
+                    ++metrics::timeouts;
                     ulog::warn("Timeout expired");
                     return false;
                 }
@@ -41,7 +43,8 @@ namespace mqtt
 
                 if(read < 0)
                 {
-                    ulog::warn(ulog::join("Socket error ", read));
+                    ++metrics::socket_errors;
+                    ulog::warn("Socket error %d", read);
                     return false;
                 }
                 
@@ -67,6 +70,7 @@ namespace mqtt
             {
                 if(util::time() > stop_time)
                 {
+                    ++metrics::timeouts;
                     ulog::warn("Timeout expired");
                     return false;
                 }
@@ -75,7 +79,8 @@ namespace mqtt
 
                 if(written < 0)
                 {
-                    ulog::warn(ulog::join("Socket error ", written));
+                    ++metrics::socket_errors;
+                    ulog::warn("Socket error %d", written);
                     return false;
                 }
                 
@@ -95,6 +100,7 @@ namespace mqtt
             {
                 if(util::time() > stop_time)
                 {
+                    ++metrics::timeouts;
                     ulog::warn("Timeout expired");
                     return false;
                 }
@@ -103,7 +109,8 @@ namespace mqtt
 
                 if(written < 0)
                 {
-                    ulog::warn(ulog::join("Socket error ", written));
+                    ++metrics::socket_errors;
+                    ulog::warn("Socket error %d", written);
                     return false;
                 }
                 
@@ -356,7 +363,8 @@ namespace mqtt
             {
                 if(!write_raw(s, value[i]))
                 {
-                    ulog::warn(ulog::join("Cannot write [",i,"]"));
+                    ++metrics::send_errors;
+                    ulog::warn("Cannot write [%u]", i);
                     return false;
                 }
             }
@@ -446,7 +454,6 @@ namespace mqtt
             bool status = true;
             luple_do(luple, [&status, &s, &fhdr](auto& value){
                 status = status && detail::read(s, value, fhdr);
-                //std::cout << "Read " << typeid(value).name() << " : " << status << std::endl; 
             });
 
             return status;
@@ -460,7 +467,7 @@ namespace mqtt
             luple_do(luple, [&status, &s](auto& value){
                 status = status && detail::write(s, value);
                 if(!status)
-                    ulog::severe(ulog::join("Cannot write ", typeid(value).name()));
+                    ulog::severe("Cannot write %s", NAMEOF_TYPE_EXPR(value).data());
             });
 
             return status;
@@ -508,11 +515,11 @@ namespace mqtt
 
         bool write(Socket& s)
         {
-            ulog::info("Sending FHdr");   
+            ulog::debug("Sending FHdr");
             if(!Serializer<FixedHeader>::write(s, fixed_header)) return false;
-            ulog::info("Sending VHdr");
+            ulog::debug("Sending VHdr");
             if(!Serializer<VariableHeader<Type>>::write(s, variable_header)) return false;
-            ulog::info("Sending Payload");
+            ulog::debug("Sending Payload");
             if(!Serializer<Payload<Type>>::write(s, payload)) return false;
             return true;
         }
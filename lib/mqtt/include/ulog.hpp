@@ -2,7 +2,10 @@
 
 #include <etl/string.h>
 #include <mqtt/basic_types.hpp>
+#include <atomic>
 #include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <string_view>
 #include <type_traits>
 
@@ -16,6 +19,28 @@
     #include <mbed.h>
 #endif
 
+// Records below this level are compiled out (0 keeps everything, 2 drops DEBUG, ...)
+#ifndef ULOG_MIN_LEVEL
+    #define ULOG_MIN_LEVEL 0
+#endif
+
+// Deferred records, must be a power of two
+#ifndef ULOG_CAPACITY
+    #define ULOG_CAPACITY 64
+#endif
+
+#ifndef ULOG_MAX_ARGS
+    #define ULOG_MAX_ARGS 4
+#endif
+
+#if ULOG_MAX_ARGS > 8
+    #error "ULOG_MAX_ARGS must not exceed 8"
+#endif
+
+#ifndef ULOG_LINE_SIZE
+    #define ULOG_LINE_SIZE 128
+#endif
+
 namespace ulog
 {
     enum class log_level
@@ -34,35 +59,243 @@ namespace ulog
         using string_t = etl::string<64>;
     #endif
 
-    using callback_t = Callback<void(log_level, string_t)>;
+    using callback_t = Callback<void(log_level, const char*)>;
 
     extern void set_callback(callback_t&);
 
+    // Formats immediately and calls the callback from the caller's context
     extern void log(log_level, const string_t&);
-    
+
+    /*
+        Deferred records: a pointer to the format string and up to
+        ULOG_MAX_ARGS raw 32 bit arguments, queued in a lock-free ring
+        (bounded MPMC queue with per-cell sequence numbers, so interrupts may
+        log too). Formatting and console I/O happen later in process().
+
+        Formats use printf conversions. Strings are stored as pointers and
+        must outlive the record (literals, enum names); integers are
+        truncated to 32 bits and floating point values to float.
+    */
+    enum class arg_type : uint8_t
+    {
+        INT,
+        UINT,
+        FLOAT,
+        STRING
+    };
+
+    struct record
+    {
+        const char* format;
+        log_level level;
+        uint8_t argc;
+        uint16_t types; // 2 bits per argument
+        uintptr_t args[ULOG_MAX_ARGS];
+    };
+
+    class ring
+    {
+    public:
+        static bool push(const record& r)
+        {
+            auto pos = s_tail.load(std::memory_order_relaxed);
+            for(;;)
+            {
+                auto index = pos % ULOG_CAPACITY;
+                auto& cell = s_cells[index];
+                auto diff = (int32_t)(sequence(cell, index) - pos);
+
+                if(diff == 0)
+                {
+                    if(s_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        cell.data = r;
+                        cell.sequence.store(pos + 1 - index, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if(diff < 0)
+                {
+                    s_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    pos = s_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Single consumer
+        static bool pop(record& r)
+        {
+            auto pos = s_head.load(std::memory_order_relaxed);
+            auto index = pos % ULOG_CAPACITY;
+            auto& cell = s_cells[index];
+            if(sequence(cell, index) != pos + 1)
+                return false;
+
+            r = cell.data;
+            s_head.store(pos + 1, std::memory_order_relaxed);
+            cell.sequence.store(pos + ULOG_CAPACITY - index, std::memory_order_release);
+            return true;
+        }
+
+        // Returns the number of records lost since the last call
+        static uint32_t take_dropped()
+        {
+            return s_dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+    private:
+        static_assert((ULOG_CAPACITY & (ULOG_CAPACITY - 1)) == 0, "ULOG_CAPACITY must be a power of two");
+
+        struct cell
+        {
+            std::atomic<uint32_t> sequence;
+            record data;
+        };
+
+        // Sequences are stored relative to the cell index, so the zero initialized ring is valid before any constructor runs
+        static uint32_t sequence(const cell& c, uint32_t index)
+        {
+            return c.sequence.load(std::memory_order_acquire) + index;
+        }
+
+        inline static cell s_cells[ULOG_CAPACITY];
+        inline static std::atomic<uint32_t> s_tail{0}, s_head{0}, s_dropped{0};
+    };
+
+    template<typename>
+    constexpr bool unsupported_arg = false;
+
+    template<typename T>
+    inline void pack_arg(record& r, const T& value)
+    {
+        using U = std::decay_t<T>;
+        arg_type type;
+        uintptr_t word;
+
+        if constexpr(std::is_enum_v<U>)
+        {
+            auto name = NAMEOF_ENUM(value).data();
+            type = arg_type::STRING;
+            word = reinterpret_cast<uintptr_t>(name ? name : "?");
+        }
+        else if constexpr(std::is_floating_point_v<U>)
+        {
+            float f = value;
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            type = arg_type::FLOAT;
+            word = bits;
+        }
+        else if constexpr(std::is_integral_v<U>)
+        {
+            type = std::is_signed_v<U> ? arg_type::INT : arg_type::UINT;
+            word = static_cast<uint32_t>(value);
+        }
+        else if constexpr(std::is_convertible_v<U, const char*>)
+        {
+            type = arg_type::STRING;
+            word = reinterpret_cast<uintptr_t>(static_cast<const char*>(value));
+        }
+        else
+        {
+            static_assert(unsupported_arg<U>, "Deferred log arguments must be numbers, enums or static strings");
+        }
+
+        r.types |= (uint16_t)type << (2 * r.argc);
+        r.args[r.argc++] = word;
+    }
+
+    template<typename T>
+    inline void pack_arg(record& r, const mqtt::QoSOnly<T>& value)
+    {
+        pack_arg(r, value.value);
+    }
+
+    template<log_level Level, typename ... Ts>
+    inline void deferred(const char* format, const Ts& ... args)
+    {
+        static_assert(sizeof...(Ts) <= ULOG_MAX_ARGS, "Too many deferred log arguments");
+
+        if constexpr((int)Level >= ULOG_MIN_LEVEL)
+        {
+            record r;
+            r.format = format;
+            r.level = Level;
+            r.argc = 0;
+            r.types = 0;
+            (pack_arg(r, args), ...);
+            ring::push(r);
+        }
+    }
+
+    // Formats a deferred record into out, returns the length
+    extern size_t format(const record&, char* out, size_t size);
+
+    // Formats up to max queued records through the callback, returns the number handled
+    extern size_t process(size_t max = ULOG_CAPACITY);
+
     inline void debug(const string_t& s)
     {
-        log(log_level::DEBUG, s);
+        if constexpr((int)log_level::DEBUG >= ULOG_MIN_LEVEL)
+            log(log_level::DEBUG, s);
     }
 
     inline void info(const string_t& s)
     {
-        log(log_level::INFO, s);
+        if constexpr((int)log_level::INFO >= ULOG_MIN_LEVEL)
+            log(log_level::INFO, s);
     }
 
     inline void warn(const string_t& s)
     {
-        log(log_level::WARNING, s);
+        if constexpr((int)log_level::WARNING >= ULOG_MIN_LEVEL)
+            log(log_level::WARNING, s);
     }
     inline void severe(const string_t& s)
     {
-        log(log_level::SEVERE, s);
+        if constexpr((int)log_level::SEVERE >= ULOG_MIN_LEVEL)
+            log(log_level::SEVERE, s);
     }
     inline void fatal(const string_t& s)
     {
         log(log_level::FATAL, s);
     }
 
+    // String literals and format strings take the deferred path
+    template<typename ... Ts>
+    inline void debug(const char* format, const Ts& ... args)
+    {
+        deferred<log_level::DEBUG>(format, args...);
+    }
+
+    template<typename ... Ts>
+    inline void info(const char* format, const Ts& ... args)
+    {
+        deferred<log_level::INFO>(format, args...);
+    }
+
+    template<typename ... Ts>
+    inline void warn(const char* format, const Ts& ... args)
+    {
+        deferred<log_level::WARNING>(format, args...);
+    }
+
+    template<typename ... Ts>
+    inline void severe(const char* format, const Ts& ... args)
+    {
+        deferred<log_level::SEVERE>(format, args...);
+    }
+
+    template<typename ... Ts>
+    inline void fatal(const char* format, const Ts& ... args)
+    {
+        deferred<log_level::FATAL>(format, args...);
+    }
+
     template<typename T, std::enable_if_t<!std::is_enum<T>::value && !std::is_integral<T>::value, int> = 0>
     inline void add_impl(string_t& str, const T& value)
     {
@@ -6,21 +6,54 @@ using namespace mqtt;
 
 #define IMPL(x) case x : pimpl<x>::process_impl(this, hdr); break
 
+// Messages are leased from mqtt::memory_resource only while a packet is handled
 template<MessageType Type>
-static Message<Type> message;
+using message_lease = lease<Message<Type>>;
 
 #ifndef MQTT_DISABLE_QOS
-    static etl::map<uint16_t, Message<MessageType::PUBLISH>, 16> persistence;
+    // QoS 1 PUBLISH messages stay leased here until their PUBACK
+    static etl::map<uint16_t, Message<MessageType::PUBLISH>*, MQTT_MAX_PERSISTENT_MESSAGES> persistence;
 
 #endif
 
 template<MessageType Type>
-Message<Type>& read_msg(Client* c, FixedHeader& hdr)
+message_lease<Type> lease_msg()
 {
-    message<Type>.fixed_header = hdr;
-    if(!message<Type>.read_without_fixed_header(c->getSocket()))
-        ulog::warn(ulog::join("Cannot read packet of type ", (int)Type));
-    return message<Type>;
+    auto msg = message_lease<Type>::make();
+    if(!msg)
+    {
+        ++metrics::pool_failures;
+        ulog::warn("No memory for a packet of type %s", Type);
+    }
+    return msg;
+}
+
+static void report_pool()
+{
+    #ifdef MQTT_USE_PMR_ALLOCATOR
+        metrics::pool_used.set(pool.used());
+        metrics::pool_peak.set(pool.peak());
+    #endif
+}
+
+template<MessageType Type>
+message_lease<Type> read_msg(Client* c, FixedHeader& hdr)
+{
+    auto msg = lease_msg<Type>();
+    if(!msg)
+    {
+        // Keep the stream in sync
+        detail::skip(c->getSocket(), (uint32_t)hdr.length);
+        return msg;
+    }
+
+    msg->fixed_header = hdr;
+    if(!msg->read_without_fixed_header(c->getSocket()))
+    {
+        ++mqtt::metrics::read_errors;
+        ulog::warn("Cannot read packet of type %d", (int)Type);
+    }
+    return msg;
 }
 
 namespace mqtt
@@ -31,7 +64,7 @@ namespace mqtt
     {
         static void process_impl(Client* client, FixedHeader& hd)
         {
-            ulog::warn(ulog::join("No actions for Packet type : ", Type));
+            ulog::warn("No actions for Packet type : %s", Type);
         }
     };
 
@@ -40,9 +73,10 @@ namespace mqtt
     {
         static void process_impl(Client* c, FixedHeader& hdr)
         {
-            auto& msg = read_msg<MessageType::CONNACK>(c, hdr);
+            auto msg = read_msg<MessageType::CONNACK>(c, hdr);
+            if(!msg) return;
 
-            c->m_conn_status = msg.variable_header.reason_code;
+            c->m_conn_status = msg->variable_header.reason_code;
         }
     };
 
@@ -51,22 +85,34 @@ namespace mqtt
     {
         static void process_impl(Client* c, FixedHeader& hdr)
         {
-            auto& msg = read_msg<MessageType::PUBLISH>(c, hdr);
+            auto msg = read_msg<MessageType::PUBLISH>(c, hdr);
+            if(!msg) return;
 
-            auto result = c->m_rx_cb(msg);
+            auto result = c->m_rx_cb(*msg);
+            uint16_t pid = msg->variable_header.packet_id;
+            // Free the PUBLISH before leasing the reply
+            msg.reset();
 
             switch ((hdr.type_and_flags >> 1) & 3)
             {
             case 1:
-                message<MessageType::PUBACK>.fixed_header.type_and_flags = (uint8_t)MessageType::PUBACK << 4;
-                message<MessageType::PUBACK>.variable_header.packet_id = msg.variable_header.packet_id;
-                message<MessageType::PUBACK>.variable_header.code = result ? PubAckReasonCode::SUCCESS : PubAckReasonCode::IMPL_SPECIFIC_ERROR;
+            {
+                auto ack = lease_msg<MessageType::PUBACK>();
+                if(!ack) break;
+
+                ack->fixed_header.type_and_flags = (uint8_t)MessageType::PUBACK << 4;
+                ack->variable_header.packet_id = pid;
+                ack->variable_header.code = result ? PubAckReasonCode::SUCCESS : PubAckReasonCode::IMPL_SPECIFIC_ERROR;
                 #if MQTT_VERSION >= 5
-                message<MessageType::PUBACK>.variable_header.properties.properties.clear();
+                ack->variable_header.properties.properties.clear();
                 #endif
-                if(!c->send(message<MessageType::PUBACK>))
-                    ulog::warn(ulog::join("Cannot send PUBACK for packet #", msg.variable_header.packet_id));
+                if(!c->send(*ack))
+                {
+                    ++metrics::send_errors;
+                    ulog::warn("Cannot send PUBACK for packet #%u", pid);
+                }
                 break;
+            }
 
             case 2:
                 ulog::warn("QoS 2 is not supported");
@@ -81,14 +127,23 @@ namespace mqtt
         static void process_impl(Client* c, FixedHeader& hdr)
         {
 
-            auto& msg = read_msg<MessageType::PUBACK>(c, hdr);
+            auto msg = read_msg<MessageType::PUBACK>(c, hdr);
+            if(!msg) return;
 
-            auto pid = msg.variable_header.packet_id;
+            uint16_t pid = msg->variable_header.packet_id;
 
-            if(msg.variable_header.code != PubAckReasonCode::SUCCESS)
-                ulog::warn(ulog::join("Cannot deliver packet #", pid, " (", msg.variable_header.code, ")"));
+            if(msg->variable_header.code != PubAckReasonCode::SUCCESS)
+            {
+                ++metrics::delivery_errors;
+                ulog::warn("Cannot deliver packet #%u (%s)", pid, msg->variable_header.code);
+            }
 
-            persistence.erase(persistence.find(pid));
+            auto it = persistence.find(pid);
+            if(it != persistence.end())
+            {
+                message_lease<MessageType::PUBLISH>::destroy(it->second);
+                persistence.erase(it);
+            }
         }
     };
     #endif
@@ -100,6 +155,7 @@ void Client::process()
     
     if(!Serializer<FixedHeader>::read(getSocket(), hdr))
     {
+        ++metrics::read_errors;
         ulog::warn("Cannot read MQTT packet");
         return;
     }
@@ -125,15 +181,39 @@ void Client::process()
         IMPL(MessageType::DISCONNECT);
         IMPL(MessageType::AUTH);
     }
+
+    report_pool();
 }
 
 bool Client::connect_async(const Payload<MessageType::CONNECT>& payload)
+{
+    auto msg = lease_msg<MessageType::CONNECT>();
+    if(!msg) return false;
+
+    msg->payload = payload;
+    return send_connect(*msg);
+}
+
+bool Client::connect_async(const char* username, const char* password)
+{
+    auto msg = lease_msg<MessageType::CONNECT>();
+    if(!msg) return false;
+
+    msg->payload.username = username;
+    msg->payload.password = password;
+    #if MQTT_VERSION >= 5
+    msg->payload.will_properties.properties.clear();
+    #endif
+    msg->payload.will_topic.clear();
+
+    return send_connect(*msg);
+}
+
+bool Client::send_connect(Message<MessageType::CONNECT>& msg)
 {
     // TODO Customization
 
-    auto& msg = message<MessageType::CONNECT>;
-    if(std::addressof(msg.payload) != std::addressof(payload))
-        msg.payload = payload;
+    auto& payload = msg.payload;
     msg.fixed_header.type_and_flags = (uint8_t)MessageType::CONNECT << 4;
     msg.variable_header.proto_name = "MQTT";
     msg.variable_header.proto_version = 5;
@@ -151,6 +231,7 @@ bool Client::connect_async(const Payload<MessageType::CONNECT>& payload)
 
     if(!send(msg))
     {
+        ++metrics::send_errors;
         ulog::warn("Cannot send connect message");
         return false;
     }
@@ -158,19 +239,6 @@ bool Client::connect_async(const Payload<MessageType::CONNECT>& payload)
     return true;
 }
 
-bool Client::connect_async(const char* username, const char* password)
-{
-    auto& msg = message<MessageType::CONNECT>;
-    msg.payload.username = username;
-    msg.payload.password = password;
-    #if MQTT_VERSION >= 5
-    msg.payload.will_properties.properties.clear();
-    #endif
-    msg.payload.will_topic.clear();
-
-    return connect_async(msg.payload);
-}
-
 bool Client::publish(const etl::istring& topic, const etl::istring& data, uint8_t qos, bool dup)
 {
     if(qos > 1)
@@ -179,7 +247,16 @@ bool Client::publish(const etl::istring& topic, const etl::istring& data, uint8_
         qos = 1;
     }
 
-    auto& msg = message<MessageType::PUBLISH>;
+    #ifndef MQTT_DISABLE_QOS
+    if(qos && persistence.full())
+    {
+        ulog::warn("Too many unacknowledged messages");
+        return false;
+    }
+    #endif
+
+    auto msg = lease_msg<MessageType::PUBLISH>();
+    if(!msg) return false;
 
     uint8_t flags = (uint8_t)MessageType::PUBLISH << 4;
 
@@ -187,21 +264,27 @@ bool Client::publish(const etl::istring& topic, const etl::istring& data, uint8_
     if(dup)
         flags |= 1 << 3;
 
-    msg.fixed_header.type_and_flags = flags;
-    msg.variable_header.topic = topic;
+    msg->fixed_header.type_and_flags = flags;
+    msg->variable_header.topic = topic;
 
     if(qos)
-        msg.variable_header.packet_id.value = ++m_pid_counter;
+        msg->variable_header.packet_id.value = ++m_pid_counter;
     else
-        msg.variable_header.packet_id.value = 0;
+        msg->variable_header.packet_id.value = 0;
 
     #if MQTT_VERSION >= 5
-    msg.variable_header.properties.properties.clear();
+    msg->variable_header.properties.properties.clear();
     #endif
-    msg.payload.payload.assign((const uint8_t*)data.cbegin(), (const uint8_t*)data.cend());
+    msg->payload.payload.assign((const uint8_t*)data.cbegin(), (const uint8_t*)data.cend());
+
+    auto result = send(*msg);
 
+    #ifndef MQTT_DISABLE_QOS
+    // Kept for redelivery until acknowledged
     if(qos)
-        persistence.insert({m_pid_counter, msg});
+        persistence.insert({m_pid_counter, msg.release()});
+    #endif
 
-    return send(msg);
-}
\ No newline at end of file
+    report_pool();
+    return result;
+}
@@ -1,12 +1,123 @@
 #include <mqtt/config.hpp>
 
-#ifdef MQTT_USE_PMR_ALLOCATOR
+// Allocations may come from the client and the application thread
+#ifdef __MBED__
+    #include <platform/mbed_critical.h>
 
+    #define MQTT_POOL_LOCK() core_util_critical_section_enter()
+    #define MQTT_POOL_UNLOCK() core_util_critical_section_exit()
+#else
+    #define MQTT_POOL_LOCK()
+    #define MQTT_POOL_UNLOCK()
+#endif
 
 namespace mqtt
 {
-    extern std::pmr::memory_resource* memory_resource;
+    #ifdef MQTT_USE_PMR_ALLOCATOR
+        alignas(fixed_pool_resource::MIN_BLOCK) static unsigned char arena[MQTT_POOL_SIZE];
 
-}
+        fixed_pool_resource pool(arena, sizeof(arena));
+
+        std::pmr::memory_resource* memory_resource = &pool;
+
+        void* try_allocate(size_t size, size_t alignment)
+        {
+            return pool.try_allocate(size, alignment);
+        }
+    #else
+        std::pmr::memory_resource* memory_resource = std::pmr::new_delete_resource();
+
+        void* try_allocate(size_t size, size_t alignment)
+        {
+            return memory_resource->allocate(size, alignment);
+        }
+    #endif
+
+    fixed_pool_resource::fixed_pool_resource(unsigned char* buffer, size_t size) :
+        m_buffer(buffer),
+        m_size(size),
+        m_offset(0),
+        m_free{},
+        m_used(0),
+        m_peak(0),
+        m_failures(0)
+    {
+        // Blocks are multiples of MIN_BLOCK, so they stay aligned if the first one is
+        auto misalignment = reinterpret_cast<uintptr_t>(buffer) % MIN_BLOCK;
+        if(misalignment) m_offset = MIN_BLOCK - misalignment;
+    }
+
+    int fixed_pool_resource::size_class(size_t size)
+    {
+        int c = 0;
+        for(size_t block = MIN_BLOCK; block < size; block <<= 1)
+        {
+            if(++c >= (int)CLASS_COUNT) return -1;
+        }
+        return c;
+    }
+
+    size_t fixed_pool_resource::block_size(size_t size)
+    {
+        auto c = size_class(size);
+        return c < 0 ? 0 : MIN_BLOCK << c;
+    }
+
+    void* fixed_pool_resource::try_allocate(size_t size, size_t alignment)
+    {
+        auto c = alignment <= MIN_BLOCK ? size_class(size) : -1;
+        if(c < 0)
+        {
+            m_failures++;
+            return nullptr;
+        }
 
-#endif
\ No newline at end of file
+        size_t block = MIN_BLOCK << c;
+        void* p = nullptr;
+
+        MQTT_POOL_LOCK();
+        if(m_free[c])
+        {
+            p = m_free[c];
+            m_free[c] = m_free[c]->next;
+        }
+        else if(m_size - m_offset >= block)
+        {
+            p = m_buffer + m_offset;
+            m_offset += block;
+        }
+
+        if(p)
+        {
+            m_used += block;
+            if(m_used > m_peak) m_peak = m_used;
+        }
+        else
+        {
+            m_failures++;
+        }
+        MQTT_POOL_UNLOCK();
+
+        return p;
+    }
+
+    void* fixed_pool_resource::do_allocate(size_t size, size_t alignment)
+    {
+        auto p = try_allocate(size, alignment);
+        return p ? p : std::pmr::null_memory_resource()->allocate(size, alignment);
+    }
+
+    void fixed_pool_resource::do_deallocate(void* p, size_t size, size_t)
+    {
+        auto c = size_class(size);
+        if(!p || c < 0) return;
+
+        auto block = static_cast<free_block*>(p);
+
+        MQTT_POOL_LOCK();
+        block->next = m_free[c];
+        m_free[c] = block;
+        m_used -= MIN_BLOCK << c;
+        MQTT_POOL_UNLOCK();
+    }
+}
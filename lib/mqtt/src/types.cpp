@@ -80,7 +80,7 @@ bool Payload<MessageType::PUBLISH>::read(Socket& s, Payload<MessageType::PUBLISH
 
         if(read < 0)
         {
-            ulog::warn(ulog::join("Socket error ", read));
+            ulog::warn("Socket error %d", read);
             return false;
         }
         
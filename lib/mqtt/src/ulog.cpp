@@ -1,4 +1,6 @@
 #include <ulog.hpp>
+#include <cstdio>
+#include <algorithm>
 
 static ulog::callback_t log_callback;
 
@@ -9,5 +11,100 @@ void ulog::set_callback(ulog::callback_t& cb)
 
 void ulog::log(ulog::log_level level, const ulog::string_t& str)
 {
-    log_callback(level, str);
-}
\ No newline at end of file
+    if(log_callback) log_callback(level, str.c_str());
+}
+
+size_t ulog::format(const ulog::record& r, char* out, size_t size)
+{
+    size_t length = 0;
+    uint8_t arg = 0;
+
+    auto append = [&](int n)
+    {
+        if(n > 0) length += std::min((size_t)n, size - 1 - length);
+    };
+
+    for(auto p = r.format; *p && length + 1 < size; ++p)
+    {
+        if(*p != '%')
+        {
+            out[length++] = *p;
+            continue;
+        }
+
+        if(p[1] == '%')
+        {
+            out[length++] = '%';
+            ++p;
+            continue;
+        }
+
+        // Copy one conversion spec, length modifiers are dropped since arguments are normalized
+        char spec[16] = {'%'};
+        size_t n = 1;
+        for(++p; *p && std::strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 3; ++p)
+            spec[n++] = *p;
+        while(*p && std::strchr("hlLqjzt", *p))
+            ++p;
+        if(!*p) break;
+
+        if(arg >= r.argc)
+        {
+            append(snprintf(out + length, size - length, "<?>"));
+            continue;
+        }
+
+        auto type = (ulog::arg_type)((r.types >> (2 * arg)) & 3);
+        auto word = r.args[arg++];
+
+        switch(type)
+        {
+        case ulog::arg_type::STRING:
+            spec[n++] = 's';
+            append(snprintf(out + length, size - length, spec, reinterpret_cast<const char*>(word)));
+            break;
+        case ulog::arg_type::FLOAT:
+        {
+            float f;
+            uint32_t bits = word;
+            std::memcpy(&f, &bits, sizeof(f));
+            spec[n++] = std::strchr("eEfFgGaA", *p) ? *p : 'g';
+            append(snprintf(out + length, size - length, spec, (double)f));
+            break;
+        }
+        case ulog::arg_type::INT:
+            spec[n++] = std::strchr("diuxXoc", *p) ? *p : 'd';
+            append(snprintf(out + length, size - length, spec, (int)(int32_t)word));
+            break;
+        case ulog::arg_type::UINT:
+            spec[n++] = std::strchr("diuxXoc", *p) ? *p : 'u';
+            append(snprintf(out + length, size - length, spec, (unsigned)word));
+            break;
+        }
+    }
+
+    out[length] = 0;
+    return length;
+}
+
+size_t ulog::process(size_t max)
+{
+    char line[ULOG_LINE_SIZE];
+    size_t handled = 0;
+
+    if(auto dropped = ring::take_dropped())
+    {
+        snprintf(line, sizeof(line), "%u log records dropped", (unsigned)dropped);
+        if(log_callback) log_callback(log_level::WARNING, line);
+    }
+
+    ulog::record r;
+    while(handled < max && ring::pop(r))
+    {
+        format(r, line, sizeof(line));
+        if(log_callback) log_callback(r.level, line);
+        ++handled;
+    }
+
+    return handled;
+}
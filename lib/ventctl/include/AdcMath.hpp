@@ -0,0 +1,57 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// VREFINT_CAL is measured by ST at VDDA = 3.3 V, 30 degC
+#ifndef VC_VREFINT_CAL_VDDA
+    #define VC_VREFINT_CAL_VDDA 3.3f
+#endif
+
+namespace ventctl
+{
+    /*
+        Ratiometric ADC conversion against the internal reference. With
+        VREFINT sampled together with the input, both readings scale with
+        the same VDDA, so
+
+            VDDA = CAL_VDDA * VREFINT_CAL / vrefint
+            V    = VDDA * raw / 4095
+
+        and supply ripple cancels out. raw and vrefint may be sums over
+        the same number of samples, only their ratio matters.
+    */
+    inline float adc_vdda(float vrefint, uint16_t vrefint_cal)
+    {
+        if(!(vrefint > 0)) return NAN;
+        return VC_VREFINT_CAL_VDDA * vrefint_cal / vrefint;
+    }
+
+    inline float adc_volts(float raw, float vrefint, uint16_t vrefint_cal)
+    {
+        if(!(vrefint > 0)) return NAN;
+        return VC_VREFINT_CAL_VDDA * vrefint_cal * raw / (vrefint * 4095.0f);
+    }
+
+    /*
+        Sums a block of dual regular simultaneous DMA words (DMA mode 2:
+        ADC1 in the low half, ADC2 in the high half) scan by scan. ADC1
+        converts VREFINT in every slot, ADC2 the inputs, so ref[i] is the
+        reference sampled at the same instants as raw[i].
+    */
+    inline void adc_accumulate_dual(const uint32_t* words, size_t scans, size_t channels, uint32_t* raw, uint32_t* ref)
+    {
+        for(size_t c = 0; c < channels; ++c)
+            raw[c] = ref[c] = 0;
+
+        for(size_t s = 0; s < scans; ++s)
+        {
+            for(size_t c = 0; c < channels; ++c)
+            {
+                auto word = *words++;
+                ref[c] += word & 0xFFFF;
+                raw[c] += word >> 16;
+            }
+        }
+    }
+}
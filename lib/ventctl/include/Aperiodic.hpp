@@ -6,19 +6,36 @@ namespace ventctl
     class Aperiodic : public UnitBase
     {
     public:
+        struct State
+        {
+            float integral;
+        };
+
         Aperiodic(UnitBase& input, float k, float tp) : 
             m_input(input),
             m_k(k), 
             m_tp(tp),
             m_integral(0.0)
-        {}
+        {
+            dependsOn(input);
+            setTimeDependent();
+        }
+
+        State getState() const
+        {
+            return State{m_integral};
+        }
+
+        void setState(const State& state)
+        {
+            m_integral = state.integral;
+        }
 
         virtual float getValueUncached(float time)
         {
-            auto m_last_time = getLastTime();
             auto result = m_integral / m_tp;
 
-            m_integral += (m_k * m_input.getValue(time) - result) * (time - m_last_time);
+            m_integral += (m_k * m_input.getValue(time) - result) * (time - getPreviousTime());
 
             return result;
         }
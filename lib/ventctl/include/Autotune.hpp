@@ -0,0 +1,208 @@
+#pragma once
+#include <Unit.hpp>
+#include <cmath>
+#include <cstdint>
+
+#ifndef VC_AUTOTUNE_MAX_CYCLES
+    #define VC_AUTOTUNE_MAX_CYCLES 8
+#endif
+
+namespace ventctl
+{
+    struct PIDGains
+    {
+        float kp, ki, kd;
+    };
+
+    /*
+        Relay feedback autotuner (Astrom-Hagglund).
+
+        While idle it passes the controller output through. When started it
+        swaps a hysteresis relay into the loop, drives the plant into a limit
+        cycle and measures its period and amplitude. The ultimate gain and
+        period are then turned into PID gains and applied to the controller.
+        The controller is not evaluated during the run, so whenever the run
+        ends its time is re-stamped; its first step afterwards must not
+        integrate over the whole run.
+    */
+    template<typename TPID>
+    class Autotune : public UnitBase
+    {
+    public:
+        enum class Rule
+        {
+            ZIEGLER_NICHOLS,
+            TYREUS_LUYBEN
+        };
+
+        enum class State
+        {
+            IDLE,
+            RUNNING,
+            DONE,
+            FAILED
+        };
+
+        Autotune(TPID& pid, UnitBase& error, UnitBase& control, float bias, float amplitude, float hysteresis, Rule rule = Rule::ZIEGLER_NICHOLS, uint8_t cycles = 4, float timeout = 3600) :
+            m_pid(pid),
+            m_error(error),
+            m_control(control),
+            m_relay(-hysteresis, hysteresis, error),
+            m_bias(bias),
+            m_amplitude(amplitude),
+            m_hysteresis(hysteresis),
+            m_timeout(timeout),
+            m_rule(rule),
+            m_cycles(cycles < 2 ? 2 : (cycles > VC_AUTOTUNE_MAX_CYCLES ? VC_AUTOTUNE_MAX_CYCLES : cycles)),
+            m_state(State::IDLE),
+            m_result_pending(false)
+        {}
+
+        virtual void setLastTime(float time)
+        {
+            UnitBase::setLastTime(time);
+            m_control.setLastTime(time);
+            m_error.setLastTime(time);
+        }
+
+        void start(float time)
+        {
+            m_state = State::RUNNING;
+            m_start_time = time;
+            m_edge_time = -1;
+            m_edges = 0;
+            m_high = false;
+            m_min = INFINITY;
+            m_max = -INFINITY;
+            m_period_sum = 0;
+            m_amplitude_sum = 0;
+            m_ku = m_tu = 0;
+            m_result_pending = false;
+        }
+
+        void abort(float time)
+        {
+            if(m_state == State::RUNNING) finish(State::FAILED, time);
+        }
+
+        State state() const { return m_state; }
+        bool running() const { return m_state == State::RUNNING; }
+
+        float ultimateGain() const { return m_ku; }
+        float ultimatePeriod() const { return m_tu; }
+        const PIDGains& gains() const { return m_gains; }
+
+        // Returns true exactly once after a successful run, so the caller can persist the gains
+        bool takeResult(PIDGains& gains)
+        {
+            if(!m_result_pending) return false;
+            m_result_pending = false;
+            gains = m_gains;
+            return true;
+        }
+
+        static PIDGains computeGains(float ku, float tu, Rule rule)
+        {
+            float kp, ti, td;
+            switch(rule)
+            {
+            case Rule::TYREUS_LUYBEN:
+                kp = ku / 2.2;
+                ti = tu * 2.2;
+                td = tu / 6.3;
+                break;
+            case Rule::ZIEGLER_NICHOLS:
+            default:
+                kp = ku * 0.6;
+                ti = tu / 2.0;
+                td = tu / 8.0;
+                break;
+            }
+
+            return PIDGains{kp, kp / ti, kp * td};
+        }
+
+        virtual float getValueUncached(float time)
+        {
+            if(m_state != State::RUNNING)
+                return m_control.getValue(time);
+
+            if(time - m_start_time > m_timeout)
+            {
+                finish(State::FAILED, time);
+                return m_control.getValue(time);
+            }
+
+            auto error = m_error.getValue(time);
+            bool high = m_relay.getValue(time) > 0.5;
+
+            if(error < m_min) m_min = error;
+            if(error > m_max) m_max = error;
+
+            if(high && !m_high)
+                onRisingEdge(time);
+
+            m_high = high;
+
+            if(m_state == State::DONE)
+                return m_control.getValue(time);
+
+            return m_bias + (high ? m_amplitude : -m_amplitude);
+        }
+
+    private:
+        void onRisingEdge(float time)
+        {
+            // The first edge only synchronizes, the first full cycle is a transient
+            if(m_edges >= 2)
+            {
+                auto a = (m_max - m_min) / 2;
+                m_period_sum += time - m_edge_time;
+                m_amplitude_sum += a;
+            }
+
+            m_edges++;
+            m_edge_time = time;
+            m_min = INFINITY;
+            m_max = -INFINITY;
+
+            if(m_edges < m_cycles + 2) return;
+
+            auto measured = m_cycles;
+            auto a = m_amplitude_sum / measured;
+            m_tu = m_period_sum / measured;
+
+            if(a <= m_hysteresis || m_tu <= 0)
+            {
+                finish(State::FAILED, time);
+                return;
+            }
+
+            m_ku = 4 * m_amplitude / (M_PI * std::sqrt(a * a - m_hysteresis * m_hysteresis));
+            m_gains = computeGains(m_ku, m_tu, m_rule);
+            m_pid.setCoefficients(m_gains.kp, m_gains.ki, m_gains.kd);
+            m_pid.reset();
+            finish(State::DONE, time);
+            m_result_pending = true;
+        }
+
+        void finish(State state, float time)
+        {
+            m_state = state;
+            m_pid.setLastTime(time);
+        }
+
+        TPID& m_pid;
+        UnitBase &m_error, &m_control;
+        Relay<float> m_relay;
+        float m_bias, m_amplitude, m_hysteresis, m_timeout;
+        Rule m_rule;
+        uint8_t m_cycles, m_edges;
+        State m_state;
+        bool m_high, m_result_pending;
+        float m_start_time, m_edge_time, m_min, m_max;
+        float m_period_sum, m_amplitude_sum;
+        float m_ku, m_tu;
+        PIDGains m_gains;
+    };
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <etl/vector.h>
+#include <Fixed.hpp>
+
+// Reference points per channel
+#ifndef VC_CAL_POINTS
+    #define VC_CAL_POINTS 8
+#endif
+
+#ifndef VC_CAL_CHANNELS
+    #define VC_CAL_CHANNELS 16
+#endif
+
+namespace ventctl
+{
+    struct CalibrationPoint
+    {
+        float input, value;
+    };
+
+    /*
+        Raw input to engineering value of one named channel, owned by the
+        peripheral that converts it and found by that name when stored
+        points are loaded or captured.
+
+        Without points the channel uses its default gain and offset, one
+        point shifts the default through it (offset trim), two or more
+        give a piecewise linear curve through the sorted points whose end
+        segments extrapolate. The segments are precomputed as Q16.16
+        start, value and slope, so apply() is a short search and one
+        fixed point multiply-add; inputs and values must stay within
+        +-32767.
+
+        apply() remembers its input, which is what a capture reads as
+        the raw side of a reference point.
+    */
+    class Calibration
+    {
+    public:
+        Calibration(const char* name, float gain, float offset) :
+            m_name(name),
+            m_gain(gain),
+            m_offset(offset),
+            m_count(0),
+            m_segments(0),
+            m_input(NAN)
+        {
+            if(!s_channels.full()) s_channels.push_back(this);
+            reset();
+        }
+
+        ~Calibration()
+        {
+            etl::erase(s_channels, this);
+        }
+
+        Calibration(const Calibration&) = delete;
+        Calibration& operator=(const Calibration&) = delete;
+
+        // Fails on more than VC_CAL_POINTS points, non finite numbers or repeated inputs
+        bool set(const CalibrationPoint* points, size_t count)
+        {
+            if(count > VC_CAL_POINTS) return false;
+
+            CalibrationPoint sorted[VC_CAL_POINTS];
+            for(size_t i = 0; i < count; ++i)
+            {
+                auto p = points[i];
+                if(!std::isfinite(p.input) || !std::isfinite(p.value)) return false;
+
+                size_t j = i;
+                for(; j > 0 && p.input < sorted[j - 1].input; --j)
+                    sorted[j] = sorted[j - 1];
+                sorted[j] = p;
+            }
+
+            for(size_t i = 1; i < count; ++i)
+            {
+                if(Fixed(sorted[i].input) == Fixed(sorted[i - 1].input)) return false;
+            }
+
+            std::memcpy(m_points, sorted, count * sizeof(CalibrationPoint));
+            m_count = count;
+            precompute();
+            return true;
+        }
+
+        void reset()
+        {
+            set(nullptr, 0);
+        }
+
+        float apply(float input)
+        {
+            m_input = input;
+            if(std::isnan(input)) return NAN;
+
+            Fixed x(input);
+            uint8_t i = 0;
+            while(i + 1 < m_segments && !(x < m_x[i + 1])) ++i;
+            return (m_y[i] + m_slope[i] * (x - m_x[i])).to_float();
+        }
+
+        // The default transfer in float, for comparison
+        float nominal(float input) const
+        {
+            return m_gain * input + m_offset;
+        }
+
+        const char* name() const { return m_name; }
+        size_t size() const { return m_count; }
+        const CalibrationPoint* points() const { return m_points; }
+        float last_input() const { return m_input; }
+
+        static Calibration* find(const char* name, size_t length)
+        {
+            for(auto c : s_channels)
+            {
+                if(std::strlen(c->m_name) == length && std::strncmp(c->m_name, name, length) == 0)
+                    return c;
+            }
+            return nullptr;
+        }
+
+        static const etl::ivector<Calibration*>& channels()
+        {
+            return s_channels;
+        }
+
+    private:
+        void precompute()
+        {
+            if(m_count < 2)
+            {
+                auto x = m_count ? m_points[0].input : 0.0f;
+                auto y = m_count ? m_points[0].value : m_offset;
+                set_segment(0, x, y, m_gain);
+                m_segments = 1;
+                return;
+            }
+
+            for(size_t i = 0; i + 1 < m_count; ++i)
+            {
+                auto& a = m_points[i];
+                auto& b = m_points[i + 1];
+                set_segment(i, a.input, a.value, (b.value - a.value) / (b.input - a.input));
+            }
+            m_segments = m_count - 1;
+        }
+
+        void set_segment(size_t i, float x, float y, float slope)
+        {
+            m_x[i] = Fixed(x);
+            m_y[i] = Fixed(y);
+            m_slope[i] = Fixed(slope);
+        }
+
+        const char* m_name;
+        float m_gain, m_offset;
+        CalibrationPoint m_points[VC_CAL_POINTS];
+        uint8_t m_count, m_segments;
+        Fixed m_x[VC_CAL_POINTS], m_y[VC_CAL_POINTS], m_slope[VC_CAL_POINTS];
+        float m_input;
+
+        inline static etl::vector<Calibration*, VC_CAL_CHANNELS> s_channels;
+    };
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <crc32.hpp>
+#include <etl/vector.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifndef VC_CHECKPOINT_MAX_ITEMS
+    #define VC_CHECKPOINT_MAX_ITEMS 16
+#endif
+
+namespace ventctl
+{
+    /*
+        Snapshot of the dynamic state of control units (integrals, filter
+        outputs), so a reset doesn't restart them from zero.
+
+        Any object with a trivially copyable `State` type and
+        getState()/setState() can be added under a name. The image carries a
+        layout hash of the registered names and sizes in order, a wall clock
+        timestamp for the staleness check and a CRC; restore() applies
+        nothing unless all of them match, so reordered or swapped items of
+        the same type are not restored into each other.
+    */
+    class Checkpoint
+    {
+    public:
+        constexpr const static uint32_t MAGIC = 0x4B504843; // "CHPK"
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t sequence;
+            uint32_t timestamp;
+            uint16_t count;
+            uint16_t size;
+            uint32_t layout;
+            uint32_t crc;
+        };
+
+        static_assert(sizeof(Header) == 24, "Checkpoint header must be packed");
+
+        enum class Result
+        {
+            OK,
+            EMPTY,
+            CORRUPT,
+            LAYOUT_CHANGED,
+            STALE
+        };
+
+        Checkpoint() : m_sequence(0) {}
+
+        template<typename T>
+        bool add(T& object, const char* name)
+        {
+            if(m_items.full()) return false;
+            m_items.push_back(Item{&object, name, sizeof(typename T::State), &save_item<T>, &restore_item<T>});
+            return true;
+        }
+
+        // Size of the image including the header
+        size_t size() const
+        {
+            size_t size = sizeof(Header);
+            for(auto& item : m_items)
+                size += item.size;
+            return size;
+        }
+
+        uint32_t sequence() const { return m_sequence; }
+
+        // Returns the image size, 0 if it doesn't fit
+        size_t save(uint8_t* buffer, size_t capacity, uint32_t timestamp)
+        {
+            auto total = size();
+            if(total > capacity || total > 0xFFFF) return 0;
+
+            auto cursor = buffer + sizeof(Header);
+            for(auto& item : m_items)
+            {
+                item.save(item.object, cursor);
+                cursor += item.size;
+            }
+
+            Header hdr{MAGIC, ++m_sequence, timestamp, (uint16_t)m_items.size(), (uint16_t)total, layout(), 0};
+            hdr.crc = crc32(buffer + sizeof(Header), total - sizeof(Header), crc32(&hdr, offsetof(Header, crc)));
+            std::memcpy(buffer, &hdr, sizeof(hdr));
+
+            return total;
+        }
+
+        // Checks an image without applying it, sequence is set for valid images
+        Result check(const uint8_t* buffer, size_t size, uint32_t& sequence) const
+        {
+            Header hdr;
+            if(size < sizeof(hdr)) return Result::EMPTY;
+            std::memcpy(&hdr, buffer, sizeof(hdr));
+
+            if(hdr.magic != MAGIC) return Result::EMPTY;
+            if(hdr.size > size || hdr.size < sizeof(hdr)) return Result::CORRUPT;
+            if(crc32(buffer + sizeof(Header), hdr.size - sizeof(Header), crc32(&hdr, offsetof(Header, crc))) != hdr.crc)
+                return Result::CORRUPT;
+            if(hdr.count != m_items.size() || hdr.size != this->size() || hdr.layout != layout())
+                return Result::LAYOUT_CHANGED;
+
+            sequence = hdr.sequence;
+            return Result::OK;
+        }
+
+        // Applies the image if it is valid and not older than max_age seconds
+        Result restore(const uint8_t* buffer, size_t size, uint32_t now, uint32_t max_age)
+        {
+            uint32_t sequence;
+            auto result = check(buffer, size, sequence);
+            if(result != Result::OK) return result;
+
+            // Keep counting from the stored image so the next save is the newest one
+            m_sequence = sequence;
+
+            Header hdr;
+            std::memcpy(&hdr, buffer, sizeof(hdr));
+            if(now < hdr.timestamp || now - hdr.timestamp > max_age) return Result::STALE;
+
+            auto cursor = buffer + sizeof(Header);
+            for(auto& item : m_items)
+            {
+                item.restore(item.object, cursor);
+                cursor += item.size;
+            }
+
+            return Result::OK;
+        }
+
+    private:
+        struct Item
+        {
+            void* object;
+            const char* name;
+            size_t size;
+            void (*save)(void*, uint8_t*);
+            void (*restore)(void*, const uint8_t*);
+        };
+
+        template<typename T>
+        static void save_item(void* object, uint8_t* out)
+        {
+            auto state = static_cast<T*>(object)->getState();
+            std::memcpy(out, &state, sizeof(state));
+        }
+
+        template<typename T>
+        static void restore_item(void* object, const uint8_t* in)
+        {
+            typename T::State state;
+            std::memcpy(&state, in, sizeof(state));
+            static_cast<T*>(object)->setState(state);
+        }
+
+        uint32_t layout() const
+        {
+            uint32_t crc = 0;
+            for(auto& item : m_items)
+            {
+                uint32_t size = item.size;
+                crc = crc32(&size, sizeof(size), crc);
+                crc = crc32(item.name, std::strlen(item.name) + 1, crc);
+            }
+            return crc;
+        }
+
+        etl::vector<Item, VC_CHECKPOINT_MAX_ITEMS> m_items;
+        uint32_t m_sequence;
+    };
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include <etl/string_view.h>
+#include <charconv.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace ventctl
+{
+    inline bool equals(etl::string_view view, const char* text)
+    {
+        return view.size() == std::strlen(text) && std::strncmp(view.data(), text, view.size()) == 0;
+    }
+
+    /*
+        Whitespace separated arguments of one command. Typed parsing goes
+        through ventctl::from_chars; get() consumes a token only when all of
+        it converts, so "1.5" is not accepted as an int.
+    */
+    class Args
+    {
+    public:
+        explicit Args(etl::string_view view) :
+            m_view(view)
+            {}
+
+        bool empty()
+        {
+            skip_spaces();
+            return m_view.empty();
+        }
+
+        etl::string_view word()
+        {
+            skip_spaces();
+            size_t length = 0;
+            while(length < m_view.size() && !is_space(m_view[length]))
+                length++;
+
+            auto result = m_view.substr(0, length);
+            m_view.remove_prefix(length);
+            return result;
+        }
+
+        // Everything left, without surrounding spaces
+        etl::string_view rest()
+        {
+            skip_spaces();
+            auto result = m_view;
+            while(!result.empty() && is_space(result.back()))
+                result.remove_suffix(1);
+            m_view.remove_prefix(m_view.size());
+            return result;
+        }
+
+        template<typename T>
+        bool get(T& value)
+        {
+            auto saved = m_view;
+            auto token = word();
+            if(!token.empty() && convert(token, value)) return true;
+
+            m_view = saved;
+            return false;
+        }
+
+        static bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+
+    private:
+        void skip_spaces()
+        {
+            while(!m_view.empty() && is_space(m_view.front()))
+                m_view.remove_prefix(1);
+        }
+
+        template<typename T>
+        static bool convert(etl::string_view token, T& value)
+        {
+            auto result = ventctl::from_chars<T>(token.data(), token.data() + token.size(), value);
+            return result.ec == std::errc() && result.ptr == token.data() + token.size();
+        }
+
+        static bool convert(etl::string_view token, bool& value)
+        {
+            static const char* const names[][2] = {{"0", "1"}, {"false", "true"}, {"off", "on"}};
+
+            for(auto& name : names)
+            {
+                for(int i = 0; i < 2; ++i)
+                {
+                    if(equals(token, name[i]))
+                    {
+                        value = i;
+                        return true;
+                    }
+                }
+            }
+
+            return false;
+        }
+
+        static bool convert(etl::string_view token, etl::string_view& value)
+        {
+            value = token;
+            return true;
+        }
+
+        etl::string_view m_view;
+    };
+
+    // Commands are looked up by their first word in a table sorted by name
+    template<typename Context>
+    struct Command
+    {
+        const char* name;
+        void (*run)(Context&, Args&);
+        const char* usage;
+    };
+
+    constexpr int compare_names(const char* a, const char* b)
+    {
+        while(*a && *a == *b)
+        {
+            ++a;
+            ++b;
+        }
+        return (unsigned char)*a - (unsigned char)*b;
+    }
+
+    template<typename Context, size_t N>
+    constexpr bool is_sorted(const Command<Context> (&table)[N])
+    {
+        for(size_t i = 1; i < N; ++i)
+        {
+            if(compare_names(table[i - 1].name, table[i].name) >= 0)
+                return false;
+        }
+        return true;
+    }
+
+    template<typename Context, size_t N>
+    const Command<Context>* find_command(const Command<Context> (&table)[N], etl::string_view name)
+    {
+        size_t low = 0, high = N;
+        while(low < high)
+        {
+            auto mid = (low + high) / 2;
+            auto entry = table[mid].name;
+            auto length = std::strlen(entry);
+
+            int cmp = std::strncmp(entry, name.data(), std::min(length, name.size()));
+            if(cmp == 0) cmp = (int)length - (int)name.size();
+
+            if(cmp == 0) return &table[mid];
+            if(cmp < 0)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return nullptr;
+    }
+
+    // Calls run(etl::string_view) for every ';' separated, non-empty command of a line
+    template<typename F>
+    void split_commands(etl::string_view line, F&& run)
+    {
+        while(!line.empty())
+        {
+            auto end = line.find(';');
+            auto command = line.substr(0, end);
+
+            Args trimmed(command);
+            if(!trimmed.empty()) run(command);
+
+            if(end == etl::string_view::npos) break;
+            line.remove_prefix(end + 1);
+        }
+    }
+}
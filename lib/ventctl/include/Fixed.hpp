@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+
+namespace ventctl
+{
+    /*
+        Signed Q16.16 fixed point. Conversions from float round to nearest
+        and saturate; arithmetic wraps like int32_t except multiplication
+        and division, which go through 64 bits.
+    */
+    class Fixed
+    {
+    public:
+        static constexpr int FRACTION_BITS = 16;
+        static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+        constexpr Fixed() : m_raw(0) {}
+
+        constexpr explicit Fixed(float value) : m_raw(from_float(value)) {}
+
+        static constexpr Fixed from_raw(int32_t raw)
+        {
+            Fixed f;
+            f.m_raw = raw;
+            return f;
+        }
+
+        static constexpr Fixed from_int(int32_t value)
+        {
+            return from_raw(value * ONE);
+        }
+
+        constexpr int32_t raw() const { return m_raw; }
+        constexpr float to_float() const { return (float)m_raw / ONE; }
+        constexpr explicit operator float() const { return to_float(); }
+        // Rounds toward negative infinity
+        constexpr int32_t to_int() const { return m_raw >> FRACTION_BITS; }
+
+        constexpr Fixed operator+(Fixed other) const { return from_raw(m_raw + other.m_raw); }
+        constexpr Fixed operator-(Fixed other) const { return from_raw(m_raw - other.m_raw); }
+        constexpr Fixed operator-() const { return from_raw(-m_raw); }
+
+        constexpr Fixed operator*(Fixed other) const
+        {
+            return from_raw((int32_t)(((int64_t)m_raw * other.m_raw + (ONE / 2)) >> FRACTION_BITS));
+        }
+
+        constexpr Fixed operator/(Fixed other) const
+        {
+            return from_raw((int32_t)(((int64_t)m_raw << FRACTION_BITS) / other.m_raw));
+        }
+
+        constexpr bool operator==(Fixed other) const { return m_raw == other.m_raw; }
+        constexpr bool operator!=(Fixed other) const { return m_raw != other.m_raw; }
+        constexpr bool operator<(Fixed other) const { return m_raw < other.m_raw; }
+
+    private:
+        static constexpr int32_t from_float(float value)
+        {
+            auto scaled = value * ONE;
+            if(scaled != scaled) return 0;
+            if(scaled >= 2147483647.0f) return INT32_MAX;
+            if(scaled <= -2147483648.0f) return INT32_MIN;
+            return (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+        }
+
+        int32_t m_raw;
+    };
+}
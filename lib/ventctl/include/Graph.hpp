@@ -0,0 +1,487 @@
+#pragma once
+#include <Unit.hpp>
+#include <PID.hpp>
+#include <Saturation.hpp>
+#include <Aperiodic.hpp>
+#include <IntFilter.hpp>
+#include <ModulatedSink.hpp>
+#include <crc32.hpp>
+#include <etl/vector.h>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#ifndef VC_GRAPH_POOL_SIZE
+    #define VC_GRAPH_POOL_SIZE 4096
+#endif
+
+#ifndef VC_GRAPH_MAX_NODES
+    #define VC_GRAPH_MAX_NODES 64
+#endif
+
+#ifndef VC_GRAPH_MAX_SINKS
+    #define VC_GRAPH_MAX_SINKS 8
+#endif
+
+#ifndef VC_GRAPH_MAX_SIZE
+    #define VC_GRAPH_MAX_SIZE 2048
+#endif
+
+namespace ventctl
+{
+    /*
+        Binary control graph description, little endian:
+
+        header: u32 magic, u16 version, u16 node count, u32 total size, u32 crc32 of the node section
+        node:   u8 type, u8 input count, u8 param count, u8 name length,
+                u16 inputs[input count], f32 params[param count], char name[name length]
+
+        Inputs refer to earlier nodes only, so nodes are instantiated in order.
+        The name is a peripheral name for sources/sinks, or a comma separated
+        list of peripherals for stage sinks.
+    */
+    constexpr const static uint32_t GRAPH_MAGIC = 0x52474356; // "VCGR"
+    constexpr const static uint16_t GRAPH_VERSION = 1;
+
+    enum class NodeType : uint8_t
+    {
+        SOURCE = 0,
+        SUM,
+        GAIN,
+        SATURATION,
+        PID,
+        APERIODIC,
+        INT_FILTER,
+        RELAY,
+        SINK,
+        STEPPED_SINK,
+        MODULATED_SINK,
+        COUNT
+    };
+
+    enum class GraphError
+    {
+        NONE,
+        TRUNCATED,
+        BAD_MAGIC,
+        BAD_VERSION,
+        BAD_CRC,
+        TOO_MANY_NODES,
+        BAD_NODE_TYPE,
+        BAD_ARITY,
+        BAD_INPUT,
+        UNKNOWN_PERIPHERAL,
+        WRONG_PERIPHERAL_TYPE,
+        OUT_OF_MEMORY
+    };
+
+    struct GraphHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t node_count;
+        uint32_t size;
+        uint32_t crc;
+    };
+
+    static_assert(sizeof(GraphHeader) == 16, "Graph header must be packed");
+
+    struct NodeView
+    {
+        NodeType type;
+        uint8_t input_count, param_count, name_length;
+        const uint8_t* inputs;
+        const uint8_t* params;
+        const char* name;
+
+        uint16_t input(size_t i) const
+        {
+            uint16_t v;
+            std::memcpy(&v, inputs + i * sizeof(v), sizeof(v));
+            return v;
+        }
+
+        float param(size_t i) const
+        {
+            float v;
+            std::memcpy(&v, params + i * sizeof(v), sizeof(v));
+            return v;
+        }
+    };
+
+    // Bump allocator over a static arena, nodes live until the next reset()
+    template<size_t Size>
+    class NodePool
+    {
+    public:
+        NodePool() : m_used(0) {}
+
+        template<typename T, typename ... Args>
+        T* create(Args&& ... args)
+        {
+            auto offset = (m_used + alignof(T) - 1) & ~(alignof(T) - 1);
+            if(offset + sizeof(T) > Size) return nullptr;
+            m_used = offset + sizeof(T);
+            return new(m_buffer + offset) T(std::forward<Args>(args)...);
+        }
+
+        void reset()
+        {
+            m_used = 0;
+        }
+
+        size_t used() const { return m_used; }
+        constexpr size_t capacity() const { return Size; }
+
+    private:
+        alignas(8) uint8_t m_buffer[Size];
+        size_t m_used;
+    };
+
+    class Graph
+    {
+    public:
+        using pid_type = PIDController<float, float>;
+        using stage_vec_type = etl::vector<PeriphRef<bool>, VC_MODULATED_MAX_STAGES>;
+
+        Graph() : m_loaded(false) {}
+
+        static GraphError parse(const uint8_t*& cursor, const uint8_t* end, NodeView& node)
+        {
+            if(end - cursor < 4) return GraphError::TRUNCATED;
+
+            node.type = static_cast<NodeType>(cursor[0]);
+            node.input_count = cursor[1];
+            node.param_count = cursor[2];
+            node.name_length = cursor[3];
+            cursor += 4;
+
+            size_t length = node.input_count * sizeof(uint16_t) + node.param_count * sizeof(float) + node.name_length;
+            if((size_t)(end - cursor) < length) return GraphError::TRUNCATED;
+
+            node.inputs = cursor;
+            node.params = node.inputs + node.input_count * sizeof(uint16_t);
+            node.name = reinterpret_cast<const char*>(node.params + node.param_count * sizeof(float));
+            cursor += length;
+
+            return GraphError::NONE;
+        }
+
+        static bool is_sink(NodeType t)
+        {
+            return t == NodeType::SINK || t == NodeType::STEPPED_SINK || t == NodeType::MODULATED_SINK;
+        }
+
+        static GraphError check_arity(const NodeView& n)
+        {
+            uint8_t inputs = 1, params = 0;
+            bool named = false;
+
+            switch(n.type)
+            {
+            case NodeType::SOURCE: inputs = 0; named = true; break;
+            case NodeType::SUM:
+                if(n.input_count < 1 || n.input_count > 4 || n.param_count != n.input_count) return GraphError::BAD_ARITY;
+                return GraphError::NONE;
+            case NodeType::GAIN: params = 1; break;
+            case NodeType::SATURATION: params = 2; break;
+            case NodeType::PID: params = 6; break;
+            case NodeType::APERIODIC: params = 2; break;
+            case NodeType::INT_FILTER: params = 1; break;
+            case NodeType::RELAY: params = 2; break;
+            case NodeType::SINK: named = true; break;
+            case NodeType::STEPPED_SINK: params = 1; named = true; break;
+            case NodeType::MODULATED_SINK: params = 4; named = true; break;
+            default: return GraphError::BAD_NODE_TYPE;
+            }
+
+            if(n.input_count != inputs || n.param_count != params || (named && n.name_length == 0))
+                return GraphError::BAD_ARITY;
+
+            return GraphError::NONE;
+        }
+
+        // Structural validation, doesn't touch peripherals
+        static GraphError validate(const uint8_t* data, size_t size)
+        {
+            GraphHeader hdr;
+            if(size < sizeof(hdr)) return GraphError::TRUNCATED;
+            std::memcpy(&hdr, data, sizeof(hdr));
+
+            if(hdr.magic != GRAPH_MAGIC) return GraphError::BAD_MAGIC;
+            if(hdr.version != GRAPH_VERSION) return GraphError::BAD_VERSION;
+            if(hdr.size > size || hdr.size < sizeof(hdr)) return GraphError::TRUNCATED;
+            if(hdr.node_count > VC_GRAPH_MAX_NODES) return GraphError::TOO_MANY_NODES;
+            if(crc32(data + sizeof(hdr), hdr.size - sizeof(hdr)) != hdr.crc) return GraphError::BAD_CRC;
+
+            const uint8_t* cursor = data + sizeof(hdr);
+            const uint8_t* end = data + hdr.size;
+            NodeType types[VC_GRAPH_MAX_NODES];
+
+            for(uint16_t i = 0; i < hdr.node_count; ++i)
+            {
+                NodeView n;
+                auto err = parse(cursor, end, n);
+                if(err != GraphError::NONE) return err;
+
+                err = check_arity(n);
+                if(err != GraphError::NONE) return err;
+
+                for(uint8_t j = 0; j < n.input_count; ++j)
+                {
+                    auto in = n.input(j);
+                    if(in >= i || is_sink(types[in])) return GraphError::BAD_INPUT;
+                }
+
+                types[i] = n.type;
+            }
+
+            return cursor == end ? GraphError::NONE : GraphError::TRUNCATED;
+        }
+
+        GraphError load(const uint8_t* data, size_t size)
+        {
+            m_loaded = false;
+            m_pool.reset();
+            m_nodes.clear();
+            m_sinks.clear();
+            m_modulated.clear();
+
+            auto err = validate(data, size);
+            if(err != GraphError::NONE) return err;
+
+            GraphHeader hdr;
+            std::memcpy(&hdr, data, sizeof(hdr));
+
+            const uint8_t* cursor = data + sizeof(hdr);
+            const uint8_t* end = data + hdr.size;
+
+            for(uint16_t i = 0; i < hdr.node_count; ++i)
+            {
+                NodeView n;
+                parse(cursor, end, n);
+
+                err = instantiate(n);
+                if(err != GraphError::NONE)
+                {
+                    m_nodes.clear();
+                    m_sinks.clear();
+                    m_modulated.clear();
+                    return err;
+                }
+            }
+
+            m_loaded = true;
+            return GraphError::NONE;
+        }
+
+        void update(float time)
+        {
+            VC_TRACE_ZONE("Graph::update");
+            for(auto sink : m_sinks)
+                sink->update(time);
+        }
+
+        // Called from the modulation timer
+        void tick(float time)
+        {
+            for(auto sink : m_modulated)
+                sink->tick(time);
+        }
+
+        bool loaded() const { return m_loaded; }
+        size_t node_count() const { return m_nodes.size(); }
+        size_t pool_used() const { return m_pool.used(); }
+
+    private:
+        UnitBase& input(const NodeView& n, size_t i)
+        {
+            return *m_nodes[n.input(i)];
+        }
+
+        template<typename T>
+        Peripheral<T>* peripheral(const char* name, size_t length, GraphError& err)
+        {
+            auto p = PeripheralBase::find(name, length);
+            if(!p)
+            {
+                err = GraphError::UNKNOWN_PERIPHERAL;
+                return nullptr;
+            }
+            if(!p->accepts_type<T>())
+            {
+                err = GraphError::WRONG_PERIPHERAL_TYPE;
+                return nullptr;
+            }
+            return static_cast<Peripheral<T>*>(p);
+        }
+
+        stage_vec_type* stages(const NodeView& n, GraphError& err)
+        {
+            auto vec = m_pool.create<stage_vec_type>();
+            if(!vec)
+            {
+                err = GraphError::OUT_OF_MEMORY;
+                return nullptr;
+            }
+
+            const char* begin = n.name;
+            const char* end = n.name + n.name_length;
+            while(begin < end)
+            {
+                auto comma = static_cast<const char*>(std::memchr(begin, ',', end - begin));
+                if(!comma) comma = end;
+
+                auto p = peripheral<bool>(begin, comma - begin, err);
+                if(!p) return nullptr;
+                if(vec->full())
+                {
+                    err = GraphError::BAD_ARITY;
+                    return nullptr;
+                }
+                vec->push_back(*p);
+
+                begin = comma + 1;
+            }
+
+            return vec;
+        }
+
+        GraphError instantiate(const NodeView& n)
+        {
+            GraphError err = GraphError::OUT_OF_MEMORY;
+            UnitBase* unit = nullptr;
+            SinkBase* sink = nullptr;
+            ModulatedOutputSink* modulated = nullptr;
+
+            switch(n.type)
+            {
+            case NodeType::SOURCE:
+            {
+                auto p = peripheral<float>(n.name, n.name_length, err);
+                if(p) unit = m_pool.create<Source>(*p);
+                break;
+            }
+            case NodeType::SUM:
+            {
+                Sum::input_vec_type inputs;
+                for(uint8_t i = 0; i < n.input_count; ++i)
+                    inputs.push_back({input(n, i), n.param(i) < 0});
+                unit = m_pool.create<Sum>(inputs);
+                break;
+            }
+            case NodeType::GAIN:
+                unit = m_pool.create<Gain>(n.param(0), input(n, 0));
+                break;
+            case NodeType::SATURATION:
+            {
+                auto sat = m_pool.create<Saturation>(n.param(0), n.param(1));
+                if(sat) unit = m_pool.create<Unit<Saturation>>(*sat, input(n, 0));
+                break;
+            }
+            case NodeType::PID:
+            {
+                auto pid = m_pool.create<pid_type>(n.param(0), n.param(1), n.param(2), n.param(3), n.param(4), n.param(5));
+                if(pid) unit = m_pool.create<Unit<pid_type>>(*pid, input(n, 0));
+                break;
+            }
+            case NodeType::APERIODIC:
+                unit = m_pool.create<Aperiodic>(input(n, 0), n.param(0), n.param(1));
+                break;
+            case NodeType::INT_FILTER:
+                unit = m_pool.create<IntFilter>(input(n, 0), n.param(0));
+                break;
+            case NodeType::RELAY:
+                unit = m_pool.create<Relay<float>>(n.param(0), n.param(1), input(n, 0));
+                break;
+            case NodeType::SINK:
+            {
+                auto p = peripheral<float>(n.name, n.name_length, err);
+                if(p) sink = m_pool.create<Sink>(input(n, 0), *p);
+                break;
+            }
+            case NodeType::STEPPED_SINK:
+            {
+                auto vec = stages(n, err);
+                if(vec) sink = m_pool.create<SteppedOutputSink>(input(n, 0), *vec, n.param(0) != 0);
+                break;
+            }
+            case NodeType::MODULATED_SINK:
+            {
+                auto vec = stages(n, err);
+                auto mode = n.param(0) != 0 ? ModulatedOutputSink::Mode::SIGMA_DELTA : ModulatedOutputSink::Mode::TIME_PROPORTIONAL;
+                if(vec) sink = modulated = m_pool.create<ModulatedOutputSink>(input(n, 0), *vec, mode, n.param(1), n.param(2), n.param(3));
+                break;
+            }
+            default:
+                return GraphError::BAD_NODE_TYPE;
+            }
+
+            if(!unit && !sink) return err;
+
+            if(sink)
+            {
+                if(m_sinks.full()) return GraphError::TOO_MANY_NODES;
+                m_sinks.push_back(sink);
+            }
+
+            if(modulated)
+            {
+                if(m_modulated.full()) return GraphError::TOO_MANY_NODES;
+                m_modulated.push_back(modulated);
+            }
+
+            // Sinks keep a null slot, validate() guarantees they are never used as inputs
+            m_nodes.push_back(unit);
+            return GraphError::NONE;
+        }
+
+        NodePool<VC_GRAPH_POOL_SIZE> m_pool;
+        etl::vector<UnitBase*, VC_GRAPH_MAX_NODES> m_nodes;
+        etl::vector<SinkBase*, VC_GRAPH_MAX_SINKS> m_sinks;
+        etl::vector<ModulatedOutputSink*, VC_GRAPH_MAX_SINKS> m_modulated;
+        bool m_loaded;
+    };
+
+    // Collects a graph blob in chunks (terminal or MQTT) and validates it before it is stored
+    class GraphUploader
+    {
+    public:
+        GraphUploader() : m_size(0), m_active(false) {}
+
+        void begin()
+        {
+            m_size = 0;
+            m_active = true;
+        }
+
+        bool append(const uint8_t* data, size_t length)
+        {
+            if(!m_active || m_size + length > sizeof(m_buffer))
+            {
+                m_active = false;
+                return false;
+            }
+
+            std::memcpy(m_buffer + m_size, data, length);
+            m_size += length;
+            return true;
+        }
+
+        GraphError finish()
+        {
+            m_active = false;
+            return Graph::validate(m_buffer, m_size);
+        }
+
+        bool active() const { return m_active; }
+        const uint8_t* data() const { return m_buffer; }
+        size_t size() const { return m_size; }
+
+    private:
+        alignas(4) uint8_t m_buffer[VC_GRAPH_MAX_SIZE];
+        size_t m_size;
+        bool m_active;
+    };
+}
@@ -6,11 +6,29 @@ namespace ventctl
     class IntFilter : public UnitBase
     {
     public:
+        struct State
+        {
+            float last;
+        };
+
         IntFilter(UnitBase& input, float k) : 
         m_input(input), 
         m_k(k),
         m_last(0)
-        {}
+        {
+            dependsOn(input);
+            setTimeDependent();
+        }
+
+        State getState() const
+        {
+            return State{m_last};
+        }
+
+        void setState(const State& state)
+        {
+            m_last = state.last;
+        }
 
         virtual float getValueUncached(float time)
         {
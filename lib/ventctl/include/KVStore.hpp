@@ -0,0 +1,457 @@
+#pragma once
+#include <crc32.hpp>
+#include <etl/vector.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifndef VC_KV_MAX_KEYS
+    #define VC_KV_MAX_KEYS 32
+#endif
+
+#ifndef VC_KV_MAX_VALUE
+    #define VC_KV_MAX_VALUE 4096
+#endif
+
+namespace ventctl
+{
+    /*
+        Log structured key/value store over two flash sectors.
+
+        sector: header {u32 magic, u32 sequence, u32 ~sequence, u32 reserved}, records...
+        record: {u16 key, u16 length, u32 crc32 of key, length and value}, value, padding
+
+        Records are appended to the active sector, the newest record for a
+        key wins and an empty value deletes the key. The record header is
+        programmed before the value, so a record torn by a power cut fails
+        its CRC and is skipped. When the active sector is full, live records
+        are copied to the spare one and its header is written last; the
+        sector with the highest valid sequence is active at boot.
+
+        Erasing a sector stalls the CPU on single bank parts, so it is never
+        done while saving. maintain() erases the old sector and compacts
+        ahead of time, call it from the main loop when a stall is acceptable.
+
+        TFlash follows the mbed::FlashIAP interface.
+    */
+    template<typename TFlash>
+    class KVStore
+    {
+    public:
+        constexpr const static uint32_t MAGIC = 0x3153564B; // "KVS1"
+        constexpr const static uint16_t ERASED_KEY = 0xFFFF;
+
+        struct Entry
+        {
+            uint16_t key;
+            uint16_t length;
+            uint32_t address;
+        };
+
+        KVStore(TFlash& flash, uint32_t sector_a, uint32_t sector_b, uint32_t sector_size) :
+            m_flash(flash),
+            m_sectors{sector_a, sector_b},
+            m_sector_size(sector_size),
+            m_active(0),
+            m_sequence(0),
+            m_write(0),
+            m_align(8),
+            m_spare(SpareState::UNKNOWN),
+            m_ready(false)
+            {}
+
+        // Picks the active sector and builds the index, formats the store if neither sector is valid
+        bool init()
+        {
+            m_ready = false;
+            m_index.clear();
+
+            auto page = m_flash.get_page_size();
+            if(page == 0 || page > sizeof(RecordHeader) || (page & (page - 1))) return false;
+            m_align = sizeof(RecordHeader);
+
+            uint32_t seq[2];
+            bool valid[2] = {read_sector_header(0, seq[0]), read_sector_header(1, seq[1])};
+
+            if(!valid[0] && !valid[1])
+                return format();
+
+            m_active = (valid[0] && (!valid[1] || seq[0] > seq[1])) ? 0 : 1;
+            m_sequence = seq[m_active];
+            m_spare = SpareState::UNKNOWN;
+
+            if(!scan()) return false;
+
+            m_ready = true;
+            return true;
+        }
+
+        bool format()
+        {
+            m_ready = false;
+            m_index.clear();
+
+            if(m_flash.erase(m_sectors[0], m_sector_size)) return false;
+            if(m_flash.erase(m_sectors[1], m_sector_size)) return false;
+
+            m_active = 0;
+            m_sequence = 1;
+            m_write = sizeof(SectorHeader);
+            m_spare = SpareState::ERASED;
+
+            if(!write_sector_header(m_active, m_sequence)) return false;
+
+            m_ready = true;
+            return true;
+        }
+
+        // Copies at most size bytes of the value, the stored length is returned in length
+        bool get(uint16_t key, void* data, size_t size, size_t* length = nullptr)
+        {
+            auto entry = find(key);
+            if(!entry) return false;
+
+            if(length) *length = entry->length;
+            auto n = size < entry->length ? size : entry->length;
+            return m_flash.read(data, entry->address, n) == 0;
+        }
+
+        // Absolute flash address of the value, valid until the next write
+        bool locate(uint16_t key, uint32_t& address, size_t& length)
+        {
+            auto entry = find(key);
+            if(!entry) return false;
+
+            address = entry->address;
+            length = entry->length;
+            return true;
+        }
+
+        bool contains(uint16_t key)
+        {
+            return find(key) != nullptr;
+        }
+
+        bool set(uint16_t key, const void* data, size_t size)
+        {
+            if(!m_ready || key == ERASED_KEY || size > VC_KV_MAX_VALUE || size > 0xFFFF) return false;
+
+            auto entry = find(key);
+            if(entry && equals(*entry, data, size)) return true;
+            if(!entry && size == 0) return true;
+            if(!entry && m_index.full()) return false;
+
+            if(m_write + record_size(size) > m_sector_size)
+            {
+                if(!compact()) return false;
+                if(m_write + record_size(size) > m_sector_size) return false;
+            }
+
+            auto address = base() + m_write;
+            if(!write_record(address, key, data, size))
+            {
+                // Whatever was programmed is garbage now, never write over it
+                m_write = m_sector_size;
+                return false;
+            }
+
+            m_write += record_size(size);
+            update_index(key, size, address + sizeof(RecordHeader));
+            return true;
+        }
+
+        bool remove(uint16_t key)
+        {
+            return set(key, nullptr, 0);
+        }
+
+        // Moves live records to the spare sector, erases it first if maintain() didn't
+        bool compact()
+        {
+            if(!m_ready) return false;
+
+            auto spare = 1 - m_active;
+            if(m_spare != SpareState::ERASED && m_flash.erase(m_sectors[spare], m_sector_size))
+                return false;
+
+            // From here on the spare holds a partial copy until it is erased again
+            m_spare = SpareState::DIRTY;
+
+            uint32_t write = sizeof(SectorHeader);
+            for(auto& entry : m_index)
+            {
+                auto from = entry.address - sizeof(RecordHeader);
+                auto to = m_sectors[spare] + write;
+                if(!copy(to, from, record_size(entry.length)))
+                {
+                    scan();
+                    return false;
+                }
+                entry.address = to + sizeof(RecordHeader);
+                write += record_size(entry.length);
+            }
+
+            if(!write_sector_header(spare, m_sequence + 1))
+            {
+                // The index points into a sector that won't be picked at boot, rebuild it
+                scan();
+                return false;
+            }
+
+            m_active = spare;
+            m_sequence++;
+            m_write = write;
+            return true;
+        }
+
+        // Background work: erases the old sector and compacts when the active one is 3/4 full
+        void maintain()
+        {
+            if(!m_ready) return;
+
+            auto spare = 1 - m_active;
+            if(m_spare == SpareState::UNKNOWN)
+                m_spare = is_blank(m_sectors[spare], m_sector_size) ? SpareState::ERASED : SpareState::DIRTY;
+
+            if(m_spare == SpareState::DIRTY)
+            {
+                if(m_flash.erase(m_sectors[spare], m_sector_size) == 0)
+                    m_spare = SpareState::ERASED;
+                return;
+            }
+
+            if(m_write > m_sector_size / 4 * 3 && live_size() < m_sector_size / 2)
+                compact();
+        }
+
+        bool ready() const { return m_ready; }
+        size_t count() const { return m_index.size(); }
+        size_t used() const { return m_write; }
+        size_t capacity() const { return m_sector_size; }
+        uint32_t sequence() const { return m_sequence; }
+        const etl::ivector<Entry>& entries() const { return m_index; }
+
+        size_t live_size() const
+        {
+            size_t size = sizeof(SectorHeader);
+            for(auto& entry : m_index)
+                size += record_size(entry.length);
+            return size;
+        }
+
+    private:
+        enum class SpareState
+        {
+            UNKNOWN,
+            ERASED,
+            DIRTY
+        };
+
+        struct SectorHeader
+        {
+            uint32_t magic, sequence, check, reserved;
+        };
+
+        struct RecordHeader
+        {
+            uint16_t key, length;
+            uint32_t crc;
+        };
+
+        static_assert(sizeof(SectorHeader) == 16, "Sector header must be packed");
+        static_assert(sizeof(RecordHeader) == 8, "Record header must be packed");
+
+        uint32_t base() const
+        {
+            return m_sectors[m_active];
+        }
+
+        size_t record_size(size_t length) const
+        {
+            return sizeof(RecordHeader) + (length + m_align - 1) / m_align * m_align;
+        }
+
+        Entry* find(uint16_t key)
+        {
+            for(auto& entry : m_index)
+                if(entry.key == key) return &entry;
+            return nullptr;
+        }
+
+        void update_index(uint16_t key, size_t length, uint32_t address)
+        {
+            auto entry = find(key);
+
+            if(length == 0)
+            {
+                if(entry)
+                {
+                    *entry = m_index.back();
+                    m_index.pop_back();
+                }
+                return;
+            }
+
+            if(entry)
+            {
+                entry->length = length;
+                entry->address = address;
+            }
+            else if(!m_index.full())
+            {
+                m_index.push_back(Entry{key, (uint16_t)length, address});
+            }
+        }
+
+        bool read_sector_header(size_t sector, uint32_t& sequence)
+        {
+            SectorHeader hdr;
+            if(m_flash.read(&hdr, m_sectors[sector], sizeof(hdr))) return false;
+            if(hdr.magic != MAGIC || hdr.check != ~hdr.sequence) return false;
+            sequence = hdr.sequence;
+            return true;
+        }
+
+        bool write_sector_header(size_t sector, uint32_t sequence)
+        {
+            SectorHeader hdr{MAGIC, sequence, ~sequence, erased_word()};
+            return m_flash.program(&hdr, m_sectors[sector], sizeof(hdr)) == 0;
+        }
+
+        uint32_t erased_word()
+        {
+            return 0x01010101u * (uint8_t)m_flash.get_erase_value();
+        }
+
+        static uint32_t record_crc(const RecordHeader& hdr, const void* data)
+        {
+            auto crc = crc32(&hdr, offsetof(RecordHeader, crc));
+            return crc32(data, hdr.length, crc);
+        }
+
+        bool write_record(uint32_t address, uint16_t key, const void* data, size_t size)
+        {
+            RecordHeader hdr{key, (uint16_t)size, 0};
+            hdr.crc = record_crc(hdr, data);
+
+            if(m_flash.program(&hdr, address, sizeof(hdr))) return false;
+            address += sizeof(hdr);
+
+            auto aligned = size / m_align * m_align;
+            if(aligned && m_flash.program(data, address, aligned)) return false;
+
+            if(aligned < size)
+            {
+                uint8_t tail[sizeof(RecordHeader)];
+                std::memset(tail, (uint8_t)m_flash.get_erase_value(), sizeof(tail));
+                std::memcpy(tail, static_cast<const uint8_t*>(data) + aligned, size - aligned);
+                if(m_flash.program(tail, address + aligned, m_align)) return false;
+            }
+
+            return true;
+        }
+
+        // Rebuilds the index from the active sector and finds the append position
+        bool scan()
+        {
+            m_index.clear();
+            m_write = sizeof(SectorHeader);
+
+            while(m_write + sizeof(RecordHeader) <= m_sector_size)
+            {
+                RecordHeader hdr;
+                auto address = base() + m_write;
+                if(m_flash.read(&hdr, address, sizeof(hdr))) return false;
+
+                if(hdr.key == ERASED_KEY && hdr.length == 0xFFFF && hdr.crc == erased_word())
+                    return true;
+
+                // A torn header may carry any length, only skip records that are plausible
+                if(hdr.key == ERASED_KEY || hdr.length > VC_KV_MAX_VALUE || m_write + record_size(hdr.length) > m_sector_size)
+                {
+                    m_write = m_sector_size;
+                    return true;
+                }
+
+                if(check_record(hdr, address + sizeof(hdr)))
+                    update_index(hdr.key, hdr.length, address + sizeof(hdr));
+
+                m_write += record_size(hdr.length);
+            }
+
+            return true;
+        }
+
+        bool check_record(const RecordHeader& hdr, uint32_t address)
+        {
+            uint8_t chunk[64];
+            auto crc = crc32(&hdr, offsetof(RecordHeader, crc));
+
+            for(size_t offset = 0; offset < hdr.length; offset += sizeof(chunk))
+            {
+                auto n = hdr.length - offset < sizeof(chunk) ? hdr.length - offset : sizeof(chunk);
+                if(m_flash.read(chunk, address + offset, n)) return false;
+                crc = crc32(chunk, n, crc);
+            }
+
+            return crc == hdr.crc;
+        }
+
+        bool equals(const Entry& entry, const void* data, size_t size)
+        {
+            if(entry.length != size) return false;
+
+            uint8_t chunk[64];
+            auto bytes = static_cast<const uint8_t*>(data);
+
+            for(size_t offset = 0; offset < size; offset += sizeof(chunk))
+            {
+                auto n = size - offset < sizeof(chunk) ? size - offset : sizeof(chunk);
+                if(m_flash.read(chunk, entry.address + offset, n)) return false;
+                if(std::memcmp(chunk, bytes + offset, n)) return false;
+            }
+
+            return true;
+        }
+
+        bool copy(uint32_t to, uint32_t from, size_t size)
+        {
+            uint8_t chunk[64];
+
+            for(size_t offset = 0; offset < size; offset += sizeof(chunk))
+            {
+                auto n = size - offset < sizeof(chunk) ? size - offset : sizeof(chunk);
+                if(m_flash.read(chunk, from + offset, n)) return false;
+                if(m_flash.program(chunk, to + offset, n)) return false;
+            }
+
+            return true;
+        }
+
+        bool is_blank(uint32_t address, size_t size)
+        {
+            uint32_t chunk[16];
+            auto erased = erased_word();
+
+            for(size_t offset = 0; offset < size; offset += sizeof(chunk))
+            {
+                if(m_flash.read(chunk, address + offset, sizeof(chunk))) return false;
+                for(auto word : chunk)
+                    if(word != erased) return false;
+            }
+
+            return true;
+        }
+
+        TFlash& m_flash;
+        uint32_t m_sectors[2];
+        uint32_t m_sector_size;
+        size_t m_active;
+        uint32_t m_sequence;
+        uint32_t m_write;
+        uint32_t m_align;
+        SpareState m_spare;
+        bool m_ready;
+        etl::vector<Entry, VC_KV_MAX_KEYS> m_index;
+    };
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+
+namespace ventctl
+{
+    /*
+        Minimal terminal line editor: echo, backspace, Ctrl-U (kill line),
+        Ctrl-C (cancel) and Up arrow (recall the previous line). CR, LF and
+        CRLF all end a line. Input past the capacity is discarded and the
+        line is reported as TOO_LONG instead of being executed truncated.
+    */
+    template<size_t N>
+    class LineEditor
+    {
+    public:
+        enum class Result
+        {
+            NONE,
+            LINE,
+            TOO_LONG,
+            CANCEL
+        };
+
+        LineEditor() :
+            m_line{0},
+            m_history{0},
+            m_size(0),
+            m_overflow(false),
+            m_last_cr(false),
+            m_escape(0)
+            {}
+
+        // echo(const char* data, size_t size) receives the characters to send back
+        template<typename F>
+        Result feed(char ch, F&& echo)
+        {
+            auto last_cr = m_last_cr;
+            m_last_cr = ch == '\r';
+
+            if(m_escape)
+                return feed_escape(ch, echo);
+
+            switch(ch)
+            {
+            case '\n':
+                if(last_cr) return Result::NONE;
+                // fallthrough
+            case '\r':
+                echo("\r\n", 2);
+                return finish();
+            case '\b':
+            case 0x7F:
+                if(m_size)
+                {
+                    m_size--;
+                    echo("\b \b", 3);
+                }
+                return Result::NONE;
+            case 0x15: // Ctrl-U
+                erase(echo);
+                m_overflow = false;
+                return Result::NONE;
+            case 0x03: // Ctrl-C
+                echo("^C\r\n", 4);
+                clear();
+                return Result::CANCEL;
+            case 0x1B:
+                m_escape = 1;
+                return Result::NONE;
+            default:
+                break;
+            }
+
+            if(ch < 0x20 || ch > 0x7E) return Result::NONE;
+
+            if(m_size + 1 >= N)
+            {
+                m_overflow = true;
+                return Result::NONE;
+            }
+
+            m_line[m_size++] = ch;
+            echo(&ch, 1);
+            return Result::NONE;
+        }
+
+        // The finished line, valid after LINE until the next feed()
+        const char* line() const { return m_line; }
+        // Length of the line being edited
+        size_t size() const { return m_size; }
+
+        void clear()
+        {
+            m_size = 0;
+            m_overflow = false;
+            m_line[0] = 0;
+        }
+
+    private:
+        Result finish()
+        {
+            m_line[m_size] = 0;
+            auto overflow = m_overflow;
+            auto size = m_size;
+
+            m_size = 0;
+            m_overflow = false;
+
+            if(overflow) return Result::TOO_LONG;
+            if(size == 0) return Result::NONE;
+
+            std::memcpy(m_history, m_line, size + 1);
+            return Result::LINE;
+        }
+
+        template<typename F>
+        void erase(F& echo)
+        {
+            while(m_size)
+            {
+                m_size--;
+                echo("\b \b", 3);
+            }
+        }
+
+        // ESC [ <final>, only Up is handled
+        template<typename F>
+        Result feed_escape(char ch, F& echo)
+        {
+            if(m_escape == 1)
+            {
+                m_escape = ch == '[' ? 2 : 0;
+                return Result::NONE;
+            }
+
+            // Parameter bytes of longer sequences
+            if(ch >= 0x30 && ch <= 0x3F) return Result::NONE;
+
+            m_escape = 0;
+            if(ch == 'A' && m_history[0])
+            {
+                erase(echo);
+                m_overflow = false;
+                m_size = std::strlen(m_history);
+                std::memcpy(m_line, m_history, m_size);
+                echo(m_line, m_size);
+            }
+
+            return Result::NONE;
+        }
+
+        char m_line[N];
+        char m_history[N];
+        size_t m_size;
+        bool m_overflow;
+        bool m_last_cr;
+        uint8_t m_escape;
+    };
+}
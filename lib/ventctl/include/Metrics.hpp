@@ -0,0 +1,273 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <charconv.hpp>
+
+#ifndef VC_METRICS_CAP
+    #define VC_METRICS_CAP 32
+#endif
+
+#ifndef VC_METRICS_SLOTS
+    #define VC_METRICS_SLOTS 512
+#endif
+
+// Log-linear histogram: 4 buckets per power of two, 80 buckets cover 0..2^21
+#ifndef VC_METRICS_HIST_BUCKETS
+    #define VC_METRICS_HIST_BUCKETS 80
+#endif
+
+namespace ventctl
+{
+    /*
+        Statically registered metrics. Every value lives in one flat array of
+        32 bit atomics, metrics only keep their slot index, so an update is a
+        single relaxed atomic operation (LDREX/STREX on Cortex-M) and is safe
+        from interrupts.
+
+        Metrics are meant to be globals with string literal names; when the
+        registry or the slot array is full, the metric still works but writes
+        to a shared scratch slot and is not listed.
+    */
+    class Metrics
+    {
+    public:
+        enum class Kind : uint8_t
+        {
+            COUNTER,
+            GAUGE,
+            HISTOGRAM
+        };
+
+        struct Descriptor
+        {
+            const char* name;
+            Kind kind;
+            uint16_t slot;
+            uint16_t size;
+        };
+
+        using slot_type = std::atomic<uint32_t>;
+
+        static slot_type* allocate(const char* name, Kind kind, uint16_t size)
+        {
+            if(s_count >= VC_METRICS_CAP || s_used + size > VC_METRICS_SLOTS)
+                return s_scratch;
+
+            s_metrics[s_count++] = Descriptor{name, kind, s_used, size};
+            auto slots = &s_slots[s_used];
+            s_used += size;
+            return slots;
+        }
+
+        static size_t count() { return s_count; }
+        static const Descriptor& descriptor(size_t i) { return s_metrics[i]; }
+        static uint32_t slot(size_t i) { return s_slots[i].load(std::memory_order_relaxed); }
+
+        static float as_float(uint32_t bits)
+        {
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        static uint32_t bucket(uint32_t value)
+        {
+            if(value < 4) return value;
+
+            uint32_t e = 31 - __builtin_clz(value);
+            uint32_t b = 4 * (e - 1) + ((value >> (e - 2)) & 3);
+            return b < VC_METRICS_HIST_BUCKETS ? b : VC_METRICS_HIST_BUCKETS - 1;
+        }
+
+        // Smallest value that falls into the bucket
+        static uint32_t bucket_floor(uint32_t b)
+        {
+            if(b < 4) return b;
+            uint32_t e = b / 4 + 1;
+            return (4 + b % 4) << (e - 2);
+        }
+
+        // Approximate quantile (0..1) of a histogram as the lower edge of its bucket
+        static uint32_t quantile(const Descriptor& d, float q)
+        {
+            auto total = slot(d.slot);
+            if(total == 0) return 0;
+
+            uint64_t rank = (uint64_t)(q * (total - 1)) + 1, seen = 0;
+            for(uint32_t b = 0; b < VC_METRICS_HIST_BUCKETS; ++b)
+            {
+                seen += slot(d.slot + 3 + b);
+                if(seen >= rank) return bucket_floor(b);
+            }
+            return bucket_floor(VC_METRICS_HIST_BUCKETS - 1);
+        }
+
+        // Sum of a histogram's values, read again when the high word moved meanwhile
+        static uint64_t sum(const Descriptor& d)
+        {
+            uint32_t high, low;
+            do
+            {
+                high = slot(d.slot + 2);
+                low = slot(d.slot + 1);
+            }
+            while(high != slot(d.slot + 2));
+            return (uint64_t)high << 32 | low;
+        }
+
+        // One line per metric
+        template<typename F>
+        static void print(F&& write)
+        {
+            char line[96];
+            for(size_t i = 0; i < s_count; ++i)
+            {
+                format(s_metrics[i], line, sizeof(line), false);
+                write(line);
+            }
+        }
+
+        // Compact "name=value;..." form for a single MQTT PUBLISH, returns the length
+        static size_t serialize(char* buffer, size_t size)
+        {
+            size_t length = 0;
+            for(size_t i = 0; i < s_count; ++i)
+            {
+                char item[64];
+                auto n = format(s_metrics[i], item, sizeof(item), true);
+                if(length + n >= size) break;
+                std::memcpy(buffer + length, item, n);
+                length += n;
+                buffer[length++] = ';';
+            }
+            if(length) length--;
+            buffer[length] = 0;
+            return length;
+        }
+
+    private:
+        static size_t format(const Descriptor& d, char* out, size_t size, bool compact)
+        {
+            // Floats go through to_chars, printf only assembles the line
+            char number[24];
+            auto fixed = [&](float value, int precision)
+            {
+                *to_chars(number, number + sizeof(number) - 1, value, precision).ptr = 0;
+                return number;
+            };
+
+            int n = 0;
+            switch(d.kind)
+            {
+            case Kind::COUNTER:
+                n = snprintf(out, size, compact ? "%s=%lu" : "%-24s %lu\n", d.name, (unsigned long)slot(d.slot));
+                break;
+            case Kind::GAUGE:
+                n = snprintf(out, size, compact ? "%s=%s" : "%-24s %s\n", d.name, fixed(as_float(slot(d.slot)), 3));
+                break;
+            case Kind::HISTOGRAM:
+            {
+                auto count = slot(d.slot);
+                auto p50 = (unsigned long)quantile(d, 0.5), p99 = (unsigned long)quantile(d, 0.99);
+                if(compact)
+                    n = snprintf(out, size, "%s=%lu/%lu/%lu/%lu", d.name, (unsigned long)count,
+                        (unsigned long)(count ? sum(d) / count : 0), p50, p99);
+                else
+                    n = snprintf(out, size, "%-24s n=%lu mean=%s p50=%lu p99=%lu\n", d.name, (unsigned long)count,
+                        fixed(count ? (float)sum(d) / count : 0.0f, 1), p50, p99);
+                break;
+            }
+            }
+            if(n < 0) return 0;
+            return (size_t)n < size ? n : size - 1;
+        }
+
+        inline static Descriptor s_metrics[VC_METRICS_CAP];
+        inline static slot_type s_slots[VC_METRICS_SLOTS];
+        inline static slot_type s_scratch[VC_METRICS_HIST_BUCKETS + 3];
+        inline static size_t s_count = 0;
+        inline static uint16_t s_used = 0;
+    };
+
+    class Counter
+    {
+    public:
+        explicit Counter(const char* name) :
+            m_slot(Metrics::allocate(name, Metrics::Kind::COUNTER, 1))
+            {}
+
+        void increment(uint32_t n = 1)
+        {
+            m_slot->fetch_add(n, std::memory_order_relaxed);
+        }
+
+        Counter& operator++()
+        {
+            increment();
+            return *this;
+        }
+
+        uint32_t value() const
+        {
+            return m_slot->load(std::memory_order_relaxed);
+        }
+
+    private:
+        Metrics::slot_type* m_slot;
+    };
+
+    class Gauge
+    {
+    public:
+        explicit Gauge(const char* name) :
+            m_slot(Metrics::allocate(name, Metrics::Kind::GAUGE, 1))
+            {}
+
+        void set(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            m_slot->store(bits, std::memory_order_relaxed);
+        }
+
+        float value() const
+        {
+            return Metrics::as_float(m_slot->load(std::memory_order_relaxed));
+        }
+
+    private:
+        Metrics::slot_type* m_slot;
+    };
+
+    /*
+        Slots: count, sum low and high word, buckets. The sum is 64 bit so
+        the mean survives more than 2^32 us of recorded loop time; a carry
+        out of the low word is added to the high one.
+    */
+    class Histogram
+    {
+    public:
+        explicit Histogram(const char* name) :
+            m_slots(Metrics::allocate(name, Metrics::Kind::HISTOGRAM, VC_METRICS_HIST_BUCKETS + 3))
+            {}
+
+        void record(uint32_t value)
+        {
+            m_slots[0].fetch_add(1, std::memory_order_relaxed);
+            auto low = m_slots[1].fetch_add(value, std::memory_order_relaxed);
+            if(low + value < low) m_slots[2].fetch_add(1, std::memory_order_relaxed);
+            m_slots[3 + Metrics::bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        uint32_t count() const
+        {
+            return m_slots[0].load(std::memory_order_relaxed);
+        }
+
+    private:
+        Metrics::slot_type* m_slots;
+    };
+}
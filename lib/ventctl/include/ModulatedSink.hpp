@@ -0,0 +1,243 @@
+#pragma once
+#include <Unit.hpp>
+#include <cstdint>
+
+#ifndef VC_MODULATED_MAX_STAGES
+    #define VC_MODULATED_MAX_STAGES 8
+#endif
+
+namespace ventctl
+{
+    /*
+        Drives a bank of on/off stages (heater relays) with continuous power
+        resolution. update() samples the demand from the graph, tick() is
+        called at a fixed rate from a timer and switches the stages.
+
+        TIME_PROPORTIONAL: every period, floor(N * demand) stages are on for
+        the whole period and one more for the fractional remainder.
+        SIGMA_DELTA: every period the number of active stages is chosen by a
+        first order sigma-delta modulator.
+
+        In both modes every stage respects minimum on/off times, the energy
+        lost to these constraints is carried over to the next periods, and
+        the stage to switch is chosen by accumulated on-time so relay wear is
+        spread evenly.
+    */
+    class ModulatedOutputSink : public SinkBase
+    {
+    public:
+        enum class Mode
+        {
+            TIME_PROPORTIONAL,
+            SIGMA_DELTA
+        };
+
+        ModulatedOutputSink(UnitBase& source, etl::ivector<PeriphRef<bool>>& peripherals, Mode mode, float period, float min_on = 0, float min_off = 0) :
+            ModulatedOutputSink(source, &peripherals, nullptr, mode, period, min_on, min_off)
+            {}
+
+        // Stages switched in the same tick are written to the bank together
+        ModulatedOutputSink(UnitBase& source, StageBank& bank, Mode mode, float period, float min_on = 0, float min_off = 0) :
+            ModulatedOutputSink(source, nullptr, &bank, mode, period, min_on, min_off)
+            {}
+
+        virtual void update(float time)
+        {
+            auto value = m_source.getValue(time);
+            if(value < 0) value = 0;
+            if(value > 1) value = 1;
+            m_demand = value;
+        }
+
+        void tick(float time)
+        {
+            auto n = stageCount();
+            if(n == 0) return;
+
+            if(m_last_tick < 0) m_last_tick = time;
+            auto dt = time - m_last_tick;
+            m_last_tick = time;
+
+            auto demand = m_demand * n;
+            auto active = 0;
+
+            for(size_t i = 0; i < n; ++i)
+            {
+                if(m_stages[i].on)
+                {
+                    m_stages[i].on_time += dt;
+                    active++;
+                }
+            }
+
+            float limit = n * m_period;
+            m_error += (demand - active) * dt;
+            if(m_error > limit) m_error = limit;
+            if(m_error < -limit) m_error = -limit;
+
+            if(m_period_start < 0 || time - m_period_start >= m_period)
+            {
+                m_period_start = time;
+                startPeriod(demand);
+            }
+
+            uint8_t target = m_target;
+
+            if(m_mode == Mode::TIME_PROPORTIONAL)
+            {
+                target = m_full;
+                if(time - m_period_start < m_on_time) target++;
+            }
+
+            applyCount(target, time);
+            commit();
+        }
+
+        float demand() const { return m_demand; }
+        uint32_t switchCount() const { return m_switches; }
+        uint32_t switchCount(size_t stage) const { return m_stages[stage].switches; }
+        float onTime(size_t stage) const { return m_stages[stage].on_time; }
+
+    private:
+        struct Stage
+        {
+            bool on;
+            float changed, on_time;
+            uint32_t switches;
+        };
+
+        ModulatedOutputSink(UnitBase& source, etl::ivector<PeriphRef<bool>>* peripherals, StageBank* bank, Mode mode, float period, float min_on, float min_off) :
+            m_source(source),
+            m_refs(peripherals),
+            m_bank(bank ? *bank : m_refs),
+            m_mode(mode),
+            m_period(period),
+            m_min_on(min_on),
+            m_min_off(min_off),
+            m_demand(0),
+            m_error(0),
+            m_period_start(-1),
+            m_last_tick(-1),
+            m_on_time(0),
+            m_full(0),
+            m_target(0),
+            m_switches(0),
+            m_changed(0),
+            m_pattern(0)
+            {
+                for(auto& stage : m_stages)
+                    stage = Stage{false, -INFINITY, 0, 0};
+            }
+
+        size_t stageCount() const
+        {
+            auto n = m_bank.stages();
+            return n < VC_MODULATED_MAX_STAGES ? n : VC_MODULATED_MAX_STAGES;
+        }
+
+        void startPeriod(float demand)
+        {
+            auto n = stageCount();
+
+            if(m_mode == Mode::SIGMA_DELTA)
+            {
+                float k = std::round(demand + m_error / m_period);
+                if(k < 0) k = 0;
+                if(k > n) k = n;
+                m_target = k;
+                return;
+            }
+
+            float limit = n * m_period;
+            auto energy = demand * m_period + m_error;
+            if(energy < 0) energy = 0;
+            if(energy > limit) energy = limit;
+
+            m_full = std::floor(energy / m_period);
+            m_on_time = energy - m_full * m_period;
+
+            if(m_full >= n)
+            {
+                m_full = n;
+                m_on_time = 0;
+            }
+            else if(m_on_time < m_min_on)
+            {
+                m_on_time = 0;
+            }
+            else if(m_period - m_on_time < m_min_off)
+            {
+                m_on_time = m_period;
+            }
+        }
+
+        void applyCount(uint8_t target, float time)
+        {
+            auto n = stageCount();
+            uint8_t active = 0;
+            for(size_t i = 0; i < n; ++i)
+                if(m_stages[i].on) active++;
+
+            while(active < target)
+            {
+                int best = -1;
+                for(size_t i = 0; i < n; ++i)
+                {
+                    auto& s = m_stages[i];
+                    if(s.on || time - s.changed < m_min_off) continue;
+                    if(best < 0 || s.on_time < m_stages[best].on_time) best = i;
+                }
+                if(best < 0) break;
+                set(best, true, time);
+                active++;
+            }
+
+            while(active > target)
+            {
+                int best = -1;
+                for(size_t i = 0; i < n; ++i)
+                {
+                    auto& s = m_stages[i];
+                    if(!s.on || time - s.changed < m_min_on) continue;
+                    if(best < 0 || s.on_time > m_stages[best].on_time) best = i;
+                }
+                if(best < 0) break;
+                set(best, false, time);
+                active--;
+            }
+        }
+
+        void set(size_t i, bool on, float time)
+        {
+            auto& s = m_stages[i];
+            s.on = on;
+            s.changed = time;
+            s.switches++;
+            m_switches++;
+            m_changed |= 1u << i;
+            if(on)
+                m_pattern |= 1u << i;
+            else
+                m_pattern &= ~(1u << i);
+        }
+
+        void commit()
+        {
+            if(!m_changed) return;
+            m_bank.write_stages(m_changed, m_pattern);
+            m_changed = 0;
+        }
+
+        UnitBase& m_source;
+        PeripheralStages m_refs;
+        StageBank& m_bank;
+        Mode m_mode;
+        float m_period, m_min_on, m_min_off;
+        volatile float m_demand;
+        float m_error, m_period_start, m_last_tick, m_on_time;
+        uint8_t m_full, m_target;
+        uint32_t m_switches;
+        uint32_t m_changed, m_pattern;
+        Stage m_stages[VC_MODULATED_MAX_STAGES];
+    };
+}
@@ -1,15 +1,21 @@
+#pragma once
 #include <Unit.hpp>
 
 namespace ventctl
 {
-    template<typename TC = float, TKB = float>
-    class PIDController : public UnitBase
+    template<typename TC = float, typename TKB = float>
+    class PIDController
     {
     public:
         using TValue = float;
-        
-        PIDController(UnitBase& input, TC kp, TC ki, TC kd, TValue l, TValue h, TKB kb) :
-            m_input(input),
+
+        // Dynamic state for checkpoints, gains are settings and stored separately
+        struct State
+        {
+            TValue integral, error, derivative;
+        };
+
+        PIDController(TC kp, TC ki, TC kd, TValue l = 0, TValue h = 0, TKB kb = 0) :
             m_k_p(kp),
             m_k_i(ki),
             m_k_d(kd),
@@ -17,7 +23,15 @@ namespace ventctl
             m_low(l),
             m_high(h),
             m_integral(0),
-            m_saturate(kb > 0)
+            m_error(0),
+            m_derivative(0),
+            m_t_f(0),
+            m_k_ff(0),
+            m_last_time(0),
+            m_measurement(nullptr),
+            m_feed_forward(nullptr),
+            m_saturate(kb > 0),
+            m_primed(false)
             {}
 
         void setCoefficients(TC p, TC i, TC d)
@@ -26,32 +40,89 @@ namespace ventctl
             m_k_d = d;
             m_k_i = i;
         }
-        
-        TValue getValueUncached(float time)
+
+        TC getP() const { return m_k_p; }
+        TC getI() const { return m_k_i; }
+        TC getD() const { return m_k_d; }
+
+        // Time constant of the first order filter applied to the derivative term, 0 disables it
+        void setDerivativeFilter(float tf)
+        {
+            m_t_f = tf;
+        }
+
+        // Differentiate -measurement instead of the error, so setpoint steps don't kick the output
+        void setMeasurement(UnitBase& measurement)
+        {
+            m_measurement = &measurement;
+        }
+
+        void setFeedForward(UnitBase& input, TC k = 1)
+        {
+            m_feed_forward = &input;
+            m_k_ff = k;
+        }
+
+        void setLastTime(float time)
         {
-            auto error = m_input.getValue(time);
-            auto m_last_time = getLastTime();
+            m_last_time = time;
+        }
+
+        State getState() const
+        {
+            return State{m_integral, m_error, m_derivative};
+        }
+
+        void setState(const State& state)
+        {
+            m_integral = state.integral;
+            m_error = state.error;
+            m_derivative = state.derivative;
+            m_primed = true;
+        }
+
+        // The next sample only seeds the derivative, so the step to it doesn't kick the output
+        void reset()
+        {
+            m_integral = 0;
+            m_error = 0;
+            m_derivative = 0;
+            m_primed = false;
+        }
+
+        TValue nextValue(TValue error, float currentTime)
+        {
+            auto dt = currentTime - m_last_time;
             auto raw_output = m_k_p * error;
             if(m_k_i != 0)
             {
-                m_integral += error * m_k_i * (currentTime - m_last_time);
+                m_integral += error * m_k_i * dt;
                 raw_output += m_integral;
             }
 
-            if(m_k_d != 0)
+            auto d_input = m_measurement ? -m_measurement->getValue(currentTime) : error;
+
+            if(m_k_d != 0 && dt > 0 && m_primed)
             {
-                raw_output += (error - m_error) / (currentTime - m_last_time);
+                auto d = m_k_d * (d_input - m_error) / dt;
+                m_derivative += (d - m_derivative) * dt / (m_t_f + dt);
+                raw_output += m_derivative;
+            }
+
+            if(m_feed_forward)
+            {
+                raw_output += m_k_ff * m_feed_forward->getValue(currentTime);
             }
 
             if(m_saturate)
             {
                 TValue overshoot(0);
                 if(raw_output > m_high)
-                { 
+                {
                     overshoot = raw_output - m_high;
-                    raw_output = m_high; 
+                    raw_output = m_high;
                 }
-                    
+
                 if(raw_output < m_low)
                 {
                     overshoot = raw_output - m_low;
@@ -60,22 +131,84 @@ namespace ventctl
 
                 if(m_k_b != 0)
                 {
-                    m_integral -= overshoot * m_k_b * (currentTime - m_last_time);
+                    m_integral -= overshoot * m_k_b * dt;
                 }
-                
+
             }
 
             setLastTime(currentTime);
-            m_error = error;
+            m_error = d_input;
+            m_primed = true;
 
             return raw_output;
         }
 
     private:
-        UnitBase& m_input;
         TC m_k_p, m_k_i, m_k_d;
         TKB m_k_b;
-        TValue m_low, m_high, m_integral;
-        bool m_saturate;
+        TValue m_low, m_high, m_integral, m_error, m_derivative;
+        float m_t_f;
+        TC m_k_ff;
+        float m_last_time;
+        UnitBase *m_measurement, *m_feed_forward;
+        bool m_saturate, m_primed;
+    };
+
+    template<typename TC = float>
+    struct GainPoint
+    {
+        float x;
+        TC kp, ki, kd;
+    };
+
+    /*
+        PID whose gains are linearly interpolated from a table indexed by an
+        arbitrary unit (e.g. outdoor temperature). The table must be sorted by x,
+        values outside of it are clamped to the first/last point.
+    */
+    template<typename TC = float, typename TKB = float>
+    class GainScheduledPID : public PIDController<TC, TKB>
+    {
+    public:
+        using TValue = typename PIDController<TC, TKB>::TValue;
+        using table_type = etl::ivector<GainPoint<TC>>;
+
+        GainScheduledPID(const table_type& table, UnitBase& schedule, TValue l = 0, TValue h = 0, TKB kb = 0) :
+            PIDController<TC, TKB>(0, 0, 0, l, h, kb),
+            m_table(table),
+            m_schedule(schedule)
+            {}
+
+        static GainPoint<TC> interpolate(const table_type& table, float x)
+        {
+            if(table.empty()) return GainPoint<TC>{x, 0, 0, 0};
+            if(x <= table.front().x) return table.front();
+            if(x >= table.back().x) return table.back();
+
+            size_t i = 1;
+            while(table[i].x < x) ++i;
+
+            auto& a = table[i - 1];
+            auto& b = table[i];
+            auto t = (x - a.x) / (b.x - a.x);
+
+            return GainPoint<TC>{
+                x,
+                a.kp + (b.kp - a.kp) * t,
+                a.ki + (b.ki - a.ki) * t,
+                a.kd + (b.kd - a.kd) * t
+            };
+        }
+
+        TValue nextValue(TValue error, float currentTime)
+        {
+            auto g = interpolate(m_table, m_schedule.getValue(currentTime));
+            this->setCoefficients(g.kp, g.ki, g.kd);
+            return PIDController<TC, TKB>::nextValue(error, currentTime);
+        }
+
+    private:
+        const table_type& m_table;
+        UnitBase& m_schedule;
     };
-}
\ No newline at end of file
+}
@@ -4,9 +4,12 @@
 
 namespace ventctl
 {
+    // Nominal divider transfer, the default of uncalibrated channels
+    constexpr float pt1000_gain = -250, pt1000_offset = 1500;
+
     inline float pt1000_resistance(float voltage)
     {
-        return voltage*(-250) + 1500;
+        return voltage*pt1000_gain + pt1000_offset;
     }
 
     constexpr float pt1000_correction[] = {1.51892983e-15, -2.85842067e-12, -5.34227299e-09,
@@ -33,4 +36,13 @@ namespace ventctl
     
         return result;
     }
-}
\ No newline at end of file
+
+    // Callendar-Van Dusen, the inverse of pt1000_temp() for reference points
+    inline float pt1000_resistance_at(float temp)
+    {
+        constexpr float A = 3.9083e-3, B = -5.775e-7, C = -4.183e-12, R0 = 1000;
+        float result = R0 * (1 + A * temp + B * temp * temp);
+        if(temp < 0) result += R0 * C * (temp - 100) * temp * temp * temp;
+        return result;
+    }
+}
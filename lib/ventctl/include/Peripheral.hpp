@@ -2,7 +2,11 @@
 
 #include <etl/vector.h>
 #include <cstdio>
-#include <loophole.hpp>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <Fixed.hpp>
+#include <Trace.hpp>
 
 
 #ifndef VC_PERIPH_CAP
@@ -12,7 +16,156 @@
 namespace ventctl
 {
     using file_t = FILE*;
-    using type_id_t = int;
+
+    // Stable type ids, the values are part of the settings and telemetry formats
+    enum class ValueType : uint8_t
+    {
+        NONE = 0,
+        BOOL = 1,
+        INT = 2,
+        FLOAT = 3,
+        FIXED = 4
+    };
+
+    template<typename T>
+    constexpr ValueType value_type_v =
+        std::is_same<T, bool>::value ? ValueType::BOOL :
+        std::is_same<T, int>::value ? ValueType::INT :
+        std::is_same<T, float>::value ? ValueType::FLOAT :
+        std::is_same<T, Fixed>::value ? ValueType::FIXED : ValueType::NONE;
+
+    constexpr const char* value_type_name(ValueType type)
+    {
+        return type == ValueType::BOOL ? "bool" :
+            type == ValueType::INT ? "int" :
+            type == ValueType::FLOAT ? "float" :
+            type == ValueType::FIXED ? "fixed" : "none";
+    }
+
+    // Quality of the last reading, peripherals without checks are always GOOD
+    enum class Quality : uint8_t
+    {
+        GOOD,
+        NO_DATA,    // Nothing acquired yet or the converter failed
+        OPEN,       // Raw signal beyond the open circuit limit
+        SHORT,      // Raw signal beyond the short circuit limit
+        RATE,       // Changed faster than physically plausible
+        STUCK       // Has not changed at all for too long
+    };
+
+    constexpr const char* quality_name(Quality quality)
+    {
+        return quality == Quality::GOOD ? "good" :
+            quality == Quality::NO_DATA ? "no_data" :
+            quality == Quality::OPEN ? "open" :
+            quality == Quality::SHORT ? "short" :
+            quality == Quality::RATE ? "rate" : "stuck";
+    }
+
+    /*
+        Value of any peripheral: a closed tagged union over the value
+        types. get() only succeeds for the exact type, as<T>() converts
+        between the numeric types.
+    */
+    class PeripheralValue
+    {
+    public:
+        PeripheralValue() : m_type(ValueType::NONE), m_int(0) {}
+        PeripheralValue(bool value) : m_type(ValueType::BOOL), m_bool(value) {}
+        PeripheralValue(int value) : m_type(ValueType::INT), m_int(value) {}
+        PeripheralValue(float value) : m_type(ValueType::FLOAT), m_float(value) {}
+        PeripheralValue(Fixed value) : m_type(ValueType::FIXED), m_fixed(value) {}
+
+        ValueType type() const { return m_type; }
+        bool empty() const { return m_type == ValueType::NONE; }
+
+        template<typename T>
+        bool get(T& value) const
+        {
+            if(m_type != value_type_v<T>) return false;
+            value = stored<T>();
+            return true;
+        }
+
+        template<typename T>
+        T as() const
+        {
+            switch(m_type)
+            {
+            case ValueType::BOOL: return convert<T>(m_bool);
+            case ValueType::INT: return convert<T>(m_int);
+            case ValueType::FLOAT: return convert<T>(m_float);
+            case ValueType::FIXED: return convert<T>(m_fixed.to_float());
+            default: return T();
+            }
+        }
+
+    private:
+        template<typename T, typename U>
+        static T convert(U value)
+        {
+            if constexpr(std::is_same<T, Fixed>::value)
+                return Fixed((float)value);
+            else
+                return static_cast<T>(value);
+        }
+
+        template<typename T>
+        T stored() const
+        {
+            if constexpr(std::is_same<T, bool>::value) return m_bool;
+            else if constexpr(std::is_same<T, int>::value) return m_int;
+            else if constexpr(std::is_same<T, float>::value) return m_float;
+            else return m_fixed;
+        }
+
+        ValueType m_type;
+        union
+        {
+            bool m_bool;
+            int m_int;
+            float m_float;
+            Fixed m_fixed;
+        };
+    };
+
+    /*
+        Compile time description of a peripheral class, used for printing
+        and serialization instead of RTTI. One constant per class in flash.
+    */
+    struct PeripheralDescriptor
+    {
+        enum Flags : uint8_t
+        {
+            READABLE = 1,
+            WRITABLE = 2,
+            HARDWARE = 4,   // Backed by a pin or a bus, not computed
+            UPDATES = 8     // update() does work every loop
+        };
+
+        // Update buckets, run in this order so computed values see fresh samples
+        enum Group : uint8_t
+        {
+            VARIABLE,
+            ANALOG,
+            INPUT,
+            OUTPUT,
+            MODBUS,
+            COMPUTED,
+            GROUP_COUNT
+        };
+
+        const char* kind;
+        ValueType type;
+        const char* unit;   // Empty when dimensionless
+        uint8_t flags;
+        Group group;
+    };
+
+    // Declares the descriptor of a peripheral class inside its body
+    #define VC_PERIPHERAL_DESCRIPTOR(T, KIND, UNIT, GROUP, FLAGS) \
+        static constexpr ::ventctl::PeripheralDescriptor s_descriptor{KIND, ::ventctl::value_type_v<T>, UNIT, FLAGS, GROUP}; \
+        virtual const ::ventctl::PeripheralDescriptor& descriptor() const override { return s_descriptor; }
 
     
     class PeripheralBase
@@ -26,34 +179,45 @@ namespace ventctl
 
         virtual void print(file_t file, bool short_info = false);
 
-        virtual bool accepts_type_id(int type_id) = 0;
-        
+        virtual const PeripheralDescriptor& descriptor() const = 0;
+
+        // Generic access, one virtual call each; write() fails unless the value has the peripheral's type
+        virtual PeripheralValue read() = 0;
+        virtual bool write(const PeripheralValue& value) = 0;
+
+        ValueType type() const
+        {
+            return descriptor().type;
+        }
+
+        virtual Quality quality() const
+        {
+            return Quality::GOOD;
+        }
+
         template<typename T>
-        bool accepts_type()
+        bool accepts_type() const
         {
-            return accepts_type_id(util::type_id_v<T>);
+            return type() == value_type_v<T>;
         }
 
         template<typename T>
         bool set_value(T* value)
         {
-            return accepts_type<T>() && set_value(static_cast<void*>(value), util::type_id_v<T>);
+            return write(PeripheralValue(*value));
         }
 
         template<typename T>
         bool get_value(T* value)
         {
-            return accepts_type<T>() && get_value(static_cast<void*>(value), util::type_id_v<T>);
+            return read().get(*value);
         }
 
-        virtual bool set_value(void* ptr, type_id_t value) = 0;
-
-        virtual bool get_value(void* ptr, type_id_t value) = 0;
-
         static bool register_peripheral(PeripheralBase* p)
         {
             if(m_peripherals.full()) return false;
             m_peripherals.push_back(p);
+            s_scheduled = false;
             return true;
         }
 
@@ -62,34 +226,108 @@ namespace ventctl
             return m_peripherals;
         }
 
-        ~PeripheralBase()
+        static PeripheralBase* find(const char* name, size_t length)
+        {
+            for(auto p : m_peripherals)
+            {
+                if(std::strlen(p->m_name) == length && std::strncmp(p->m_name, name, length) == 0)
+                    return p;
+            }
+            return nullptr;
+        }
+
+        const char* name() const
+        {
+            return m_name;
+        }
+
+        virtual ~PeripheralBase()
         {
             etl::erase(m_peripherals, this);
+            s_scheduled = false;
         }
 
         virtual void initialize() {}
         virtual void update() {}
 
+        /*
+            Sorts the peripherals that declare UPDATES into one contiguous
+            run per group, keeping registration order within a group.
+            Descriptors are only looked at here; update_all() walks the
+            runs and never touches Variables, outputs or anything else
+            without update work. Called lazily after the registry changes,
+            call it once at startup to keep that out of the first loop.
+        */
+        static void schedule_updates()
+        {
+            size_t count = 0;
+            for(uint8_t g = 0; g < PeripheralDescriptor::GROUP_COUNT; ++g)
+            {
+                for(auto p : m_peripherals)
+                {
+                    auto& d = p->descriptor();
+                    if(d.group == g && (d.flags & PeripheralDescriptor::UPDATES))
+                        s_schedule[count++] = p;
+                }
+                s_group_end[g] = count;
+            }
+            s_scheduled = true;
+        }
+
+        // Number of peripherals updated in a group
+        static size_t scheduled(PeripheralDescriptor::Group group)
+        {
+            if(!s_scheduled) schedule_updates();
+            return s_group_end[group] - (group ? s_group_end[group - 1] : 0);
+        }
+
+        static void update_all()
+        {
+            if(!s_scheduled) schedule_updates();
+
+            static constexpr const char* zones[PeripheralDescriptor::GROUP_COUNT] = {
+                "update_variable", "update_analog", "update_input",
+                "update_output", "update_modbus", "update_computed"
+            };
+
+            size_t i = 0;
+            for(uint8_t g = 0; g < PeripheralDescriptor::GROUP_COUNT; ++g)
+            {
+                auto end = s_group_end[g];
+                if(i == end) continue;
+
+                VC_TRACE_ZONE(zones[g]);
+                for(; i < end; ++i)
+                    s_schedule[i]->update();
+            }
+        }
+
     private:
         const char* m_name;
 
         static etl::vector<PeripheralBase*, VC_PERIPH_CAP> m_peripherals;
 
-        
+        inline static PeripheralBase* s_schedule[VC_PERIPH_CAP];
+        inline static uint16_t s_group_end[PeripheralDescriptor::GROUP_COUNT];
+        inline static bool s_scheduled = false;
     };
 
     template<typename T>
     class Peripheral : public PeripheralBase
     {
     public:
+        using value_type = T;
+
         Peripheral(const char* name) :
             PeripheralBase(name)
         {}
 
-        virtual bool accepts_type_id(type_id_t type_id);
+        // Unknown subclasses may override update(), so they are scheduled
+        VC_PERIPHERAL_DESCRIPTOR(T, "Peripheral", "", PeripheralDescriptor::COMPUTED,
+            PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE | PeripheralDescriptor::UPDATES)
 
-        virtual bool set_value(void*, type_id_t);
-        virtual bool get_value(void*, type_id_t);
+        virtual PeripheralValue read() override;
+        virtual bool write(const PeripheralValue& value) override;
 
         virtual bool accept_value(T& t) = 0;
         virtual T read_value() = 0;
@@ -112,7 +350,24 @@ namespace ventctl
         }
     };
 
+    /*
+        Statically dispatched access for when the concrete class is known:
+        the qualified call skips the vtable and can be inlined.
+    */
+    template<typename P>
+    typename P::value_type read_direct(P& p)
+    {
+        return p.P::read_value();
+    }
+
+    template<typename P>
+    bool write_direct(P& p, typename P::value_type value)
+    {
+        return p.P::accept_value(value);
+    }
+
     extern template class Peripheral<float>;
     extern template class Peripheral<bool>;
     extern template class Peripheral<int>;
+    extern template class Peripheral<Fixed>;
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include "Peripheral.hpp"
+
+namespace ventctl
+{
+    struct PlausibilityLimits
+    {
+        /*
+            Raw voltages past which the front end must be open or shorted.
+            open_voltage may be on either side of short_voltage, whichever
+            way the divider is wired.
+        */
+        float open_voltage, short_voltage;
+        // Largest believable change in value units per second, 0 disables
+        float max_rate;
+        // A value that moves less than stuck_epsilon for stuck_us is stuck, 0 disables
+        uint32_t stuck_us;
+        float stuck_epsilon;
+
+        /*
+            PT1000 divider of the thermal inputs, V = (1500 - R) / 250:
+            an open sensor pulls the input to ground, a short to the rail.
+            Room and duct air never moves 5 degC in a second.
+        */
+        static constexpr PlausibilityLimits pt1000()
+        {
+            return {0.02f, 3.2f, 5.0f, 60000000, 0.0f};
+        }
+    };
+
+    /*
+        Per reading sanity checks of an analog sensor, all O(1) so they
+        can run in the acquisition path.
+
+        The rate check compares against the last reading that passed,
+        allowing max_rate times the time since then, so after a fault the
+        sensor is accepted again as soon as the jump is explainable. The
+        stuck check restarts its window whenever the value moves.
+
+        Times are free running microseconds, differences are taken modulo
+        2^32.
+    */
+    class Plausibility
+    {
+    public:
+        Plausibility(const PlausibilityLimits& limits = PlausibilityLimits::pt1000()) :
+            m_limits(limits),
+            m_quality(Quality::NO_DATA),
+            m_has_good(false),
+            m_good(0),
+            m_good_time(0),
+            m_stuck_value(NAN),
+            m_stuck_time(0)
+            {}
+
+        void set_limits(const PlausibilityLimits& limits)
+        {
+            m_limits = limits;
+        }
+
+        const PlausibilityLimits& limits() const
+        {
+            return m_limits;
+        }
+
+        Quality check(float voltage, float value, uint32_t now)
+        {
+            m_quality = classify(voltage, value, now);
+            if(m_quality == Quality::GOOD)
+            {
+                m_has_good = true;
+                m_good = value;
+                m_good_time = now;
+            }
+            return m_quality;
+        }
+
+        Quality quality() const
+        {
+            return m_quality;
+        }
+
+        // Last value that passed, NAN before the first one
+        float last_good() const
+        {
+            return m_has_good ? m_good : NAN;
+        }
+
+    private:
+        Quality classify(float voltage, float value, uint32_t now)
+        {
+            if(std::isnan(voltage) || std::isnan(value))
+                return Quality::NO_DATA;
+
+            auto& l = m_limits;
+            bool open_low = l.open_voltage < l.short_voltage;
+            if(open_low ? voltage < l.open_voltage : voltage > l.open_voltage)
+                return Quality::OPEN;
+            if(open_low ? voltage > l.short_voltage : voltage < l.short_voltage)
+                return Quality::SHORT;
+
+            if(l.stuck_us)
+            {
+                if(!(std::fabs(value - m_stuck_value) <= l.stuck_epsilon))
+                {
+                    m_stuck_value = value;
+                    m_stuck_time = now;
+                }
+                else if(now - m_stuck_time >= l.stuck_us)
+                    return Quality::STUCK;
+            }
+
+            if(l.max_rate > 0 && m_has_good)
+            {
+                auto allowed = l.max_rate * (now - m_good_time) * 1e-6f;
+                if(std::fabs(value - m_good) > allowed)
+                    return Quality::RATE;
+            }
+
+            return Quality::GOOD;
+        }
+
+        PlausibilityLimits m_limits;
+        Quality m_quality;
+        bool m_has_good;
+        float m_good;
+        uint32_t m_good_time;
+        float m_stuck_value;
+        uint32_t m_stuck_time;
+    };
+}
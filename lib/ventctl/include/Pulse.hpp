@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Edges averaged for the frequency, a power of two
+#ifndef VC_PULSE_HISTORY
+    #define VC_PULSE_HISTORY 8
+#endif
+
+namespace ventctl
+{
+    /*
+        Edge timestamps of a pulse train, written by an interrupt and read
+        lock-free from the main loop.
+
+        edge() is the whole ISR: it rejects edges closer than the debounce
+        interval to the last accepted one and stores the timestamp in a
+        small ring. read() takes a consistent snapshot under a sequence
+        counter (the ISR cannot be preempted by the reader, so it never
+        waits); the frequency is computed from the snapshot, averaged over
+        up to VC_PULSE_HISTORY - 1 periods.
+
+        Timestamps are free running microseconds, differences are taken
+        modulo 2^32. For a running input the 71 minute wrap is harmless;
+        for a stopped one `now - last` would come back small after a
+        wrap, so the reader latches the stop once it sees the timeout
+        pass. That needs frequency() to be called at least once per
+        wrap minus the timeout, which any polling loop does.
+    */
+    class PulseCapture
+    {
+    public:
+        struct Reading
+        {
+            uint32_t count;     // Accepted edges since start
+            uint32_t rejected;  // Edges dropped by the debounce
+            uint32_t last;      // Timestamp of the last accepted edge
+            uint32_t span;      // Time covered by the last `periods` periods
+            uint8_t periods;
+        };
+
+        // Without an edge for timeout_us the input counts as stopped
+        PulseCapture(uint32_t debounce_us, uint32_t timeout_us) :
+            m_debounce(debounce_us),
+            m_timeout(timeout_us),
+            m_seq(0),
+            m_count(0),
+            m_rejected(0),
+            m_stopped(false),
+            m_stopped_count(0)
+            {}
+
+        void edge(uint32_t now)
+        {
+            auto count = m_count.load(std::memory_order_relaxed);
+            if(count && now - m_times[(count - 1) % VC_PULSE_HISTORY].load(std::memory_order_relaxed) < m_debounce)
+            {
+                m_rejected.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            m_seq.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_signal_fence(std::memory_order_release);
+            m_times[count % VC_PULSE_HISTORY].store(now, std::memory_order_relaxed);
+            m_count.store(count + 1, std::memory_order_relaxed);
+            std::atomic_signal_fence(std::memory_order_release);
+            m_seq.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Reading read() const
+        {
+            Reading r;
+            uint32_t seq;
+            do
+            {
+                seq = m_seq.load(std::memory_order_relaxed);
+                std::atomic_signal_fence(std::memory_order_acquire);
+
+                r.count = m_count.load(std::memory_order_relaxed);
+                r.rejected = m_rejected.load(std::memory_order_relaxed);
+                r.last = r.count ? m_times[(r.count - 1) % VC_PULSE_HISTORY].load(std::memory_order_relaxed) : 0;
+
+                auto periods = r.count ? r.count - 1 : 0;
+                if(periods > VC_PULSE_HISTORY - 1) periods = VC_PULSE_HISTORY - 1;
+                r.periods = periods;
+                r.span = r.last - m_times[(r.count - 1 - periods) % VC_PULSE_HISTORY].load(std::memory_order_relaxed);
+
+                std::atomic_signal_fence(std::memory_order_acquire);
+            }
+            while((seq & 1) || seq != m_seq.load(std::memory_order_relaxed));
+            return r;
+        }
+
+        uint32_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+        // Mean period in microseconds, 0 before two edges or once stopped
+        float period(uint32_t now) const
+        {
+            auto f = frequency(now);
+            return f > 0 ? 1e6f / f : 0.0f;
+        }
+
+        /*
+            Edges per second. While the train slows down, the time since
+            the last edge bounds the frequency from above, so a stopping
+            fan reads as decelerating until the timeout, not frozen at
+            its last speed.
+        */
+        float frequency(uint32_t now) const
+        {
+            auto r = read();
+            if(m_stopped && r.count == m_stopped_count) return 0.0f;
+
+            m_stopped = r.count && now - r.last > m_timeout;
+            m_stopped_count = r.count;
+            return frequency(r, now, m_timeout);
+        }
+
+        static float frequency(const Reading& r, uint32_t now, uint32_t timeout_us)
+        {
+            if(r.periods == 0 || r.span == 0) return 0.0f;
+
+            auto since = now - r.last;
+            if(since > timeout_us) return 0.0f;
+
+            auto f = r.periods * 1e6f / r.span;
+            if(since > 0 && 1e6f / since < f) f = 1e6f / since;
+            return f;
+        }
+
+        static float rpm(float frequency, uint8_t pulses_per_revolution)
+        {
+            return pulses_per_revolution ? frequency * 60.0f / pulses_per_revolution : 0.0f;
+        }
+
+    private:
+        uint32_t m_debounce, m_timeout;
+        std::atomic<uint32_t> m_seq, m_count, m_rejected;
+        std::atomic<uint32_t> m_times[VC_PULSE_HISTORY] = {};
+
+        // Reader side only, see the wrap note above
+        mutable bool m_stopped;
+        mutable uint32_t m_stopped_count;
+    };
+}
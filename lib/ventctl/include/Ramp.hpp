@@ -0,0 +1,109 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace ventctl
+{
+    /*
+        Slew limited transition between two output levels.
+
+        LINEAR moves at the slew rate, S_CURVE follows smoothstep
+        (3x^2 - 2x^3): zero slope at both ends and a peak slope of 1.5
+        times the mean, so the duration is stretched by 1.5 to keep the
+        peak at the slew rate. A slew rate of 0 means no limit.
+
+        Everything here is pure, fill() renders samples for the DAC DMA
+        buffer and is also what the host tests check.
+    */
+    struct Ramp
+    {
+        enum class Shape : uint8_t
+        {
+            LINEAR,
+            S_CURVE
+        };
+
+        float from, to, duration;
+        Shape shape;
+
+        // slew is in output units per second
+        static Ramp plan(float from, float to, float slew, Shape shape)
+        {
+            auto distance = std::fabs(to - from);
+            float duration = 0;
+            if(slew > 0)
+                duration = distance / slew * (shape == Shape::S_CURVE ? 1.5f : 1.0f);
+            return Ramp{from, to, duration, shape};
+        }
+
+        // A ramp that already sits at value
+        static Ramp hold(float value)
+        {
+            return Ramp{value, value, 0, Shape::LINEAR};
+        }
+
+        /*
+            The ramp taking over at t towards a new target. From rest it
+            has the given shape; while moving, an S-curve would restart at
+            zero slope and a writer retargeting every tick would barely
+            move, so it continues linearly at the slew rate instead.
+        */
+        Ramp retarget(float t, float target, float slew, Shape shape) const
+        {
+            if(slope(t) != 0) shape = Shape::LINEAR;
+            return plan(at(t), target, slew, shape);
+        }
+
+        // Whether value is the target to within one DAC code
+        bool targets(float value) const
+        {
+            return code(value) == code(to);
+        }
+
+        bool done(float t) const
+        {
+            return t >= duration;
+        }
+
+        float at(float t) const
+        {
+            if(t >= duration) return to;
+            if(t <= 0) return from;
+
+            auto x = t / duration;
+            if(shape == Shape::S_CURVE)
+                x = x * x * (3 - 2 * x);
+            return from + (to - from) * x;
+        }
+
+        // Output units per second
+        float slope(float t) const
+        {
+            if(t >= duration || t < 0) return 0;
+
+            auto x = t / duration;
+            auto d = shape == Shape::S_CURVE ? 6 * x * (1 - x) : 1.0f;
+            return (to - from) * d / duration;
+        }
+
+        /*
+            Writes samples first .. first + count - 1 as 12 bit DAC codes
+            for an output range of 0..1, sample i being the value at
+            (i + 1) / rate. Returns true when the last one is at the target.
+        */
+        bool fill(float rate, uint32_t first, uint16_t* out, size_t count) const
+        {
+            for(size_t i = 0; i < count; ++i)
+                out[i] = code(at((first + i + 1) / rate));
+            return done((first + count) / rate);
+        }
+
+        static uint16_t code(float value)
+        {
+            if(!(value > 0)) return 0;
+            if(value >= 1) return 4095;
+            return (uint16_t)(value * 4095 + 0.5f);
+        }
+    };
+}
@@ -5,6 +5,8 @@ namespace ventctl
     class Saturation
     {
     public:
+        static constexpr bool time_dependent = false;
+
         Saturation(float low, float high) : m_low(low), m_high(high) {}
 
         void setLastTime(float t)
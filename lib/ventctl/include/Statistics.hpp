@@ -0,0 +1,363 @@
+#pragma once
+#include <Peripheral.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#ifndef VC_STATS_NAME_SIZE
+    #define VC_STATS_NAME_SIZE 32
+#endif
+
+namespace ventctl
+{
+    // Running mean and variance (Welford), numerically stable in single precision
+    class Welford
+    {
+    public:
+        Welford() :
+            m_count(0),
+            m_mean(0),
+            m_m2(0)
+            {}
+
+        void add(float x)
+        {
+            m_count++;
+            auto delta = x - m_mean;
+            m_mean += delta / m_count;
+            m_m2 += delta * (x - m_mean);
+        }
+
+        void reset() { *this = Welford(); }
+
+        uint32_t count() const { return m_count; }
+        float mean() const { return m_mean; }
+        // Sample variance, 0 below two samples
+        float variance() const { return m_count > 1 ? m_m2 / (m_count - 1) : 0.0f; }
+        float stddev() const { return std::sqrt(variance()); }
+
+    private:
+        uint32_t m_count;
+        float m_mean, m_m2;
+    };
+
+    /*
+        P-square quantile estimator (Jain & Chlamtac, 1985): five markers
+        track the minimum, p/2, p, (1+p)/2 and the maximum, adjusted by
+        piecewise parabolic interpolation. Constant memory and time per
+        sample; exact for the first five samples.
+    */
+    class P2Quantile
+    {
+    public:
+        explicit P2Quantile(float p) :
+            m_p(p),
+            m_count(0)
+            {}
+
+        void reset() { m_count = 0; }
+
+        float quantile() const { return m_p; }
+
+        void add(float x)
+        {
+            if(m_count < 5)
+            {
+                m_q[m_count++] = x;
+                if(m_count == 5)
+                {
+                    std::sort(m_q, m_q + 5);
+                    for(int i = 0; i < 5; ++i)
+                        m_n[i] = i;
+                    m_np[0] = 0;
+                    m_np[1] = 2 * m_p;
+                    m_np[2] = 4 * m_p;
+                    m_np[3] = 2 + 2 * m_p;
+                    m_np[4] = 4;
+                }
+                return;
+            }
+
+            m_count++;
+
+            int k;
+            if(x < m_q[0])
+            {
+                m_q[0] = x;
+                k = 0;
+            }
+            else if(x >= m_q[4])
+            {
+                m_q[4] = x;
+                k = 3;
+            }
+            else
+            {
+                k = 0;
+                while(x >= m_q[k + 1]) k++;
+            }
+
+            for(int i = k + 1; i < 5; ++i)
+                m_n[i]++;
+
+            const float dn[5] = {0, m_p / 2, m_p, (1 + m_p) / 2, 1};
+            for(int i = 0; i < 5; ++i)
+                m_np[i] += dn[i];
+
+            for(int i = 1; i < 4; ++i)
+            {
+                auto d = m_np[i] - m_n[i];
+                if((d >= 1 && m_n[i + 1] - m_n[i] > 1) || (d <= -1 && m_n[i - 1] - m_n[i] < -1))
+                {
+                    int s = d > 0 ? 1 : -1;
+                    auto q = parabolic(i, s);
+                    if(!(m_q[i - 1] < q && q < m_q[i + 1]))
+                        q = m_q[i] + s * (m_q[i + s] - m_q[i]) / (m_n[i + s] - m_n[i]);
+                    m_q[i] = q;
+                    m_n[i] += s;
+                }
+            }
+        }
+
+        float value() const
+        {
+            if(m_count == 0) return NAN;
+            if(m_count >= 5) return m_q[2];
+
+            // Nearest rank over the few samples seen so far
+            float sorted[5];
+            std::copy(m_q, m_q + m_count, sorted);
+            std::sort(sorted, sorted + m_count);
+            return sorted[std::min<uint32_t>(m_count - 1, (uint32_t)(m_p * m_count))];
+        }
+
+    private:
+        float parabolic(int i, int s) const
+        {
+            float n0 = m_n[i - 1], n1 = m_n[i], n2 = m_n[i + 1];
+            return m_q[i] + s / (n2 - n0) * (
+                (n1 - n0 + s) * (m_q[i + 1] - m_q[i]) / (n2 - n1) +
+                (n2 - n1 - s) * (m_q[i] - m_q[i - 1]) / (n1 - n0));
+        }
+
+        float m_p;
+        uint32_t m_count;
+        float m_q[5];
+        int32_t m_n[5];
+        float m_np[5];
+    };
+
+    // Everything known about one window of samples
+    class WindowStats
+    {
+    public:
+        explicit WindowStats(float p) :
+            m_quantile(p),
+            m_min(NAN),
+            m_max(NAN),
+            m_first(NAN),
+            m_last(NAN)
+            {}
+
+        void add(float x)
+        {
+            if(m_welford.count() == 0)
+            {
+                m_min = m_max = m_first = x;
+            }
+            else
+            {
+                m_min = std::min(m_min, x);
+                m_max = std::max(m_max, x);
+            }
+            m_last = x;
+            m_welford.add(x);
+            m_quantile.add(x);
+        }
+
+        void reset()
+        {
+            m_welford.reset();
+            m_quantile.reset();
+            m_min = m_max = m_first = m_last = NAN;
+        }
+
+        uint32_t count() const { return m_welford.count(); }
+        float mean() const { return count() ? m_welford.mean() : NAN; }
+        float stddev() const { return m_welford.stddev(); }
+        float min() const { return m_min; }
+        float max() const { return m_max; }
+        float first() const { return m_first; }
+        float last() const { return m_last; }
+        float quantile() const { return m_quantile.value(); }
+
+    private:
+        Welford m_welford;
+        P2Quantile m_quantile;
+        float m_min, m_max, m_first, m_last;
+    };
+
+    namespace detail
+    {
+        using stat_name_t = std::array<char, VC_STATS_NAME_SIZE>;
+
+        // Names are built before the peripherals that point to them are registered
+        struct StatNames
+        {
+            static constexpr size_t COUNT = 8;
+
+            StatNames(const char* source, float window, float p)
+            {
+                char label[12];
+                auto seconds = (unsigned)std::lround(window);
+                if(seconds % 60 == 0)
+                    snprintf(label, sizeof(label), "%um", seconds / 60);
+                else
+                    snprintf(label, sizeof(label), "%us", seconds);
+
+                char quantile[8];
+                snprintf(quantile, sizeof(quantile), "p%u", (unsigned)std::lround(p * 100));
+
+                const char* stats[COUNT] = {"n", "mean", "std", "min", "max", "first", "last", quantile};
+                for(size_t i = 0; i < COUNT; ++i)
+                    snprintf(m_names[i].data(), VC_STATS_NAME_SIZE, "%s.%s_%s", source, stats[i], label);
+            }
+
+            std::array<stat_name_t, COUNT> m_names;
+        };
+    }
+
+    /*
+        Tumbling window statistics of a float peripheral, sampled on every
+        update() and computed incrementally. The results of the last
+        complete window are registered as peripherals named
+        "<source>.<stat>_<window>", e.g. T_Room.max_1m, T_Room.p95_1m, so
+        they can be read like sensors and used as graph sources. Until the
+        first window completes, the partial window is reported. Readings
+        that are NaN or not of GOOD quality are left out, so an open sensor
+        does not show up as a spike.
+
+        The clock is a free running microsecond counter such as
+        us_ticker_read; window boundaries are taken modulo 2^32, so they
+        keep closing across its wrap.
+
+        The object itself is the sample count peripheral ("<source>.n_1m").
+    */
+    class Statistics : private detail::StatNames, public Peripheral<int>
+    {
+    public:
+        enum class Kind : uint8_t
+        {
+            MEAN,
+            STDDEV,
+            MIN,
+            MAX,
+            FIRST,
+            LAST,
+            QUANTILE
+        };
+
+        class Stat : public Peripheral<float>
+        {
+        public:
+            Stat(const char* name, const Statistics& owner, Kind kind) :
+                Peripheral<float>(name),
+                m_owner(owner),
+                m_kind(kind)
+                {}
+
+            VC_PERIPHERAL_DESCRIPTOR(float, "Statistic", "", PeripheralDescriptor::COMPUTED, PeripheralDescriptor::READABLE)
+
+            virtual bool accept_value(float&) { return false; }
+            virtual float read_value() { return m_owner.value(m_kind); }
+
+        private:
+            const Statistics& m_owner;
+            Kind m_kind;
+        };
+
+        // clock returns microseconds, window is in seconds, p is the quantile to estimate
+        Statistics(Peripheral<float>& source, float window, uint32_t (*clock)(), float p = 0.95f) :
+            StatNames(source.name(), window, p),
+            Peripheral<int>(m_names[0].data()),
+            m_source(source),
+            m_clock(clock),
+            m_window(window * 1e6f),
+            m_start(0),
+            m_started(false),
+            m_current(p),
+            m_complete(p),
+            m_has_complete(false),
+            m_stats{
+                Stat(m_names[1].data(), *this, Kind::MEAN),
+                Stat(m_names[2].data(), *this, Kind::STDDEV),
+                Stat(m_names[3].data(), *this, Kind::MIN),
+                Stat(m_names[4].data(), *this, Kind::MAX),
+                Stat(m_names[5].data(), *this, Kind::FIRST),
+                Stat(m_names[6].data(), *this, Kind::LAST),
+                Stat(m_names[7].data(), *this, Kind::QUANTILE)
+            }
+            {}
+
+        VC_PERIPHERAL_DESCRIPTOR(int, "Statistics", "", PeripheralDescriptor::COMPUTED, PeripheralDescriptor::READABLE | PeripheralDescriptor::UPDATES)
+
+        virtual bool accept_value(int&) { return false; }
+        virtual int read_value() { return window().count(); }
+
+        virtual void update() override
+        {
+            auto now = m_clock();
+            if(!m_started)
+            {
+                m_start = now;
+                m_started = true;
+            }
+
+            if(now - m_start >= m_window)
+            {
+                m_complete = m_current;
+                m_has_complete = true;
+                m_current.reset();
+                // Stay on the window grid unless updates stalled for longer than a window
+                m_start += m_window;
+                if(now - m_start >= m_window) m_start = now;
+            }
+
+            auto value = m_source.read_value();
+            if(std::isfinite(value) && m_source.quality() == Quality::GOOD)
+                m_current.add(value);
+        }
+
+        // The window the peripherals report
+        const WindowStats& window() const { return m_has_complete ? m_complete : m_current; }
+
+        float value(Kind kind) const
+        {
+            auto& w = window();
+            switch(kind)
+            {
+            case Kind::MEAN: return w.mean();
+            case Kind::STDDEV: return w.stddev();
+            case Kind::MIN: return w.min();
+            case Kind::MAX: return w.max();
+            case Kind::FIRST: return w.first();
+            case Kind::LAST: return w.last();
+            case Kind::QUANTILE: return w.quantile();
+            }
+            return NAN;
+        }
+
+        Stat& stat(Kind kind) { return m_stats[(size_t)kind]; }
+
+    private:
+        Peripheral<float>& m_source;
+        uint32_t (*m_clock)();
+        uint32_t m_window, m_start;
+        bool m_started;
+        WindowStats m_current, m_complete;
+        bool m_has_complete;
+        Stat m_stats[7];
+    };
+}
@@ -0,0 +1,654 @@
+#pragma once
+#include <Peripheral.hpp>
+#include <charconv.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+#ifndef VC_TELEMETRY_CHANNELS
+    #define VC_TELEMETRY_CHANNELS 48
+#endif
+
+// Queue lengths between the stages
+#ifndef VC_TELEMETRY_SNAPSHOTS
+    #define VC_TELEMETRY_SNAPSHOTS 8
+#endif
+
+#ifndef VC_TELEMETRY_WINDOWS
+    #define VC_TELEMETRY_WINDOWS 2
+#endif
+
+#ifndef VC_TELEMETRY_MESSAGES
+    #define VC_TELEMETRY_MESSAGES 4
+#endif
+
+#ifndef VC_TELEMETRY_MESSAGE_SIZE
+    #define VC_TELEMETRY_MESSAGE_SIZE 512
+#endif
+
+#ifndef VC_TELEMETRY_BATCH_SIZE
+    #define VC_TELEMETRY_BATCH_SIZE 1024
+#endif
+
+namespace ventctl
+{
+    /*
+        Telemetry pipeline: Sampler -> Aggregator -> Encoder -> Publisher,
+        connected by fixed queues and driven from the main loop by
+        Telemetry::update(). Nothing is allocated.
+
+        Only the sampler drops data: every later stage leaves its input
+        queued while the next queue is full (counted as a stall), so a
+        publisher that cannot send fills the queues back to the sampler,
+        which then drops snapshots. Messages are never lost once encoded.
+
+        Times are free running microseconds, differences are taken modulo
+        2^32; intervals are given in seconds.
+    */
+    namespace telemetry
+    {
+        template<typename T, size_t N>
+        class Queue
+        {
+        public:
+            Queue() :
+                m_head(0),
+                m_count(0),
+                m_peak(0),
+                m_dropped(0),
+                m_stalled(0)
+                {}
+
+            bool empty() const { return m_count == 0; }
+            bool full() const { return m_count == N; }
+            size_t size() const { return m_count; }
+            constexpr size_t capacity() const { return N; }
+
+            // Slot of the next element or nullptr when full, the element is added by commit()
+            T* reserve()
+            {
+                return full() ? nullptr : &m_items[(m_head + m_count) % N];
+            }
+
+            void commit()
+            {
+                m_count++;
+                if(m_count > m_peak) m_peak = m_count;
+            }
+
+            // i-th element from the front
+            T& at(size_t i) { return m_items[(m_head + i) % N]; }
+            T& front() { return m_items[m_head]; }
+
+            void pop()
+            {
+                m_head = (m_head + 1) % N;
+                m_count--;
+            }
+
+            // A producer found the queue full and discarded its element
+            void drop() { m_dropped++; }
+            // A producer found the queue full and kept its input for later
+            void stall() { m_stalled++; }
+
+            size_t peak() const { return m_peak; }
+            uint32_t dropped() const { return m_dropped; }
+            uint32_t stalled() const { return m_stalled; }
+
+        private:
+            T m_items[N];
+            size_t m_head, m_count, m_peak;
+            uint32_t m_dropped, m_stalled;
+        };
+
+        // Values of all channels at one time, NaN when a channel could not be read
+        struct Snapshot
+        {
+            uint32_t time;
+            uint8_t channels;
+            float values[VC_TELEMETRY_CHANNELS];
+        };
+
+        struct Summary
+        {
+            float min, max, mean;
+            uint16_t count;
+        };
+
+        struct Window
+        {
+            uint32_t start, end;
+            uint16_t samples;
+            uint8_t channels;
+            Summary values[VC_TELEMETRY_CHANNELS];
+        };
+
+        struct Message
+        {
+            size_t size;
+            char data[VC_TELEMETRY_MESSAGE_SIZE];
+        };
+
+        using SnapshotQueue = Queue<Snapshot, VC_TELEMETRY_SNAPSHOTS>;
+        using WindowQueue = Queue<Window, VC_TELEMETRY_WINDOWS>;
+        using MessageQueue = Queue<Message, VC_TELEMETRY_MESSAGES>;
+
+        class Sampler
+        {
+        public:
+            explicit Sampler(float interval) :
+                m_interval(interval * 1e6f),
+                m_last(0),
+                m_polled(false),
+                m_count(0),
+                m_overflow(0)
+                {}
+
+            // Only peripherals readable as float, int or bool are sampled
+            bool add(PeripheralBase& p)
+            {
+                if(!readable(p)) return false;
+                if(m_count >= VC_TELEMETRY_CHANNELS)
+                {
+                    m_overflow++;
+                    return false;
+                }
+                m_channels[m_count++] = &p;
+                return true;
+            }
+
+            // Adds every registered peripheral, returns the number of channels
+            size_t add_all()
+            {
+                for(auto p : PeripheralBase::get_peripherals())
+                    add(*p);
+                return m_count;
+            }
+
+            // Readable peripherals left out because every channel was taken
+            size_t overflow() const { return m_overflow; }
+
+            size_t channels() const { return m_count; }
+            const char* name(size_t i) const { return m_channels[i]->name(); }
+            const PeripheralDescriptor& descriptor(size_t i) const { return m_channels[i]->descriptor(); }
+
+            void set_interval(float interval) { m_interval = interval * 1e6f; }
+            float interval() const { return m_interval * 1e-6f; }
+
+            // Takes a snapshot when one is due, returns false when it had to be dropped
+            bool poll(uint32_t now, SnapshotQueue& out)
+            {
+                if(m_polled && now - m_last < m_interval) return true;
+
+                // Late polls do not try to catch up
+                m_last = m_polled ? m_last + m_interval : now;
+                if(now - m_last >= m_interval) m_last = now;
+                m_polled = true;
+
+                auto snapshot = out.reserve();
+                if(!snapshot)
+                {
+                    out.drop();
+                    return false;
+                }
+
+                snapshot->time = now;
+                snapshot->channels = m_count;
+                for(size_t i = 0; i < m_count; ++i)
+                {
+                    if(!read(*m_channels[i], snapshot->values[i]))
+                        snapshot->values[i] = std::numeric_limits<float>::quiet_NaN();
+                }
+                out.commit();
+                return true;
+            }
+
+            static bool readable(PeripheralBase& p)
+            {
+                return p.descriptor().type != ValueType::NONE;
+            }
+
+            static bool read(PeripheralBase& p, float& value)
+            {
+                auto v = p.read();
+                if(v.empty()) return false;
+                value = v.as<float>();
+                return true;
+            }
+
+        private:
+            uint32_t m_interval, m_last;
+            bool m_polled;
+            size_t m_count, m_overflow;
+            PeripheralBase* m_channels[VC_TELEMETRY_CHANNELS];
+        };
+
+        // Folds snapshots into min/max/mean per channel over fixed windows
+        class Aggregator
+        {
+        public:
+            explicit Aggregator(float window) :
+                m_window(window * 1e6f),
+                m_open(false)
+                {}
+
+            void set_window(float window) { m_window = window * 1e6f; }
+            float window() const { return m_window * 1e-6f; }
+
+            void process(SnapshotQueue& in, WindowQueue& out)
+            {
+                while(!in.empty())
+                {
+                    auto& snapshot = in.front();
+
+                    if(m_open && snapshot.time - m_current.start >= m_window)
+                    {
+                        if(!close(out)) return;
+                    }
+
+                    if(!m_open) open(snapshot);
+                    accumulate(snapshot);
+                    in.pop();
+                }
+            }
+
+        private:
+            void open(const Snapshot& snapshot)
+            {
+                m_open = true;
+                m_current.start = snapshot.time;
+                m_current.samples = 0;
+                m_current.channels = snapshot.channels;
+                for(size_t i = 0; i < snapshot.channels; ++i)
+                    m_current.values[i] = Summary{0, 0, 0, 0};
+            }
+
+            void accumulate(const Snapshot& snapshot)
+            {
+                m_current.end = snapshot.time;
+                m_current.samples++;
+
+                for(size_t i = 0; i < m_current.channels && i < snapshot.channels; ++i)
+                {
+                    auto value = snapshot.values[i];
+                    if(value != value) continue;
+
+                    auto& s = m_current.values[i];
+                    if(s.count == 0 || value < s.min) s.min = value;
+                    if(s.count == 0 || value > s.max) s.max = value;
+                    s.mean += value; // Sum until the window closes
+                    s.count++;
+                }
+            }
+
+            bool close(WindowQueue& out)
+            {
+                auto window = out.reserve();
+                if(!window)
+                {
+                    out.stall();
+                    return false;
+                }
+
+                *window = m_current;
+                for(size_t i = 0; i < window->channels; ++i)
+                {
+                    auto& s = window->values[i];
+                    if(s.count) s.mean /= s.count;
+                }
+                out.commit();
+                m_open = false;
+                return true;
+            }
+
+            uint32_t m_window;
+            bool m_open;
+            Window m_current;
+        };
+
+        /*
+            One JSON object per window:
+            {"t":<end>,"dt":<length>,"n":<samples>,"v":{"<name>":[min,mean,max],...}}
+            with times in seconds, t wrapping with the microsecond clock.
+            Channels without a valid sample are left out. A window with more
+            channels than fit in one message continues in further messages
+            with the same t, dt and n; only a channel too long for a message
+            of its own is left out (counted as truncated).
+        */
+        class Encoder
+        {
+        public:
+            explicit Encoder(const Sampler& sampler, int precision = 3) :
+                m_sampler(sampler),
+                m_precision(precision),
+                m_next(0),
+                m_truncated(0)
+                {}
+
+            void process(WindowQueue& in, MessageQueue& out)
+            {
+                while(!in.empty())
+                {
+                    auto message = out.reserve();
+                    if(!message)
+                    {
+                        out.stall();
+                        return;
+                    }
+
+                    message->size = encode(in.front(), message->data, sizeof(message->data), m_next);
+                    out.commit();
+
+                    if(m_next >= in.front().channels)
+                    {
+                        in.pop();
+                        m_next = 0;
+                    }
+                }
+            }
+
+            // Channels from first on until the buffer is full, first is advanced past the ones written
+            size_t encode(const Window& w, char* buffer, size_t size, size_t& first)
+            {
+                Writer out{buffer, buffer + size, true};
+
+                out.text("{\"t\":");
+                out.number(w.end * 1e-6f, 1);
+                out.text(",\"dt\":");
+                out.number((w.end - w.start) * 1e-6f, 1);
+                out.text(",\"n\":");
+                out.number(w.samples);
+                out.text(",\"v\":{");
+
+                bool empty = true;
+                auto channels = w.channels < m_sampler.channels() ? w.channels : m_sampler.channels();
+                size_t i = first;
+                for(; i < channels; ++i)
+                {
+                    auto& s = w.values[i];
+                    if(s.count == 0) continue;
+
+                    // Leave room for the closing braces
+                    Writer item{out.p, out.end - 2, true};
+                    if(!empty) item.text(",");
+                    item.text("\"");
+                    item.text(m_sampler.name(i));
+                    item.text("\":[");
+                    item.number(s.min, m_precision);
+                    item.text(",");
+                    item.number(s.mean, m_precision);
+                    item.text(",");
+                    item.number(s.max, m_precision);
+                    item.text("]");
+
+                    if(!item.ok)
+                    {
+                        // The next message starts with this channel, unless it is alone already
+                        if(!empty) break;
+                        m_truncated++;
+                        continue;
+                    }
+
+                    out.p = item.p;
+                    empty = false;
+                }
+
+                first = i < channels ? i : w.channels;
+                out.text("}}");
+                return out.p - buffer;
+            }
+
+            /*
+                Channel metadata from the peripheral descriptors, sent once so
+                windows can stay compact:
+                {"<name>":{"kind":"ThermalSensor","type":"float","unit":"degC"},...}
+                Like encode(), channels from first on until the buffer is
+                full; the parts together describe every channel.
+            */
+            size_t encode_meta(char* buffer, size_t size, size_t& first)
+            {
+                Writer out{buffer, buffer + size, true};
+                out.text("{");
+
+                bool empty = true;
+                size_t i = first;
+                for(; i < m_sampler.channels(); ++i)
+                {
+                    auto& d = m_sampler.descriptor(i);
+
+                    Writer item{out.p, out.end - 1, true};
+                    if(!empty) item.text(",");
+                    item.text("\"");
+                    item.text(m_sampler.name(i));
+                    item.text("\":{\"kind\":\"");
+                    item.text(d.kind);
+                    item.text("\",\"type\":\"");
+                    item.text(value_type_name(d.type));
+                    item.text("\",\"unit\":\"");
+                    item.text(d.unit);
+                    item.text("\"}");
+
+                    if(!item.ok)
+                    {
+                        if(!empty) break;
+                        m_truncated++;
+                        continue;
+                    }
+
+                    out.p = item.p;
+                    empty = false;
+                }
+
+                first = i;
+                out.text("}");
+                return out.p - buffer;
+            }
+
+            uint32_t truncated() const { return m_truncated; }
+
+        private:
+            struct Writer
+            {
+                char* p;
+                char* end;
+                bool ok;
+
+                void text(const char* s)
+                {
+                    auto n = std::strlen(s);
+                    if(!ok || end - p < (ptrdiff_t)n)
+                    {
+                        ok = false;
+                        return;
+                    }
+                    std::memcpy(p, s, n);
+                    p += n;
+                }
+
+                // JSON has no NaN or infinity
+                void number(float value, int precision)
+                {
+                    if(!std::isfinite(value)) return text("null");
+                    if(!ok) return;
+                    auto r = to_chars(p, end, value, precision);
+                    if(r.ec != std::errc()) ok = false;
+                    else p = r.ptr;
+                }
+
+                void number(unsigned value)
+                {
+                    if(!ok) return;
+                    auto r = to_chars(p, end, value);
+                    if(r.ec != std::errc()) ok = false;
+                    else p = r.ptr;
+                }
+            };
+
+            const Sampler& m_sampler;
+            int m_precision;
+            size_t m_next;
+            uint32_t m_truncated;
+        };
+
+        /*
+            Sends queued messages as one JSON array per publish, once batch
+            messages are waiting or the oldest has waited linger seconds.
+            Messages leave the queue only after the sink accepted them.
+
+            A payload never exceeds max_payload, the most the transport
+            takes. After a rejected batch the next attempt carries half as
+            many messages, down to one, so a batch the transport refuses for
+            its size is split rather than retried whole forever; a message
+            longer than max_payload on its own can never be sent and is
+            discarded.
+        */
+        class Publisher
+        {
+        public:
+            Publisher(size_t batch, float linger, size_t max_payload = VC_TELEMETRY_BATCH_SIZE) :
+                m_batch(batch),
+                m_limit(batch),
+                m_max_payload(max_payload < VC_TELEMETRY_BATCH_SIZE ? max_payload : VC_TELEMETRY_BATCH_SIZE),
+                m_linger(linger * 1e6f),
+                m_waiting(false),
+                m_waiting_since(0),
+                m_published(0),
+                m_batches(0),
+                m_failed(0),
+                m_discarded(0)
+                {}
+
+            // sink(const char* data, size_t size) returns true when the payload was sent
+            template<typename TSink>
+            bool process(uint32_t now, MessageQueue& in, TSink&& sink)
+            {
+                if(in.empty())
+                {
+                    m_waiting = false;
+                    return true;
+                }
+
+                if(!m_waiting)
+                {
+                    m_waiting = true;
+                    m_waiting_since = now;
+                }
+                if(in.size() < m_batch && now - m_waiting_since < m_linger) return true;
+
+                while(!in.empty() && in.front().size + 2 > m_max_payload)
+                {
+                    in.pop();
+                    m_discarded++;
+                }
+                if(in.empty()) return true;
+
+                // The batch takes as many messages as fit, at least the first
+                size_t length = 1, count = 0;
+                m_payload[0] = '[';
+                while(count < in.size() && count < m_limit)
+                {
+                    auto& message = in.at(count);
+                    if(length + (count ? 1 : 0) + message.size + 1 > m_max_payload) break;
+                    if(count) m_payload[length++] = ',';
+                    std::memcpy(m_payload + length, message.data, message.size);
+                    length += message.size;
+                    count++;
+                }
+                m_payload[length++] = ']';
+
+                if(!sink(static_cast<const char*>(m_payload), length))
+                {
+                    m_failed++;
+                    m_limit = count > 1 ? count / 2 : 1;
+                    return false;
+                }
+
+                for(size_t i = 0; i < count; ++i)
+                    in.pop();
+
+                m_published += count;
+                m_batches++;
+                m_limit = m_batch;
+                m_waiting = !in.empty();
+                m_waiting_since = now;
+                return true;
+            }
+
+            uint32_t published() const { return m_published; }
+            uint32_t batches() const { return m_batches; }
+            uint32_t failed() const { return m_failed; }
+            uint32_t discarded() const { return m_discarded; }
+
+        private:
+            static_assert(VC_TELEMETRY_BATCH_SIZE >= VC_TELEMETRY_MESSAGE_SIZE + 2, "A message must fit in a batch");
+
+            size_t m_batch, m_limit, m_max_payload;
+            uint32_t m_linger;
+            bool m_waiting;
+            uint32_t m_waiting_since;
+            uint32_t m_published, m_batches, m_failed, m_discarded;
+            char m_payload[VC_TELEMETRY_BATCH_SIZE];
+        };
+    }
+
+    class Telemetry
+    {
+    public:
+        struct Stats
+        {
+            uint32_t dropped;   // Snapshots lost because the pipeline was full
+            uint32_t stalled;   // Stage runs held back by a full downstream queue
+            uint32_t truncated; // Channels too long for a message of their own
+            uint32_t published; // Messages accepted by the sink
+            uint32_t failed;    // Rejected publishes, retried later
+            uint32_t discarded; // Messages longer than the transport takes
+        };
+
+        Telemetry(float interval, float window, size_t batch, float linger, size_t max_payload = VC_TELEMETRY_BATCH_SIZE) :
+            m_sampler(interval),
+            m_aggregator(window),
+            m_encoder(m_sampler),
+            m_publisher(batch, linger, max_payload)
+            {}
+
+        telemetry::Sampler& sampler() { return m_sampler; }
+        telemetry::Aggregator& aggregator() { return m_aggregator; }
+
+        // Channel metadata from channel first on, see Encoder::encode_meta
+        size_t describe(char* buffer, size_t size, size_t& first) { return m_encoder.encode_meta(buffer, size, first); }
+
+        // Runs every stage once, the publisher first so it frees room upstream
+        template<typename TSink>
+        void update(uint32_t now, TSink&& sink)
+        {
+            m_publisher.process(now, m_messages, sink);
+            m_encoder.process(m_windows, m_messages);
+            m_aggregator.process(m_snapshots, m_windows);
+            m_sampler.poll(now, m_snapshots);
+        }
+
+        Stats stats() const
+        {
+            return Stats{
+                m_snapshots.dropped(),
+                m_windows.stalled() + m_messages.stalled(),
+                m_encoder.truncated(),
+                m_publisher.published(),
+                m_publisher.failed(),
+                m_publisher.discarded()
+            };
+        }
+
+    private:
+        telemetry::Sampler m_sampler;
+        telemetry::Aggregator m_aggregator;
+        telemetry::Encoder m_encoder;
+        telemetry::Publisher m_publisher;
+
+        telemetry::SnapshotQueue m_snapshots;
+        telemetry::WindowQueue m_windows;
+        telemetry::MessageQueue m_messages;
+    };
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#ifndef VC_TRACE
+    #define VC_TRACE 1
+#endif
+
+#ifndef VC_TRACE_CAPACITY
+    #define VC_TRACE_CAPACITY 256
+#endif
+
+#if defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_7M__)
+    #include <mbed.h>
+    #define VC_TRACE_DWT 1
+#else
+    #include <chrono>
+#endif
+
+namespace ventctl
+{
+    /*
+        Scoped timing zones recorded into a fixed RAM ring.
+
+        On Cortex-M the DWT cycle counter is used, the native build counts
+        nanoseconds of std::chrono::steady_clock. Zones cost a load and a
+        branch while tracing is off and compile to nothing with VC_TRACE=0.
+        Only the main thread may record, interrupts are not traced.
+
+        dump() prints one line per event for tools/trace2chrome.py:
+            T <counter frequency> <event count>
+            E <zone> <start> <duration>
+    */
+    class Trace
+    {
+    public:
+        struct Event
+        {
+            const char* zone;
+            uint32_t start, duration;
+        };
+
+        static void enable(bool on = true)
+        {
+            if(on) init_counter();
+            s_enabled = on;
+        }
+
+        static bool enabled()
+        {
+            return s_enabled;
+        }
+
+        static void clear()
+        {
+            s_head = 0;
+            s_count = 0;
+        }
+
+        static uint32_t now()
+        {
+        #ifdef VC_TRACE_DWT
+            return DWT->CYCCNT;
+        #else
+            using namespace std::chrono;
+            return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        #endif
+        }
+
+        static uint32_t frequency()
+        {
+        #ifdef VC_TRACE_DWT
+            return SystemCoreClock;
+        #else
+            return 1000000000;
+        #endif
+        }
+
+        static void record(const char* zone, uint32_t start, uint32_t end)
+        {
+            s_events[s_head] = Event{zone, start, end - start};
+            s_head = (s_head + 1) % VC_TRACE_CAPACITY;
+            if(s_count < VC_TRACE_CAPACITY) s_count++;
+        }
+
+        static size_t count()
+        {
+            return s_count;
+        }
+
+        // Oldest first
+        static const Event& event(size_t i)
+        {
+            return s_events[(s_head + VC_TRACE_CAPACITY - s_count + i) % VC_TRACE_CAPACITY];
+        }
+
+        // Writes the ring through write(const char* line), tracing is paused meanwhile
+        template<typename F>
+        static void dump(F&& write)
+        {
+            auto was_enabled = s_enabled;
+            s_enabled = false;
+
+            char line[64];
+            snprintf(line, sizeof(line), "T %lu %u\n", (unsigned long)frequency(), (unsigned)s_count);
+            write(line);
+
+            for(size_t i = 0; i < s_count; ++i)
+            {
+                auto& e = event(i);
+                snprintf(line, sizeof(line), "E %s %lu %lu\n", e.zone, (unsigned long)e.start, (unsigned long)e.duration);
+                write(line);
+            }
+
+            s_enabled = was_enabled;
+        }
+
+    private:
+        static void init_counter()
+        {
+        #ifdef VC_TRACE_DWT
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+            DWT->CYCCNT = 0;
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        #endif
+        }
+
+        inline static bool s_enabled = false;
+        inline static size_t s_head = 0, s_count = 0;
+        inline static Event s_events[VC_TRACE_CAPACITY];
+    };
+
+    class TraceZone
+    {
+    public:
+        explicit TraceZone(const char* zone) :
+            m_zone(zone),
+            m_active(Trace::enabled()),
+            m_start(m_active ? Trace::now() : 0)
+            {}
+
+        ~TraceZone()
+        {
+            if(m_active) Trace::record(m_zone, m_start, Trace::now());
+        }
+
+        TraceZone(const TraceZone&) = delete;
+        TraceZone& operator=(const TraceZone&) = delete;
+
+    private:
+        const char* m_zone;
+        bool m_active;
+        uint32_t m_start;
+    };
+}
+
+#define VC_TRACE_CONCAT_(a, b) a##b
+#define VC_TRACE_CONCAT(a, b) VC_TRACE_CONCAT_(a, b)
+
+#if VC_TRACE
+    // Zone names must not contain spaces and must outlive the ring (string literals)
+    #define VC_TRACE_ZONE(name) ::ventctl::TraceZone VC_TRACE_CONCAT(vc_trace_zone_, __LINE__)(name)
+#else
+    #define VC_TRACE_ZONE(name) do {} while(0)
+#endif
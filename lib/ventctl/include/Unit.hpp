@@ -1,18 +1,42 @@
 #pragma once
 #include <functional>
+#include <cmath>
 #include <etl/vector.h>
+#include <type_traits>
 #include <Peripheral.hpp>
 
+#ifndef VC_UNIT_MAX_INPUTS
+    #define VC_UNIT_MAX_INPUTS 4
+#endif
+
 namespace ventctl
 {
+    /*
+        Units are evaluated lazily and incrementally. A unit that registered
+        its inputs with dependsOn() is only recomputed when one of them
+        changed by more than its epsilon since the last evaluation; otherwise
+        the cached value is returned. Units without registered inputs
+        (sources) and time dependent units (integrators, filters) are
+        recomputed on every tick.
+    */
     class UnitBase
     {
     public:
+        struct Stats
+        {
+            uint32_t evaluated, skipped;
+        };
+
         virtual float getValueUncached(float time) = 0;
 
         UnitBase() : 
             m_last(0),
-            m_last_time(0){}
+            m_last_time(0),
+            m_previous_time(0),
+            m_changed_time(-INFINITY),
+            m_epsilon(0),
+            m_time_dependent(false),
+            m_valid(false){}
 
         virtual void setLastTime(float time)
         {
@@ -24,12 +48,40 @@ namespace ventctl
             return m_last_time;
         }
 
+        /*
+            Time of the evaluation before the current one. getLastTime()
+            already holds the current time inside getValueUncached(), so
+            units that integrate take their dt from this.
+        */
+        float getPreviousTime()
+        {
+            return m_previous_time;
+        }
+
         virtual float getValue(float time)
         {
             if(m_last_time < time)
             {
+                auto previous = m_last_time;
                 m_last_time = time;
-                m_last = getValueUncached(time);
+
+                if(needsUpdate(previous, time))
+                {
+                    m_previous_time = previous;
+                    auto value = getValueUncached(time);
+                    s_stats.evaluated++;
+
+                    if(!m_valid || !(std::fabs(value - m_last) <= m_epsilon))
+                    {
+                        m_last = value;
+                        m_changed_time = time;
+                    }
+                    m_valid = true;
+                }
+                else
+                {
+                    s_stats.skipped++;
+                }
             }  
 
             return m_last;
@@ -39,11 +91,70 @@ namespace ventctl
         {
             return m_last;
         }
+
+        // Changes smaller than epsilon are not propagated downstream
+        void setEpsilon(float epsilon)
+        {
+            m_epsilon = epsilon;
+        }
+
+        bool isTimeDependent() const
+        {
+            return m_time_dependent || m_inputs.empty();
+        }
+
+        // Counters since the last call, the main loop takes them once per tick
+        static Stats takeStats()
+        {
+            auto stats = s_stats;
+            s_stats = Stats{0, 0};
+            return stats;
+        }
+
+    protected:
+        void dependsOn(UnitBase& input)
+        {
+            // Too many inputs to track, fall back to evaluating every tick
+            if(m_inputs.full())
+                m_time_dependent = true;
+            else
+                m_inputs.push_back(&input);
+        }
+
+        void setTimeDependent(bool value = true)
+        {
+            m_time_dependent = value;
+        }
+
     private:
-        float m_last, m_last_time;
-    
+        bool needsUpdate(float previous, float time)
+        {
+            if(!m_valid || isTimeDependent()) return true;
+
+            bool changed = false;
+            for(auto input : m_inputs)
+            {
+                input->getValue(time);
+                if(input->m_changed_time > previous) changed = true;
+            }
+
+            return changed;
+        }
+
+        float m_last, m_last_time, m_previous_time, m_changed_time, m_epsilon;
+        bool m_time_dependent, m_valid;
+        etl::vector<UnitBase*, VC_UNIT_MAX_INPUTS> m_inputs;
+
+        inline static Stats s_stats = {0, 0};
     };
 
+    // Wrapped types declare `static constexpr bool time_dependent = false` when nextValue() is a pure function of the input
+    template<typename T, typename = void>
+    struct is_time_dependent : std::true_type {};
+
+    template<typename T>
+    struct is_time_dependent<T, std::void_t<decltype(T::time_dependent)>> : std::integral_constant<bool, T::time_dependent> {};
+
     template<typename T>
     class Unit : public UnitBase
     {
@@ -51,7 +162,10 @@ namespace ventctl
         Unit(T& value, UnitBase& input) :
             m_unit(value),
             m_input(input)
-        {}
+        {
+            dependsOn(input);
+            setTimeDependent(is_time_dependent<T>::value);
+        }
 
         virtual void setLastTime(float time)
         {
@@ -77,7 +191,11 @@ namespace ventctl
     public:
         using input_vec_type = etl::vector<std::pair<UnitRef, bool>, 4>;
 
-        Sum(input_vec_type vec) : m_inputs(vec){}
+        Sum(input_vec_type vec) : m_inputs(vec)
+        {
+            for(auto& input : m_inputs)
+                dependsOn(input.first.get());
+        }
 
         virtual void setLastTime(float time)
         {
@@ -113,7 +231,9 @@ namespace ventctl
             m_input(input),
             m_last(0),
             m_last_time(0)
-        {}
+        {
+            dependsOn(input);
+        }
 
         virtual void setLastTime(float time)
         {
@@ -132,31 +252,92 @@ namespace ventctl
         UnitBase &m_input;
     };
 
+    /*
+        Reads a peripheral into the graph. While the peripheral reports a
+        quality other than GOOD, the reading is replaced by the redundant
+        sensor if that one is GOOD, else by the model unit, else by the
+        last good value, or by the default before any good one, so a
+        failed sensor never drives the loop to an extreme.
+    */
     class Source : public UnitBase
     {
     public:
         using source_type = Peripheral<float>;
 
-        Source(source_type& src) : m_source(src) {}
+        Source(source_type& src, float epsilon = 0) :
+            m_source(src),
+            m_redundant(nullptr),
+            m_model(nullptr),
+            m_substituted(false),
+            m_seen_good(false),
+            m_default(0)
+        {
+            setEpsilon(epsilon);
+        }
+
+        void setRedundant(source_type& redundant)
+        {
+            m_redundant = &redundant;
+        }
+
+        // Evaluated only while substituting, so it is not a tracked input
+        void setModel(UnitBase& model)
+        {
+            m_model = &model;
+        }
+
+        // Used when the source is faulted from boot and nothing else is available
+        void setDefault(float value)
+        {
+            m_default = value;
+        }
 
         virtual void setLastTime(float)
         {}
 
         virtual float getValueUncached(float time)
         {
-            return m_source.read_value();
+            m_substituted = m_source.quality() != Quality::GOOD;
+            if(!m_substituted)
+            {
+                m_seen_good = true;
+                return m_source.read_value();
+            }
+
+            if(m_redundant && m_redundant->quality() == Quality::GOOD)
+                return m_redundant->read_value();
+            if(m_model)
+                return m_model->getValue(time);
+            return m_seen_good ? getLast() : m_default;
+        }
+
+        Quality quality() const
+        {
+            return m_source.quality();
+        }
+
+        // Whether the last evaluation used something other than the source
+        bool substituted() const
+        {
+            return m_substituted;
         }
 
     private:
         source_type& m_source;
-
+        source_type* m_redundant;
+        UnitBase* m_model;
+        bool m_substituted, m_seen_good;
+        float m_default;
     };
 
     template<typename TLim>
     class Relay : public UnitBase
     {
     public:
-        Relay(TLim off, TLim on, UnitBase& src) : m_off(off), m_on(on), m_source(src){}
+        Relay(TLim off, TLim on, UnitBase& src) : m_off(off), m_on(on), m_source(src)
+        {
+            dependsOn(src);
+        }
 
         virtual float getValueUncached(float time)
         {
@@ -209,41 +390,95 @@ namespace ventctl
     template<typename T>
     using PeriphRef = std::reference_wrapper<Peripheral<T>>;
 
+    /*
+        A set of on/off stages switched by a sink. Stage i is bit i of
+        mask and pattern; an implementation backed by one GPIO port
+        (DOutBank) switches all of them in a single write, so no
+        intermediate combination is ever driven.
+    */
+    class StageBank
+    {
+    public:
+        virtual size_t stages() const = 0;
+        virtual void write_stages(uint32_t mask, uint32_t pattern) = 0;
+
+        // Mask of the first n stages
+        static uint32_t mask(size_t n)
+        {
+            return n < 32 ? (1u << n) - 1 : ~0u;
+        }
+    };
+
+    // Individual peripherals as a bank, written one after another
+    class PeripheralStages : public StageBank
+    {
+    public:
+        explicit PeripheralStages(etl::ivector<PeriphRef<bool>>* peripherals) :
+            m_peripherals(peripherals)
+            {}
+
+        virtual size_t stages() const
+        {
+            return m_peripherals ? m_peripherals->size() : 0;
+        }
+
+        virtual void write_stages(uint32_t mask, uint32_t pattern)
+        {
+            for(size_t i = 0; i < stages(); ++i)
+            {
+                if(!(mask & (1u << i))) continue;
+                bool on = pattern & (1u << i);
+                (*m_peripherals)[i].get().accept_value(on);
+            }
+        }
+
+    private:
+        etl::ivector<PeriphRef<bool>>* m_peripherals;
+    };
+
 
     class SteppedOutputSink : public SinkBase
     {
     public:
         SteppedOutputSink(UnitBase& source, etl::ivector<PeriphRef<bool>>& peripherals, bool ordered = false) :
             m_source(source),
-            m_peripherals(peripherals),
+            m_refs(&peripherals),
+            m_bank(m_refs),
+            m_ordered(ordered)
+            {}
+
+        SteppedOutputSink(UnitBase& source, StageBank& bank, bool ordered = false) :
+            m_source(source),
+            m_refs(nullptr),
+            m_bank(bank),
             m_ordered(ordered)
             {}
 
         virtual void update(float time)
         {
+            auto n = m_bank.stages();
+            uint32_t pattern;
+
             if(m_ordered)
             {
-                auto max_value = (float)((1 << m_peripherals.size()) - 1);
-
-                auto scaled = (uint8_t)std::round(max_value * m_source.getValue(time));
+                auto max_value = (float)((1 << n) - 1);
 
-                for(uint8_t i = 0; i < m_peripherals.size(); ++i)
-                {
-                    m_peripherals[i].get() = (scaled & i) != 0;
-                }
+                pattern = (uint8_t)std::round(max_value * m_source.getValue(time));
             }
             else
             {
-                auto scaled = (uint8_t)std::round(m_peripherals.size() * m_source.getValue(time));
+                auto scaled = (uint8_t)std::round(n * m_source.getValue(time));
 
-                for(uint8_t i = 0; i < m_peripherals.size(); ++i)
-                    m_peripherals[i].get() = scaled <= i;
+                pattern = StageBank::mask(scaled);
             }
+
+            m_bank.write_stages(StageBank::mask(n), pattern);
         }
 
     private:
         UnitBase& m_source;
-        etl::ivector<PeriphRef<bool>>& m_peripherals;
+        PeripheralStages m_refs;
+        StageBank& m_bank;
         bool m_ordered;
     };
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <Peripheral.hpp>
+#include <charconv.hpp>
 
 namespace ventctl
 {
@@ -30,7 +31,9 @@ namespace ventctl
     protected:
         void print(file_t file, float value)
         {
-            fprintf(file, "= %1.2f", value);
+            char buffer[24];
+            auto result = to_chars(buffer, buffer + sizeof(buffer), value, 2);
+            fprintf(file, "= %.*s", (int)(result.ptr - buffer), buffer);
         }
     };
 
@@ -50,7 +53,7 @@ namespace ventctl
     protected:
         void print(file_t file, T value)
         {
-            fprintf(file, "= (%s*) %p", typeid(value).name(), value);
+            fprintf(file, "= %p", (void*)value);
         }
     };
 
@@ -64,6 +67,8 @@ namespace ventctl
         {     
         }
 
+        VC_PERIPHERAL_DESCRIPTOR(T, "Variable", "", PeripheralDescriptor::VARIABLE, PeripheralDescriptor::READABLE | PeripheralDescriptor::WRITABLE)
+
         virtual bool accept_value(T& t)
         {
             m_value = t;
@@ -1,68 +1,338 @@
 #pragma once
 #include <charconv>
-#include <cstdlib>
+#include <cstdint>
 #include <cstring>
+#include <limits>
+#include <type_traits>
 #include <etl/error_handler.h>
+#include <etl/string_view.h>
 
 namespace ventctl
 {
+    /*
+        Locale-free number conversion without libc, used instead of strtof
+        and printf("%f") on the terminal and in telemetry.
 
-    template<typename T>
-    T convert(const char* buf, char ** end)
+        from_chars accepts [+-]digits[.digits][(e|E)[+-]digits] for floating
+        point and [+-]digits for integers, parsing in place. Up to 19
+        significant digits are kept; when they fit in 53 bits and the decimal
+        exponent is within +-22 the result is correctly rounded (exact powers
+        of ten in double), so text produced by to_chars reads back to the
+        same value. Outside that range the error is at most a few ulp.
+
+        to_chars writes fixed point with a given number of decimals (like
+        "%.*f", ties to even, but never "-0.00"), or integers. Magnitudes
+        from 1e19 on, past the 64 bit whole part, are written in exponent
+        form with as many decimals ("1.50e+20"); NaN and infinity come out
+        as "nan" and "inf", which JSON writers must replace themselves.
+        Nothing is null-terminated.
+    */
+    namespace detail
     {
-        *end = buf;
-        return T();
+        constexpr const double pow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        inline bool is_digit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        // Writes the digits of value right-aligned ending at end, returns the first one
+        inline char* write_digits(char* end, uint64_t value)
+        {
+            do
+            {
+                *--end = '0' + value % 10;
+                value /= 10;
+            }
+            while(value);
+            return end;
+        }
+
+        // Rounding error of a * b (Dekker), exact without an FMA instruction
+        inline double product_error(double a, double b, double product)
+        {
+            constexpr double split = 134217729.0; // 2^27 + 1
+            double ta = split * a, tb = split * b;
+            double ahi = ta - (ta - a), alo = a - ahi;
+            double bhi = tb - (tb - b), blo = b - bhi;
+            return ((ahi * bhi - product) + ahi * blo + alo * bhi) + alo * blo;
+        }
+
+        inline double scale(double value, int exponent)
+        {
+            while(exponent > 22)
+            {
+                value *= 1e22;
+                exponent -= 22;
+            }
+            while(exponent < -22)
+            {
+                value /= 1e22;
+                exponent += 22;
+            }
+            return exponent >= 0 ? value * pow10[exponent] : value / pow10[-exponent];
+        }
     }
 
-    template<>
-    float convert<float>(const char* buf, char** end)
+    template<typename T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value, int> = 0>
+    std::from_chars_result from_chars(const char* first, const char* last, T& value)
     {
-        return std::strtof(buf, end);
+        using U = std::make_unsigned_t<T>;
+
+        auto p = first;
+        bool negative = false;
+
+        if(p != last && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            if(negative && !std::is_signed<T>::value) return {first, std::errc::invalid_argument};
+            ++p;
+        }
+
+        if(p == last || !detail::is_digit(*p)) return {first, std::errc::invalid_argument};
+
+        U limit = negative ? U(std::numeric_limits<T>::max()) + 1 : U(std::numeric_limits<T>::max());
+        U result = 0;
+        bool overflow = false;
+
+        for(; p != last && detail::is_digit(*p); ++p)
+        {
+            U digit = *p - '0';
+            if(result > (limit - digit) / 10)
+                overflow = true;
+            else
+                result = result * 10 + digit;
+        }
+
+        if(overflow) return {p, std::errc::result_out_of_range};
+
+        value = negative ? T(U(0) - result) : T(result);
+        return {p, std::errc()};
     }
 
-    template<>
-    double convert<double>(const char* buf, char** end)
+    template<typename T, std::enable_if_t<std::is_floating_point<T>::value, int> = 0>
+    std::from_chars_result from_chars(const char* first, const char* last, T& value)
     {
-        return std::strtod(buf, end);
+        auto p = first;
+        bool negative = false;
+
+        if(p != last && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int exponent = 0, digits = 0, significant = 0;
+
+        for(; p != last && detail::is_digit(*p); ++p, ++digits)
+        {
+            if(significant < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if(mantissa) significant++;
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+
+        if(p != last && *p == '.')
+        {
+            ++p;
+            for(; p != last && detail::is_digit(*p); ++p, ++digits)
+            {
+                if(significant < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    exponent--;
+                    if(mantissa) significant++;
+                }
+            }
+        }
+
+        if(digits == 0) return {first, std::errc::invalid_argument};
+
+        if(p != last && (*p == 'e' || *p == 'E'))
+        {
+            auto q = p + 1;
+            bool exp_negative = false;
+            if(q != last && (*q == '-' || *q == '+'))
+            {
+                exp_negative = *q == '-';
+                ++q;
+            }
+
+            if(q != last && detail::is_digit(*q))
+            {
+                int exp = 0;
+                for(; q != last && detail::is_digit(*q); ++q)
+                {
+                    if(exp < 10000) exp = exp * 10 + (*q - '0');
+                }
+                exponent += exp_negative ? -exp : exp;
+                p = q;
+            }
+        }
+
+        // Exact for mantissa <= 2^53 and |exponent| <= 22, clamped far outside the double range
+        double result = 0.0;
+        if(mantissa != 0 && exponent > -400)
+            result = detail::scale((double)mantissa, exponent < 400 ? exponent : 400);
+
+        auto converted = static_cast<T>(negative ? -result : result);
+
+        // Overflow to infinity or underflow to zero, value is left untouched like std::from_chars
+        if((converted == 0 && mantissa != 0) || converted - converted != 0)
+            return {p, std::errc::result_out_of_range};
+
+        value = converted;
+        return {p, std::errc()};
     }
 
-    template<>
-    int convert<int>(const char* buf, char** end)
+    template<typename T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value, int> = 0>
+    std::to_chars_result to_chars(char* first, char* last, T value)
     {
-        return std::strtol(buf, end, 10); // TODO
+        using U = std::make_unsigned_t<T>;
+        char buffer[24];
+        auto end = buffer + sizeof(buffer);
+
+        U magnitude = value < 0 ? U(0) - U(value) : U(value);
+        auto begin = detail::write_digits(end, magnitude);
+        if(value < 0) *--begin = '-';
+
+        if(last - first < end - begin) return {last, std::errc::value_too_large};
+
+        std::memcpy(first, begin, end - begin);
+        return {first + (end - begin), std::errc()};
     }
 
-    template<typename T>
-    std::from_chars_result from_chars(const char* b, const char* e, T& v)
+    // Fixed point with precision (0..9) decimals
+    template<typename T, std::enable_if_t<std::is_floating_point<T>::value, int> = 0>
+    std::to_chars_result to_chars(char* first, char* last, T value, int precision)
     {
-        std::from_chars_result result;
+        char buffer[48];
+        auto end = buffer + sizeof(buffer);
+        auto begin = end;
 
-        constexpr std::size_t buf_size = 64;
-        VC_ASSERT(e > b, "Invalid string");
-        VC_ASSERT((e - b) < buf_size, "String is too long");
-        char buffer[buf_size] = {0};
-        char* end;
-        std::memcpy(buffer, b, (e - b));
-        v = convert<T>(buffer, &end);
+        if(precision < 0) precision = 0;
+        if(precision > 9) precision = 9;
 
-        result.ec = std::errc();
+        double v = value;
+        bool negative = v < 0;
+        if(negative) v = -v;
 
-        if(end == buffer) result.ec = std::errc::invalid_argument;
+        if(v != v)
+        {
+            begin -= 3;
+            std::memcpy(begin, "nan", 3);
+            negative = false;
+        }
+        else if(v > 1.7976931348623157e308)
+        {
+            begin -= 3;
+            std::memcpy(begin, "inf", 3);
+        }
+        else if(v >= 1e19)
+        {
+            // Out of the fixed range: d.ddde+XX, the mantissa rounded half up
+            int exponent = 0;
+            while(v >= 1e22)
+            {
+                v /= 1e22;
+                exponent += 22;
+            }
+            int k = 22;
+            while(k > 0 && v < detail::pow10[k]) --k;
+            v /= detail::pow10[k];
+            exponent += k;
+            if(v < 1)
+            {
+                v *= 10;
+                exponent--;
+            }
 
-        if(errno == ERANGE) result.ec = std::errc::result_out_of_range;
+            auto digits = (uint64_t)(v * detail::pow10[precision] + 0.5);
+            if(digits >= (uint64_t)detail::pow10[precision + 1])
+            {
+                digits = (digits + 5) / 10;
+                exponent++;
+            }
+
+            begin = detail::write_digits(begin, (uint64_t)exponent);
+            if(exponent < 10) *--begin = '0';
+            *--begin = '+';
+            *--begin = 'e';
+            for(int i = 0; i < precision; ++i)
+            {
+                *--begin = '0' + digits % 10;
+                digits /= 10;
+            }
+            if(precision > 0) *--begin = '.';
+            *--begin = '0' + digits;
+        }
+        else
+        {
+            // Whole and fractional parts are rounded together so 0.999 -> "1.00", ties to even
+            uint64_t whole = (uint64_t)v;
+            double part = v - (double)whole;
+            double scaled = part * detail::pow10[precision];
+            uint64_t fraction = (uint64_t)scaled;
+            double remainder = scaled - (double)fraction;
 
-        result.ptr = b + (end - buffer);
+            if(remainder == 0.5)
+            {
+                // A tie after rounding the product, the exact product decides
+                auto error = detail::product_error(part, detail::pow10[precision], scaled);
+                if(error > 0 || (error == 0 && ((precision ? fraction : whole) & 1)))
+                    fraction++;
+            }
+            else if(remainder > 0.5)
+            {
+                fraction++;
+            }
 
-        return result;
+            if(fraction >= (uint64_t)detail::pow10[precision])
+            {
+                fraction -= (uint64_t)detail::pow10[precision];
+                whole++;
+            }
+
+            // No "-0.00"
+            if(whole == 0 && fraction == 0) negative = false;
+
+            if(precision > 0)
+            {
+                for(int i = 0; i < precision; ++i)
+                {
+                    *--begin = '0' + fraction % 10;
+                    fraction /= 10;
+                }
+                *--begin = '.';
+            }
+
+            begin = detail::write_digits(begin, whole);
+        }
+
+        if(negative) *--begin = '-';
+
+        if(last - first < end - begin) return {last, std::errc::value_too_large};
+
+        std::memcpy(first, begin, end - begin);
+        return {first + (end - begin), std::errc()};
     }
 
-    template<typename T> 
+    template<typename T>
     T parse_arg(etl::string_view& v, etl::exception* exc)
     {
         auto first = v.begin();
         auto last = v.end();
 
-        T value;
+        T value = T();
 
         std::from_chars_result result = ventctl::from_chars<T>(first, last, value);
 
@@ -77,7 +347,7 @@ namespace ventctl
     }
 
     template<>
-    bool parse_arg<bool>(etl::string_view& v, etl::exception* exc)
+    inline bool parse_arg<bool>(etl::string_view& v, etl::exception* exc)
     {
         if(v.starts_with("true"))
         {
@@ -101,7 +371,7 @@ namespace ventctl
     }
 
     template<>
-    etl::string_view parse_arg<etl::string_view>(etl::string_view& v, etl::exception* exc)
+    inline etl::string_view parse_arg<etl::string_view>(etl::string_view& v, etl::exception* exc)
     {
         auto pos = v.find_first_of(" \t\r\n");
 
@@ -115,4 +385,4 @@ namespace ventctl
         else
             return v.substr(0, pos);
     }
-}
\ No newline at end of file
+}
@@ -1,11 +1,23 @@
 #include <AIn.hpp>
+#include <AdcScan.hpp>
 
 
 ventctl::AIn::AIn(const char* name, PinName pin) :
     Peripheral<float>(name),
-    m_in(pin)
+    m_channel(AdcScan::channel(pin)),
+    m_slot(-1),
+    m_cal(name, 1 / 3.3f, 0)
     {}
 
+void ventctl::AIn::initialize()
+{
+    if(m_channel < 0) return;
+    AdcScan::configure_pin(m_channel);
+    m_slot = AdcScan::add(m_channel);
+    if(m_slot < 0)
+        printf("%s: no ADC scan slot, reads NAN once the scan runs\n", name());
+}
+
 bool ventctl::AIn::accept_value(float&)
 {
     return false;
@@ -13,7 +25,9 @@ bool ventctl::AIn::accept_value(float&)
 
 float ventctl::AIn::read_value()
 {
-    return m_in.read();
+    if(m_channel < 0) return NAN;
+    auto volts = AdcScan::running() ? AdcScan::voltage(m_slot) : AdcScan::convert(m_channel, 3);
+    return m_cal.apply(volts);
 }
 
 void ventctl::AIn::print(file_t file, bool s)
@@ -24,4 +38,3 @@ void ventctl::AIn::print(file_t file, bool s)
     else
         fprintf(file, "= %1.2f (%1.2fV)", read_value(), read_value() * 10.0);
 }
-
@@ -1,26 +1,165 @@
 #include <AOut.hpp>
 
+// DAC requests are on channel 7 of DMA1: DAC1 stream 5, DAC2 stream 6
+#define VC_AOUT_DMA_CHANNEL (7U << DMA_SxCR_CHSEL_Pos)
+#define VC_AOUT_DMA1_FLAGS (DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5)
+#define VC_AOUT_DMA2_FLAGS (DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6 | DMA_HIFCR_CDMEIF6 | DMA_HIFCR_CFEIF6)
+
+ventctl::AOut* ventctl::AOut::s_channels[2] = {nullptr, nullptr};
+
+static DMA_Stream_TypeDef* const dma_streams[2] = {DMA1_Stream5, DMA1_Stream6};
+
 ventctl::AOut::AOut(const char* name, PinName pin) :
     m_out(pin),
-    Peripheral<float>(name)
+    Peripheral<float>(name),
+    m_channel(pin == PA_5 ? 1 : 0),
+    m_slew(0),
+    m_shape(Ramp::Shape::LINEAR),
+    m_ramp(Ramp::hold(0)),
+    m_next(0),
+    m_running(false)
 {}
 
+void ventctl::AOut::ramp(float slew, Ramp::Shape shape)
+{
+    if(slew > 0 && !s_channels[m_channel])
+    {
+        s_channels[m_channel] = this;
+
+        __HAL_RCC_DMA1_CLK_ENABLE();
+        __HAL_RCC_TIM6_CLK_ENABLE();
+
+        // TIM6 update as TRGO at the ramp rate, APB1 timers run at twice PCLK1
+        if(!(TIM6->CR1 & TIM_CR1_CEN))
+        {
+            TIM6->PSC = HAL_RCC_GetPCLK1Freq() * 2 / 1000000 - 1;
+            TIM6->ARR = 1000000 / VC_AOUT_RAMP_RATE - 1;
+            TIM6->CR2 = TIM_CR2_MMS_1;
+            TIM6->CR1 = TIM_CR1_CEN;
+        }
+
+        auto stream = dma_streams[m_channel];
+        stream->CR = 0;
+        while(stream->CR & DMA_SxCR_EN);
+        DMA1->HIFCR = m_channel ? VC_AOUT_DMA2_FLAGS : VC_AOUT_DMA1_FLAGS;
+        stream->PAR = m_channel ? (uint32_t)&DAC->DHR12R2 : (uint32_t)&DAC->DHR12R1;
+        stream->M0AR = (uint32_t)m_buffer;
+        stream->CR = VC_AOUT_DMA_CHANNEL | DMA_SxCR_DIR_0 | DMA_SxCR_MINC | DMA_SxCR_CIRC |
+            DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0 | DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+
+        auto irq = m_channel ? DMA1_Stream6_IRQn : DMA1_Stream5_IRQn;
+        NVIC_SetVector(irq, m_channel ? (uint32_t)&dma2_irq : (uint32_t)&dma1_irq);
+        NVIC_EnableIRQ(irq);
+
+        m_ramp = Ramp::hold(m_out.read());
+    }
+
+    core_util_critical_section_enter();
+    m_slew = slew;
+    m_shape = shape;
+    if(slew <= 0 && m_running) stop();
+    core_util_critical_section_exit();
+}
+
 bool ventctl::AOut::accept_value(float& value)
 {
-    m_out.write(value);
+    if(m_slew <= 0)
+    {
+        m_out.write(value);
+        return true;
+    }
+
+    // The buffer holds m_ramp up to m_next, the new ramp continues from there.
+    // Writers that repeat the target every tick must not restart the ramp
+    core_util_critical_section_enter();
+    if(!m_ramp.targets(value))
+    {
+        auto t = m_running ? m_next / (float)VC_AOUT_RAMP_RATE : m_ramp.duration;
+        m_ramp = m_ramp.retarget(t, value, m_slew, m_shape);
+        m_next = 0;
+        if(!m_running) start();
+    }
+    core_util_critical_section_exit();
     return true;
 }
 
+void ventctl::AOut::start()
+{
+    auto stream = dma_streams[m_channel];
+    refill(m_buffer);
+    refill(m_buffer + VC_AOUT_RAMP_BUFFER / 2);
+
+    // Flags left from the last run must be clear before the stream is enabled again
+    while(stream->CR & DMA_SxCR_EN);
+    DMA1->HIFCR = m_channel ? VC_AOUT_DMA2_FLAGS : VC_AOUT_DMA1_FLAGS;
+    stream->NDTR = VC_AOUT_RAMP_BUFFER;
+    stream->CR |= DMA_SxCR_EN;
+
+    // Trigger on TIM6 TRGO (TSEL = 0) and take samples by DMA
+    auto shift = m_channel ? 16 : 0;
+    DAC->CR &= ~((DAC_CR_TSEL1 | DAC_CR_TEN1 | DAC_CR_DMAEN1) << shift);
+    DAC->CR |= (DAC_CR_TEN1 | DAC_CR_DMAEN1) << shift;
+    m_running = true;
+}
+
+void ventctl::AOut::stop()
+{
+    auto stream = dma_streams[m_channel];
+    auto shift = m_channel ? 16 : 0;
+
+    DAC->CR &= ~((DAC_CR_TEN1 | DAC_CR_DMAEN1) << shift);
+    stream->CR &= ~DMA_SxCR_EN;
+
+    // Without a trigger the holding register is output right away
+    auto code = Ramp::code(m_ramp.to);
+    if(m_channel)
+        DAC->DHR12R2 = code;
+    else
+        DAC->DHR12R1 = code;
+    m_running = false;
+}
+
+// Interrupt context, or with interrupts disabled
+void ventctl::AOut::refill(uint16_t* half)
+{
+    m_ramp.fill(VC_AOUT_RAMP_RATE, m_next, half, VC_AOUT_RAMP_BUFFER / 2);
+    m_next += VC_AOUT_RAMP_BUFFER / 2;
+}
+
+void ventctl::AOut::dma1_irq()
+{
+    auto isr = DMA1->HISR;
+    DMA1->HIFCR = VC_AOUT_DMA1_FLAGS;
+    s_channels[0]->on_dma(isr & DMA_HISR_HTIF5);
+}
+
+void ventctl::AOut::dma2_irq()
+{
+    auto isr = DMA1->HISR;
+    DMA1->HIFCR = VC_AOUT_DMA2_FLAGS;
+    s_channels[1]->on_dma(isr & DMA_HISR_HTIF6);
+}
+
+void ventctl::AOut::on_dma(bool half)
+{
+    // The other half is playing, samples m_next - N/2 .. m_next - 1; stop once all of it is at the target
+    constexpr uint32_t n = VC_AOUT_RAMP_BUFFER / 2;
+    if(m_next >= n && m_ramp.done((m_next - n) / (float)VC_AOUT_RAMP_RATE))
+        stop();
+    else
+        refill(half ? m_buffer : m_buffer + n);
+}
+
 void ventctl::AOut::print(ventctl::file_t file, bool s)
 {
     Peripheral<float>::print(file, s);
     if(s)
         fprintf(file, "=%1.2f", read_value());
     else
-        fprintf(file, "= %1.2f (%1.2fV)", read_value(), read_value() * 10.0);
+        fprintf(file, "= %1.2f (%1.2fV)%s", read_value(), read_value() * 10.0, m_running ? " ramping" : "");
 }
 
 float ventctl::AOut::read_value()
 {
     return m_out.read();
-}
\ No newline at end of file
+}
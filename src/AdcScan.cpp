@@ -0,0 +1,242 @@
+#include <AdcScan.hpp>
+#include <AdcMath.hpp>
+
+// ADC1 requests are on channel 0 of DMA2 stream 0
+#define VC_ADC_STREAM DMA2_Stream0
+#define VC_ADC_IRQ DMA2_Stream0_IRQn
+#define VC_ADC_FLAGS (DMA_LIFCR_CTCIF0 | DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTEIF0 | DMA_LIFCR_CDMEIF0 | DMA_LIFCR_CFEIF0)
+
+// 480 cycles, the minimum for VREFINT at 21 MHz
+#define VC_ADC_SMP 7U
+#define VC_ADC_VREFINT 17U
+
+uint8_t ventctl::AdcScan::s_channels[VC_ADC_CHANNELS];
+uint8_t ventctl::AdcScan::s_count = 0;
+bool ventctl::AdcScan::s_running = false;
+uint32_t ventctl::AdcScan::s_buffer[2 * VC_ADC_OVERSAMPLE * VC_ADC_CHANNELS];
+std::atomic<uint32_t> ventctl::AdcScan::s_seq(0);
+std::atomic<uint32_t> ventctl::AdcScan::s_blocks(0);
+std::atomic<uint32_t> ventctl::AdcScan::s_raw[VC_ADC_CHANNELS];
+std::atomic<uint32_t> ventctl::AdcScan::s_ref[VC_ADC_CHANNELS];
+
+struct adc_pin
+{
+    uint8_t port;   // 0 = GPIOA
+    uint8_t pin;
+};
+
+// ADC123_IN0..IN15
+static constexpr const adc_pin pinmap[] = {
+    {0, 0},
+    {0, 1},
+    {0, 2},
+    {0, 3},
+    {0, 4},
+    {0, 5},
+    {0, 6},
+    {0, 7},
+    {1, 0},
+    {1, 1},
+    {2, 0},
+    {2, 1},
+    {2, 2},
+    {2, 3},
+    {2, 4},
+    {2, 5}
+};
+
+static void set_sampling_time(ADC_TypeDef* adc, uint8_t channel, uint32_t smp)
+{
+    auto reg = channel > 9 ? &adc->SMPR1 : &adc->SMPR2;
+    auto shift = (channel % 10) * 3;
+    *reg = (*reg & ~(7U << shift)) | (smp << shift);
+}
+
+// Slot (0..15) of a regular sequence, the length is set separately
+static void set_sequence(ADC_TypeDef* adc, uint8_t slot, uint8_t channel)
+{
+    auto reg = slot < 6 ? &adc->SQR3 : slot < 12 ? &adc->SQR2 : &adc->SQR1;
+    auto shift = (slot % 6) * 5;
+    *reg = (*reg & ~(0x1FU << shift)) | ((uint32_t)channel << shift);
+}
+
+static void set_length(ADC_TypeDef* adc, uint8_t length)
+{
+    adc->SQR1 = (adc->SQR1 & ~ADC_SQR1_L) | ((uint32_t)(length - 1) << ADC_SQR1_L_Pos);
+}
+
+int ventctl::AdcScan::channel(PinName pin)
+{
+    for(uint8_t i = 0; i < sizeof(pinmap) / sizeof(pinmap[0]); ++i)
+    {
+        if(pinmap[i].port == STM_PORT(pin) && pinmap[i].pin == STM_PIN(pin))
+            return i;
+    }
+    return -1;
+}
+
+void ventctl::AdcScan::configure_pin(uint8_t channel)
+{
+    if(channel >= sizeof(pinmap) / sizeof(pinmap[0])) return;
+
+    auto& p = pinmap[channel];
+    RCC->AHB1ENR |= 1U << p.port;
+    auto gpio = reinterpret_cast<GPIO_TypeDef*>(GPIOA_BASE + p.port * (GPIOB_BASE - GPIOA_BASE));
+    gpio->MODER |= 3U << (p.pin * 2);
+}
+
+int ventctl::AdcScan::add(uint8_t channel)
+{
+    if(s_running || s_count >= VC_ADC_CHANNELS) return -1;
+
+    for(uint8_t i = 0; i < s_count; ++i)
+    {
+        if(s_channels[i] == channel) return i;
+    }
+
+    s_channels[s_count] = channel;
+    return s_count++;
+}
+
+void ventctl::AdcScan::start()
+{
+    if(s_running || s_count == 0) return;
+
+    RCC->APB2ENR |= RCC_APB2ENR_ADC1EN | RCC_APB2ENR_ADC2EN;
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    ADC1->CR2 = 0;
+    ADC2->CR2 = 0;
+
+    // PCLK2 / 4, VREFINT on, dual regular simultaneous, DMA mode 2 with continuous requests
+    ADC->CCR = ADC_CCR_ADCPRE_0 | ADC_CCR_TSVREFE | ADC_CCR_DMA_1 | ADC_CCR_DDS | ADC_CCR_MULTI_2 | ADC_CCR_MULTI_1;
+
+    set_sampling_time(ADC1, VC_ADC_VREFINT, VC_ADC_SMP);
+    for(uint8_t i = 0; i < s_count; ++i)
+    {
+        set_sequence(ADC1, i, VC_ADC_VREFINT);
+        set_sequence(ADC2, i, s_channels[i]);
+        set_sampling_time(ADC2, s_channels[i], VC_ADC_SMP);
+    }
+    set_length(ADC1, s_count);
+    set_length(ADC2, s_count);
+
+    ADC1->CR1 = ADC_CR1_SCAN;
+    ADC2->CR1 = ADC_CR1_SCAN;
+
+    auto words = 2 * VC_ADC_OVERSAMPLE * s_count;
+    VC_ADC_STREAM->CR = 0;
+    while(VC_ADC_STREAM->CR & DMA_SxCR_EN);
+    DMA2->LIFCR = VC_ADC_FLAGS;
+    VC_ADC_STREAM->PAR = (uint32_t)&ADC->CDR;
+    VC_ADC_STREAM->M0AR = (uint32_t)s_buffer;
+    VC_ADC_STREAM->NDTR = words;
+    VC_ADC_STREAM->CR = DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1 |
+        DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+
+    NVIC_SetVector(VC_ADC_IRQ, (uint32_t)&dma_irq);
+    NVIC_EnableIRQ(VC_ADC_IRQ);
+    VC_ADC_STREAM->CR |= DMA_SxCR_EN;
+
+    ADC1->CR2 = ADC_CR2_ADON | ADC_CR2_CONT;
+    ADC2->CR2 = ADC_CR2_ADON | ADC_CR2_CONT;
+    wait_us(3); // tSTAB
+
+    s_running = true;
+    ADC1->CR2 |= ADC_CR2_SWSTART;
+}
+
+void ventctl::AdcScan::dma_irq()
+{
+    auto isr = DMA2->LISR;
+    DMA2->LIFCR = VC_ADC_FLAGS;
+
+    // The half just completed is stable until the DMA wraps around to it
+    auto half = VC_ADC_OVERSAMPLE * s_count;
+    process(isr & DMA_LISR_HTIF0 ? s_buffer : s_buffer + half);
+}
+
+void ventctl::AdcScan::process(const uint32_t* words)
+{
+    uint32_t raw[VC_ADC_CHANNELS], ref[VC_ADC_CHANNELS];
+    adc_accumulate_dual(words, VC_ADC_OVERSAMPLE, s_count, raw, ref);
+
+    s_seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_release);
+    for(uint8_t i = 0; i < s_count; ++i)
+    {
+        s_raw[i].store(raw[i], std::memory_order_relaxed);
+        s_ref[i].store(ref[i], std::memory_order_relaxed);
+    }
+    std::atomic_signal_fence(std::memory_order_release);
+    s_seq.fetch_add(1, std::memory_order_relaxed);
+    s_blocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+float ventctl::AdcScan::voltage(int slot)
+{
+    if(slot < 0 || slot >= s_count) return NAN;
+
+    uint32_t seq, raw, ref;
+    do
+    {
+        seq = s_seq.load(std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_acquire);
+        raw = s_raw[slot].load(std::memory_order_relaxed);
+        ref = s_ref[slot].load(std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_acquire);
+    }
+    while((seq & 1) || seq != s_seq.load(std::memory_order_relaxed));
+
+    return adc_volts(raw, ref, VC_VREFINT_CAL);
+}
+
+float ventctl::AdcScan::vdda()
+{
+    if(s_count == 0 || !s_running) return NAN;
+
+    uint32_t seq, ref;
+    do
+    {
+        seq = s_seq.load(std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_acquire);
+        ref = s_ref[0].load(std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_acquire);
+    }
+    while((seq & 1) || seq != s_seq.load(std::memory_order_relaxed));
+
+    return adc_vdda((float)ref / VC_ADC_OVERSAMPLE, VC_VREFINT_CAL);
+}
+
+float ventctl::AdcScan::convert(uint8_t channel, uint8_t sampling_time)
+{
+    if(s_running) return NAN;
+
+    RCC->APB2ENR |= RCC_APB2ENR_ADC1EN | RCC_APB2ENR_ADC2EN;
+    ADC->CCR = (ADC->CCR & ~ADC_CCR_MULTI) | ADC_CCR_TSVREFE;
+    ADC1->CR1 = 0;
+    ADC2->CR1 = 0;
+    ADC1->CR2 = ADC_CR2_ADON;
+    ADC2->CR2 = ADC_CR2_ADON;
+
+    // VREFINT needs 10 us whatever the input asks for
+    set_sampling_time(ADC1, VC_ADC_VREFINT, VC_ADC_SMP);
+    set_sampling_time(ADC2, channel, sampling_time);
+    set_sequence(ADC1, 0, VC_ADC_VREFINT);
+    set_sequence(ADC2, 0, channel);
+    set_length(ADC1, 1);
+    set_length(ADC2, 1);
+
+    ADC1->CR2 |= ADC_CR2_SWSTART;
+    ADC2->CR2 |= ADC_CR2_SWSTART;
+
+    while(!((ADC1->SR & ADC_SR_EOC) && (ADC2->SR & ADC_SR_EOC)));
+
+    uint16_t vrefint = ADC1->DR;
+    uint16_t value = ADC2->DR;
+
+    ADC1->SR &= ~(ADC_SR_STRT | ADC_SR_EOC);
+    ADC2->SR &= ~(ADC_SR_STRT | ADC_SR_EOC);
+
+    return adc_volts(value, vrefint, VC_VREFINT_CAL);
+}
@@ -0,0 +1,96 @@
+#include <DOutBank.hpp>
+
+ventctl::DOutBank::DOutBank(const char* name, std::initializer_list<Pin> pins) :
+    Peripheral<int>(name),
+    m_port(nullptr)
+{
+    for(auto& p : pins)
+    {
+        if(m_stages.full()) break;
+
+        gpio_t gpio;
+        gpio_init_out(&gpio, p.pin);
+
+        if(!m_port)
+            m_port = gpio.gpio;
+        else if(gpio.gpio != m_port)
+            error("DOutBank %s: %s is not on the bank's port\n", name, p.name);
+
+        m_pins[m_stages.size()] = gpio.mask;
+        m_stages.emplace_back(p.name, *this, m_stages.size());
+    }
+}
+
+void ventctl::DOutBank::write_stages(uint32_t mask, uint32_t pattern)
+{
+    uint32_t set = 0, reset = 0;
+    for(size_t i = 0; i < m_stages.size(); ++i)
+    {
+        if(!(mask & (1u << i))) continue;
+        if(pattern & (1u << i))
+            set |= m_pins[i];
+        else
+            reset |= m_pins[i];
+    }
+
+    // Upper half resets, lower half sets, all pins switch on the same bus cycle
+    if(m_port) m_port->BSRR = set | (reset << 16);
+}
+
+uint32_t ventctl::DOutBank::read_stages() const
+{
+    if(!m_port) return 0;
+
+    uint32_t odr = m_port->ODR, pattern = 0;
+    for(size_t i = 0; i < m_stages.size(); ++i)
+    {
+        if(odr & m_pins[i]) pattern |= 1u << i;
+    }
+    return pattern;
+}
+
+bool ventctl::DOutBank::accept_value(int& value)
+{
+    write_stages(StageBank::mask(m_stages.size()), (uint32_t)value);
+    return true;
+}
+
+int ventctl::DOutBank::read_value()
+{
+    return read_stages();
+}
+
+void ventctl::DOutBank::print(ventctl::file_t file, bool s)
+{
+    Peripheral<int>::print(file, s);
+    if(s)
+        fprintf(file, "=0x%02lx", (unsigned long)read_stages());
+    else
+        fprintf(file, "= 0x%02lx (%u stages)", (unsigned long)read_stages(), (unsigned)m_stages.size());
+}
+
+ventctl::DOutBank::Stage::Stage(const char* name, DOutBank& bank, uint8_t index) :
+    Peripheral<bool>(name),
+    m_bank(bank),
+    m_index(index)
+{}
+
+bool ventctl::DOutBank::Stage::accept_value(bool& value)
+{
+    m_bank.write_stages(1u << m_index, value ? 1u << m_index : 0);
+    return true;
+}
+
+bool ventctl::DOutBank::Stage::read_value()
+{
+    return (m_bank.read_stages() >> m_index) & 1;
+}
+
+void ventctl::DOutBank::Stage::print(ventctl::file_t file, bool s)
+{
+    Peripheral<bool>::print(file, s);
+    if(s)
+        fprintf(file, "=%d", (int)read_value());
+    else
+        fprintf(file, "= %d", (int)read_value());
+}
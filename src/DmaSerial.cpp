@@ -0,0 +1,212 @@
+#include <DmaSerial.hpp>
+#include <Metrics.hpp>
+#include <hal/serial_api.h>
+#include <algorithm>
+#include <cstring>
+
+// UART5 requests are on channel 4 of DMA1: RX stream 0, TX stream 7
+#define VC_SERIAL_UART UART5
+#define VC_SERIAL_UART_IRQ UART5_IRQn
+#define VC_SERIAL_RX_STREAM DMA1_Stream0
+#define VC_SERIAL_RX_IRQ DMA1_Stream0_IRQn
+#define VC_SERIAL_TX_STREAM DMA1_Stream7
+#define VC_SERIAL_TX_IRQ DMA1_Stream7_IRQn
+#define VC_SERIAL_DMA_CHANNEL (4U << DMA_SxCR_CHSEL_Pos)
+
+#define VC_SERIAL_RX_FLAGS (DMA_LIFCR_CTCIF0 | DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTEIF0 | DMA_LIFCR_CDMEIF0 | DMA_LIFCR_CFEIF0)
+#define VC_SERIAL_TX_FLAGS (DMA_HIFCR_CTCIF7 | DMA_HIFCR_CHTIF7 | DMA_HIFCR_CTEIF7 | DMA_HIFCR_CDMEIF7 | DMA_HIFCR_CFEIF7)
+
+ventctl::DmaSerial* ventctl::DmaSerial::s_instance = nullptr;
+
+static ventctl::Counter rx_overruns("serial.rx_overruns");
+static ventctl::Counter tx_dropped("serial.tx_dropped");
+
+ventctl::DmaSerial::DmaSerial(PinName tx, PinName rx, int baud) :
+    m_rx_pos(0),
+    m_rx_total(0),
+    m_rx_read(0),
+    m_tx_head(0),
+    m_tx_tail(0),
+    m_tx_busy(0),
+    m_control_thread(nullptr)
+{
+    s_instance = this;
+
+    // Pins, clock and baud rate through the mbed HAL, the data path is ours
+    serial_init(&m_serial, tx, rx);
+    serial_baud(&m_serial, baud);
+
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    VC_SERIAL_RX_STREAM->CR = 0;
+    while(VC_SERIAL_RX_STREAM->CR & DMA_SxCR_EN);
+    DMA1->LIFCR = VC_SERIAL_RX_FLAGS;
+    VC_SERIAL_RX_STREAM->PAR = (uint32_t)&VC_SERIAL_UART->DR;
+    VC_SERIAL_RX_STREAM->M0AR = (uint32_t)m_rx;
+    VC_SERIAL_RX_STREAM->NDTR = VC_SERIAL_RX_SIZE;
+    VC_SERIAL_RX_STREAM->CR = VC_SERIAL_DMA_CHANNEL | DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+
+    VC_SERIAL_TX_STREAM->CR = 0;
+    while(VC_SERIAL_TX_STREAM->CR & DMA_SxCR_EN);
+    DMA1->HIFCR = VC_SERIAL_TX_FLAGS;
+    VC_SERIAL_TX_STREAM->PAR = (uint32_t)&VC_SERIAL_UART->DR;
+    VC_SERIAL_TX_STREAM->CR = VC_SERIAL_DMA_CHANNEL | DMA_SxCR_DIR_0 | DMA_SxCR_MINC | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+    NVIC_SetVector(VC_SERIAL_UART_IRQ, (uint32_t)&uart_irq);
+    NVIC_SetVector(VC_SERIAL_RX_IRQ, (uint32_t)&rx_dma_irq);
+    NVIC_SetVector(VC_SERIAL_TX_IRQ, (uint32_t)&tx_dma_irq);
+    NVIC_EnableIRQ(VC_SERIAL_UART_IRQ);
+    NVIC_EnableIRQ(VC_SERIAL_RX_IRQ);
+    NVIC_EnableIRQ(VC_SERIAL_TX_IRQ);
+
+    VC_SERIAL_RX_STREAM->CR |= DMA_SxCR_EN;
+    VC_SERIAL_UART->CR3 |= USART_CR3_DMAR | USART_CR3_DMAT;
+    VC_SERIAL_UART->CR1 |= USART_CR1_IDLEIE;
+}
+
+void ventctl::DmaSerial::uart_irq()
+{
+    auto sr = VC_SERIAL_UART->SR;
+    if(sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_FE | USART_SR_NE))
+    {
+        // Reading SR then DR clears the idle and error flags
+        (void)VC_SERIAL_UART->DR;
+        s_instance->rx_advance();
+    }
+}
+
+void ventctl::DmaSerial::rx_dma_irq()
+{
+    DMA1->LIFCR = VC_SERIAL_RX_FLAGS;
+    s_instance->rx_advance();
+}
+
+void ventctl::DmaSerial::tx_dma_irq()
+{
+    auto self = s_instance;
+    DMA1->HIFCR = VC_SERIAL_TX_FLAGS;
+
+    self->m_tx_tail = self->m_tx_tail + self->m_tx_busy;
+    self->m_tx_busy = 0;
+    self->tx_start();
+    self->m_flags.set(TX_FLAG);
+}
+
+// Interrupt context only, half and full transfer interrupts guarantee less than a buffer between calls
+void ventctl::DmaSerial::rx_advance()
+{
+    uint32_t pos = VC_SERIAL_RX_SIZE - VC_SERIAL_RX_STREAM->NDTR;
+    if(pos == VC_SERIAL_RX_SIZE) pos = 0;
+
+    auto received = (pos + VC_SERIAL_RX_SIZE - m_rx_pos) % VC_SERIAL_RX_SIZE;
+    if(received == 0) return;
+
+    m_rx_pos = pos;
+    m_rx_total.fetch_add(received, std::memory_order_release);
+    m_flags.set(RX_FLAG);
+}
+
+// Called with interrupts masked or from the TX interrupt
+void ventctl::DmaSerial::tx_start()
+{
+    if(m_tx_busy || m_tx_head == m_tx_tail) return;
+
+    auto start = m_tx_tail % VC_SERIAL_TX_SIZE;
+    auto length = std::min<uint32_t>(m_tx_head - m_tx_tail, VC_SERIAL_TX_SIZE - start);
+    m_tx_busy = length;
+
+    DMA1->HIFCR = VC_SERIAL_TX_FLAGS;
+    VC_SERIAL_TX_STREAM->M0AR = (uint32_t)&m_tx[start];
+    VC_SERIAL_TX_STREAM->NDTR = length;
+    VC_SERIAL_TX_STREAM->CR |= DMA_SxCR_EN;
+}
+
+size_t ventctl::DmaSerial::receive(char* data, size_t size)
+{
+    auto total = m_rx_total.load(std::memory_order_acquire);
+
+    if(total - m_rx_read > VC_SERIAL_RX_SIZE)
+    {
+        // The reader fell a whole buffer behind, the oldest data is gone
+        ++rx_overruns;
+        m_rx_read = total - VC_SERIAL_RX_SIZE;
+    }
+
+    size_t count = std::min<size_t>(size, total - m_rx_read);
+    for(size_t i = 0; i < count; ++i)
+        data[i] = m_rx[(m_rx_read + i) % VC_SERIAL_RX_SIZE];
+
+    m_rx_read += count;
+    return count;
+}
+
+void ventctl::DmaSerial::wait_readable()
+{
+    while(m_rx_total.load(std::memory_order_acquire) == m_rx_read)
+        m_flags.wait_any(RX_FLAG);
+}
+
+ssize_t ventctl::DmaSerial::read(void* buffer, size_t size)
+{
+    if(size == 0) return 0;
+    wait_readable();
+    return receive(static_cast<char*>(buffer), size);
+}
+
+bool ventctl::DmaSerial::may_wait() const
+{
+    return !core_util_is_isr_active() && !(m_control_thread && ThisThread::get_id() == m_control_thread);
+}
+
+ssize_t ventctl::DmaSerial::write(const void* buffer, size_t size)
+{
+    auto data = static_cast<const char*>(buffer);
+    size_t written = 0;
+
+    while(written < size)
+    {
+        core_util_critical_section_enter();
+
+        auto head = m_tx_head;
+        size_t count = std::min<size_t>(VC_SERIAL_TX_SIZE - (head - m_tx_tail), size - written);
+        auto start = head % VC_SERIAL_TX_SIZE;
+        auto first = std::min<size_t>(count, VC_SERIAL_TX_SIZE - start);
+
+        std::memcpy(&m_tx[start], data + written, first);
+        std::memcpy(m_tx, data + written + first, count - first);
+        m_tx_head = head + count;
+        written += count;
+        tx_start();
+
+        core_util_critical_section_exit();
+
+        if(written < size)
+        {
+            if(!may_wait())
+            {
+                tx_dropped.increment(size - written);
+                break;
+            }
+            m_flags.wait_any(TX_FLAG);
+        }
+    }
+
+    return size;
+}
+
+int ventctl::DmaSerial::sync()
+{
+    if(!may_wait()) return 0;
+
+    while(m_tx_head != m_tx_tail)
+        m_flags.wait_any(TX_FLAG);
+    return 0;
+}
+
+short ventctl::DmaSerial::poll(short events) const
+{
+    short result = 0;
+    if(m_rx_total.load(std::memory_order_acquire) != m_rx_read) result |= POLLIN;
+    if(m_tx_head - m_tx_tail < VC_SERIAL_TX_SIZE) result |= POLLOUT;
+    return result & events;
+}
@@ -1,46 +1,22 @@
 #include <HiFiThermalSensor.hpp>
 #include <PT1000.hpp>
+#include <AdcScan.hpp>
 
 ventctl::HiFiThermalSensor::HiFiThermalSensor(const char* name, uint8_t channel, SamplingTime st) :
     Peripheral<float>(name),
     m_channel(channel),
+    m_voltage(0),
     m_samplingTime(st),
-    m_voltage(0)
+    m_slot(-1),
+    m_cal(name, pt1000_gain, pt1000_offset)
 {}
 
-struct adc_pin
-{
-    GPIO_TypeDef* gpio;
-    uint8_t pin;
-};
-
-static constexpr const adc_pin pinmap[] = {
-    {GPIOA, 0},
-    {GPIOA, 1},
-    {GPIOA, 2},
-    {GPIOA, 3},
-    {GPIOA, 4},
-    {GPIOA, 5},
-    {GPIOA, 6},
-    {GPIOA, 7},
-    {GPIOB, 0},
-    {GPIOB, 1},
-    {GPIOC, 0},
-    {GPIOC, 1},
-    {GPIOC, 2},
-    {GPIOC, 3},
-    {GPIOC, 4},
-    {GPIOC, 5}
-};
-
 void ventctl::HiFiThermalSensor::initialize()
 {
-    RCC->APB2ENR |= RCC_APB2ENR_ADC1EN_Msk | RCC_APB2ENR_ADC2EN_Msk;
-    
-    auto gpio = pinmap[m_channel].gpio;
-    auto num = pinmap[m_channel].pin;
-
-    gpio->MODER |= 3 << (num * 2);
+    AdcScan::configure_pin(m_channel);
+    m_slot = AdcScan::add(m_channel);
+    if(m_slot < 0)
+        printf("%s: no ADC scan slot, reads NO_DATA once the scan runs\n", name());
 }
 
 float ventctl::HiFiThermalSensor::read_value()
@@ -50,45 +26,10 @@ float ventctl::HiFiThermalSensor::read_value()
 
 void ventctl::HiFiThermalSensor::update()
 {
-    ADC1->CR2 |= ADC_CR2_ADON_Msk;
-    ADC2->CR2 |= ADC_CR2_ADON_Msk;
-    // Vrefint is ADC1_IN17
-    ADC123_COMMON->CCR |= ADC_CCR_TSVREFE_Msk;
-    
-    auto chan = m_channel;
-    auto* adc1_smpr = &ADC1->SMPR1;
-    auto* adc2_smpr = &ADC2->SMPR2;
-    if(chan > 9)
-    {
-        chan -= 10;
-        adc2_smpr = &ADC2->SMPR1;
-    }
-
-    *adc1_smpr &= ~(7 << 21);
-    *adc1_smpr |= (uint32_t)m_samplingTime << 21;
-    *adc2_smpr &= ~(7 << (chan * 3));
-    *adc2_smpr |= (uint32_t)m_samplingTime << (chan * 3);
-
-    ADC1->SQR1 &= ~(0xF) << 20;
-    ADC1->SQR1 |= 1 << 20;
-    ADC1->SQR3 = 17;
-    ADC2->SQR1 &= ~(0xF) << 20;
-    ADC2->SQR1 |= 1 << 20;
-    ADC2->SQR1 = m_channel;
-
-    ADC1->CR2 |= ADC_CR2_SWSTART_Msk;
-    ADC2->CR2 |= ADC_CR2_SWSTART_Msk;
-
-    while(!((ADC1->SR & ADC_SR_EOC_Msk) && (ADC2->SR & ADC_SR_EOC_Msk)));
-
-    uint16_t vrefint = ADC1->DR;
-    uint16_t value = ADC2->DR;
-
-    ADC1->SR &= ~(ADC_SR_STRT_Msk | ADC_SR_EOC_Msk);
-    ADC2->SR &= ~(ADC_SR_STRT_Msk | ADC_SR_EOC_Msk);
+    // Polled until the scan runs; without a scan slot the voltage is NAN from then on
+    m_voltage = AdcScan::running() ? AdcScan::voltage(m_slot) : AdcScan::convert(m_channel, m_samplingTime);
 
-    float v_cpu = 1.2 * 4096 / vrefint;
-    m_voltage = value * v_cpu / 4096;
+    m_check.check(m_voltage, read_temperature(), us_ticker_read());
 }
 
 float ventctl::HiFiThermalSensor::read_voltage()
@@ -98,7 +39,7 @@ float ventctl::HiFiThermalSensor::read_voltage()
 
 float ventctl::HiFiThermalSensor::read_resistance()
 {
-    return read_resistance(read_voltage());
+    return m_cal.apply(read_voltage());
 }
 
 float ventctl::HiFiThermalSensor::read_resistance(float voltage)
@@ -120,10 +61,12 @@ void ventctl::HiFiThermalSensor::print(ventctl::file_t file, bool s)
 {
     Peripheral<float>::print(file, s);
     float voltage = read_voltage();
-    float res = read_resistance(voltage);
+    float res = read_resistance();
     float temp = read_temperature(res);
     if(s)
         fprintf(file, "=%1.1f", temp);
     else
         fprintf(file, "= %1.4f C (%1.4f V, %1.2f Ohm)", temp, voltage, res);
+    if(quality() != Quality::GOOD)
+        fprintf(file, " [%s]", quality_name(quality()));
 }
@@ -0,0 +1,70 @@
+#include <PulseInput.hpp>
+
+ventctl::PulseInput::PulseInput(const char* name, PinName pin, uint32_t debounce_us, uint32_t timeout_us, Edge edge, PinMode mode) :
+    Peripheral<float>(name),
+    m_in(pin, mode),
+    m_capture(debounce_us, timeout_us),
+    m_edge(edge)
+{}
+
+void ventctl::PulseInput::initialize()
+{
+    if(m_edge != Edge::FALL) m_in.rise(callback(this, &PulseInput::on_edge));
+    if(m_edge != Edge::RISE) m_in.fall(callback(this, &PulseInput::on_edge));
+}
+
+void ventctl::PulseInput::on_edge()
+{
+    m_capture.edge(us_ticker_read());
+}
+
+float ventctl::PulseInput::frequency()
+{
+    return m_capture.frequency(us_ticker_read());
+}
+
+float ventctl::PulseInput::period()
+{
+    return m_capture.period(us_ticker_read());
+}
+
+float ventctl::PulseInput::read_value()
+{
+    return frequency();
+}
+
+void ventctl::PulseInput::print(ventctl::file_t file, bool s)
+{
+    Peripheral<float>::print(file, s);
+    auto r = reading();
+    if(s)
+        fprintf(file, "=%1.1f", read_value());
+    else
+        fprintf(file, "= %1.2f %s (%1.2f Hz, %lu pulses, %lu rejected)", read_value(), descriptor().unit,
+            frequency(), (unsigned long)r.count, (unsigned long)r.rejected);
+}
+
+ventctl::Tachometer::Tachometer(const char* name, PinName pin, uint8_t pulses_per_revolution, uint32_t debounce_us) :
+    PulseInput(name, pin, debounce_us),
+    m_pulses_per_revolution(pulses_per_revolution)
+{}
+
+float ventctl::Tachometer::read_value()
+{
+    return PulseCapture::rpm(frequency(), m_pulses_per_revolution);
+}
+
+ventctl::PulseCounter::PulseCounter(const char* name, PinName pin, float per_pulse, uint32_t debounce_us) :
+    PulseInput(name, pin, debounce_us, 60000000),
+    m_per_pulse(per_pulse)
+{}
+
+float ventctl::PulseCounter::read_value()
+{
+    return count() * m_per_pulse;
+}
+
+float ventctl::PulseCounter::rate(float scale)
+{
+    return frequency() * m_per_pulse * scale;
+}
@@ -1,16 +1,25 @@
 #include <ThermalSensor.hpp>
 #include <PT1000.hpp>
+#include <Metrics.hpp>
+
+// Time between the newest ADC sample and its use by the control loop
+static ventctl::Histogram sample_age("adc.sample_age_us");
 
 
 ventctl::ThermalSensor::ThermalSensor(const char* name, PinName pin) :
     m_input(pin),
     Peripheral<float>(name),
     m_values({0}),
-    m_value_cnt(0)
+    m_sum(0),
+    m_value_cnt(0),
+    m_filled(false),
+    m_sample_time(0),
+    m_cal(name, pt1000_gain, pt1000_offset)
 {}
 
 float ventctl::ThermalSensor::read_value()
 {
+    sample_age.record(us_ticker_read() - m_sample_time);
     return read_temperature();
 }
 
@@ -21,10 +30,7 @@ float ventctl::ThermalSensor::read_raw()
 
 float ventctl::ThermalSensor::read_voltage()
 {
-    float result = 0.0;
-    for(auto value : m_values) result += value;
-    result /= VC_TS_F;
-    return read_voltage(result);
+    return read_voltage(m_sum / VC_TS_F);
 }
 
 float ventctl::ThermalSensor::read_voltage(float raw)
@@ -34,7 +40,7 @@ float ventctl::ThermalSensor::read_voltage(float raw)
 
 float ventctl::ThermalSensor::read_resistance()
 {
-    return read_resistance(read_voltage());
+    return m_cal.apply(read_voltage());
 }
 
 float ventctl::ThermalSensor::read_resistance(float voltage)
@@ -56,19 +62,36 @@ void ventctl::ThermalSensor::print(ventctl::file_t file, bool s)
 {
     Peripheral<float>::print(file, s);
     float raw = read_raw();
-    float voltage = read_voltage(raw);
-    float res = read_resistance(voltage);
+    float voltage = read_voltage();
+    float res = read_resistance();
     float temp = read_temperature(res);
     if(s)
         fprintf(file, "=%1.1f", temp);
     else
         fprintf(file, "= %1.4f C (%1.4f, %1.4f V, %1.2f Ohm)", temp, raw, voltage, res);
+    if(quality() != Quality::GOOD)
+        fprintf(file, " [%s]", quality_name(quality()));
 }
 
 
 void ventctl::ThermalSensor::update()
 {
-    m_values[m_value_cnt] = read_raw();
+    // Running sum keeps the average O(1), rebuilt once per lap against float drift
+    auto raw = read_raw();
+    m_sum += raw - m_values[m_value_cnt];
+    m_values[m_value_cnt] = raw;
+    m_sample_time = us_ticker_read();
     m_value_cnt++;
     m_value_cnt %= VC_TS_F;
+
+    if(m_value_cnt == 0)
+    {
+        m_sum = 0;
+        for(auto value : m_values) m_sum += value;
+        m_filled = true;
+    }
+
+    // The average is meaningless until the ring has been filled once
+    if(m_filled)
+        m_check.check(read_voltage(), read_temperature(), m_sample_time);
 }
\ No newline at end of file
@@ -10,8 +10,9 @@
 #include <Peripheral.hpp>
 #include <AOut.hpp>
 #include <AIn.hpp>
-#include <DOut.hpp>
-#include <ThermalSensor.hpp>
+#include <DOutBank.hpp>
+#include <PulseInput.hpp>
+#include <AdcScan.hpp>
 #include <Variable.hpp>
 #include <time.hpp>
 #include <EthernetInterface.h>
@@ -23,6 +24,12 @@
 #include <HiFiThermalSensor.hpp>
 #include <settings.hpp>
 #include <Aperiodic.hpp>
+#include <Autotune.hpp>
+#include <ModulatedSink.hpp>
+#include <Graph.hpp>
+#include <Metrics.hpp>
+#include <Telemetry.hpp>
+#include <Statistics.hpp>
 #include <ModbusMaster.h>
 #include <MQTTClientMbedOs.h>
 #include <NTPClient.h>
@@ -73,28 +80,18 @@ void error_handler(const etl::exception& e)
     printf("Exc %s at %s:%d\n", e.what(), e.file_name(), e.line_number());
 }
 
-void do_log()
-{
-    for(auto periph : ventctl::PeripheralBase::get_peripherals())
-    {
-        periph->print(stdout, true);
-        printf(";");
-    }
-    printf("\n");
-}
-
+// Stages on one port switch together, the sinks never drive a partial pattern
+ventctl::DOutBank coolers("C", {
+    {"C_1", PD_0},
+    {"C_2", PD_1}});
 
-ventctl::DOut 
-    cooler1("C_1", PD_0),
-    cooler2("C_2", PD_1);
-
-ventctl::DOut
-    heater0 ("H_0", PE_8),
-    heater1("H_1", PE_9),
-    heater2("H_2", PE_10),
-    heater3("H_3", PE_11),
-    heater4("H_4", PE_12),
-    heater5("H_5", PE_13);
+ventctl::DOutBank heaters("H", {
+    {"H_0", PE_8},
+    {"H_1", PE_9},
+    {"H_2", PE_10},
+    {"H_3", PE_11},
+    {"H_4", PE_12},
+    {"H_5", PE_13}});
 
 ventctl::AOut
     motor1("M_1", PA_4),
@@ -104,17 +101,26 @@ ventctl::AIn
     sensor1("P_1", PB_0),
     sensor2("P_2", PB_1);
 
-ventctl::ThermalSensor
-    temp_room("T_Room", PC_3),
-    temp_iflow("T_IFlow", PC_2),
-    temp_coolant("T_C", PA_0),
-    temp_oflow("T_OFlow", PA_3);
+// PE2..PE4 have no timer channel, edges are timestamped on EXTI
+ventctl::Tachometer
+    fan_intake("F_In", PE_2),
+    fan_exhaust("F_Out", PE_3);
+
+// 1000 impulses per kWh
+ventctl::PulseCounter
+    heater_energy("E_Heat", PE_4, 0.001f);
 
-/*ventctl::HiFiThermalSensor
+// PC3, PC2, PA0, PA3; sampled with the pressure inputs in one dual ADC scan
+ventctl::HiFiThermalSensor
     temp_room("T_Room", 13),
     temp_iflow("T_IFlow", 12),
     temp_coolant("T_C", 0),
-    temp_oflow("T_OFlow", 3);*/
+    temp_oflow("T_OFlow", 3);
+
+// Per-minute summaries at the loop rate, e.g. T_C.max_1m catches coolant spikes between telemetry samples
+ventctl::Statistics
+    temp_room_1m(temp_room, 60, &us_ticker_read),
+    temp_coolant_1m(temp_coolant, 60, &us_ticker_read);
 
 ventctl::Variable<float>
     k_p("Kp", 0.5),
@@ -124,9 +130,10 @@ ventctl::Variable<float>
 
 ventctl::Variable<bool>
     log_state("Log", false),
-    manual_override("Manual", false);
+    manual_override("Manual", false),
+    tune_request("Tune", false);
     
-Serial pc(PC_12, PD_2);
+ventctl::DmaSerial pc(PC_12, PD_2);
 RawSerial rs485(PA_9, PA_10);
 DigitalOut rs485_de(PA_11), rs485_re(PA_12);
 
@@ -142,7 +149,8 @@ void post_transmission()
     rs485_de = 1;
 }
 
-ventctl::Term term(pc);
+ventctl::GraphUploader graph_upload;
+ventctl::Term term(pc, &graph_upload);
 ModbusMaster modbus;
 
 /*ventctl::PIDController<float, float>
@@ -159,11 +167,12 @@ ventctl::PIDController<float, float>
     pid_correction(0.1, 0.01, 0, 0, 3, 0),
     pid_deicer(1,1,0,0,2,1);
 
+// Sensor noise below 0.01 degC is not propagated through the graph
 ventctl::Source
-    src_room_temp(temp_room),
-    src_iflow_temp(temp_iflow),
-    src_oflow_temp(temp_oflow),
-    src_coolant_temp(temp_coolant),
+    src_room_temp(temp_room, 0.01),
+    src_iflow_temp(temp_iflow, 0.01),
+    src_oflow_temp(temp_oflow, 0.01),
+    src_coolant_temp(temp_coolant, 0.01),
     src_iflow_sensor(sensor1),
     src_oflow_sensor(sensor2),
     /* Variables */
@@ -196,34 +205,311 @@ ventctl::Sum
 ventctl::Unit<ventctl::PIDController<float, float>>
     iflow_temp_ctl(pid_intake_temp, iflow_temp_error);
 
+ventctl::Autotune<ventctl::PIDController<float, float>>
+    iflow_temp_tune(pid_intake_temp, iflow_temp_error, iflow_temp_ctl, 0.5, 0.5, 1.0);
+
+enum PIDSlot
+{
+    PID_ROOM_TEMP,
+    PID_INTAKE_TEMP,
+    PID_CORRECTION,
+    PID_DEICER
+};
+
+template<typename TPID>
+void load_pid_gains(TPID& pid, PIDSlot slot)
+{
+    auto& s = ventctl::application_settings.pid[slot];
+    if(s.valid == ventctl::PID_GAINS_VALID)
+        pid.setCoefficients(s.kp, s.ki, s.kd);
+}
+
+void store_pid_gains(const ventctl::PIDGains& gains, PIDSlot slot)
+{
+    auto& s = ventctl::application_settings.pid[slot];
+    s.valid = ventctl::PID_GAINS_VALID;
+    s.kp = gains.kp;
+    s.ki = gains.ki;
+    s.kd = gains.kd;
+}
+
 ventctl::Saturation
     heater_power_lim(0, 1),
     cooler_power_lim(0, 1);
 
 ventctl::Gain
-    cooler_power_flip(-1, iflow_temp_ctl);
+    cooler_power_flip(-1, iflow_temp_tune);
 
 ventctl::Unit<ventctl::Saturation>
-    heater_power_limit(heater_power_lim, iflow_temp_ctl),
+    heater_power_limit(heater_power_lim, iflow_temp_tune),
     cooler_power_limit(cooler_power_lim, cooler_power_flip);
 
-etl::vector<ventctl::PeriphRef<bool>, 1> cooler = {cooler1};
-etl::vector<ventctl::PeriphRef<bool>, 6> heater_ref = {
-    heater0,
-    heater1,
-    heater2,
-    heater3,
-    heater4,
-    heater5};
+etl::vector<ventctl::PeriphRef<bool>, 1> cooler = {coolers[0]};
 
 ventctl::Aperiodic
     heater_power_filter(heater_power_limit, 1.0, 10.0),
     cooler_power_filter(cooler_power_limit, 1.0, 10.0);
 
+ventctl::ModulatedOutputSink
+    heater_power_sink(heater_power_filter, heaters, ventctl::ModulatedOutputSink::Mode::TIME_PROPORTIONAL, 60.0, 10.0, 10.0);
+
 ventctl::SteppedOutputSink
-    heater_power_sink(heater_power_filter, heater_ref, false),
     cooler_power_sink(cooler_power_filter, cooler, false);
 
+// Loaded from flash at boot, replaces the graph above when present
+ventctl::Graph runtime_graph;
+
+// Integrals and filter states, restored after a reset
+ventctl::Checkpoint controller_state;
+
+Ticker heater_ticker;
+
+void heater_tick()
+{
+    if(manual_override) return;
+
+    if(runtime_graph.loaded())
+        runtime_graph.tick(ventctl::time());
+    else
+        heater_power_sink.tick(ventctl::time());
+}
+
+// Any message on p2d/trace requests a dump to d2p/trace/data, sent from the main loop
+volatile bool trace_dump_requested = false;
+
+void on_trace_message(MQTT::MessageData&)
+{
+    trace_dump_requested = true;
+}
+
+template<typename TClient>
+void publish_trace(TClient& client)
+{
+    char chunk[512];
+    size_t size = 0;
+
+    auto flush = [&]()
+    {
+        if(size == 0) return;
+        MQTT::Message msg {
+            .qos = MQTT::QOS0,
+            .retained = false,
+            .dup = false,
+            .id = 0,
+            .payload = chunk,
+            .payloadlen = size
+        };
+        client.publish("d2p/trace/data", msg);
+        size = 0;
+    };
+
+    ventctl::Trace::dump([&](const char* line)
+    {
+        auto length = strlen(line);
+        if(size + length > sizeof(chunk)) flush();
+        memcpy(chunk + size, line, length);
+        size += length;
+    });
+
+    flush();
+}
+
+#ifndef VC_METRICS_INTERVAL
+    #define VC_METRICS_INTERVAL 60
+#endif
+
+ventctl::Counter loop_count("loop.count");
+ventctl::Histogram loop_time("loop.us");
+ventctl::Gauge eval_ratio("graph.eval_ratio");
+ventctl::Counter publish_errors("mqtt.publish_errors");
+ventctl::Counter sensor_faults("sensor.faults");
+
+// Logs every change of a thermal input's quality, so failovers are visible
+void report_sensor_quality()
+{
+    static ventctl::PeripheralBase* const sensors[] = {&temp_room, &temp_iflow, &temp_oflow, &temp_coolant};
+    static ventctl::Quality last[4] = {};
+
+    for(size_t i = 0; i < 4; ++i)
+    {
+        auto quality = sensors[i]->quality();
+        if(quality == last[i]) continue;
+
+        if(quality == ventctl::Quality::GOOD)
+            ulog::info("%s recovered", sensors[i]->name());
+        else
+        {
+            ulog::warn("%s faulted: %s", sensors[i]->name(), ventctl::quality_name(quality));
+            ++sensor_faults;
+        }
+        last[i] = quality;
+    }
+}
+
+template<typename TClient>
+void publish_metrics(TClient& client)
+{
+    char payload[512];
+    auto size = ventctl::Metrics::serialize(payload, sizeof(payload));
+
+    MQTT::Message msg {
+        .qos = MQTT::QOS0,
+        .retained = false,
+        .dup = false,
+        .id = 0,
+        .payload = payload,
+        .payloadlen = size
+    };
+
+    if(client.publish("d2p/metrics", msg) != 0)
+        ++publish_errors;
+}
+
+#ifndef VC_TELEMETRY_INTERVAL
+    #define VC_TELEMETRY_INTERVAL 1
+#endif
+
+#ifndef VC_TELEMETRY_WINDOW
+    #define VC_TELEMETRY_WINDOW 10
+#endif
+
+/*
+    Largest payload the MQTT client serializes to a topic: the packet
+    less the fixed header (type and two length bytes), the topic with
+    its length and, above QoS0, the packet id.
+*/
+template<size_t N>
+constexpr size_t mqtt_max_payload(const char (&topic)[N], MQTT::QoS qos)
+{
+    return MBED_CONF_MBED_MQTT_MAX_PACKET_SIZE - 3 - (2 + N - 1) - (qos != MQTT::QOS0 ? 2 : 0);
+}
+
+constexpr size_t telemetry_max_payload = mqtt_max_payload("d2p/telemetry", MQTT::QOS0);
+static_assert(VC_TELEMETRY_MESSAGE_SIZE + 2 <= telemetry_max_payload, "A telemetry message must fit in one MQTT packet");
+
+// Peripheral min/mean/max per window, published to d2p/telemetry in batches of up to 6 messages
+ventctl::Telemetry telemetry(VC_TELEMETRY_INTERVAL, VC_TELEMETRY_WINDOW, 6, 60, telemetry_max_payload);
+
+template<typename TClient>
+void update_telemetry(TClient& client)
+{
+    VC_TRACE_ZONE("telemetry");
+
+    telemetry.update(us_ticker_read(), [&](const char* payload, size_t size)
+    {
+        if(!client.isConnected()) return false;
+
+        MQTT::Message msg {
+            .qos = MQTT::QOS0,
+            .retained = false,
+            .dup = false,
+            .id = 0,
+            .payload = const_cast<char*>(payload),
+            .payloadlen = size
+        };
+
+        if(client.publish("d2p/telemetry", msg) != 0)
+        {
+            ++publish_errors;
+            return false;
+        }
+        return true;
+    });
+
+    // Reported once when dropping starts and once when it stops
+    static uint32_t dropped = 0, reported = 0;
+    auto stats = telemetry.stats();
+    if(stats.dropped != dropped && dropped == reported)
+        ulog::warn("Telemetry queues full, dropping snapshots");
+    else if(stats.dropped == dropped && dropped != reported)
+    {
+        ulog::info("Telemetry resumed, %u snapshots dropped", (unsigned)(dropped - reported));
+        reported = dropped;
+    }
+    dropped = stats.dropped;
+}
+
+// Graph upload over MQTT: 'B' begins, 'D' + binary chunk appends, 'C' validates and stores
+void on_graph_message(MQTT::MessageData& md)
+{
+    auto& msg = md.message;
+    auto data = static_cast<const uint8_t*>(msg.payload);
+    if(msg.payloadlen == 0) return;
+
+    switch(data[0])
+    {
+    case 'B':
+        graph_upload.begin();
+        break;
+    case 'D':
+        if(!graph_upload.append(data + 1, msg.payloadlen - 1))
+            printf("Graph upload failed\n");
+        break;
+    case 'C':
+    {
+        auto err = graph_upload.finish();
+        if(err != ventctl::GraphError::NONE)
+            printf("Invalid graph: error %d\n", (int)err);
+        else if(!ventctl::save_graph(graph_upload.data(), graph_upload.size()))
+            printf("Cannot save graph\n");
+        else
+            printf("Graph saved, reset to apply\n");
+        break;
+    }
+    }
+}
+
+// Calibration over MQTT: the payload is what follows "s cal" on the terminal, the channel is reported back on d2p/cal
+char cal_report[ventctl::CAL_NAME_SIZE + 1] = {0};
+
+void on_cal_message(MQTT::MessageData& md)
+{
+    auto& msg = md.message;
+    auto payload = static_cast<const char*>(msg.payload);
+    // One command only, no ';' chaining into other terminal commands
+    if(msg.payloadlen == 0 || msg.payloadlen > VC_TERM_LINE_SIZE - 8 || memchr(payload, ';', msg.payloadlen)) return;
+
+    char line[VC_TERM_LINE_SIZE];
+    snprintf(line, sizeof(line), "s cal %.*s", (int)msg.payloadlen, payload);
+    term.execute(line);
+
+    auto name = line + 6;
+    snprintf(cal_report, sizeof(cal_report), "%.*s", (int)strcspn(name, " "), name);
+}
+
+template<typename TClient>
+void publish_calibration(TClient& client)
+{
+    auto cal = ventctl::Calibration::find(cal_report, strlen(cal_report));
+    cal_report[0] = 0;
+    if(!cal) return;
+
+    // Numbers go through to_chars, snprintf only assembles the object; no reading is null
+    char input[24], value[24];
+    auto json = [](char (&out)[24], float x, int precision)
+    {
+        auto end = std::isfinite(x) ? ventctl::to_chars(out, out + sizeof(out) - 1, x, precision).ptr : std::strcpy(out, "null") + 4;
+        *end = 0;
+        return out;
+    };
+    auto raw = cal->last_input();
+
+    char payload[128];
+    auto size = snprintf(payload, sizeof(payload), "{\"name\":\"%s\",\"points\":%u,\"input\":%s,\"value\":%s}",
+        cal->name(), (unsigned)cal->size(), json(input, raw, 5), json(value, cal->apply(raw), 4));
+
+    MQTT::Message msg {
+        .qos = MQTT::QOS0,
+        .retained = false,
+        .dup = false,
+        .id = 0,
+        .payload = payload,
+        .payloadlen = (size_t)size
+    };
+    if(client.publish("d2p/cal", msg) != 0)
+        ++publish_errors;
+}
+
 
 FileHandle *mbed::mbed_override_console(int fd)
 {
@@ -268,7 +554,6 @@ const char* ca_cert = "-----BEGIN CERTIFICATE-----\n"
 
 EthernetInterface eth;
 
-AnalogIn vref(ADC_VREF);
 
 int main()
 {
@@ -278,13 +563,28 @@ int main()
     {
         p->initialize();
     }
-
-    auto cb = ulog::callback_t([](ulog::log_level l , ulog::string_t s){
-        printf("[%d] %s\n", (int)l, s.c_str() );
+    ventctl::AdcScan::start();
+    ventctl::PeripheralBase::schedule_updates();
+
+    // Exhaust air is room air; the supply loop assumes it tracks its setpoint
+    src_room_temp.setRedundant(temp_oflow);
+    src_iflow_temp.setModel(iflow_temp_limit);
+    // Room sensors faulted from boot read as the setpoint, so the room loop idles
+    src_room_temp.setModel(src_temp_setting);
+    src_oflow_temp.setModel(src_temp_setting);
+
+    auto cb = ulog::callback_t([](ulog::log_level l , const char* s){
+        printf("[%d] %s\n", (int)l, s);
     });
 
     ulog::set_callback(cb);
 
+    term.start();
+
+    printf("Telemetry channels: %u\n", (unsigned)telemetry.sampler().add_all());
+    if(telemetry.sampler().overflow())
+        printf("Warning: %u peripherals left out of telemetry, raise VC_TELEMETRY_CHANNELS\n", (unsigned)telemetry.sampler().overflow());
+
     modbus.preTransmission(&pre_transmission);
     modbus.postTransmission(&post_transmission);
     modbus.begin(228, rs485);
@@ -298,6 +598,30 @@ int main()
 
     printf("Settings load status : %d\n", (int)result);
 
+    load_pid_gains(pid_room_temp, PID_ROOM_TEMP);
+    load_pid_gains(pid_intake_temp, PID_INTAKE_TEMP);
+    load_pid_gains(pid_correction, PID_CORRECTION);
+    load_pid_gains(pid_deicer, PID_DEICER);
+
+    controller_state.add(pid_room_temp, "pid_room_temp");
+    controller_state.add(pid_intake_temp, "pid_intake_temp");
+    controller_state.add(pid_correction, "pid_correction");
+    controller_state.add(pid_deicer, "pid_deicer");
+    controller_state.add(src_iflow_temp_f, "src_iflow_temp_f");
+    controller_state.add(src_oflow_temp_f, "src_oflow_temp_f");
+    controller_state.add(heater_power_filter, "heater_power_filter");
+    controller_state.add(cooler_power_filter, "cooler_power_filter");
+
+    auto restored = ventctl::restore_checkpoint(controller_state);
+    printf("Controller state restore status: %d\n", (int)restored);
+
+    size_t graph_size = 0;
+    if(auto graph = ventctl::stored_graph(graph_size))
+    {
+        auto err = runtime_graph.load(graph, graph_size);
+        printf("Graph load status: %d (%d nodes, %d bytes of pool)\n", (int)err, (int)runtime_graph.node_count(), (int)runtime_graph.pool_used());
+    }
+
     auto err = eth.connect();
 
     printf("Eth connection status: %d\n", (int)err);
@@ -347,27 +671,42 @@ int main()
 
     if(!result)
     {
-        // TODO : Data from sensors
-
-        const char* topic = "d2p/sensor_reading/d/test_0/r/T0"; 
-        ulog::string_t payload = ulog::join("{ \"utc\" : ", ::time(nullptr), ", \"data\":\"28.0\"}");
         MQTT::Message msg {
             .qos = MQTT::QOS1,
             .retained = false,
             .dup = false,
             .id = 1,
-            .payload = payload.data(),
-            .payloadlen = payload.size()
+            .payload = nullptr,
+            .payloadlen = 0
         };
 
-        printf("Payload: %s\n", payload.c_str());
-
-        result = client.publish(topic, msg);
-        printf("Publish result: %d\n", (int)result);
-
-        msg.payloadlen = 0;
-
         result = client.publish("ping/", msg);
+
+        result = client.subscribe("p2d/graph", MQTT::QOS1, &on_graph_message);
+        printf("Graph topic subscribe status: %d\n", (int)result);
+
+        result = client.subscribe("p2d/trace", MQTT::QOS0, &on_trace_message);
+        result = client.subscribe("p2d/cal", MQTT::QOS1, &on_cal_message);
+
+        /*
+            Channel kinds, types and units, retained for consumers joining
+            later. They take more than one packet, so they go out as parts
+            d2p/telemetry/meta/<n>, each an object of whole channels.
+        */
+        static char meta[mqtt_max_payload("d2p/telemetry/meta/00", MQTT::QOS1)];
+        msg.qos = MQTT::QOS1;
+        msg.retained = true;
+        msg.payload = meta;
+        size_t next = 0;
+        for(unsigned part = 0; next < telemetry.sampler().channels() && part < 100; ++part)
+        {
+            char topic[24];
+            snprintf(topic, sizeof(topic), "d2p/telemetry/meta/%u", part);
+            msg.id = 2 + part;
+            msg.payloadlen = telemetry.describe(meta, sizeof(meta), next);
+            if(client.publish(topic, msg) != 0)
+                ++publish_errors;
+        }
     }
 
     /*result = client.connect_async("man","dude");
@@ -379,38 +718,133 @@ int main()
         {
             client.process(); // TODO : Thread
         }
-        ulog::debug(ulog::join("MQTT client connection status : ", client.status()));
+        ulog::debug("MQTT client connection status : %s", client.status());
     }
     else
     {
         printf("Cannot send MQTT CONNECT packet\n");
     }*/
     
+    // Soft start, 0 to 50% in under 4 s, played by DMA
+    motor1.ramp(0.2f);
+    motor2.ramp(0.2f);
     motor1 = 0.5;
     motor2 = 0.5;
 
+    heater_ticker.attach(callback(&heater_tick), 0.1);
+
+    // Integrate from the first control step on, not over boot and the network bring-up
+    auto now = ventctl::time();
+    pid_room_temp.setLastTime(now);
+    pid_intake_temp.setLastTime(now);
+    pid_correction.setLastTime(now);
+    pid_deicer.setLastTime(now);
+    src_iflow_temp_f.setLastTime(now);
+    src_oflow_temp_f.setLastTime(now);
+    heater_power_filter.setLastTime(now);
+    cooler_power_filter.setLastTime(now);
+
+    // Terminal commands run in this thread, from here on their output must not stall a control step
+    pc.set_control_thread(ThisThread::get_id());
+
+    uint32_t loop_start = us_ticker_read();
+
     while(1)
     {
-        for(ventctl::PeripheralBase* p : ventctl::PeripheralBase::get_peripherals())
+        auto loop_end = us_ticker_read();
+        loop_time.record(loop_end - loop_start);
+        loop_start = loop_end;
+        ++loop_count;
+
+        // Committed terminal batches take effect together, before this control step
+        term.apply_batch();
+
+        ventctl::PeripheralBase::update_all();
+        report_sensor_quality();
+
+        if(tune_request)
         {
-            p->update();
+            tune_request = false;
+            iflow_temp_tune.start(ventctl::time());
+            printf("Autotune started\n");
+        }
+
+        ventctl::PIDGains tuned;
+        if(iflow_temp_tune.takeResult(tuned))
+        {
+            printf("Autotune done: Ku = %.4f, Tu = %.2fs, Kp = %.4f, Ki = %.4f, Kd = %.4f\n",
+                iflow_temp_tune.ultimateGain(), iflow_temp_tune.ultimatePeriod(), tuned.kp, tuned.ki, tuned.kd);
+            store_pid_gains(tuned, PID_INTAKE_TEMP);
+            if(!ventctl::save_settings())
+                printf("Cannot save tuned gains\n");
         }
 
         if(!manual_override)
         {
-            heater_power_sink.update(ventctl::time());
-            cooler_power_sink.update(ventctl::time());
+            VC_TRACE_ZONE("sinks");
+            if(runtime_graph.loaded())
+            {
+                runtime_graph.update(ventctl::time());
+            }
+            else
+            {
+                heater_power_sink.update(ventctl::time());
+                cooler_power_sink.update(ventctl::time());
+            }
         }
 
+        auto eval_stats = ventctl::UnitBase::takeStats();
+        if(eval_stats.evaluated + eval_stats.skipped)
+            eval_ratio.set((float)eval_stats.evaluated / (eval_stats.evaluated + eval_stats.skipped));
+
+        ventctl::maintain_settings();
+
+        // Microsecond ticks, the difference stays right across their wrap
+        static uint32_t last_checkpoint = us_ticker_read();
+        if(us_ticker_read() - last_checkpoint >= ventctl::CHECKPOINT_INTERVAL * 1000000u)
+        {
+            last_checkpoint = us_ticker_read();
+            if(!ventctl::save_checkpoint(controller_state))
+                printf("Cannot save controller state\n");
+        }
+
+        if(client.isConnected())
+        {
+            VC_TRACE_ZONE("MQTT::yield");
+            client.yield(1);
+
+            if(trace_dump_requested)
+            {
+                trace_dump_requested = false;
+                publish_trace(client);
+            }
+
+            if(cal_report[0])
+                publish_calibration(client);
+
+            static uint32_t last_metrics = us_ticker_read();
+            if(us_ticker_read() - last_metrics >= VC_METRICS_INTERVAL * 1000000u)
+            {
+                last_metrics = us_ticker_read();
+                publish_metrics(client);
+            }
+        }
+
+        update_telemetry(client);
+
         if(log_state)
         {
             static uint8_t i = 0;
 
             if(i++ == 0)
-                printf("T = %.2f (%.4fV), H = %.3f, C = %.1f, Ref = %.4fV\n", temp_room.read_temperature(), temp_room.read_voltage(), heater_power_limit.getLast(), cooler_power_limit.getLast(), vref.read() * 3.3);
+                printf("T = %.2f (%.4fV), H = %.3f, C = %.1f, VDDA = %.4fV, Eval = %u/%u\n", temp_room.read_temperature(), temp_room.read_voltage(), heater_power_limit.getLast(), cooler_power_limit.getLast(), ventctl::AdcScan::vdda(),
+                    (unsigned)eval_stats.evaluated, (unsigned)(eval_stats.evaluated + eval_stats.skipped));
             //wait_ms(200);
         }
 
+        // Deferred log records are formatted here, bounded so a burst can't stall the loop
+        ulog::process(8);
+
         term.try_command();
     }
 }
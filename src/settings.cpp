@@ -1,4 +1,8 @@
 #include <settings.hpp>
+#include <Metrics.hpp>
+#include <mbed.h>
+#include <cstring>
+#include <algorithm>
 
 
 namespace ventctl
@@ -18,16 +22,16 @@ namespace ventctl
         return !(flags & SETTINGS_OVERWRITTEN_MASK);
     }
 
-    constexpr const static uint16_t settings_size = sizeof(settings);
+    KVStore<mbed::FlashIAP> kv_store(flash, KV_SECTOR_A, KV_SECTOR_B, KV_SECTOR_SIZE);
 
     settings application_settings{
-        .flags = 0,
-        .size = settings_size,
         .ip_addr = {0},
         .api_addr = {'a','p','i','-','d','e','m','o','.','w','o','l','k','a','b','o','u','t','.','c','o','m'},
         .client_id = {'m','a','n'},
         .password = {'d','u','d','e'},
-        .calibration = {-250.0}
+        .calibration = {-250.0},
+        .pid = {},
+        .cal = {}
     };
 
     static bool loaded = false;
@@ -37,89 +41,256 @@ namespace ventctl
         return loaded;
     }
 
-    bool load_settings()
+    // Layout of the records written before the key/value store
+    struct alignas(4) legacy_settings
+    {
+        uint16_t flags;
+        uint16_t size;
+        uint8_t ip_addr[4];
+        uint8_t api_addr[40];
+        uint8_t client_id[40];
+        uint8_t password[40];
+        float calibration[6];
+    };
+
+    static bool load_legacy_settings()
     {
         uint32_t flags_and_size;
         uint32_t addr = SETTINGS_START;
 
-        volatile auto erased = flash.get_erase_value();
-
         while(addr < SETTINGS_START + SETTINGS_SIZE)
         {
             if(flash.read(&flags_and_size, addr, sizeof(flags_and_size)))
                 return false;
 
-            if(is_valid_settings(flags_and_size & 0xFFFF))
-            {
-                if(is_overwritten(flags_and_size & 0xFFFF))
-                {
-                    if((flags_and_size >> 16) == 0) return false;
-                    addr += (flags_and_size >> 16);
-                }
-                else
-                {
-                    auto result = flash.read(&application_settings, addr, flags_and_size >> 16) == 0;                    
-                    loaded = result;
-                    return result;
-                }
-            }
-            else
-            {
+            if(!is_valid_settings(flags_and_size & 0xFFFF) || (flags_and_size >> 16) == 0)
                 return false;
+
+            if(is_overwritten(flags_and_size & 0xFFFF))
+            {
+                addr += (flags_and_size >> 16);
+                continue;
             }
 
+            legacy_settings legacy;
+            auto size = std::min<size_t>(flags_and_size >> 16, sizeof(legacy));
+            if(flash.read(&legacy, addr, size)) return false;
+
+            std::memcpy(application_settings.ip_addr, legacy.ip_addr, sizeof(legacy.ip_addr));
+            std::memcpy(application_settings.api_addr, legacy.api_addr, sizeof(legacy.api_addr));
+            std::memcpy(application_settings.client_id, legacy.client_id, sizeof(legacy.client_id));
+            std::memcpy(application_settings.password, legacy.password, sizeof(legacy.password));
+            std::memcpy(application_settings.calibration, legacy.calibration, sizeof(legacy.calibration));
+            return true;
         }
 
         return false;
     }
 
+    template<typename T>
+    static bool load_field(uint16_t key, T& field)
+    {
+        return kv_store.get(key, &field, sizeof(field));
+    }
+
+    bool load_settings()
+    {
+        // Must run before the store formats the sector it lives in
+        auto migrate = load_legacy_settings();
+
+        if(!kv_store.init()) return false;
+
+        if(migrate)
+        {
+            loaded = save_settings();
+            return loaded;
+        }
+
+        load_field(KEY_IP_ADDR, application_settings.ip_addr);
+        load_field(KEY_API_ADDR, application_settings.api_addr);
+        load_field(KEY_CLIENT_ID, application_settings.client_id);
+        load_field(KEY_PASSWORD, application_settings.password);
+        load_field(KEY_CALIBRATION, application_settings.calibration);
+
+        for(size_t i = 0; i < PID_SLOTS; ++i)
+            load_field(KEY_PID + i, application_settings.pid[i]);
+
+        for(size_t i = 0; i < CAL_SLOTS; ++i)
+        {
+            auto& cal = application_settings.cal[i];
+            if(!load_field(KEY_CAL + i, cal) || cal.valid != CAL_VALID) continue;
+
+            // Channels of sensors no longer in the firmware keep their slot, bad points keep the default
+            auto channel = Calibration::find(cal.name, strnlen(cal.name, CAL_NAME_SIZE));
+            if(channel) channel->set(cal.points, cal.count);
+        }
+
+        loaded = kv_store.count() > 0;
+        return loaded;
+    }
+
+    static Histogram flash_write_time("flash.write_us");
+    static Counter flash_errors("flash.errors");
+
+    // Flash writes stall the CPU while programming, so their durations are tracked
+    static bool store(uint16_t key, const void* data, size_t size)
+    {
+        auto start = us_ticker_read();
+        auto result = kv_store.set(key, data, size);
+        flash_write_time.record(us_ticker_read() - start);
+
+        if(!result) ++flash_errors;
+        return result;
+    }
+
+    template<typename T>
+    static bool save_field(uint16_t key, const T& field)
+    {
+        return store(key, &field, sizeof(field));
+    }
+
     bool save_settings()
     {
-        uint32_t addr = SETTINGS_START;
+        auto result = save_field(KEY_IP_ADDR, application_settings.ip_addr);
+        result = save_field(KEY_API_ADDR, application_settings.api_addr) && result;
+        result = save_field(KEY_CLIENT_ID, application_settings.client_id) && result;
+        result = save_field(KEY_PASSWORD, application_settings.password) && result;
+        result = save_field(KEY_CALIBRATION, application_settings.calibration) && result;
 
-        while(addr + sizeof(application_settings) < SETTINGS_START + SETTINGS_SIZE)
+        for(size_t i = 0; i < PID_SLOTS; ++i)
         {
+            if(application_settings.pid[i].valid == PID_GAINS_VALID)
+                result = save_field(KEY_PID + i, application_settings.pid[i]) && result;
+        }
 
-            uint32_t flags_and_size;
+        for(size_t i = 0; i < CAL_SLOTS; ++i)
+        {
+            if(application_settings.cal[i].valid == CAL_VALID)
+                result = save_field(KEY_CAL + i, application_settings.cal[i]) && result;
+        }
 
-            if(flash.read(&flags_and_size, addr, sizeof(flags_and_size)))
-                return false;
+        return result;
+    }
 
-            if(is_valid_settings(flags_and_size & 0xFFFF))
-            {
-                if((flags_and_size >> 16) == 0)
-                {
-                    if(flash.erase(SETTINGS_START, SETTINGS_SIZE)) return false;
-                    addr = SETTINGS_START;
-                    break;
-                }
-
-                if(!is_overwritten(flags_and_size & 0xFFFF) )
-                {
-                    uint8_t flags = 0; //valid & overwritten
-                    if(flash.program(&flags, addr, 1))
-                        return false;
-                }
+    bool save_calibration(const Calibration& calibration)
+    {
+        auto length = std::strlen(calibration.name());
+        if(length > CAL_NAME_SIZE) return false;
 
-                addr += (flags_and_size >> 16);
-            }
-            else
+        cal_settings* slot = nullptr;
+        for(auto& cal : application_settings.cal)
+        {
+            if(cal.valid == CAL_VALID && strnlen(cal.name, CAL_NAME_SIZE) == length && std::strncmp(cal.name, calibration.name(), length) == 0)
             {
-                addr = SETTINGS_START;
-                if(flash.erase(SETTINGS_START, SETTINGS_SIZE)) return false;
+                slot = &cal;
                 break;
             }
+            if(!slot && cal.valid != CAL_VALID) slot = &cal;
         }
+        if(!slot) return false;
+
+        std::memset(slot, 0, sizeof(*slot));
+        slot->valid = CAL_VALID;
+        std::memcpy(slot->name, calibration.name(), length);
+        slot->count = calibration.size();
+        std::memcpy(slot->points, calibration.points(), calibration.size() * sizeof(CalibrationPoint));
+        return save_settings();
+    }
+
+    bool format_settings()
+    {
+        loaded = false;
+        return kv_store.format();
+    }
+
+    void maintain_settings()
+    {
+        kv_store.maintain();
+    }
+
+    const uint8_t* stored_graph(size_t& size)
+    {
+        uint32_t address;
+        if(!kv_store.locate(KEY_GRAPH, address, size))
+            return nullptr;
+
+        // Internal flash is memory mapped
+        return reinterpret_cast<const uint8_t*>(address);
+    }
 
-        if(addr + sizeof(application_settings) >= SETTINGS_START + SETTINGS_SIZE)
+    bool save_graph(const uint8_t* data, size_t size)
+    {
+        return store(KEY_GRAPH, data, size);
+    }
+
+#if defined(VC_CHECKPOINT_FLASH)
+    bool save_checkpoint(Checkpoint& checkpoint)
+    {
+        uint8_t buffer[CHECKPOINT_MAX_SIZE];
+        auto size = checkpoint.save(buffer, sizeof(buffer), ::time(nullptr));
+        return size && store(KEY_CHECKPOINT, buffer, size);
+    }
+
+    Checkpoint::Result restore_checkpoint(Checkpoint& checkpoint)
+    {
+        uint8_t buffer[CHECKPOINT_MAX_SIZE];
+        size_t size = 0;
+        if(!kv_store.get(KEY_CHECKPOINT, buffer, sizeof(buffer), &size) || size > sizeof(buffer))
+            return Checkpoint::Result::EMPTY;
+
+        return checkpoint.restore(buffer, size, ::time(nullptr), CHECKPOINT_MAX_AGE);
+    }
+#else
+    /* Two alternating slots, so a reset in the middle of a save keeps the previous image */
+    constexpr const static size_t CHECKPOINT_SLOT_SIZE = 2048;
+    static size_t checkpoint_slot = 0;
+
+    static uint8_t* backup_sram()
+    {
+        static bool enabled = false;
+
+        if(!enabled)
         {
-            if(flash.erase(SETTINGS_START, SETTINGS_SIZE)) return false;
-            addr = SETTINGS_START;
+            __HAL_RCC_PWR_CLK_ENABLE();
+            HAL_PWR_EnableBkUpAccess();
+            __HAL_RCC_BKPSRAM_CLK_ENABLE();
+            // Keeps the contents on VBAT, fails harmlessly without a battery
+            HAL_PWREx_EnableBkUpReg();
+            enabled = true;
         }
 
-        application_settings.flags = SETTINGS_OVERWRITTEN_MASK;
-        application_settings.size = sizeof(application_settings);
+        return reinterpret_cast<uint8_t*>(BKPSRAM_BASE);
+    }
+
+    bool save_checkpoint(Checkpoint& checkpoint)
+    {
+        auto slot = backup_sram() + checkpoint_slot * CHECKPOINT_SLOT_SIZE;
+        if(!checkpoint.save(slot, CHECKPOINT_SLOT_SIZE, ::time(nullptr)))
+            return false;
+
+        checkpoint_slot = 1 - checkpoint_slot;
+        return true;
+    }
+
+    Checkpoint::Result restore_checkpoint(Checkpoint& checkpoint)
+    {
+        auto sram = backup_sram();
+        uint32_t sequence[2];
+        Checkpoint::Result result[2];
+
+        for(size_t i = 0; i < 2; ++i)
+            result[i] = checkpoint.check(sram + i * CHECKPOINT_SLOT_SIZE, CHECKPOINT_SLOT_SIZE, sequence[i]);
+
+        size_t newest;
+        if(result[0] == Checkpoint::Result::OK && result[1] == Checkpoint::Result::OK)
+            newest = sequence[1] > sequence[0] ? 1 : 0;
+        else if(result[0] == Checkpoint::Result::OK || result[1] == Checkpoint::Result::OK)
+            newest = result[1] == Checkpoint::Result::OK ? 1 : 0;
+        else
+            return result[0] != Checkpoint::Result::EMPTY ? result[0] : result[1];
 
-        return flash.program(&application_settings, addr, sizeof(application_settings)) == 0;
+        checkpoint_slot = 1 - newest;
+        return checkpoint.restore(sram + newest * CHECKPOINT_SLOT_SIZE, CHECKPOINT_SLOT_SIZE, ::time(nullptr), CHECKPOINT_MAX_AGE);
     }
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,73 @@
+#include <AdcMath.hpp>
+#include <unity.h>
+#include <cstdint>
+
+// A typical part: VREFINT = 1.21 V reads 1502 at 3.3 V
+constexpr uint16_t cal = 1502;
+
+void test_adc_vdda()
+{
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 3.3, ventctl::adc_vdda(1502, cal));
+    // Supply sagged to 3.0 V: the reference reads higher
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 3.0, ventctl::adc_vdda(1502 * 3.3f / 3.0f, cal));
+    TEST_ASSERT_TRUE(std::isnan(ventctl::adc_vdda(0, cal)));
+}
+
+void test_adc_ratiometric()
+{
+    // 1.0 V input read at a supply of 3.0 V and 3.6 V gives the same volts
+    for(float vdda : {3.0f, 3.3f, 3.6f})
+    {
+        auto raw = 1.0f / vdda * 4095;
+        auto ref = cal * 3.3f / vdda;
+        TEST_ASSERT_FLOAT_WITHIN(1e-4, 1.0, ventctl::adc_volts(raw, ref, cal));
+    }
+    TEST_ASSERT_TRUE(std::isnan(ventctl::adc_volts(100, 0, cal)));
+}
+
+void test_adc_accumulate()
+{
+    // Three scans of two channels, ADC2 (input) high, ADC1 (VREFINT) low
+    const uint32_t words[] = {
+        (1000u << 16) | 1500, (3000u << 16) | 1501,
+        (1002u << 16) | 1502, (3001u << 16) | 1503,
+        (1004u << 16) | 1504, (3002u << 16) | 1505,
+    };
+    uint32_t raw[2] = {7, 7}, ref[2] = {7, 7};
+    ventctl::adc_accumulate_dual(words, 3, 2, raw, ref);
+
+    TEST_ASSERT_EQUAL(3006, raw[0]);
+    TEST_ASSERT_EQUAL(9003, raw[1]);
+    TEST_ASSERT_EQUAL(4506, ref[0]);
+    TEST_ASSERT_EQUAL(4509, ref[1]);
+
+    // Sums over the same scans convert like averages
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, ventctl::adc_volts(1002, 1502, cal), ventctl::adc_volts(raw[0], ref[0], cal));
+}
+
+void test_adc_supply_ripple()
+{
+    // Ripple on VDDA moves the raw codes but not the compensated average
+    const int scans = 32;
+    uint32_t words[scans];
+    for(int i = 0; i < scans; ++i)
+    {
+        float vdda = 3.3f + 0.05f * ((i % 4) - 1.5f);
+        auto raw = (uint32_t)(1.2f / vdda * 4095 + 0.5f);
+        auto ref = (uint32_t)(cal * 3.3f / vdda + 0.5f);
+        words[i] = (raw << 16) | ref;
+    }
+    uint32_t raw, ref;
+    ventctl::adc_accumulate_dual(words, scans, 1, &raw, &ref);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 1.2, ventctl::adc_volts(raw, ref, cal));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_adc_vdda);
+    RUN_TEST(test_adc_ratiometric);
+    RUN_TEST(test_adc_accumulate);
+    RUN_TEST(test_adc_supply_ripple);
+    return UNITY_END();
+}
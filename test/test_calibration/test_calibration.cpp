@@ -0,0 +1,114 @@
+#include <Calibration.hpp>
+#include <PT1000.hpp>
+#include <unity.h>
+
+using ventctl::Calibration;
+using ventctl::CalibrationPoint;
+
+void test_calibration_default()
+{
+    Calibration cal("T", ventctl::pt1000_gain, ventctl::pt1000_offset);
+    TEST_ASSERT_EQUAL(0, cal.size());
+
+    // Q16.16 input steps of 15 uV are 4 mOhm, about 1 mdegC
+    for(float v = 0; v <= 3.3f; v += 0.01f)
+        TEST_ASSERT_FLOAT_WITHIN(5e-3, ventctl::pt1000_resistance(v), cal.apply(v));
+
+    cal.apply(2.0f);
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, cal.last_input());
+    TEST_ASSERT_TRUE(std::isnan(cal.apply(NAN)));
+}
+
+void test_calibration_offset_trim()
+{
+    Calibration cal("T", -250, 1500);
+    CalibrationPoint point = {2.0f, 1003.0f};
+    TEST_ASSERT_TRUE(cal.set(&point, 1));
+
+    // Nominal gain through the point
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 1003.0, cal.apply(2.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 1253.0, cal.apply(1.0f));
+}
+
+void test_calibration_two_point()
+{
+    Calibration cal("T", -250, 1500);
+    // Reference resistors of 1000 and 1385 Ohm, a divider slightly off nominal
+    CalibrationPoint points[] = {{0.4700f, 1385.0f}, {1.9900f, 1000.0f}};
+    TEST_ASSERT_TRUE(cal.set(points, 2));
+
+    auto slope = (1000.0f - 1385.0f) / (1.99f - 0.47f);
+    for(float v = 0; v <= 3.3f; v += 0.01f)
+        TEST_ASSERT_FLOAT_WITHIN(5e-3, 1385.0f + slope * (v - 0.47f), cal.apply(v));
+}
+
+void test_calibration_multi_point()
+{
+    Calibration cal("T", 1, 0);
+    // Unsorted on purpose
+    CalibrationPoint points[] = {{2, 25}, {0, 0}, {1, 5}};
+    TEST_ASSERT_TRUE(cal.set(points, 3));
+    TEST_ASSERT_EQUAL_FLOAT(0, cal.points()[0].input);
+    TEST_ASSERT_EQUAL_FLOAT(2, cal.points()[2].input);
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 2.5, cal.apply(0.5f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 5.0, cal.apply(1.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 15.0, cal.apply(1.5f));
+    // End segments extrapolate
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, -5.0, cal.apply(-1.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 45.0, cal.apply(3.0f));
+
+    cal.reset();
+    TEST_ASSERT_EQUAL(0, cal.size());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 3.0, cal.apply(3.0f));
+}
+
+void test_calibration_rejects()
+{
+    Calibration cal("T", 1, 0);
+    CalibrationPoint same[] = {{1, 2}, {1, 3}};
+    TEST_ASSERT_FALSE(cal.set(same, 2));
+
+    CalibrationPoint bad[] = {{0, 0}, {NAN, 3}};
+    TEST_ASSERT_FALSE(cal.set(bad, 2));
+
+    CalibrationPoint many[VC_CAL_POINTS + 1] = {};
+    TEST_ASSERT_FALSE(cal.set(many, VC_CAL_POINTS + 1));
+
+    // Still the default
+    TEST_ASSERT_EQUAL(0, cal.size());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 2.0, cal.apply(2.0f));
+}
+
+void test_calibration_registry()
+{
+    TEST_ASSERT_EQUAL(0, Calibration::channels().size());
+    {
+        Calibration a("T_Room", 1, 0), b("T_C", 1, 0);
+        TEST_ASSERT_EQUAL(2, Calibration::channels().size());
+        TEST_ASSERT_EQUAL_PTR(&b, Calibration::find("T_C", 3));
+        TEST_ASSERT_EQUAL_PTR(&a, Calibration::find("T_Room", 6));
+        TEST_ASSERT_NULL(Calibration::find("T_Roo", 5));
+    }
+    TEST_ASSERT_EQUAL(0, Calibration::channels().size());
+}
+
+void test_pt1000_reference()
+{
+    for(float t = -40; t <= 120; t += 5)
+        TEST_ASSERT_FLOAT_WITHIN(0.01, t, ventctl::pt1000_temp(ventctl::pt1000_resistance_at(t)));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1385.06, ventctl::pt1000_resistance_at(100));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_calibration_default);
+    RUN_TEST(test_calibration_offset_trim);
+    RUN_TEST(test_calibration_two_point);
+    RUN_TEST(test_calibration_multi_point);
+    RUN_TEST(test_calibration_rejects);
+    RUN_TEST(test_calibration_registry);
+    RUN_TEST(test_pt1000_reference);
+    return UNITY_END();
+}
@@ -0,0 +1,243 @@
+#include <charconv.hpp>
+#include <unity.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::mt19937 rng(1234);
+
+// Exact outside the fast path ranges would need big integers, there a few ulp are allowed
+template<typename T>
+static void check_parse(const char* text, T tolerance = 0)
+{
+    auto last = text + strlen(text);
+    T expected = 0, actual = 0;
+    auto e = std::from_chars(text, last, expected);
+    auto a = ventctl::from_chars(text, last, actual);
+
+    if(e.ec != a.ec || e.ptr != a.ptr || (e.ec == std::errc() && std::fabs(expected - actual) > std::fabs(expected) * tolerance))
+    {
+        printf("  mismatch for \"%s\": %.9g vs %.9g\n", text, (double)expected, (double)actual);
+        TEST_FAIL();
+    }
+}
+
+void test_charconv_ints()
+{
+    const char* cases[] = {"0", "-0", "42", "-17x", "2147483647", "2147483648", "-2147483648", "-2147483649", "", "-", "x1", "007"};
+    for(auto c : cases)
+        check_parse<int>(c);
+
+    check_parse<unsigned>("4294967295");
+    check_parse<unsigned>("4294967296");
+
+    char buffer[16];
+    auto r = ventctl::to_chars(buffer, buffer + sizeof(buffer), -2147483647 - 1);
+    TEST_ASSERT_EQUAL_STRING("-2147483648", std::string(buffer, r.ptr).c_str());
+
+    r = ventctl::to_chars(buffer, buffer + 3, 12345);
+    TEST_ASSERT_TRUE(r.ec == std::errc::value_too_large);
+}
+
+void test_charconv_float_cases()
+{
+    const char* exact[] = {"0", "1", "-1.5", "25.0", "0.0001", "3.", ".5", ".", "-.", "1e3", "1E-3", "2.5e", "2.5e+",
+        "1e39", "-1e39", "12.5abc", "-0.0", "abc", "1234567.125", "0.000000000000000000001"};
+
+    for(auto c : exact)
+    {
+        check_parse<float>(c);
+        check_parse<double>(c);
+    }
+
+    const char* approximate[] = {"1e-50", "3.4028235e38", "1.17549435e-38", "123456789012345678901234", "0.000000000000000000000001"};
+
+    for(auto c : approximate)
+    {
+        check_parse<float>(c, 1e-7f);
+        check_parse<double>(c, 1e-15);
+    }
+}
+
+// Settings-style values: up to 9 significant digits, up to 8 decimals
+void test_charconv_float_fuzz()
+{
+    std::uniform_int_distribution<uint32_t> digits(0, 999999999);
+    std::uniform_int_distribution<int> decimals(0, 8), sign(0, 1);
+    char text[32];
+
+    for(int i = 0; i < 200000; ++i)
+    {
+        auto value = digits(rng);
+        auto d = decimals(rng);
+        auto whole = value / (uint32_t)ventctl::detail::pow10[d];
+        auto fraction = value % (uint32_t)ventctl::detail::pow10[d];
+
+        if(d)
+            snprintf(text, sizeof(text), "%s%u.%0*u", sign(rng) ? "-" : "", whole, d, fraction);
+        else
+            snprintf(text, sizeof(text), "%s%u", sign(rng) ? "-" : "", whole);
+
+        check_parse<float>(text);
+        check_parse<double>(text);
+    }
+}
+
+// Shortest round trip text of random floats must read back bit exact
+void test_charconv_float_roundtrip()
+{
+    std::uniform_real_distribution<float> dist(-1e6, 1e6);
+    char text[32];
+
+    for(int i = 0; i < 200000; ++i)
+    {
+        float value = dist(rng);
+        auto r = std::to_chars(text, text + sizeof(text), value);
+        *r.ptr = 0;
+        check_parse<float>(text);
+    }
+}
+
+void test_charconv_fixed()
+{
+    struct { double value; int precision; } cases[] = {
+        {0, 2}, {1.5, 0}, {2.5, 1}, {-3.14159, 4}, {0.999, 2}, {-0.01, 2}, {123456.789, 3}, {1e-7, 9},
+        {25.0, 2}, {-1234567.25, 1}, {0.05, 1}, {99.995, 2}
+    };
+
+    char ours[48], theirs[48];
+    for(auto& c : cases)
+    {
+        auto r = ventctl::to_chars(ours, ours + sizeof(ours), c.value, c.precision);
+        *r.ptr = 0;
+        snprintf(theirs, sizeof(theirs), "%.*f", c.precision, c.value);
+
+        // Exact binary ties (2.5, -1234567.25) round to even like printf
+        if(strcmp(ours, theirs) != 0)
+        {
+            printf("  %s vs %s\n", ours, theirs);
+            TEST_FAIL();
+        }
+    }
+
+    // Random floats at random precisions format like printf
+    std::uniform_real_distribution<float> wide(-1e6, 1e6);
+    std::uniform_int_distribution<int> precisions(0, 6);
+    for(int i = 0; i < 200000; ++i)
+    {
+        float value = wide(rng);
+        int precision = precisions(rng);
+        auto r = ventctl::to_chars(ours, ours + sizeof(ours), value, precision);
+        *r.ptr = 0;
+        snprintf(theirs, sizeof(theirs), "%.*f", precision, value);
+
+        bool negative_zero = theirs[0] == '-' && atof(theirs) == 0 && strcmp(ours, theirs + 1) == 0;
+        if(strcmp(ours, theirs) != 0 && !negative_zero)
+        {
+            printf("  %s vs %s\n", ours, theirs);
+            TEST_FAIL();
+        }
+    }
+
+    // Unlike printf, values rounding to zero lose their sign
+    auto r = ventctl::to_chars(ours, ours + sizeof(ours), -0.001f, 2);
+    TEST_ASSERT_EQUAL_STRING("0.00", std::string(ours, r.ptr).c_str());
+
+    r = ventctl::to_chars(ours, ours + 4, 12345.0f, 2);
+    TEST_ASSERT_TRUE(r.ec == std::errc::value_too_large);
+
+    // Past the fixed range in exponent form, like "%.*e"
+    const double large[] = {1e19, -2.345e25, 9.9999e30, 3.4028235e38, 1e44};
+    for(auto value : large)
+    {
+        for(int precision = 0; precision <= 4; ++precision)
+        {
+            r = ventctl::to_chars(ours, ours + sizeof(ours), value, precision);
+            *r.ptr = 0;
+            snprintf(theirs, sizeof(theirs), "%.*e", precision, value);
+            TEST_ASSERT_EQUAL_STRING(theirs, ours);
+        }
+    }
+    r = ventctl::to_chars(ours, ours + sizeof(ours), INFINITY, 2);
+    TEST_ASSERT_EQUAL_STRING("inf", std::string(ours, r.ptr).c_str());
+
+    // Values printed with 6 decimals read back to the same float
+    std::uniform_real_distribution<float> dist(-1000, 1000);
+    for(int i = 0; i < 100000; ++i)
+    {
+        char text[32];
+        float value = std::round(dist(rng) * 1000) / 1000, parsed;
+        auto w = ventctl::to_chars(text, text + sizeof(text), value, 6);
+        ventctl::from_chars(text, w.ptr, parsed);
+        TEST_ASSERT_EQUAL_FLOAT(value, parsed);
+    }
+}
+
+template<typename F>
+static double measure(F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void test_charconv_benchmark()
+{
+    constexpr int count = 100000;
+    std::vector<std::string> inputs;
+    std::uniform_real_distribution<float> dist(-1000, 1000);
+
+    for(int i = 0; i < count; ++i)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.4f", dist(rng));
+        inputs.push_back(text);
+    }
+
+    volatile float sink = 0;
+    auto ours = measure([&]
+    {
+        for(auto& s : inputs)
+        {
+            float v;
+            ventctl::from_chars(s.data(), s.data() + s.size(), v);
+            sink = v;
+        }
+    });
+    auto libc = measure([&]
+    {
+        for(auto& s : inputs)
+            sink = strtof(s.c_str(), nullptr);
+    });
+
+    char buffer[32];
+    auto format_ours = measure([&]
+    {
+        for(int i = 0; i < count; ++i)
+            sink = *ventctl::to_chars(buffer, buffer + sizeof(buffer), (float)i * 0.37f, 2).ptr;
+    });
+    auto format_libc = measure([&]
+    {
+        for(int i = 0; i < count; ++i)
+            sink = snprintf(buffer, sizeof(buffer), "%.2f", (float)i * 0.37f);
+    });
+
+    printf("  parse: %.1f ns (strtof %.1f ns), format: %.1f ns (snprintf %.1f ns)\n",
+        ours / count, libc / count, format_ours / count, format_libc / count);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_charconv_ints);
+    RUN_TEST(test_charconv_float_cases);
+    RUN_TEST(test_charconv_float_fuzz);
+    RUN_TEST(test_charconv_float_roundtrip);
+    RUN_TEST(test_charconv_fixed);
+    RUN_TEST(test_charconv_benchmark);
+    UNITY_END();
+}
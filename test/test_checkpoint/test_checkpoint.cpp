@@ -0,0 +1,122 @@
+#include <Checkpoint.hpp>
+#include <PID.hpp>
+#include <Aperiodic.hpp>
+#include <unity.h>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+using PID = ventctl::PIDController<float, float>;
+
+class ConstInput : public ventctl::UnitBase
+{
+public:
+    virtual float getValueUncached(float)
+    {
+        return 1.0;
+    }
+};
+
+void test_checkpoint_roundtrip()
+{
+    ConstInput input;
+    PID pid(1, 0.5, 0);
+    ventctl::Aperiodic filter(input, 1.0, 10.0);
+
+    for(int i = 1; i <= 10; ++i)
+        pid.nextValue(2.0, i);
+
+    ventctl::Checkpoint saved;
+    saved.add(pid, "pid");
+    saved.add(filter, "filter");
+
+    uint8_t image[256];
+    auto size = saved.save(image, sizeof(image), 1000);
+    TEST_ASSERT_EQUAL(saved.size(), size);
+
+    // Fresh controllers after a reset
+    PID restored_pid(1, 0.5, 0);
+    ventctl::Aperiodic restored_filter(input, 1.0, 10.0);
+    ventctl::Checkpoint checkpoint;
+    checkpoint.add(restored_pid, "pid");
+    checkpoint.add(restored_filter, "filter");
+
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::OK, checkpoint.restore(image, size, 1060, 300));
+    TEST_ASSERT_EQUAL_FLOAT(pid.getState().integral, restored_pid.getState().integral);
+    TEST_ASSERT_EQUAL_FLOAT(10.0, restored_pid.getState().integral);
+
+    // Bumpless: the restored controller continues where the old one stopped
+    restored_pid.setLastTime(10);
+    TEST_ASSERT_EQUAL_FLOAT(pid.nextValue(2.0, 11), restored_pid.nextValue(2.0, 11));
+
+    // Newer images get higher sequence numbers
+    TEST_ASSERT_EQUAL(saved.sequence(), checkpoint.sequence());
+    checkpoint.save(image, sizeof(image), 1100);
+    TEST_ASSERT_GREATER_THAN(saved.sequence(), checkpoint.sequence());
+}
+
+void test_checkpoint_rejects()
+{
+    PID pid(1, 1, 0), other(1, 1, 0);
+    ventctl::Checkpoint checkpoint;
+    checkpoint.add(pid, "pid");
+
+    uint8_t image[64];
+    auto size = checkpoint.save(image, sizeof(image), 1000);
+
+    uint8_t erased[64];
+    std::memset(erased, 0, sizeof(erased));
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::EMPTY, checkpoint.restore(erased, sizeof(erased), 1000, 60));
+
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::STALE, checkpoint.restore(image, size, 1061, 60));
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::STALE, checkpoint.restore(image, size, 999, 60));
+
+    image[size - 1] ^= 0x10;
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::CORRUPT, checkpoint.restore(image, size, 1000, 60));
+    image[size - 1] ^= 0x10;
+
+    ventctl::Checkpoint changed;
+    changed.add(pid, "pid");
+    changed.add(other, "other");
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::LAYOUT_CHANGED, changed.restore(image, size, 1000, 60));
+
+    // Same size, another item
+    ventctl::Checkpoint renamed;
+    renamed.add(other, "other");
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::LAYOUT_CHANGED, renamed.restore(image, size, 1000, 60));
+
+    TEST_ASSERT_EQUAL(0, checkpoint.save(image, 8, 1000));
+}
+
+void test_checkpoint_swapped_items()
+{
+    PID room(1, 1, 0), intake(1, 1, 0);
+    for(int i = 1; i <= 10; ++i)
+    {
+        room.nextValue(1.0, i);
+        intake.nextValue(-1.0, i);
+    }
+
+    ventctl::Checkpoint saved;
+    saved.add(room, "room");
+    saved.add(intake, "intake");
+    uint8_t image[64];
+    auto size = saved.save(image, sizeof(image), 1000);
+
+    // Same types and sizes, registered the other way round
+    PID restored_room(1, 1, 0), restored_intake(1, 1, 0);
+    ventctl::Checkpoint swapped;
+    swapped.add(restored_intake, "intake");
+    swapped.add(restored_room, "room");
+    TEST_ASSERT_EQUAL(ventctl::Checkpoint::Result::LAYOUT_CHANGED, swapped.restore(image, size, 1000, 60));
+    TEST_ASSERT_EQUAL_FLOAT(0, restored_room.getState().integral);
+    TEST_ASSERT_EQUAL_FLOAT(0, restored_intake.getState().integral);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_checkpoint_roundtrip);
+    RUN_TEST(test_checkpoint_rejects);
+    RUN_TEST(test_checkpoint_swapped_items);
+    UNITY_END();
+}
@@ -0,0 +1,91 @@
+#include <Command.hpp>
+#include <unity.h>
+#include <string>
+
+struct Context
+{
+    std::string log;
+};
+
+static void cmd_a(Context& c, ventctl::Args&) { c.log += "a;"; }
+static void cmd_b(Context& c, ventctl::Args&) { c.log += "b;"; }
+
+static void cmd_echo(Context& c, ventctl::Args& args)
+{
+    auto rest = args.rest();
+    c.log.append(rest.data(), rest.size());
+    c.log += ";";
+}
+
+constexpr ventctl::Command<Context> commands[] = {
+    {"a", &cmd_a, "a"},
+    {"ab", &cmd_b, "ab"},
+    {"echo", &cmd_echo, "echo <text>"}
+};
+
+static_assert(ventctl::is_sorted(commands), "Table must be sorted");
+
+constexpr ventctl::Command<Context> unsorted[] = {
+    {"b", &cmd_b, "b"},
+    {"a", &cmd_a, "a"}
+};
+
+static_assert(!ventctl::is_sorted(unsorted), "Unsorted table must be detected");
+
+void test_command_lookup()
+{
+    TEST_ASSERT_EQUAL_PTR(&commands[0], ventctl::find_command(commands, etl::string_view("a")));
+    TEST_ASSERT_EQUAL_PTR(&commands[1], ventctl::find_command(commands, etl::string_view("ab")));
+    TEST_ASSERT_EQUAL_PTR(&commands[2], ventctl::find_command(commands, etl::string_view("echo")));
+    TEST_ASSERT_NULL(ventctl::find_command(commands, etl::string_view("abc")));
+    TEST_ASSERT_NULL(ventctl::find_command(commands, etl::string_view("ec")));
+    TEST_ASSERT_NULL(ventctl::find_command(commands, etl::string_view("")));
+}
+
+void test_command_args()
+{
+    ventctl::Args args(etl::string_view("  12 1.5 on  x1  tail text  "));
+
+    int i = 0;
+    float f = 0;
+    bool b = false;
+
+    TEST_ASSERT_TRUE(args.get(i));
+    TEST_ASSERT_EQUAL(12, i);
+
+    // A failed conversion doesn't consume the token
+    TEST_ASSERT_FALSE(args.get(i));
+    TEST_ASSERT_TRUE(args.get(f));
+    TEST_ASSERT_EQUAL_FLOAT(1.5, f);
+
+    TEST_ASSERT_TRUE(args.get(b));
+    TEST_ASSERT_TRUE(b);
+
+    TEST_ASSERT_FALSE(args.get(f));
+    TEST_ASSERT_TRUE(ventctl::equals(args.word(), "x1"));
+    TEST_ASSERT_TRUE(ventctl::equals(args.rest(), "tail text"));
+    TEST_ASSERT_TRUE(args.empty());
+}
+
+void test_command_split()
+{
+    Context context;
+
+    ventctl::split_commands(etl::string_view("a; ab ;;echo  hi there ; ;a"), [&](etl::string_view line)
+    {
+        ventctl::Args args(line);
+        auto command = ventctl::find_command(commands, args.word());
+        if(command) command->run(context, args);
+    });
+
+    TEST_ASSERT_EQUAL_STRING("a;b;hi there;a;", context.log.c_str());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_command_lookup);
+    RUN_TEST(test_command_args);
+    RUN_TEST(test_command_split);
+    UNITY_END();
+}
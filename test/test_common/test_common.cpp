@@ -24,11 +24,41 @@ DummyPeripheral dummy("A dummy");
 void test_periph_accepts_type()
 {
     TEST_ASSERT_TRUE(dummy.accepts_type<float>());
-    TEST_ASSERT_TRUE(dummy.accepts_type_id(util::type_id_v<float>));
-    TEST_ASSERT_FALSE(dummy.accepts_type_id(util::type_id_v<int>));
+    TEST_ASSERT_TRUE(dummy.type() == ventctl::ValueType::FLOAT);
+    TEST_ASSERT_FALSE(dummy.accepts_type<int>());
     TEST_ASSERT_FALSE(dummy.accepts_type<char>());
 }
 
+void test_periph_value()
+{
+    ventctl::PeripheralValue v(2.75f);
+    float f = 0;
+    int i = 0;
+    TEST_ASSERT_TRUE(v.get(f));
+    TEST_ASSERT_EQUAL_FLOAT(2.75, f);
+    TEST_ASSERT_FALSE(v.get(i));
+    TEST_ASSERT_EQUAL(2, v.as<int>());
+    TEST_ASSERT_EQUAL(0x2C000, v.as<ventctl::Fixed>().raw());
+    TEST_ASSERT_TRUE(ventctl::PeripheralValue(ventctl::Fixed::from_int(3)).as<bool>());
+
+    // Generic access through the base, writes must match the peripheral type
+    ventctl::PeripheralBase& base = dummy;
+    TEST_ASSERT_FALSE(base.write(ventctl::PeripheralValue(1)));
+    TEST_ASSERT_TRUE(base.read().get(f));
+    TEST_ASSERT_EQUAL_FLOAT(ventctl::read_direct(dummy), f);
+}
+
+void test_periph_descriptor()
+{
+    auto& d = static_cast<ventctl::PeripheralBase&>(dummy).descriptor();
+    TEST_ASSERT_EQUAL_STRING("Peripheral", d.kind);
+    TEST_ASSERT_TRUE(d.type == ventctl::ValueType::FLOAT);
+    TEST_ASSERT_EQUAL_STRING("", d.unit);
+    TEST_ASSERT_TRUE(d.flags & ventctl::PeripheralDescriptor::WRITABLE);
+    TEST_ASSERT_TRUE(d.flags & ventctl::PeripheralDescriptor::UPDATES);
+    TEST_ASSERT_EQUAL(ventctl::PeripheralDescriptor::COMPUTED, d.group);
+}
+
 void test_periph_set_value()
 {
     float v = 13.37;
@@ -56,6 +86,8 @@ int main()
 {
     UNITY_BEGIN();
     RUN_TEST(test_periph_accepts_type);
+    RUN_TEST(test_periph_descriptor);
+    RUN_TEST(test_periph_value);
     RUN_TEST(test_periph_set_value);
     RUN_TEST(test_pt1000_conversion_pos);
     RUN_TEST(test_pt1000_conversion_neg);
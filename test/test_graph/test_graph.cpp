@@ -0,0 +1,208 @@
+#include <Graph.hpp>
+#include <unity.h>
+#include <vector>
+#include <string>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+template<typename T>
+class DummyValue : public ventctl::Peripheral<T>
+{
+public:
+    DummyValue(const char* name) :
+        ventctl::Peripheral<T>(name),
+        m_value()
+        {}
+
+    using ventctl::Peripheral<T>::operator=;
+
+    bool accept_value(T& v) override
+    {
+        m_value = v;
+        return true;
+    }
+
+    T read_value() override { return m_value; }
+
+private:
+    T m_value;
+};
+
+DummyValue<float> temp("T_Room"), setpoint("T_Set"), valve("Valve");
+DummyValue<bool> h0("H_0"), h1("H_1");
+
+// Minimal counterpart of tools/graphc.py
+class GraphWriter
+{
+public:
+    uint16_t node(ventctl::NodeType type, std::vector<uint16_t> inputs, std::vector<float> params, std::string name = "")
+    {
+        m_body.push_back(static_cast<uint8_t>(type));
+        m_body.push_back(inputs.size());
+        m_body.push_back(params.size());
+        m_body.push_back(name.size());
+        for(auto i : inputs) append(&i, sizeof(i));
+        for(auto p : params) append(&p, sizeof(p));
+        append(name.data(), name.size());
+        return m_count++;
+    }
+
+    std::vector<uint8_t> blob() const
+    {
+        ventctl::GraphHeader hdr{
+            ventctl::GRAPH_MAGIC,
+            ventctl::GRAPH_VERSION,
+            m_count,
+            static_cast<uint32_t>(sizeof(hdr) + m_body.size()),
+            ventctl::crc32(m_body.data(), m_body.size())
+        };
+
+        std::vector<uint8_t> out(sizeof(hdr));
+        std::memcpy(out.data(), &hdr, sizeof(hdr));
+        out.insert(out.end(), m_body.begin(), m_body.end());
+        return out;
+    }
+
+private:
+    void append(const void* data, size_t size)
+    {
+        auto p = static_cast<const uint8_t*>(data);
+        m_body.insert(m_body.end(), p, p + size);
+    }
+
+    std::vector<uint8_t> m_body;
+    uint16_t m_count = 0;
+};
+
+using ventctl::NodeType;
+using ventctl::GraphError;
+
+static std::vector<uint8_t> room_graph()
+{
+    GraphWriter w;
+    auto t = w.node(NodeType::SOURCE, {}, {}, "T_Room");
+    auto s = w.node(NodeType::SOURCE, {}, {}, "T_Set");
+    auto e = w.node(NodeType::SUM, {s, t}, {1, -1});
+    auto g = w.node(NodeType::GAIN, {e}, {0.5});
+    auto sat = w.node(NodeType::SATURATION, {g}, {0, 1});
+    w.node(NodeType::SINK, {sat}, {}, "Valve");
+    w.node(NodeType::STEPPED_SINK, {sat}, {0}, "H_0,H_1");
+    return w.blob();
+}
+
+void test_crc32()
+{
+    const char* check = "123456789";
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, ventctl::crc32(check, 9));
+}
+
+void test_graph_load_and_update()
+{
+    auto blob = room_graph();
+    ventctl::Graph graph;
+
+    TEST_ASSERT_EQUAL(GraphError::NONE, graph.load(blob.data(), blob.size()));
+    TEST_ASSERT_TRUE(graph.loaded());
+    TEST_ASSERT_EQUAL(7, graph.node_count());
+
+    temp = 20.0f;
+    setpoint = 21.0f;
+    graph.update(1.0);
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.5, valve.read_value());
+    TEST_ASSERT_TRUE(h0.read_value());
+    TEST_ASSERT_FALSE(h1.read_value());
+
+    temp = 25.0f;
+    graph.update(2.0);
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.0, valve.read_value());
+    TEST_ASSERT_FALSE(h0.read_value());
+}
+
+void test_graph_rejects_corruption()
+{
+    auto blob = room_graph();
+    ventctl::Graph graph;
+
+    auto bad_crc = blob;
+    bad_crc.back() ^= 0x01;
+    TEST_ASSERT_EQUAL(GraphError::BAD_CRC, graph.load(bad_crc.data(), bad_crc.size()));
+    TEST_ASSERT_FALSE(graph.loaded());
+
+    auto bad_magic = blob;
+    bad_magic[0] = 0;
+    TEST_ASSERT_EQUAL(GraphError::BAD_MAGIC, ventctl::Graph::validate(bad_magic.data(), bad_magic.size()));
+
+    TEST_ASSERT_EQUAL(GraphError::TRUNCATED, ventctl::Graph::validate(blob.data(), blob.size() - 1));
+}
+
+void test_graph_rejects_bad_nodes()
+{
+    {
+        // Forward reference
+        GraphWriter w;
+        w.node(NodeType::GAIN, {1}, {1});
+        w.node(NodeType::SOURCE, {}, {}, "T_Room");
+        auto blob = w.blob();
+        TEST_ASSERT_EQUAL(GraphError::BAD_INPUT, ventctl::Graph::validate(blob.data(), blob.size()));
+    }
+    {
+        // Sinks have no output
+        GraphWriter w;
+        auto t = w.node(NodeType::SOURCE, {}, {}, "T_Room");
+        auto s = w.node(NodeType::SINK, {t}, {}, "Valve");
+        w.node(NodeType::SINK, {s}, {}, "Valve");
+        auto blob = w.blob();
+        TEST_ASSERT_EQUAL(GraphError::BAD_INPUT, ventctl::Graph::validate(blob.data(), blob.size()));
+    }
+    {
+        GraphWriter w;
+        auto t = w.node(NodeType::SOURCE, {}, {}, "T_Room");
+        w.node(NodeType::PID, {t}, {1, 2});
+        auto blob = w.blob();
+        TEST_ASSERT_EQUAL(GraphError::BAD_ARITY, ventctl::Graph::validate(blob.data(), blob.size()));
+    }
+    {
+        GraphWriter w;
+        w.node(NodeType::SOURCE, {}, {}, "T_Nowhere");
+        auto blob = w.blob();
+        ventctl::Graph graph;
+        TEST_ASSERT_EQUAL(GraphError::NONE, ventctl::Graph::validate(blob.data(), blob.size()));
+        TEST_ASSERT_EQUAL(GraphError::UNKNOWN_PERIPHERAL, graph.load(blob.data(), blob.size()));
+    }
+    {
+        GraphWriter w;
+        w.node(NodeType::SOURCE, {}, {}, "H_0");
+        auto blob = w.blob();
+        ventctl::Graph graph;
+        TEST_ASSERT_EQUAL(GraphError::WRONG_PERIPHERAL_TYPE, graph.load(blob.data(), blob.size()));
+    }
+}
+
+void test_graph_uploader()
+{
+    auto blob = room_graph();
+    ventctl::GraphUploader upload;
+
+    TEST_ASSERT_FALSE(upload.append(blob.data(), 4));
+
+    upload.begin();
+    for(size_t i = 0; i < blob.size(); i += 16)
+        TEST_ASSERT_TRUE(upload.append(blob.data() + i, std::min<size_t>(16, blob.size() - i)));
+
+    TEST_ASSERT_EQUAL(GraphError::NONE, upload.finish());
+    TEST_ASSERT_EQUAL(blob.size(), upload.size());
+    TEST_ASSERT_EQUAL_MEMORY(blob.data(), upload.data(), blob.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32);
+    RUN_TEST(test_graph_load_and_update);
+    RUN_TEST(test_graph_rejects_corruption);
+    RUN_TEST(test_graph_rejects_bad_nodes);
+    RUN_TEST(test_graph_uploader);
+    UNITY_END();
+}
@@ -0,0 +1,215 @@
+#include <KVStore.hpp>
+#include <unity.h>
+#include <vector>
+#include <cstdio>
+
+// RAM backed stand-in for mbed::FlashIAP, programming can only clear bits
+class FakeFlash
+{
+public:
+    static constexpr uint32_t START = 0x08000000;
+    static constexpr uint32_t SECTOR = 0x1000;
+
+    FakeFlash() : m_memory(2 * SECTOR, 0xFF), m_budget(-1), m_erases(0), m_programmed(0) {}
+
+    int read(void* data, uint32_t addr, uint32_t size)
+    {
+        if(!in_range(addr, size)) return -1;
+        std::memcpy(data, &m_memory[addr - START], size);
+        return 0;
+    }
+
+    int program(const void* data, uint32_t addr, uint32_t size)
+    {
+        if(!in_range(addr, size) || addr % get_page_size() || size % get_page_size()) return -1;
+
+        auto bytes = static_cast<const uint8_t*>(data);
+        for(uint32_t i = 0; i < size; ++i)
+        {
+            // Power cut: the rest of the write and everything after it is lost
+            if(m_budget == 0) return -1;
+            if(m_budget > 0) m_budget--;
+            m_memory[addr - START + i] &= bytes[i];
+            m_programmed++;
+        }
+        return 0;
+    }
+
+    int erase(uint32_t addr, uint32_t size)
+    {
+        if(!in_range(addr, size) || m_budget == 0) return -1;
+        std::fill(m_memory.begin() + (addr - START), m_memory.begin() + (addr - START + size), 0xFF);
+        m_erases++;
+        return 0;
+    }
+
+    uint32_t get_page_size() const { return 1; }
+    uint8_t get_erase_value() const { return 0xFF; }
+
+    // Number of bytes that can still be programmed before the power goes out, -1 for unlimited
+    void cut_after(long bytes) { m_budget = bytes; }
+
+    uint32_t erases() const { return m_erases; }
+    uint32_t programmed() const { return m_programmed; }
+
+private:
+    bool in_range(uint32_t addr, uint32_t size) const
+    {
+        return addr >= START && addr + size <= START + m_memory.size();
+    }
+
+    std::vector<uint8_t> m_memory;
+    long m_budget;
+    uint32_t m_erases, m_programmed;
+};
+
+using Store = ventctl::KVStore<FakeFlash>;
+
+static Store make_store(FakeFlash& flash)
+{
+    return Store(flash, FakeFlash::START, FakeFlash::START + FakeFlash::SECTOR, FakeFlash::SECTOR);
+}
+
+void test_kv_set_get()
+{
+    FakeFlash flash;
+    auto kv = make_store(flash);
+    TEST_ASSERT_TRUE(kv.init());
+
+    float gains[3] = {1.5, 0.25, 0.0};
+    TEST_ASSERT_TRUE(kv.set(0x100, gains, sizeof(gains)));
+    TEST_ASSERT_TRUE(kv.set(1, "api.example.com", 16));
+
+    float read[3] = {0};
+    size_t length = 0;
+    TEST_ASSERT_TRUE(kv.get(0x100, read, sizeof(read), &length));
+    TEST_ASSERT_EQUAL(sizeof(gains), length);
+    TEST_ASSERT_EQUAL_FLOAT(0.25, read[1]);
+    TEST_ASSERT_FALSE(kv.get(2, read, sizeof(read)));
+
+    // Index is rebuilt from flash
+    auto reloaded = make_store(flash);
+    TEST_ASSERT_TRUE(reloaded.init());
+    TEST_ASSERT_EQUAL(2, reloaded.count());
+
+    char api[16];
+    TEST_ASSERT_TRUE(reloaded.get(1, api, sizeof(api)));
+    TEST_ASSERT_EQUAL_STRING("api.example.com", api);
+
+    TEST_ASSERT_TRUE(reloaded.remove(1));
+    TEST_ASSERT_FALSE(reloaded.contains(1));
+
+    auto after_remove = make_store(flash);
+    TEST_ASSERT_TRUE(after_remove.init());
+    TEST_ASSERT_FALSE(after_remove.contains(1));
+    TEST_ASSERT_TRUE(after_remove.contains(0x100));
+}
+
+void test_kv_small_writes()
+{
+    FakeFlash flash;
+    auto kv = make_store(flash);
+    TEST_ASSERT_TRUE(kv.init());
+
+    float gains[3] = {1.5, 0.25, 0.0};
+    TEST_ASSERT_TRUE(kv.set(0x100, gains, sizeof(gains)));
+
+    // Unchanged values are not rewritten
+    auto before = flash.programmed();
+    TEST_ASSERT_TRUE(kv.set(0x100, gains, sizeof(gains)));
+    TEST_ASSERT_EQUAL(before, flash.programmed());
+
+    gains[0] = 2.0;
+    TEST_ASSERT_TRUE(kv.set(0x100, gains, sizeof(gains)));
+    TEST_ASSERT_EQUAL(before + 8 + 16, flash.programmed());
+}
+
+void test_kv_compaction()
+{
+    FakeFlash flash;
+    auto kv = make_store(flash);
+    TEST_ASSERT_TRUE(kv.init());
+
+    for(uint32_t i = 0; i < 2000; ++i)
+    {
+        uint32_t value = i;
+        TEST_ASSERT_TRUE(kv.set(10 + i % 4, &value, sizeof(value)));
+        kv.maintain();
+    }
+
+    TEST_ASSERT_EQUAL(4, kv.count());
+    TEST_ASSERT_GREATER_THAN(1, kv.sequence());
+
+    auto reloaded = make_store(flash);
+    TEST_ASSERT_TRUE(reloaded.init());
+
+    for(uint32_t k = 0; k < 4; ++k)
+    {
+        uint32_t value = 0;
+        TEST_ASSERT_TRUE(reloaded.get(10 + k, &value, sizeof(value)));
+        TEST_ASSERT_EQUAL(1996 + k, value);
+    }
+}
+
+// Cuts the power after every possible number of programmed bytes while a
+// value is updated (including compactions) and checks that the store comes
+// back with either the old or the new value.
+void test_kv_power_cut()
+{
+    for(long cut = 0; cut < 400; ++cut)
+    {
+        FakeFlash flash;
+        {
+            auto kv = make_store(flash);
+            TEST_ASSERT_TRUE(kv.init());
+
+            uint32_t fill = 0;
+            while(kv.used() + 2 * 16 < kv.capacity())
+            {
+                fill++;
+                TEST_ASSERT_TRUE(kv.set(1, &fill, sizeof(fill)));
+            }
+
+            uint32_t other = 0xCAFE;
+            TEST_ASSERT_TRUE(kv.set(2, &other, sizeof(other)));
+
+            // The value being written when the power went out may or may not survive
+            uint32_t attempted = fill;
+            flash.cut_after(cut);
+            for(uint32_t v = 1000; v < 1004; ++v)
+            {
+                attempted = v;
+                if(!kv.set(1, &v, sizeof(v))) break;
+                fill = v;
+            }
+            flash.cut_after(-1);
+
+            auto rebooted = make_store(flash);
+            TEST_ASSERT_TRUE(rebooted.init());
+            rebooted.maintain();
+
+            uint32_t value = 0;
+            TEST_ASSERT_TRUE(rebooted.get(1, &value, sizeof(value)));
+            TEST_ASSERT_TRUE(value == fill || value == attempted);
+
+            TEST_ASSERT_TRUE(rebooted.get(2, &value, sizeof(value)));
+            TEST_ASSERT_EQUAL(0xCAFE, value);
+
+            // And keeps working after the cut
+            value = 42;
+            TEST_ASSERT_TRUE(rebooted.set(1, &value, sizeof(value)));
+            TEST_ASSERT_TRUE(rebooted.get(1, &value, sizeof(value)));
+            TEST_ASSERT_EQUAL(42, value);
+        }
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_kv_set_get);
+    RUN_TEST(test_kv_small_writes);
+    RUN_TEST(test_kv_compaction);
+    RUN_TEST(test_kv_power_cut);
+    UNITY_END();
+}
@@ -0,0 +1,80 @@
+#include <LineEditor.hpp>
+#include <unity.h>
+#include <string>
+
+using Editor = ventctl::LineEditor<16>;
+
+static std::string echoed;
+
+static Editor::Result feed(Editor& editor, const char* input)
+{
+    auto echo = [](const char* data, size_t size) { echoed.append(data, size); };
+    auto result = Editor::Result::NONE;
+
+    for(; *input; ++input)
+    {
+        auto r = editor.feed(*input, echo);
+        if(r != Editor::Result::NONE) result = r;
+    }
+
+    return result;
+}
+
+void test_line_editor_lines()
+{
+    Editor editor;
+    echoed.clear();
+
+    TEST_ASSERT_EQUAL(Editor::Result::LINE, feed(editor, "set 1 2\r"));
+    TEST_ASSERT_EQUAL_STRING("set 1 2", editor.line());
+    TEST_ASSERT_EQUAL_STRING("set 1 2\r\n", echoed.c_str());
+
+    // The LF of a CRLF pair doesn't produce an empty line, a lone LF ends one
+    TEST_ASSERT_EQUAL(Editor::Result::NONE, feed(editor, "\n"));
+    TEST_ASSERT_EQUAL(Editor::Result::LINE, feed(editor, "ls\n"));
+    TEST_ASSERT_EQUAL_STRING("ls", editor.line());
+
+    TEST_ASSERT_EQUAL(Editor::Result::NONE, feed(editor, "\r\n"));
+}
+
+void test_line_editor_editing()
+{
+    Editor editor;
+
+    echoed.clear();
+    TEST_ASSERT_EQUAL(Editor::Result::LINE, feed(editor, "sex\x7Ft\r"));
+    TEST_ASSERT_EQUAL_STRING("set", editor.line());
+    TEST_ASSERT_EQUAL_STRING("sex\b \bt\r\n", echoed.c_str());
+
+    TEST_ASSERT_EQUAL(Editor::Result::LINE, feed(editor, "garbage\x15ps\r"));
+    TEST_ASSERT_EQUAL_STRING("ps", editor.line());
+
+    TEST_ASSERT_EQUAL(Editor::Result::CANCEL, feed(editor, "erase\x03"));
+    TEST_ASSERT_EQUAL(0, editor.size());
+
+    // Up arrow recalls the last line, other sequences are ignored
+    TEST_ASSERT_EQUAL(Editor::Result::LINE, feed(editor, "x\x1b[A\x1b[1;5C\r"));
+    TEST_ASSERT_EQUAL_STRING("ps", editor.line());
+}
+
+void test_line_editor_overflow()
+{
+    Editor editor;
+
+    TEST_ASSERT_EQUAL(Editor::Result::TOO_LONG, feed(editor, "set 10 123456789012345\r"));
+    TEST_ASSERT_EQUAL(Editor::Result::LINE, feed(editor, "set 10 1\r"));
+    TEST_ASSERT_EQUAL_STRING("set 10 1", editor.line());
+
+    // Capacity includes the terminator
+    TEST_ASSERT_EQUAL(Editor::Result::LINE, feed(editor, "123456789012345\r"));
+    TEST_ASSERT_EQUAL(15, strlen(editor.line()));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_line_editor_lines);
+    RUN_TEST(test_line_editor_editing);
+    RUN_TEST(test_line_editor_overflow);
+    UNITY_END();
+}
@@ -0,0 +1,99 @@
+#include <Metrics.hpp>
+#include <unity.h>
+#include <string>
+#include <algorithm>
+
+ventctl::Counter requests("requests");
+ventctl::Gauge level("level");
+ventctl::Histogram latency("latency");
+
+void test_metrics_counter_gauge()
+{
+    ++requests;
+    requests.increment(4);
+    TEST_ASSERT_EQUAL(5, requests.value());
+
+    level.set(2.5);
+    TEST_ASSERT_EQUAL_FLOAT(2.5, level.value());
+
+    TEST_ASSERT_EQUAL(3, ventctl::Metrics::count());
+    TEST_ASSERT_EQUAL_STRING("requests", ventctl::Metrics::descriptor(0).name);
+}
+
+void test_metrics_buckets()
+{
+    using ventctl::Metrics;
+
+    // Exact below 8, then four buckets per power of two
+    for(uint32_t v = 0; v < 8; ++v)
+        TEST_ASSERT_EQUAL(v, Metrics::bucket(v));
+    TEST_ASSERT_EQUAL(8, Metrics::bucket(8));
+    TEST_ASSERT_EQUAL(8, Metrics::bucket(9));
+    TEST_ASSERT_EQUAL(9, Metrics::bucket(10));
+    TEST_ASSERT_EQUAL(11, Metrics::bucket(15));
+    TEST_ASSERT_EQUAL(12, Metrics::bucket(16));
+
+    // Bucket floors are monotonic and consistent with bucket()
+    for(uint32_t b = 1; b < VC_METRICS_HIST_BUCKETS; ++b)
+    {
+        TEST_ASSERT_GREATER_THAN(Metrics::bucket_floor(b - 1), Metrics::bucket_floor(b));
+        TEST_ASSERT_EQUAL(b, Metrics::bucket(Metrics::bucket_floor(b)));
+    }
+
+    TEST_ASSERT_EQUAL(VC_METRICS_HIST_BUCKETS - 1, Metrics::bucket(0xFFFFFFFF));
+}
+
+void test_metrics_histogram()
+{
+    for(uint32_t i = 0; i < 99; ++i)
+        latency.record(100);
+    latency.record(5000);
+
+    TEST_ASSERT_EQUAL(100, latency.count());
+
+    auto& d = ventctl::Metrics::descriptor(2);
+    TEST_ASSERT_EQUAL(96, ventctl::Metrics::quantile(d, 0.5));
+    TEST_ASSERT_EQUAL(4096, ventctl::Metrics::quantile(d, 1.0));
+}
+
+void test_metrics_serialize()
+{
+    char buffer[128];
+    auto size = ventctl::Metrics::serialize(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(buffer), size);
+    TEST_ASSERT_EQUAL_STRING("requests=5;level=2.500;latency=100/149/96/96", buffer);
+
+    // Items that don't fit are dropped whole
+    size = ventctl::Metrics::serialize(buffer, 23);
+    TEST_ASSERT_EQUAL_STRING("requests=5;level=2.500", buffer);
+
+    std::string printed;
+    ventctl::Metrics::print([&](const char* line) { printed += line; });
+    TEST_ASSERT_EQUAL(3, std::count(printed.begin(), printed.end(), '\n'));
+}
+
+void test_metrics_histogram_sum()
+{
+    // Registered last so the serialized lines above stay the same
+    static ventctl::Histogram loop("loop.us");
+    for(int i = 0; i < 4; ++i)
+        loop.record(0xC0000000u);
+
+    auto& d = ventctl::Metrics::descriptor(ventctl::Metrics::count() - 1);
+    TEST_ASSERT_TRUE(ventctl::Metrics::sum(d) == 4 * (uint64_t)0xC0000000u);
+
+    char buffer[128];
+    ventctl::Metrics::serialize(buffer, sizeof(buffer));
+    TEST_ASSERT_NOT_NULL(std::strstr(buffer, "loop.us=4/3221225472/"));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_metrics_counter_gauge);
+    RUN_TEST(test_metrics_buckets);
+    RUN_TEST(test_metrics_histogram);
+    RUN_TEST(test_metrics_serialize);
+    RUN_TEST(test_metrics_histogram_sum);
+    UNITY_END();
+}
@@ -1,6 +1,7 @@
 #include <mqtt/types.hpp>
 #include <mqtt/serializer.hpp>
 #include <unity.h>
+#include <string>
 
 
 void test_mqtt_variable_int_size()
@@ -144,6 +145,80 @@ void test_mqtt_qos_only_field_parsing()
     //TEST_ASSERT(msg.variable_header.topic == "topic");
 }
 
+void test_ulog_deferred()
+{
+    static std::string last;
+    static size_t lines = 0;
+    ulog::callback_t cb = [](ulog::log_level, const char* line)
+    {
+        last = line;
+        lines++;
+    };
+    ulog::set_callback(cb);
+    ulog::process();
+    lines = 0;
+
+    ulog::warn("Packet #%u (%s), %d%% %.1f", (uint16_t)12, mqtt::MessageType::CONNECT, -3, 0.5);
+    TEST_ASSERT_EQUAL(0, lines);
+    TEST_ASSERT_EQUAL(1, ulog::process());
+    TEST_ASSERT_EQUAL_STRING("Packet #12 (CONNECT), -3% 0.5", last.c_str());
+
+    // A full ring drops new records and reports them once
+    for(size_t i = 0; i < ULOG_CAPACITY + 3; ++i)
+        ulog::info("record %u", i);
+    lines = 0;
+    TEST_ASSERT_EQUAL(ULOG_CAPACITY, ulog::process());
+    TEST_ASSERT_EQUAL(ULOG_CAPACITY + 1, lines);
+    TEST_ASSERT_EQUAL_STRING(("record " + std::to_string(ULOG_CAPACITY - 1)).c_str(), last.c_str());
+    TEST_ASSERT_EQUAL(0, ulog::process());
+}
+
+void test_mqtt_pool()
+{
+    alignas(32) static unsigned char buffer[2048];
+    mqtt::fixed_pool_resource pool(buffer, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL(32, mqtt::fixed_pool_resource::block_size(1));
+    TEST_ASSERT_EQUAL(64, mqtt::fixed_pool_resource::block_size(33));
+    TEST_ASSERT_EQUAL(0, mqtt::fixed_pool_resource::block_size(4097));
+
+    auto a = pool.try_allocate(600, 8);
+    auto b = pool.try_allocate(20, 8);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(b) % 32);
+    TEST_ASSERT_EQUAL(1024 + 32, pool.used());
+
+    // 992 bytes of arena left, not enough for a second 1024 byte block
+    TEST_ASSERT_NULL(pool.try_allocate(600, 8));
+    TEST_ASSERT_EQUAL(1, pool.failures());
+
+    // Freed blocks are reused by their size class
+    pool.deallocate(a, 600, 8);
+    TEST_ASSERT_EQUAL(32, pool.used());
+    TEST_ASSERT_EQUAL_PTR(a, pool.try_allocate(1000, 8));
+    TEST_ASSERT_EQUAL(1024 + 32, pool.peak());
+}
+
+void test_mqtt_message_lease()
+{
+    using message_t = mqtt::Message<mqtt::MessageType::PUBLISH>;
+
+    auto used = mqtt::pool.used();
+    {
+        auto msg = mqtt::lease<message_t>::make();
+        TEST_ASSERT_TRUE((bool)msg);
+        TEST_ASSERT_EQUAL(0, msg->payload.payload.size());
+        TEST_ASSERT_EQUAL(used + mqtt::fixed_pool_resource::block_size(sizeof(message_t)), mqtt::pool.used());
+
+        auto moved = std::move(msg);
+        TEST_ASSERT_FALSE((bool)msg);
+        TEST_ASSERT_TRUE((bool)moved);
+    }
+    // Released with the lease
+    TEST_ASSERT_EQUAL(used, mqtt::pool.used());
+}
+
 int main()
 {
     UNITY_BEGIN();
@@ -151,5 +226,8 @@ int main()
     RUN_TEST(test_mqtt_connect_generation);
     RUN_TEST(test_mqtt_connect_parsing);
     RUN_TEST(test_mqtt_qos_only_field_parsing);
+    RUN_TEST(test_ulog_deferred);
+    RUN_TEST(test_mqtt_pool);
+    RUN_TEST(test_mqtt_message_lease);
     UNITY_END();
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include <Peripheral.hpp>
+#include <Variable.hpp>
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+// Stands in for an ADC backed sensor, update() takes a sample
+class Sampled : public ventctl::Peripheral<float>
+{
+public:
+    Sampled(const char* name) :
+        Peripheral(name),
+        samples(0)
+        {}
+
+    VC_PERIPHERAL_DESCRIPTOR(float, "Sampled", "", ventctl::PeripheralDescriptor::ANALOG,
+        ventctl::PeripheralDescriptor::READABLE | ventctl::PeripheralDescriptor::UPDATES)
+
+    bool accept_value(float&) override { return false; }
+    float read_value() override { return samples; }
+    void update() override { order = ++s_tick; samples++; }
+
+    int samples, order = 0;
+    inline static int s_tick = 0;
+};
+
+// An output, nothing to do per loop
+class Output : public ventctl::Peripheral<bool>
+{
+public:
+    Output(const char* name) :
+        Peripheral(name),
+        state(false)
+        {}
+
+    VC_PERIPHERAL_DESCRIPTOR(bool, "Output", "", ventctl::PeripheralDescriptor::OUTPUT,
+        ventctl::PeripheralDescriptor::READABLE | ventctl::PeripheralDescriptor::WRITABLE)
+
+    bool accept_value(bool& v) override { state = v; return true; }
+    bool read_value() override { return state; }
+
+    bool state;
+};
+
+// Without a descriptor, update() is assumed to do something
+class Derived : public ventctl::Peripheral<float>
+{
+public:
+    Derived(const char* name, Sampled& source) :
+        Peripheral(name),
+        source(source)
+        {}
+
+    bool accept_value(float&) override { return false; }
+    float read_value() override { return value; }
+    void update() override { seen_order = source.order; order = ++Sampled::s_tick; value = source.samples; }
+
+    Sampled& source;
+    float value = 0;
+    int seen_order = 0, order = 0;
+};
+
+void test_update_schedule()
+{
+    // Registered out of order on purpose, computed peripherals go last
+    Sampled a("a");
+    Derived d("d", a);
+    Sampled b("b");
+    ventctl::Variable<float> v("v", 1.0f);
+    Output o("o");
+
+    ventctl::PeripheralBase::schedule_updates();
+    TEST_ASSERT_EQUAL(2, ventctl::PeripheralBase::scheduled(ventctl::PeripheralDescriptor::ANALOG));
+    TEST_ASSERT_EQUAL(0, ventctl::PeripheralBase::scheduled(ventctl::PeripheralDescriptor::OUTPUT));
+    TEST_ASSERT_EQUAL(0, ventctl::PeripheralBase::scheduled(ventctl::PeripheralDescriptor::VARIABLE));
+    TEST_ASSERT_EQUAL(1, ventctl::PeripheralBase::scheduled(ventctl::PeripheralDescriptor::COMPUTED));
+
+    ventctl::PeripheralBase::update_all();
+    TEST_ASSERT_EQUAL(1, a.samples);
+    TEST_ASSERT_EQUAL(1, b.samples);
+    TEST_ASSERT_TRUE(a.order < b.order);
+    TEST_ASSERT_TRUE(b.order < d.order);
+    TEST_ASSERT_EQUAL(a.order, d.seen_order);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, d.value);
+
+    // Registry changes reschedule on the next update
+    {
+        Sampled c("c");
+        ventctl::PeripheralBase::update_all();
+        TEST_ASSERT_EQUAL(1, c.samples);
+        TEST_ASSERT_EQUAL(3, ventctl::PeripheralBase::scheduled(ventctl::PeripheralDescriptor::ANALOG));
+    }
+    ventctl::PeripheralBase::update_all();
+    TEST_ASSERT_EQUAL(2, ventctl::PeripheralBase::scheduled(ventctl::PeripheralDescriptor::ANALOG));
+    TEST_ASSERT_EQUAL(3, a.samples);
+}
+
+template<typename F>
+static double measure(F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void test_update_benchmark()
+{
+    // Roughly the controller's mix: mostly variables and outputs, a few sensors
+    static char names[VC_PERIPH_CAP][8];
+    etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> owned;
+    for(int i = 0; i < 48; ++i)
+    {
+        snprintf(names[i], sizeof(names[i]), "p%d", i);
+        if(i % 8 == 0)
+            owned.push_back(new Sampled(names[i]));
+        else if(i % 3 == 0)
+            owned.push_back(new Output(names[i]));
+        else
+            owned.push_back(new ventctl::Variable<float>(names[i], 0.0f));
+    }
+
+    constexpr int ticks = 100000;
+    auto& all = ventctl::PeripheralBase::get_peripherals();
+
+    auto every = measure([&]
+    {
+        for(int t = 0; t < ticks; ++t)
+            for(auto p : all)
+                p->update();
+    });
+
+    ventctl::PeripheralBase::schedule_updates();
+    auto grouped = measure([&]
+    {
+        for(int t = 0; t < ticks; ++t)
+            ventctl::PeripheralBase::update_all();
+    });
+
+    printf("  %u peripherals, %u scheduled: %.1f ns/tick (every peripheral %.1f ns/tick)\n",
+        (unsigned)all.size(), (unsigned)ventctl::PeripheralBase::scheduled(ventctl::PeripheralDescriptor::ANALOG),
+        grouped / ticks, every / ticks);
+
+    for(auto p : owned)
+        delete p;
+    TEST_ASSERT_EQUAL(0, all.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_update_schedule);
+    RUN_TEST(test_update_benchmark);
+    return UNITY_END();
+}
@@ -2,8 +2,12 @@
 #include <unity.h>
 #include <functional>
 #include <cstdio>
-#include <iostream>
+#include <cmath>
 #include <Aperiodic.hpp>
+#include <Autotune.hpp>
+#include <etl/vector.h>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
 
 ventctl::PIDController<float, float>
     pid_ol(1.5, 1.5, 0.5),
@@ -42,7 +46,7 @@ private:
     float m_time, m_step, m_result;
 };
 
-PIDTest pto(pid_ol, 0.001), ptc(pid_cl, 0.0001);
+PIDTest pto(pid_ol, 0.001);
 
 void test_pid_open_loop()
 {
@@ -55,40 +59,44 @@ void test_pid_open_loop()
 
 void test_pid_closed_loop()
 {
-    const auto task = 3.0;
-    auto input = [&task](float time, float output)
-    { 
-        auto out = task - output; 
-        if(out == INFINITY)
-        {
-            return 10.0;
-        }
-        else if(out == -INFINITY)
-        {
-            return -10.0;
-        }
-        else
-        {
-            return out;
-        }
-    };
-    auto result_1 = ptc.test_until(1.0, input );
-    TEST_ASSERT_FLOAT_WITHIN(0.1, 2.2, result_1);
-    auto result_9 = ptc.test_until(4.0, input );
-    TEST_ASSERT_FLOAT_WITHIN(0.01, 3.0, result_9);
+    // P control of an integrating plant, dy/dt = u: y = task * (1 - e^(-Kp t))
+    const float task = 3.0, step = 0.0001;
+    float y = 0, time = 0;
+
+    for(; time < 1.0; time += step)
+        y += pid_cl.nextValue(task - y, time) * step;
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 3.0 * (1 - std::exp(-1.5)), y);
+
+    for(; time < 4.0; time += step)
+        y += pid_cl.nextValue(task - y, time) * step;
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 3.0, y);
 }
 
+class TestInput : public ventctl::UnitBase
+{
+public:
+    TestInput() : value(0) {}
+
+    virtual float getValueUncached(float)
+    {
+        return value;
+    }
+
+    float value;
+};
+
 void test_aperiodic_step_response()
 {
-    ventctl::Aperiodic w(1, 1);
+    TestInput step;
+    step.value = 1.0;
+    ventctl::Aperiodic w(step, 1, 1);
 
     float result[5] = {0};
 
     for(int i = 1; i < 500; i++)
     {
-        auto r = w.nextValue(1.0, i * 0.01);
+        auto r = w.getValue(i * 0.01);
         if(i % 100 == 0) result[i/100] = r;
-        std::cout << "Value: " << r << std::endl;
     }
 
     TEST_ASSERT_FLOAT_WITHIN(0.1, 0, result[0]);
@@ -96,11 +104,212 @@ void test_aperiodic_step_response()
     TEST_ASSERT_FLOAT_WITHIN(0.1, 1, result[4]);
 }
 
+// First order plus dead time plant: tau * dy/dt = K * u(t - theta) - y
+class FOPDTPlant
+{
+public:
+    FOPDTPlant(float k, float tau, float theta, float step) :
+        m_k(k),
+        m_tau(tau),
+        m_step(step),
+        m_y(0),
+        m_head(0),
+        m_delay(std::round(theta / step))
+        {
+            m_buffer.resize(m_delay + 1, 0.0);
+        }
+
+    float next(float u)
+    {
+        m_buffer[m_head] = u;
+        m_head = (m_head + 1) % m_buffer.size();
+        auto delayed = m_buffer[m_head];
+        m_y += (m_k * delayed - m_y) * m_step / m_tau;
+        return m_y;
+    }
+
+private:
+    float m_k, m_tau, m_step, m_y;
+    size_t m_head, m_delay;
+    etl::vector<float, 1024> m_buffer;
+};
+
+void test_autotune_rules()
+{
+    using tune_t = ventctl::Autotune<ventctl::PIDController<float, float>>;
+
+    auto zn = tune_t::computeGains(10.0, 4.0, tune_t::Rule::ZIEGLER_NICHOLS);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 6.0, zn.kp);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 3.0, zn.ki);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 3.0, zn.kd);
+
+    auto tl = tune_t::computeGains(10.0, 4.0, tune_t::Rule::TYREUS_LUYBEN);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 4.545, tl.kp);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0.5165, tl.ki);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 2.886, tl.kd);
+}
+
+void test_autotune_fopdt()
+{
+    const float step = 0.01, setpoint = 1.0;
+    FOPDTPlant plant(2.0, 10.0, 2.0, step);
+    ventctl::PIDController<float, float> pid(0.1, 0.0, 0.0);
+    TestInput error;
+    ventctl::Unit<ventctl::PIDController<float, float>> ctl(pid, error);
+    ventctl::Autotune<ventctl::PIDController<float, float>> tune(pid, error, ctl, 0.5, 0.5, 0.01);
+
+    float y = 0;
+    float time = 0;
+
+    float u = 0;
+    tune.start(time);
+    for(; time < 600 && tune.running(); time += step)
+    {
+        error.value = setpoint - y;
+        u = tune.getValue(time);
+        y = plant.next(u);
+    }
+
+    TEST_ASSERT_TRUE(tune.state() == decltype(tune)::State::DONE);
+
+    // The hand-off is proportional only, nothing integrated over the tuning run
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, pid.getP() * error.value, u);
+    error.value = setpoint - y;
+    u = tune.getValue(time);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 0.0, u);
+    y = plant.next(u);
+    time += step;
+
+    // Analytical crossover of this plant: atan(w * tau) + w * theta = pi, Ku = sqrt(1 + (w * tau)^2) / K
+    TEST_ASSERT_FLOAT_WITHIN(1.5, 7.4, tune.ultimatePeriod());
+    TEST_ASSERT_FLOAT_WITHIN(1.2, 4.3, tune.ultimateGain());
+
+    ventctl::PIDGains gains;
+    TEST_ASSERT_TRUE(tune.takeResult(gains));
+    TEST_ASSERT_FALSE(tune.takeResult(gains));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, gains.kp, pid.getP());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, gains.ki, pid.getI());
+
+    // The tuned loop has to settle on the setpoint
+    for(auto end = time + 300; time < end; time += step)
+    {
+        error.value = setpoint - y;
+        y = plant.next(tune.getValue(time));
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(0.05, setpoint, y);
+}
+
+void test_pid_derivative_gain()
+{
+    ventctl::PIDController<float, float> pid(0.0, 0.0, 2.0);
+
+    float result = 0;
+    for(int i = 0; i <= 100; i++)
+    {
+        auto t = i * 0.01f;
+        result = pid.nextValue(t * 0.5f, t);
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 1.0, result);
+}
+
+void test_pid_derivative_on_measurement()
+{
+    ventctl::PIDController<float, float> pid(0.0, 0.0, 1.0);
+    TestInput measurement;
+    pid.setMeasurement(measurement);
+    pid.setDerivativeFilter(0.1);
+
+    pid.nextValue(0.0, 0.0);
+    auto kick = pid.nextValue(10.0, 0.01);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, kick);
+
+    // Measurement ramps up at 1/s, the filtered derivative converges to -Kd
+    float result = 0;
+    for(int i = 2; i <= 200; i++)
+    {
+        auto t = i * 0.01f;
+        measurement.value = t - 0.01f;
+        result = pid.nextValue(10.0 - measurement.value, t);
+    }
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-2, -1.0, result);
+}
+
+void test_pid_derivative_first_sample()
+{
+    ventctl::PIDController<float, float> pid(0.0, 0.0, 1.0);
+    TestInput measurement;
+    pid.setMeasurement(measurement);
+    measurement.value = 20.0;
+
+    // A warm room at the first sample is not a step
+    pid.setLastTime(0);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, pid.nextValue(0.0, 0.01));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, pid.nextValue(0.0, 0.02));
+
+    // Nor after a reset, e.g. when autotune hands the loop back
+    pid.reset();
+    measurement.value = 25.0;
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, pid.nextValue(0.0, 0.03));
+    measurement.value = 25.01;
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, -1.0, pid.nextValue(0.0, 0.04));
+}
+
+void test_pid_feed_forward()
+{
+    ventctl::PIDController<float, float> pid(1.0, 0.0, 0.0);
+    TestInput ff;
+    ff.value = 2.0;
+    pid.setFeedForward(ff, 0.5);
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 1.5, pid.nextValue(0.5, 1.0));
+}
+
+void test_gain_schedule()
+{
+    using pid_t = ventctl::GainScheduledPID<float, float>;
+
+    etl::vector<ventctl::GainPoint<float>, 3> table = {
+        {-20.0, 2.0, 0.2, 0.0},
+        {0.0, 1.0, 0.1, 0.0},
+        {20.0, 0.5, 0.0, 0.0}
+    };
+
+    auto g = pid_t::interpolate(table, -10.0);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 1.5, g.kp);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.15, g.ki);
+
+    g = pid_t::interpolate(table, 30.0);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.5, g.kp);
+
+    g = pid_t::interpolate(table, -40.0);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 2.0, g.kp);
+
+    TestInput outdoor, error;
+    outdoor.value = 10.0;
+    error.value = 1.0;
+    pid_t pid(table, outdoor);
+    ventctl::Unit<pid_t> unit(pid, error);
+
+    // Kp = 0.75, Ki = 0.05 at 10 degrees, integrated over 1s
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.8, unit.getValue(1.0));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.75, pid.getP());
+}
+
 int main()
 {
     UNITY_BEGIN();
     RUN_TEST(test_pid_open_loop);
     RUN_TEST(test_pid_closed_loop);
     RUN_TEST(test_aperiodic_step_response);
+    RUN_TEST(test_pid_derivative_gain);
+    RUN_TEST(test_pid_derivative_on_measurement);
+    RUN_TEST(test_pid_derivative_first_sample);
+    RUN_TEST(test_pid_feed_forward);
+    RUN_TEST(test_gain_schedule);
+    RUN_TEST(test_autotune_rules);
+    RUN_TEST(test_autotune_fopdt);
     UNITY_END();
 }
\ No newline at end of file
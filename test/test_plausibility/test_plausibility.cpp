@@ -0,0 +1,155 @@
+#include <Plausibility.hpp>
+#include <Unit.hpp>
+#include <unity.h>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+using ventctl::Quality;
+using ventctl::Plausibility;
+using ventctl::PlausibilityLimits;
+
+// A sensor whose reading and quality the test sets
+class FakeSensor : public ventctl::Peripheral<float>
+{
+public:
+    FakeSensor(const char* name) :
+        Peripheral(name),
+        value(0),
+        state(Quality::GOOD)
+        {}
+
+    bool accept_value(float&) override { return false; }
+    float read_value() override { return value; }
+    Quality quality() const override { return state; }
+
+    float value;
+    Quality state;
+};
+
+void test_open_and_short()
+{
+    Plausibility check;
+    TEST_ASSERT_EQUAL(Quality::NO_DATA, check.quality());
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(2.0f, 20.0f, 0));
+    TEST_ASSERT_EQUAL(Quality::OPEN, check.check(0.0f, 130.0f, 1000));
+    TEST_ASSERT_EQUAL(Quality::SHORT, check.check(3.3f, -77.0f, 2000));
+    TEST_ASSERT_EQUAL(Quality::NO_DATA, check.check(NAN, NAN, 3000));
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, check.last_good());
+
+    // Inverted divider: open pulls up
+    check.set_limits({3.2f, 0.02f, 0, 0, 0});
+    TEST_ASSERT_EQUAL(Quality::OPEN, check.check(3.3f, 0, 4000));
+    TEST_ASSERT_EQUAL(Quality::SHORT, check.check(0.0f, 0, 5000));
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(1.0f, 0, 6000));
+}
+
+void test_rate_limit()
+{
+    Plausibility check({0.02f, 3.2f, 5.0f, 0, 0});
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(2.0f, 20.0f, 0));
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(2.0f, 20.004f, 1000));
+
+    // A 3 degC spike within 10 ms is rejected, the reference stays put
+    TEST_ASSERT_EQUAL(Quality::RATE, check.check(2.0f, 23.0f, 11000));
+    TEST_ASSERT_EQUAL_FLOAT(20.004f, check.last_good());
+
+    // The same step is believable a second later
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(2.0f, 23.0f, 1001000));
+    TEST_ASSERT_EQUAL_FLOAT(23.0f, check.last_good());
+}
+
+void test_stuck()
+{
+    Plausibility check({0.02f, 3.2f, 0, 1000000, 0.001f});
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(2.0f, 20.0f, 0));
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(2.0f, 20.0005f, 500000));
+    TEST_ASSERT_EQUAL(Quality::STUCK, check.check(2.0f, 20.0f, 1000000));
+    TEST_ASSERT_EQUAL(Quality::GOOD, check.check(2.0f, 20.01f, 1100000));
+
+    // Timestamps wrap
+    Plausibility wrap({0.02f, 3.2f, 0, 1000000, 0});
+    TEST_ASSERT_EQUAL(Quality::GOOD, wrap.check(2.0f, 20.0f, 0xFFFFFF00u));
+    TEST_ASSERT_EQUAL(Quality::GOOD, wrap.check(2.0f, 20.0f, 100000));
+    TEST_ASSERT_EQUAL(Quality::STUCK, wrap.check(2.0f, 20.0f, 1000000));
+}
+
+void test_source_failover()
+{
+    FakeSensor room("Room"), exhaust("Exhaust");
+    ventctl::Source src(room);
+    src.setRedundant(exhaust);
+
+    room.value = 21.0f;
+    exhaust.value = 22.0f;
+    TEST_ASSERT_EQUAL_FLOAT(21.0f, src.getValue(1));
+    TEST_ASSERT_FALSE(src.substituted());
+
+    room.state = Quality::OPEN;
+    room.value = 130.0f;
+    TEST_ASSERT_EQUAL_FLOAT(22.0f, src.getValue(2));
+    TEST_ASSERT_TRUE(src.substituted());
+    TEST_ASSERT_EQUAL(Quality::OPEN, src.quality());
+
+    // Both gone and no model: hold the last good value
+    exhaust.state = Quality::SHORT;
+    TEST_ASSERT_EQUAL_FLOAT(22.0f, src.getValue(3));
+
+    room.state = Quality::GOOD;
+    room.value = 21.5f;
+    TEST_ASSERT_EQUAL_FLOAT(21.5f, src.getValue(4));
+    TEST_ASSERT_FALSE(src.substituted());
+}
+
+void test_source_model()
+{
+    FakeSensor supply("Supply"), setting("Setting");
+    ventctl::Source src(supply), src_setting(setting);
+    src.setModel(src_setting);
+
+    setting.value = 35.0f;
+    supply.value = 33.0f;
+    TEST_ASSERT_EQUAL_FLOAT(33.0f, src.getValue(1));
+
+    supply.state = Quality::STUCK;
+    TEST_ASSERT_EQUAL_FLOAT(35.0f, src.getValue(2));
+
+    setting.value = 40.0f;
+    TEST_ASSERT_EQUAL_FLOAT(40.0f, src.getValue(3));
+}
+
+void test_source_faulted_from_boot()
+{
+    FakeSensor coolant("Coolant");
+    ventctl::Source src(coolant);
+    coolant.state = Quality::OPEN;
+    coolant.value = 130.0f;
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, src.getValue(1));
+    TEST_ASSERT_TRUE(src.substituted());
+
+    ventctl::Source src_default(coolant);
+    src_default.setDefault(20.0f);
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, src_default.getValue(1));
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, src_default.getValue(2));
+
+    coolant.state = Quality::GOOD;
+    coolant.value = 15.0f;
+    TEST_ASSERT_EQUAL_FLOAT(15.0f, src_default.getValue(3));
+    TEST_ASSERT_FALSE(src_default.substituted());
+
+    // Once a good value was seen, that is held rather than the default
+    coolant.state = Quality::SHORT;
+    coolant.value = -77.0f;
+    TEST_ASSERT_EQUAL_FLOAT(15.0f, src_default.getValue(4));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_open_and_short);
+    RUN_TEST(test_rate_limit);
+    RUN_TEST(test_stuck);
+    RUN_TEST(test_source_failover);
+    RUN_TEST(test_source_model);
+    RUN_TEST(test_source_faulted_from_boot);
+    return UNITY_END();
+}
@@ -0,0 +1,108 @@
+#include <Pulse.hpp>
+#include <unity.h>
+#include <cstdint>
+#include <random>
+
+using ventctl::PulseCapture;
+
+std::mt19937 rng(7);
+
+// A fan with two pulses per revolution at a steady speed, with timestamp jitter
+static uint32_t record_fan(PulseCapture& c, uint32_t start, float rpm, int edges, float jitter_us)
+{
+    std::normal_distribution<float> noise(0, jitter_us);
+    auto period = 60e6f / rpm / 2;
+    uint32_t t = start;
+    for(int i = 0; i < edges; ++i)
+    {
+        t = start + (uint32_t)(i * period);
+        c.edge(t + (int32_t)noise(rng));
+    }
+    return t;
+}
+
+void test_pulse_rpm()
+{
+    PulseCapture c(100, 2000000);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, c.frequency(0));
+
+    auto last = record_fan(c, 1000, 1500, 200, 20);
+    TEST_ASSERT_EQUAL(200, c.count());
+
+    auto r = c.read();
+    TEST_ASSERT_EQUAL(VC_PULSE_HISTORY - 1, r.periods);
+    TEST_ASSERT_FLOAT_WITHIN(10.0, 1500.0, PulseCapture::rpm(c.frequency(last + 1000), 2));
+    TEST_ASSERT_FLOAT_WITHIN(200.0, 20000.0, c.period(last + 1000));
+}
+
+void test_pulse_debounce()
+{
+    PulseCapture c(500, 2000000);
+
+    // Every edge of a 10 Hz contact bounces twice within 200 us
+    uint32_t t = 0;
+    for(int i = 0; i < 50; ++i)
+    {
+        t = i * 100000;
+        c.edge(t);
+        c.edge(t + 80);
+        c.edge(t + 190);
+    }
+
+    auto r = c.read();
+    TEST_ASSERT_EQUAL(50, r.count);
+    TEST_ASSERT_EQUAL(100, r.rejected);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 10.0, c.frequency(t + 10));
+}
+
+void test_pulse_stop()
+{
+    PulseCapture c(100, 2000000);
+    auto last = record_fan(c, 0, 3000, 50, 0);
+
+    // Decelerates with the time since the last edge, then reads zero after the timeout
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 100.0, c.frequency(last + 5000));
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 10.0, c.frequency(last + 100000));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, c.frequency(last + 2000001));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, c.period(last + 2000001));
+}
+
+void test_pulse_wrap()
+{
+    // The microsecond counter wraps in the middle of the recording
+    PulseCapture c(100, 2000000);
+    auto last = record_fan(c, 0xFFFFFFFFu - 50000, 1200, 20, 0);
+    TEST_ASSERT_TRUE(last < 0x80000000u);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 1200.0, PulseCapture::rpm(c.frequency(last + 100), 2));
+
+    // Stopped for longer than a wrap, polled now and then: stays stopped
+    for(uint64_t t = 1; t <= 0x100000000ull + 1000000; t += 60000000)
+        TEST_ASSERT_EQUAL_FLOAT(0.0f, c.frequency(last + 3000000 + (uint32_t)t));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, c.frequency(last + 1000));
+
+    // And runs again on new edges
+    auto again = record_fan(c, last + 10000000, 600, 20, 0);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 600.0, PulseCapture::rpm(c.frequency(again + 100), 2));
+}
+
+void test_pulse_few_edges()
+{
+    PulseCapture c(100, 2000000);
+    c.edge(1000);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, c.frequency(1500));
+
+    c.edge(11000);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 100.0, c.frequency(11500));
+    TEST_ASSERT_EQUAL(1, c.read().periods);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pulse_rpm);
+    RUN_TEST(test_pulse_debounce);
+    RUN_TEST(test_pulse_stop);
+    RUN_TEST(test_pulse_wrap);
+    RUN_TEST(test_pulse_few_edges);
+    return UNITY_END();
+}
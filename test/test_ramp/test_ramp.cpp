@@ -0,0 +1,157 @@
+#include <Ramp.hpp>
+#include <unity.h>
+
+using ventctl::Ramp;
+
+void test_ramp_linear()
+{
+    auto r = Ramp::plan(0.0f, 0.5f, 0.25f, Ramp::Shape::LINEAR);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 2.0, r.duration);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.25, r.at(1.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.25, r.slope(0.5f));
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, r.at(2.0f));
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, r.at(100.0f));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, r.at(-1.0f));
+}
+
+void test_ramp_s_curve()
+{
+    // Down from full speed: starts and ends flat, never faster than the slew rate
+    auto r = Ramp::plan(1.0f, 0.2f, 0.5f, Ramp::Shape::S_CURVE);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 2.4, r.duration);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, r.slope(0.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0.0, r.slope(r.duration - 1e-4f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.6, r.at(r.duration / 2));
+
+    float peak = 0;
+    for(float t = 0; t < r.duration; t += 0.001f)
+        peak = std::fmax(peak, std::fabs(r.slope(t)));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0.5, peak);
+}
+
+void test_ramp_unlimited()
+{
+    auto r = Ramp::plan(0.1f, 0.9f, 0.0f, Ramp::Shape::S_CURVE);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, r.duration);
+    TEST_ASSERT_TRUE(r.done(0.0f));
+    TEST_ASSERT_EQUAL_FLOAT(0.9f, r.at(0.0f));
+}
+
+void test_ramp_fill()
+{
+    // 0 -> 1 in 10 ms at 1 kHz: ten steps, then the target
+    auto r = Ramp::plan(0.0f, 1.0f, 100.0f, Ramp::Shape::LINEAR);
+    uint16_t samples[16];
+    TEST_ASSERT_TRUE(r.fill(1000, 0, samples, 16));
+    TEST_ASSERT_EQUAL(410, samples[0]);
+    TEST_ASSERT_EQUAL(2048, samples[4]);
+    for(int i = 9; i < 16; ++i)
+        TEST_ASSERT_EQUAL(4095, samples[i]);
+
+    // Rendered in halves like the DMA buffer, the pieces line up
+    auto s = Ramp::plan(0.2f, 0.8f, 0.3f, Ramp::Shape::S_CURVE);
+    uint16_t whole[64], halves[64];
+    s.fill(10, 0, whole, 64);
+    TEST_ASSERT_FALSE(s.fill(10, 0, halves, 16));
+    s.fill(10, 16, halves + 16, 16);
+    s.fill(10, 32, halves + 32, 32);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(whole, halves, 64);
+
+    uint16_t last = 0;
+    for(auto code : whole)
+    {
+        TEST_ASSERT_TRUE(code >= last);
+        last = code;
+    }
+    TEST_ASSERT_EQUAL(Ramp::code(0.8f), last);
+}
+
+void test_ramp_retarget()
+{
+    // A new target mid-ramp continues from where the rendered samples stopped
+    auto r = Ramp::plan(0.0f, 1.0f, 0.5f, Ramp::Shape::S_CURVE);
+    uint16_t samples[32];
+    r.fill(100, 0, samples, 32);
+
+    auto next = Ramp::plan(r.at(32 / 100.0f), 0.3f, 0.5f, Ramp::Shape::S_CURVE);
+    uint16_t more[1];
+    next.fill(100, 0, more, 1);
+    TEST_ASSERT_INT_WITHIN(2, samples[31], more[0]);
+
+    TEST_ASSERT_EQUAL(0, Ramp::code(-0.1f));
+    TEST_ASSERT_EQUAL(4095, Ramp::code(1.5f));
+    TEST_ASSERT_EQUAL(0, Ramp::code(NAN));
+}
+
+// AOut's bookkeeping: writes retarget at the next unrendered sample, the DMA interrupt renders half a buffer
+struct RampPlayer
+{
+    static constexpr float rate = 1000;
+    static constexpr uint32_t half = 32;
+
+    Ramp ramp = Ramp::hold(0);
+    uint32_t next = 0;
+    bool running = false;
+    float slew;
+
+    void write(float value)
+    {
+        if(ramp.targets(value)) return;
+        auto t = running ? next / rate : ramp.duration;
+        ramp = ramp.retarget(t, value, slew, Ramp::Shape::S_CURVE);
+        next = 0;
+        running = true;
+    }
+
+    // Returns the last sample played by this half buffer
+    float play()
+    {
+        if(!running) return ramp.to;
+        uint16_t samples[half];
+        running = !ramp.fill(rate, next, samples, half);
+        next += half;
+        return samples[half - 1] / 4095.0f;
+    }
+};
+
+void test_ramp_retarget_every_tick()
+{
+    // A control loop writing at 100 Hz, the DMA interrupt runs every 32 ms
+    RampPlayer repeat{}, wobble{};
+    repeat.slew = wobble.slew = 0.2f;
+
+    float out_repeat = 0, out_wobble = 0, reached = 0;
+    for(int ms = 0; ms < 10000; ++ms)
+    {
+        if(ms % 10 == 0)
+        {
+            repeat.write(1.0f);
+            // Setpoint noise of a few codes
+            wobble.write(ms % 20 ? 0.999f : 0.997f);
+        }
+
+        if(ms % 32 == 31)
+        {
+            out_repeat = repeat.play();
+            out_wobble = wobble.play();
+            if(!reached && out_repeat >= 1.0f) reached = ms / 1000.0f;
+        }
+    }
+
+    // A single S-curve takes 1.5 / 0.2 = 7.5 s
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 7.5, reached);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, out_repeat);
+    TEST_ASSERT_FLOAT_WITHIN(0.003, 0.998, out_wobble);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_ramp_linear);
+    RUN_TEST(test_ramp_s_curve);
+    RUN_TEST(test_ramp_unlimited);
+    RUN_TEST(test_ramp_fill);
+    RUN_TEST(test_ramp_retarget);
+    RUN_TEST(test_ramp_retarget_every_tick);
+    return UNITY_END();
+}
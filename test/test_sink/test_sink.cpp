@@ -0,0 +1,265 @@
+#include <Unit.hpp>
+#include <ModulatedSink.hpp>
+#include <unity.h>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+class DummyRelay : public ventctl::Peripheral<bool>
+{
+public:
+    DummyRelay(const char* name) :
+        Peripheral(name),
+        m_value(false),
+        m_switches(0)
+        {}
+
+    bool accept_value(bool& v) override
+    {
+        if(v != m_value) m_switches++;
+        m_value = v;
+        return true;
+    }
+
+    bool read_value() override { return m_value; }
+
+    uint32_t switches() const { return m_switches; }
+
+private:
+    bool m_value;
+    uint32_t m_switches;
+};
+
+class ConstInput : public ventctl::UnitBase
+{
+public:
+    ConstInput() : value(0) {}
+
+    virtual float getValueUncached(float)
+    {
+        return value;
+    }
+
+    float value;
+};
+
+DummyRelay h0("H_0"), h1("H_1"), h2("H_2"), h3("H_3"), h4("H_4"), h5("H_5");
+
+etl::vector<ventctl::PeriphRef<bool>, 6> heaters = {h0, h1, h2, h3, h4, h5};
+
+static uint32_t total_switches()
+{
+    uint32_t sum = 0;
+    for(auto& h : heaters)
+        sum += static_cast<DummyRelay&>(h.get()).switches();
+    return sum;
+}
+
+static void reset_heaters()
+{
+    for(auto& h : heaters)
+        h.get() = false;
+}
+
+void test_stepped_sink_unordered()
+{
+    ConstInput demand;
+    ventctl::SteppedOutputSink sink(demand, heaters, false);
+
+    demand.value = 0.5;
+    sink.update(1.0);
+
+    TEST_ASSERT_TRUE(h0.read_value());
+    TEST_ASSERT_TRUE(h2.read_value());
+    TEST_ASSERT_FALSE(h3.read_value());
+
+    demand.value = 0.0;
+    sink.update(2.0);
+
+    TEST_ASSERT_FALSE(h0.read_value());
+}
+
+void test_stepped_sink_ordered()
+{
+    ConstInput demand;
+    ventctl::SteppedOutputSink sink(demand, heaters, true);
+
+    // 63 * 0.1 ~= 6 = 0b000110
+    demand.value = 0.1;
+    sink.update(1.0);
+
+    TEST_ASSERT_FALSE(h0.read_value());
+    TEST_ASSERT_TRUE(h1.read_value());
+    TEST_ASSERT_TRUE(h2.read_value());
+    TEST_ASSERT_FALSE(h3.read_value());
+
+    reset_heaters();
+}
+
+// Runs a slowly varying demand for an hour and returns delivered stage-seconds
+static float simulate(ventctl::ModulatedOutputSink& sink, ConstInput& demand, float& requested)
+{
+    const float step = 0.1;
+    float delivered = 0;
+    requested = 0;
+
+    for(float t = 0; t < 3600; t += step)
+    {
+        demand.value = 0.35 + 0.1 * std::sin(t / 600);
+        sink.update(t);
+        sink.tick(t);
+
+        for(auto& h : heaters)
+            if(h.get().read_value()) delivered += step;
+
+        requested += demand.value * heaters.size() * step;
+    }
+
+    return delivered;
+}
+
+void test_time_proportional_sink()
+{
+    reset_heaters();
+    auto before = total_switches();
+
+    ConstInput demand;
+    ventctl::ModulatedOutputSink sink(demand, heaters, ventctl::ModulatedOutputSink::Mode::TIME_PROPORTIONAL, 60.0, 10.0, 10.0);
+
+    float requested;
+    auto delivered = simulate(sink, demand, requested);
+
+    TEST_ASSERT_FLOAT_WITHIN(requested * 0.02, requested, delivered);
+
+    auto switches = total_switches() - before;
+    TEST_ASSERT_EQUAL(sink.switchCount(), switches);
+    printf("Time proportional: %u switches per hour\n", (unsigned)switches);
+
+    // At most two switches per period, plus stage changes
+    TEST_ASSERT_LESS_THAN(200, switches);
+
+    // Wear is spread over all stages
+    for(size_t i = 0; i < heaters.size(); i++)
+        TEST_ASSERT_GREATER_THAN(0, sink.switchCount(i));
+}
+
+void test_sigma_delta_sink()
+{
+    reset_heaters();
+    auto before = total_switches();
+
+    ConstInput demand;
+    ventctl::ModulatedOutputSink sink(demand, heaters, ventctl::ModulatedOutputSink::Mode::SIGMA_DELTA, 30.0, 30.0, 30.0);
+
+    float requested;
+    auto delivered = simulate(sink, demand, requested);
+
+    TEST_ASSERT_FLOAT_WITHIN(requested * 0.02, requested, delivered);
+
+    auto switches = total_switches() - before;
+    printf("Sigma-delta: %u switches per hour\n", (unsigned)switches);
+    TEST_ASSERT_LESS_THAN(250, switches);
+}
+
+void test_sink_min_times()
+{
+    reset_heaters();
+
+    ConstInput demand;
+    demand.value = 0.02; // 1.2s of a 60s period on a single stage, below minimum on time
+    ventctl::ModulatedOutputSink sink(demand, heaters, ventctl::ModulatedOutputSink::Mode::TIME_PROPORTIONAL, 60.0, 10.0, 10.0);
+
+    float on = 0;
+    float last_change = 0;
+    bool last = false;
+    float min_run = INFINITY;
+
+    for(float t = 0; t < 3600; t += 0.1)
+    {
+        sink.update(t);
+        sink.tick(t);
+
+        bool state = false;
+        for(auto& h : heaters) state = state || h.get().read_value();
+        if(state) on += 0.1;
+
+        if(state != last)
+        {
+            if(last && t - last_change < min_run) min_run = t - last_change;
+            last_change = t;
+            last = state;
+        }
+    }
+
+    TEST_ASSERT_GREATER_OR_EQUAL(9.9, min_run);
+    TEST_ASSERT_FLOAT_WITHIN(15.0, 0.02 * 6 * 3600, on);
+}
+
+// Records every write the way a port would see it
+class PortBank : public ventctl::StageBank
+{
+public:
+    PortBank() : pattern(0), writes(0), max_changed(0) {}
+
+    size_t stages() const override { return 6; }
+
+    void write_stages(uint32_t mask, uint32_t value) override
+    {
+        auto next = (pattern & ~mask) | (value & mask);
+        auto changed = (uint32_t)__builtin_popcount(next ^ pattern);
+        if(changed > max_changed) max_changed = changed;
+        pattern = next;
+        writes++;
+    }
+
+    uint32_t pattern, writes, max_changed;
+};
+
+void test_stepped_sink_bank()
+{
+    ConstInput demand;
+    PortBank bank;
+    ventctl::SteppedOutputSink sink(demand, bank, false);
+
+    demand.value = 0.5;
+    sink.update(1.0);
+    TEST_ASSERT_EQUAL_HEX32(0x07, bank.pattern);
+    TEST_ASSERT_EQUAL(1, bank.writes);
+
+    ventctl::SteppedOutputSink ordered(demand, bank, true);
+    demand.value = 0.1;
+    ordered.update(2.0);
+    TEST_ASSERT_EQUAL_HEX32(0x06, bank.pattern);
+    TEST_ASSERT_EQUAL(2, bank.writes);
+}
+
+void test_modulated_sink_bank()
+{
+    ConstInput demand;
+    PortBank bank;
+    ventctl::ModulatedOutputSink sink(demand, bank, ventctl::ModulatedOutputSink::Mode::SIGMA_DELTA, 30.0);
+
+    // From nothing to full power switches every stage, in one write
+    demand.value = 1.0;
+    sink.update(1);
+    sink.tick(1);
+    TEST_ASSERT_EQUAL_HEX32(0x3F, bank.pattern);
+    TEST_ASSERT_EQUAL(1, bank.writes);
+    TEST_ASSERT_EQUAL(6, bank.max_changed);
+
+    // Ticks without a switch do not touch the port
+    sink.tick(2);
+    TEST_ASSERT_EQUAL(1, bank.writes);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stepped_sink_unordered);
+    RUN_TEST(test_stepped_sink_ordered);
+    RUN_TEST(test_time_proportional_sink);
+    RUN_TEST(test_sigma_delta_sink);
+    RUN_TEST(test_sink_min_times);
+    RUN_TEST(test_stepped_sink_bank);
+    RUN_TEST(test_modulated_sink_bank);
+    UNITY_END();
+}
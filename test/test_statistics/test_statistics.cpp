@@ -0,0 +1,189 @@
+#include <Statistics.hpp>
+#include <unity.h>
+#include <cmath>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+class Sensor : public ventctl::Peripheral<float>
+{
+public:
+    Sensor(const char* name) :
+        Peripheral(name),
+        value(0),
+        state(ventctl::Quality::GOOD)
+        {}
+
+    bool accept_value(float& v) override { value = v; return true; }
+    float read_value() override { return value; }
+    ventctl::Quality quality() const override { return state; }
+
+    float value;
+    ventctl::Quality state;
+};
+
+uint32_t now = 0;
+uint32_t test_time() { return now; }
+
+Sensor room("T_Room");
+ventctl::Statistics room_1m(room, 60, &test_time);
+
+void test_welford()
+{
+    ventctl::Welford w;
+    const float values[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    for(auto v : values) w.add(v);
+
+    TEST_ASSERT_EQUAL(8, w.count());
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 5.0, w.mean());
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 32.0 / 7, w.variance());
+
+    // Large offset, small spread: the naive sum of squares loses everything here
+    ventctl::Welford offset;
+    for(int i = 0; i < 1000; ++i) offset.add(10000.0f + (i % 2 ? 0.5f : -0.5f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0.25 * 1000 / 999, offset.variance());
+}
+
+void test_p2_quantile()
+{
+    ventctl::P2Quantile median(0.5), p95(0.95);
+
+    TEST_ASSERT_TRUE(std::isnan(median.value()));
+    median.add(3);
+    median.add(1);
+    median.add(2);
+    TEST_ASSERT_EQUAL_FLOAT(2, median.value());
+
+    // Shuffled 0..9999 (multiplicative LCG over a prime field)
+    median.reset();
+    uint32_t x = 1;
+    for(int i = 0; i < 10006; ++i)
+    {
+        x = (x * 48271u) % 10007u;
+        if(x >= 10000) continue;
+        median.add(x);
+        p95.add(x);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(100, 5000, median.value());
+    TEST_ASSERT_FLOAT_WITHIN(100, 9500, p95.value());
+}
+
+void test_statistics_names()
+{
+    TEST_ASSERT_EQUAL_STRING("T_Room.n_1m", room_1m.name());
+    TEST_ASSERT_EQUAL_STRING("T_Room.max_1m", room_1m.stat(ventctl::Statistics::Kind::MAX).name());
+
+    auto p = ventctl::PeripheralBase::find("T_Room.p95_1m", 13);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_TRUE(p->accepts_type<float>());
+}
+
+void test_statistics_windows()
+{
+    using Kind = ventctl::Statistics::Kind;
+    auto read = [](const char* name)
+    {
+        float v = NAN;
+        ventctl::PeripheralBase::find(name, strlen(name))->get_value(&v);
+        return v;
+    };
+
+    // One sample per second, a one second spike in the first minute
+    for(int i = 0; i < 60; ++i, now += 1000000)
+    {
+        room.value = i == 30 ? 35.0f : 20.0f + (i % 2);
+        room_1m.update();
+    }
+
+    // Partial window until the first one completes
+    TEST_ASSERT_EQUAL(60, room_1m.read_value());
+    TEST_ASSERT_EQUAL_FLOAT(35.0, read("T_Room.max_1m"));
+
+    for(int i = 0; i < 30; ++i, now += 1000000)
+    {
+        room.value = 10;
+        room_1m.update();
+    }
+
+    // Still the first minute, the spike is kept while the next window fills
+    TEST_ASSERT_EQUAL(60, room_1m.read_value());
+    TEST_ASSERT_EQUAL_FLOAT(35.0, read("T_Room.max_1m"));
+    TEST_ASSERT_EQUAL_FLOAT(20.0, read("T_Room.min_1m"));
+    TEST_ASSERT_EQUAL_FLOAT(20.0, read("T_Room.first_1m"));
+    TEST_ASSERT_EQUAL_FLOAT(21.0, read("T_Room.last_1m"));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, (29 * 20 + 30 * 21 + 35) / 60.0, room_1m.value(Kind::MEAN));
+    TEST_ASSERT_GREATER_THAN(1.0, room_1m.value(Kind::STDDEV));
+
+    // The update at t = 120 closes the second minute
+    for(int i = 0; i <= 30; ++i, now += 1000000)
+        room_1m.update();
+
+    TEST_ASSERT_EQUAL_FLOAT(10.0, read("T_Room.max_1m"));
+    TEST_ASSERT_EQUAL_FLOAT(10.0, read("T_Room.p95_1m"));
+    TEST_ASSERT_EQUAL_FLOAT(0.0, read("T_Room.std_1m"));
+}
+
+void test_statistics_wrap()
+{
+    Sensor coolant("T_C");
+    ventctl::Statistics coolant_10s(coolant, 10, &test_time);
+
+    // Starts five seconds before the microsecond clock wraps
+    now = 0xFFFFFFFFu - 4999999;
+    for(int i = 0; i < 10; ++i, now += 1000000)
+    {
+        coolant.value = i;
+        coolant_10s.update();
+    }
+    coolant.value = 50;
+    coolant_10s.update();
+    TEST_ASSERT_EQUAL(10, coolant_10s.read_value());
+    TEST_ASSERT_EQUAL_FLOAT(9, coolant_10s.value(ventctl::Statistics::Kind::MAX));
+
+    // And the next window closes on time too
+    for(int i = 0; i < 10; ++i)
+    {
+        now += 1000000;
+        coolant_10s.update();
+    }
+    TEST_ASSERT_EQUAL(10, coolant_10s.read_value());
+    TEST_ASSERT_EQUAL_FLOAT(50, coolant_10s.value(ventctl::Statistics::Kind::MAX));
+}
+
+void test_statistics_invalid_samples()
+{
+    using Kind = ventctl::Statistics::Kind;
+    Sensor coolant("T_C");
+    ventctl::Statistics coolant_10s(coolant, 10, &test_time);
+
+    now = 0;
+    for(int i = 0; i < 10; ++i, now += 1000000)
+    {
+        coolant.value = 20;
+        coolant.state = ventctl::Quality::GOOD;
+        // A lost conversion and an open sensor reading 130 degC
+        if(i == 3) coolant.value = NAN;
+        if(i == 6)
+        {
+            coolant.value = 130;
+            coolant.state = ventctl::Quality::OPEN;
+        }
+        coolant_10s.update();
+    }
+
+    TEST_ASSERT_EQUAL(8, coolant_10s.read_value());
+    TEST_ASSERT_EQUAL_FLOAT(20, coolant_10s.value(Kind::MAX));
+    TEST_ASSERT_EQUAL_FLOAT(20, coolant_10s.value(Kind::MEAN));
+    TEST_ASSERT_EQUAL_FLOAT(0, coolant_10s.value(Kind::STDDEV));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_welford);
+    RUN_TEST(test_p2_quantile);
+    RUN_TEST(test_statistics_names);
+    RUN_TEST(test_statistics_windows);
+    RUN_TEST(test_statistics_wrap);
+    RUN_TEST(test_statistics_invalid_samples);
+    return UNITY_END();
+}
@@ -0,0 +1,357 @@
+#include <Telemetry.hpp>
+#include <unity.h>
+#include <cstring>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+template<typename T>
+class Source : public ventctl::Peripheral<T>
+{
+public:
+    Source(const char* name) :
+        ventctl::Peripheral<T>(name),
+        value()
+        {}
+
+    bool accept_value(T& v) override { value = v; return true; }
+    T read_value() override { return value; }
+
+    T value;
+};
+
+Source<float> temp("temp");
+Source<int> rpm("rpm");
+Source<bool> heater("heater");
+
+// Stands in for the MQTT socket, keeps the last payload
+struct MockSocket
+{
+    bool connected = true;
+    int publishes = 0;
+    char last[VC_TELEMETRY_BATCH_SIZE + 1];
+
+    bool operator()(const char* data, size_t size)
+    {
+        if(!connected) return false;
+        std::memcpy(last, data, size);
+        last[size] = 0;
+        publishes++;
+        return true;
+    }
+};
+
+void test_telemetry_queue()
+{
+    ventctl::telemetry::Queue<int, 3> q;
+    for(int i = 0; i < 3; ++i)
+    {
+        *q.reserve() = i;
+        q.commit();
+    }
+    TEST_ASSERT_TRUE(q.full());
+    TEST_ASSERT_NULL(q.reserve());
+
+    TEST_ASSERT_EQUAL(0, q.front());
+    q.pop();
+    *q.reserve() = 3;
+    q.commit();
+    TEST_ASSERT_EQUAL(1, q.at(0));
+    TEST_ASSERT_EQUAL(3, q.at(2));
+    TEST_ASSERT_EQUAL(3, q.peak());
+}
+
+void test_telemetry_aggregate()
+{
+    using namespace ventctl::telemetry;
+
+    Sampler sampler(1.0);
+    TEST_ASSERT_EQUAL(3, sampler.add_all());
+
+    SnapshotQueue snapshots;
+    WindowQueue windows;
+    Aggregator aggregator(4.0);
+
+    const float temps[] = {20, 22, 21, 25, 30};
+    for(int i = 0; i < 5; ++i)
+    {
+        temp.value = temps[i];
+        rpm.value = 100 * i;
+        heater.value = i & 1;
+        TEST_ASSERT_TRUE(sampler.poll(i * 1000000, snapshots));
+        // Not due yet
+        TEST_ASSERT_TRUE(sampler.poll(i * 1000000 + 500000, snapshots));
+        aggregator.process(snapshots, windows);
+    }
+
+    // The sample at t = 4 closed the first window
+    TEST_ASSERT_EQUAL(1, windows.size());
+    auto& w = windows.front();
+    TEST_ASSERT_EQUAL(4, w.samples);
+    TEST_ASSERT_EQUAL_UINT32(0, w.start);
+    TEST_ASSERT_EQUAL_UINT32(3000000, w.end);
+    TEST_ASSERT_EQUAL_FLOAT(20.0, w.values[0].min);
+    TEST_ASSERT_EQUAL_FLOAT(25.0, w.values[0].max);
+    TEST_ASSERT_EQUAL_FLOAT(22.0, w.values[0].mean);
+    TEST_ASSERT_EQUAL_FLOAT(150.0, w.values[1].mean);
+    TEST_ASSERT_EQUAL_FLOAT(0.5, w.values[2].mean);
+}
+
+void test_telemetry_overflow()
+{
+    ventctl::telemetry::Sampler sampler(1.0);
+    for(size_t i = 0; i < VC_TELEMETRY_CHANNELS; ++i)
+        TEST_ASSERT_TRUE(sampler.add(temp));
+    TEST_ASSERT_EQUAL(0, sampler.overflow());
+
+    // Counted so the firmware can warn about channels it does not report
+    TEST_ASSERT_FALSE(sampler.add(rpm));
+    TEST_ASSERT_EQUAL(1, sampler.overflow());
+    TEST_ASSERT_EQUAL(VC_TELEMETRY_CHANNELS, sampler.channels());
+}
+
+void test_telemetry_encode()
+{
+    using namespace ventctl::telemetry;
+
+    Sampler sampler(1.0);
+    sampler.add(temp);
+    sampler.add(rpm);
+    Encoder encoder(sampler, 1);
+
+    Window w{};
+    w.start = 10000000;
+    w.end = 19000000;
+    w.samples = 10;
+    w.channels = 2;
+    w.values[0] = Summary{20.0f, 25.5f, 22.25f, 10};
+    w.values[1] = Summary{0, 0, 0, 0};
+
+    char buffer[128];
+    size_t next = 0;
+    auto n = encoder.encode(w, buffer, sizeof(buffer), next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"t\":19.0,\"dt\":9.0,\"n\":10,\"v\":{\"temp\":[20.0,22.2,25.5]}}", buffer);
+    TEST_ASSERT_EQUAL(2, next);
+
+    next = 0;
+    n = encoder.encode_meta(buffer, sizeof(buffer), next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"temp\":{\"kind\":\"Peripheral\",\"type\":\"float\",\"unit\":\"\"},"
+        "\"rpm\":{\"kind\":\"Peripheral\",\"type\":\"int\",\"unit\":\"\"}}", buffer);
+    TEST_ASSERT_EQUAL(2, next);
+
+    // Split in parts when the buffer only holds one channel
+    next = 0;
+    n = encoder.encode_meta(buffer, 64, next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"temp\":{\"kind\":\"Peripheral\",\"type\":\"float\",\"unit\":\"\"}}", buffer);
+    TEST_ASSERT_EQUAL(1, next);
+    n = encoder.encode_meta(buffer, 64, next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"rpm\":{\"kind\":\"Peripheral\",\"type\":\"int\",\"unit\":\"\"}}", buffer);
+    TEST_ASSERT_EQUAL(2, next);
+
+    // JSON has no infinity
+    w.values[0] = Summary{-INFINITY, 25.5f, 22.25f, 10};
+    next = 0;
+    n = encoder.encode(w, buffer, sizeof(buffer), next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"t\":19.0,\"dt\":9.0,\"n\":10,\"v\":{\"temp\":[null,22.2,25.5]}}", buffer);
+    w.values[0] = Summary{20.0f, 25.5f, 22.25f, 10};
+
+    // A channel that does not fit even alone is left out, the object stays valid
+    next = 0;
+    n = encoder.encode(w, buffer, 40, next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"t\":19.0,\"dt\":9.0,\"n\":10,\"v\":{}}", buffer);
+    TEST_ASSERT_EQUAL(1, encoder.truncated());
+    TEST_ASSERT_EQUAL(2, next);
+}
+
+void test_telemetry_split()
+{
+    using namespace ventctl::telemetry;
+
+    Sampler sampler(1.0);
+    sampler.add(temp);
+    sampler.add(rpm);
+    sampler.add(heater);
+    Encoder encoder(sampler, 1);
+
+    WindowQueue windows;
+    auto w = windows.reserve();
+    *w = Window{};
+    w->start = 0;
+    w->end = 1000000;
+    w->samples = 2;
+    w->channels = 3;
+    w->values[0] = Summary{20.0f, 21.0f, 20.5f, 2};
+    w->values[1] = Summary{100.0f, 200.0f, 150.0f, 2};
+    w->values[2] = Summary{0.0f, 1.0f, 0.5f, 2};
+    windows.commit();
+
+    // Room for two channels per message
+    char buffer[80];
+    size_t next = 0;
+    auto n = encoder.encode(*w, buffer, sizeof(buffer), next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"t\":1.0,\"dt\":1.0,\"n\":2,\"v\":{\"temp\":[20.0,20.5,21.0],\"rpm\":[100.0,150.0,200.0]}}", buffer);
+    TEST_ASSERT_EQUAL(2, next);
+    n = encoder.encode(*w, buffer, sizeof(buffer), next);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"t\":1.0,\"dt\":1.0,\"n\":2,\"v\":{\"heater\":[0.0,0.5,1.0]}}", buffer);
+    TEST_ASSERT_EQUAL(3, next);
+    TEST_ASSERT_EQUAL(0, encoder.truncated());
+
+    // Through the queues every channel of the window is reported
+    MessageQueue messages;
+    encoder.process(windows, messages);
+    TEST_ASSERT_TRUE(windows.empty());
+    TEST_ASSERT_EQUAL(1, messages.size());
+    TEST_ASSERT_NOT_NULL(std::strstr(messages.front().data, "\"heater\":[0.0,0.5,1.0]"));
+}
+
+void test_telemetry_end_to_end()
+{
+    MockSocket socket;
+    auto sink = [&](const char* data, size_t size) { return socket(data, size); };
+
+    // 1 s samples, 2 s windows, 2 windows per publish
+    static ventctl::Telemetry telemetry(1.0, 2.0, 2, 60.0);
+    telemetry.sampler().add_all();
+
+    temp.value = 21.5;
+    uint32_t t = 0;
+    for(; socket.publishes == 0 && t < 20000000; t += 1000000)
+        telemetry.update(t, sink);
+
+    TEST_ASSERT_EQUAL(1, socket.publishes);
+    TEST_ASSERT_EQUAL('[', socket.last[0]);
+    TEST_ASSERT_NOT_NULL(std::strstr(socket.last, "\"temp\":[21.500,21.500,21.500]"));
+    TEST_ASSERT_NOT_NULL(std::strstr(socket.last, "},{"));
+    TEST_ASSERT_EQUAL(2, telemetry.stats().published);
+
+    // Disconnected: everything queues up until the sampler has to drop
+    socket.connected = false;
+    for(int i = 0; i < 60; ++i, t += 1000000)
+        telemetry.update(t, sink);
+
+    auto stats = telemetry.stats();
+    TEST_ASSERT_GREATER_THAN(0, stats.failed);
+    TEST_ASSERT_GREATER_THAN(0, stats.stalled);
+    TEST_ASSERT_GREATER_THAN(0, stats.dropped);
+    TEST_ASSERT_EQUAL(2, stats.published);
+
+    // Reconnected: the backlog drains in batches, nothing encoded was lost
+    socket.connected = true;
+    for(int i = 0; i < 10; ++i, t += 1000000)
+        telemetry.update(t, sink);
+
+    stats = telemetry.stats();
+    TEST_ASSERT_GREATER_OR_EQUAL(2 + VC_TELEMETRY_MESSAGES, stats.published);
+}
+
+void test_telemetry_wrap()
+{
+    using namespace ventctl::telemetry;
+
+    Sampler sampler(1.0);
+    sampler.add(temp);
+    SnapshotQueue snapshots;
+    WindowQueue windows;
+    Aggregator aggregator(2.0);
+
+    // Two seconds before the microsecond clock wraps, then on past it
+    uint32_t t = 0xFFFFFFFFu - 1999999;
+    for(int i = 0; i < 8; ++i, t += 1000000)
+    {
+        TEST_ASSERT_TRUE(sampler.poll(t, snapshots));
+        TEST_ASSERT_TRUE(sampler.poll(t + 500000, snapshots));
+        aggregator.process(snapshots, windows);
+        while(!windows.empty())
+        {
+            TEST_ASSERT_EQUAL(2, windows.front().samples);
+            TEST_ASSERT_EQUAL_UINT32(1000000, windows.front().end - windows.front().start);
+            windows.pop();
+        }
+    }
+    TEST_ASSERT_EQUAL(0, snapshots.dropped());
+
+    // The publisher's linger keeps counting across the wrap too
+    Publisher publisher(4, 2.0);
+    MessageQueue messages;
+    auto m = messages.reserve();
+    std::strcpy(m->data, "{}");
+    m->size = 2;
+    messages.commit();
+
+    MockSocket socket;
+    auto sink = [&](const char* data, size_t size) { return socket(data, size); };
+    t = 0xFFFFFFFFu - 999999;
+    publisher.process(t, messages, sink);
+    publisher.process(t + 1500000, messages, sink);
+    TEST_ASSERT_EQUAL(0, socket.publishes);
+    publisher.process(t + 2000000, messages, sink);
+    TEST_ASSERT_EQUAL(1, socket.publishes);
+    TEST_ASSERT_EQUAL_STRING("[{}]", socket.last);
+}
+
+void test_telemetry_payload_limit()
+{
+    using namespace ventctl::telemetry;
+
+    MessageQueue messages;
+    auto queue = [&](const char* text)
+    {
+        auto m = messages.reserve();
+        m->size = std::strlen(text);
+        std::memcpy(m->data, text, m->size);
+        messages.commit();
+    };
+
+    // A transport that takes 30 bytes, but refuses anything over 20 anyway
+    Publisher publisher(4, 0, 30);
+    size_t longest = 0;
+    int sent = 0;
+    auto sink = [&](const char*, size_t size)
+    {
+        if(size > longest) longest = size;
+        if(size > 20) return false;
+        sent++;
+        return true;
+    };
+
+    for(int i = 0; i < 4; ++i)
+        queue("{\"x\":12345}");
+    for(uint32_t t = 0; t < 10 && !messages.empty(); ++t)
+        publisher.process(t, messages, sink);
+
+    // Rejected pairs were split and sent one by one
+    TEST_ASSERT_TRUE(messages.empty());
+    TEST_ASSERT_EQUAL(4, sent);
+    TEST_ASSERT_EQUAL(4, publisher.published());
+    TEST_ASSERT_LESS_OR_EQUAL(30, longest);
+    TEST_ASSERT_GREATER_THAN(0, publisher.failed());
+
+    // A message longer than the transport takes is given up on
+    queue("{\"a_very_long_channel_name\":[1,2,3]}");
+    queue("{\"x\":1}");
+    publisher.process(20, messages, sink);
+    TEST_ASSERT_TRUE(messages.empty());
+    TEST_ASSERT_EQUAL(1, publisher.discarded());
+    TEST_ASSERT_EQUAL(5, publisher.published());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_telemetry_queue);
+    RUN_TEST(test_telemetry_aggregate);
+    RUN_TEST(test_telemetry_overflow);
+    RUN_TEST(test_telemetry_encode);
+    RUN_TEST(test_telemetry_split);
+    RUN_TEST(test_telemetry_end_to_end);
+    RUN_TEST(test_telemetry_wrap);
+    RUN_TEST(test_telemetry_payload_limit);
+    return UNITY_END();
+}
@@ -0,0 +1,67 @@
+#include <Trace.hpp>
+#include <unity.h>
+#include <string>
+
+void test_trace_disabled()
+{
+    ventctl::Trace::enable(false);
+    ventctl::Trace::clear();
+
+    {
+        VC_TRACE_ZONE("idle");
+    }
+
+    TEST_ASSERT_EQUAL(0, ventctl::Trace::count());
+}
+
+void test_trace_nested_zones()
+{
+    ventctl::Trace::clear();
+    ventctl::Trace::enable();
+
+    {
+        VC_TRACE_ZONE("outer");
+        {
+            VC_TRACE_ZONE("inner");
+        }
+    }
+
+    ventctl::Trace::enable(false);
+
+    TEST_ASSERT_EQUAL(2, ventctl::Trace::count());
+
+    // Zones are recorded when they end
+    auto& inner = ventctl::Trace::event(0);
+    auto& outer = ventctl::Trace::event(1);
+    TEST_ASSERT_EQUAL_STRING("inner", inner.zone);
+    TEST_ASSERT_EQUAL_STRING("outer", outer.zone);
+    TEST_ASSERT_TRUE(outer.start <= inner.start);
+    TEST_ASSERT_TRUE(outer.duration >= inner.duration);
+}
+
+void test_trace_ring_and_dump()
+{
+    ventctl::Trace::clear();
+
+    for(uint32_t i = 0; i < VC_TRACE_CAPACITY + 10; ++i)
+        ventctl::Trace::record("zone", i, i + 1);
+
+    TEST_ASSERT_EQUAL(VC_TRACE_CAPACITY, ventctl::Trace::count());
+    TEST_ASSERT_EQUAL(10, ventctl::Trace::event(0).start);
+
+    std::string dump;
+    ventctl::Trace::dump([&](const char* line) { dump += line; });
+
+    auto header = "T " + std::to_string(ventctl::Trace::frequency()) + " " + std::to_string(VC_TRACE_CAPACITY) + "\n";
+    TEST_ASSERT_EQUAL(0, dump.find(header));
+    TEST_ASSERT_TRUE(dump.find("E zone 10 1\n") != std::string::npos);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_trace_disabled);
+    RUN_TEST(test_trace_nested_zones);
+    RUN_TEST(test_trace_ring_and_dump);
+    UNITY_END();
+}
@@ -0,0 +1,162 @@
+#include <Unit.hpp>
+#include <Saturation.hpp>
+#include <PID.hpp>
+#include <Aperiodic.hpp>
+#include <unity.h>
+
+etl::vector<ventctl::PeripheralBase*, VC_PERIPH_CAP> ventctl::PeripheralBase::m_peripherals(0);
+
+class DummyValue : public ventctl::Peripheral<float>
+{
+public:
+    DummyValue(const char* name) :
+        Peripheral(name),
+        m_value(0)
+        {}
+
+    using Peripheral::operator=;
+
+    bool accept_value(float& v) override
+    {
+        m_value = v;
+        return true;
+    }
+
+    float read_value() override { return m_value; }
+
+private:
+    float m_value;
+};
+
+// Counts its own evaluations
+class Probe : public ventctl::UnitBase
+{
+public:
+    Probe(UnitBase& input) : m_input(input), count(0)
+    {
+        dependsOn(input);
+    }
+
+    virtual float getValueUncached(float time)
+    {
+        count++;
+        return m_input.getValue(time);
+    }
+
+    uint32_t count;
+
+private:
+    UnitBase& m_input;
+};
+
+void test_unchanged_inputs_are_skipped()
+{
+    DummyValue setting("Setting"), sensor("Sensor");
+    ventctl::Source src_setting(setting), src_sensor(sensor);
+    ventctl::Gain scaled(2, src_setting);
+    ventctl::Sum error({{scaled, false}, {src_sensor, true}});
+    Probe probe(scaled);
+
+    setting = 10.0f;
+    sensor = 3.0f;
+
+    TEST_ASSERT_EQUAL_FLOAT(17.0, error.getValue(1.0));
+    TEST_ASSERT_EQUAL_FLOAT(20.0, probe.getValue(1.0));
+    TEST_ASSERT_EQUAL(1, probe.count);
+
+    // Only the sensor changes, the setting branch keeps its cached value
+    ventctl::UnitBase::takeStats();
+    for(int i = 2; i < 10; ++i)
+    {
+        sensor = (float)i;
+        TEST_ASSERT_EQUAL_FLOAT(20.0 - i, error.getValue(i));
+        probe.getValue(i);
+    }
+
+    TEST_ASSERT_EQUAL(1, probe.count);
+
+    auto stats = ventctl::UnitBase::takeStats();
+    // Two sources and the sum per tick
+    TEST_ASSERT_EQUAL(8 * 3, stats.evaluated);
+    TEST_ASSERT_GREATER_THAN(0, stats.skipped);
+
+    setting = 11.0f;
+    TEST_ASSERT_EQUAL_FLOAT(13.0, error.getValue(10.0));
+    TEST_ASSERT_EQUAL_FLOAT(22.0, probe.getValue(10.0));
+    TEST_ASSERT_EQUAL(2, probe.count);
+}
+
+void test_source_epsilon()
+{
+    DummyValue sensor("Noisy");
+    ventctl::Source src(sensor, 0.1);
+    Probe probe(src);
+
+    sensor = 1.0f;
+    probe.getValue(1.0);
+
+    // Noise below epsilon is not propagated
+    sensor = 1.05f;
+    TEST_ASSERT_EQUAL_FLOAT(1.0, probe.getValue(2.0));
+    sensor = 0.96f;
+    TEST_ASSERT_EQUAL_FLOAT(1.0, probe.getValue(3.0));
+    TEST_ASSERT_EQUAL(1, probe.count);
+
+    sensor = 1.2f;
+    TEST_ASSERT_EQUAL_FLOAT(1.2, probe.getValue(4.0));
+    TEST_ASSERT_EQUAL(2, probe.count);
+}
+
+void test_time_dependent_units()
+{
+    DummyValue setting("Constant");
+    ventctl::Source src(setting);
+    ventctl::Saturation lim(0, 1);
+    ventctl::Unit<ventctl::Saturation> limited(lim, src);
+    ventctl::PIDController<float, float> pid(0, 1, 0);
+    ventctl::Unit<ventctl::PIDController<float, float>> integral(pid, src);
+
+    TEST_ASSERT_FALSE(limited.isTimeDependent());
+    TEST_ASSERT_TRUE(integral.isTimeDependent());
+    TEST_ASSERT_TRUE(src.isTimeDependent());
+
+    setting = 0.5f;
+    integral.setLastTime(0);
+
+    // The integral keeps growing with a constant input
+    for(int i = 1; i <= 10; ++i)
+        integral.getValue(i);
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 5.0, integral.getValue(10.0));
+    TEST_ASSERT_EQUAL_FLOAT(0.5, limited.getValue(10.0));
+}
+
+void test_aperiodic_step()
+{
+    DummyValue setting("Step");
+    ventctl::Source src(setting);
+    ventctl::Aperiodic filter(src, 1, 1);
+
+    setting = 1.0f;
+    float result[6] = {0};
+    for(int i = 1; i <= 500; i++)
+    {
+        auto r = filter.getValue(i * 0.01f);
+        if(i % 100 == 0) result[i / 100] = r;
+    }
+
+    // 1 - e^(-t), one step behind
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0.632, result[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0.865, result[2]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0.993, result[5]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_unchanged_inputs_are_skipped);
+    RUN_TEST(test_source_epsilon);
+    RUN_TEST(test_time_dependent_units);
+    RUN_TEST(test_aperiodic_step);
+    UNITY_END();
+}
@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""
+Compiles a text control graph description into the binary form loaded by
+ventctl::Graph (see lib/ventctl/include/Graph.hpp) and validates it.
+
+Each non-empty line declares one node, inputs must be declared earlier:
+
+    name = type [inputs...] [key=value...]
+
+    src_room  = source periph=T_Room
+    error     = sum +src_setting -src_room
+    ctl       = pid error kp=2 ki=0.5 kd=0 lo=0 hi=50 kb=1
+    heaters   = modulated ctl periph=H_0,H_1 mode=tp period=60 min_on=10 min_off=10
+
+Usage:
+    graphc.py graph.txt -o graph.bin [--peripherals T_Room,H_0,...] [--hex]
+    graphc.py --check graph.bin
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = 0x52474356
+VERSION = 1
+MAX_NODES = 64
+MAX_SIZE = 2048
+MAX_STAGES = 8
+
+# type id, input count (None = 1..4 signed), params in order with defaults, peripheral kind
+NODE_TYPES = {
+    'source':     (0, 0, [], 'float'),
+    'sum':        (1, None, [], None),
+    'gain':       (2, 1, [('k', None)], None),
+    'saturation': (3, 1, [('lo', None), ('hi', None)], None),
+    'pid':        (4, 1, [('kp', None), ('ki', 0.0), ('kd', 0.0), ('lo', 0.0), ('hi', 0.0), ('kb', 0.0)], None),
+    'aperiodic':  (5, 1, [('k', 1.0), ('tp', None)], None),
+    'intfilter':  (6, 1, [('k', None)], None),
+    'relay':      (7, 1, [('off', None), ('on', None)], None),
+    'sink':       (8, 1, [], 'float'),
+    'stepped':    (9, 1, [('ordered', 0.0)], 'bool'),
+    'modulated':  (10, 1, [('mode', 0.0), ('period', None), ('min_on', 0.0), ('min_off', 0.0)], 'bool'),
+}
+
+SINKS = {'sink', 'stepped', 'modulated'}
+MODES = {'tp': 0.0, 'sd': 1.0}
+
+
+class GraphError(Exception):
+    pass
+
+
+def parse_value(key, value):
+    if key == 'mode' and value in MODES:
+        return MODES[value]
+    try:
+        return float(value)
+    except ValueError:
+        raise GraphError("invalid value for %s: %r" % (key, value))
+
+
+def compile_graph(text, peripherals=None):
+    names = {}
+    kinds = []
+    nodes = []
+
+    for lineno, line in enumerate(text.splitlines(), 1):
+        line = line.split('#', 1)[0].strip()
+        if not line:
+            continue
+
+        try:
+            if '=' not in line:
+                raise GraphError("expected 'name = type ...'")
+
+            name, rest = [x.strip() for x in line.split('=', 1)]
+            tokens = rest.split()
+            if not tokens:
+                raise GraphError("missing node type")
+
+            kind = tokens[0]
+            if kind not in NODE_TYPES:
+                raise GraphError("unknown node type %r" % kind)
+            if name in names:
+                raise GraphError("node %r redefined" % name)
+
+            type_id, arity, param_spec, periph_kind = NODE_TYPES[kind]
+
+            inputs, signs, kv = [], [], {}
+            for tok in tokens[1:]:
+                if '=' in tok:
+                    k, v = tok.split('=', 1)
+                    kv[k] = v
+                    continue
+
+                sign = 1.0
+                if tok[0] in '+-':
+                    sign = -1.0 if tok[0] == '-' else 1.0
+                    tok = tok[1:]
+                if tok not in names:
+                    raise GraphError("unknown input %r (inputs must be declared first)" % tok)
+                if kinds[names[tok]] in SINKS:
+                    raise GraphError("sink %r can't be used as an input" % tok)
+                inputs.append(names[tok])
+                signs.append(sign)
+
+            if arity is None:
+                if not 1 <= len(inputs) <= 4:
+                    raise GraphError("sum takes 1 to 4 inputs")
+                params = signs
+            else:
+                if len(inputs) != arity:
+                    raise GraphError("%s takes %d input(s), got %d" % (kind, arity, len(inputs)))
+                params = []
+                for key, default in param_spec:
+                    if key in kv:
+                        params.append(parse_value(key, kv.pop(key)))
+                    elif default is None:
+                        raise GraphError("missing parameter %r" % key)
+                    else:
+                        params.append(default)
+
+            periph = kv.pop('periph', '')
+            if periph_kind and not periph:
+                raise GraphError("%s needs periph=" % kind)
+            if not periph_kind and periph:
+                raise GraphError("%s doesn't take a peripheral" % kind)
+            if kv:
+                raise GraphError("unknown parameter(s) %s" % ', '.join(sorted(kv)))
+
+            periph_names = periph.split(',') if periph else []
+            if kind in ('stepped', 'modulated') and len(periph_names) > MAX_STAGES:
+                raise GraphError("at most %d stages" % MAX_STAGES)
+            if kind in ('source', 'sink') and len(periph_names) != 1:
+                raise GraphError("%s takes a single peripheral" % kind)
+            if peripherals is not None:
+                for p in periph_names:
+                    if p not in peripherals:
+                        raise GraphError("unknown peripheral %r" % p)
+
+            encoded_name = periph.encode('ascii')
+            if len(encoded_name) > 255:
+                raise GraphError("peripheral list too long")
+
+            body = struct.pack('<BBBB', type_id, len(inputs), len(params), len(encoded_name))
+            body += struct.pack('<%dH' % len(inputs), *inputs)
+            body += struct.pack('<%df' % len(params), *params)
+            body += encoded_name
+            nodes.append(body)
+
+            names[name] = len(kinds)
+            kinds.append(kind)
+        except GraphError as e:
+            raise GraphError("line %d: %s" % (lineno, e))
+
+    if len(nodes) > MAX_NODES:
+        raise GraphError("too many nodes (%d > %d)" % (len(nodes), MAX_NODES))
+    if not any(k in SINKS for k in kinds):
+        raise GraphError("graph has no sinks")
+
+    payload = b''.join(nodes)
+    size = 16 + len(payload)
+    if size > MAX_SIZE:
+        raise GraphError("graph is too large (%d > %d bytes)" % (size, MAX_SIZE))
+
+    return struct.pack('<IHHII', MAGIC, VERSION, len(nodes), size, zlib.crc32(payload)) + payload
+
+
+def check_graph(blob):
+    if len(blob) < 16:
+        raise GraphError("truncated header")
+    magic, version, count, size, crc = struct.unpack_from('<IHHII', blob)
+    if magic != MAGIC:
+        raise GraphError("bad magic")
+    if version != VERSION:
+        raise GraphError("unsupported version %d" % version)
+    if size > len(blob) or size < 16:
+        raise GraphError("truncated graph")
+    if zlib.crc32(blob[16:size]) != crc:
+        raise GraphError("bad crc")
+
+    by_id = {v[0]: k for k, v in NODE_TYPES.items()}
+    offset = 16
+    kinds = []
+    for i in range(count):
+        if offset + 4 > size:
+            raise GraphError("node %d: truncated" % i)
+        type_id, n_in, n_par, n_name = struct.unpack_from('<BBBB', blob, offset)
+        offset += 4
+        if type_id not in by_id:
+            raise GraphError("node %d: unknown type %d" % (i, type_id))
+        inputs = struct.unpack_from('<%dH' % n_in, blob, offset)
+        offset += 2 * n_in + 4 * n_par + n_name
+        if offset > size:
+            raise GraphError("node %d: truncated" % i)
+        for x in inputs:
+            if x >= i or kinds[x] in SINKS:
+                raise GraphError("node %d: bad input %d" % (i, x))
+        kinds.append(by_id[type_id])
+    if offset != size:
+        raise GraphError("trailing data")
+    return kinds
+
+
+def main():
+    ap = argparse.ArgumentParser(description="ventctl control graph compiler")
+    ap.add_argument('input', nargs='?')
+    ap.add_argument('-o', '--output')
+    ap.add_argument('--peripherals', help="comma separated list of valid peripheral names")
+    ap.add_argument('--hex', action='store_true', help="print the blob as hex lines for the 'graph data' terminal command")
+    ap.add_argument('--check', metavar='BIN', help="validate an existing binary graph")
+    args = ap.parse_args()
+
+    try:
+        if args.check:
+            with open(args.check, 'rb') as f:
+                kinds = check_graph(f.read())
+            print("OK: %d nodes" % len(kinds))
+            return 0
+
+        if not args.input:
+            ap.error("input file required")
+
+        with open(args.input) as f:
+            peripherals = set(args.peripherals.split(',')) if args.peripherals else None
+            blob = compile_graph(f.read(), peripherals)
+
+        check_graph(blob)
+
+        if args.output:
+            with open(args.output, 'wb') as f:
+                f.write(blob)
+
+        if args.hex:
+            print("graph begin")
+            for i in range(0, len(blob), 64):
+                print("graph data " + blob[i:i + 64].hex())
+            print("graph commit")
+        elif not args.output:
+            sys.stdout.buffer.write(blob)
+    except GraphError as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
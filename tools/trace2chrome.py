@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""
+Converts a trace dump (terminal "trace dump" or the d2p/trace/data MQTT
+topic, see lib/ventctl/include/Trace.hpp) into Chrome trace event JSON for
+chrome://tracing or https://ui.perfetto.dev.
+
+Input lines:
+
+    T <counter frequency> <event count>
+    E <zone> <start> <duration>
+
+Anything else (log output around the dump) is ignored. The 32 bit counter
+wraps every ~25 s at 168 MHz, so starts are unwrapped assuming events are
+in order and no gap between two events is longer than one wrap.
+
+Usage:
+    trace2chrome.py dump.txt -o trace.json
+    mosquitto_sub -t d2p/trace/data | trace2chrome.py - -o trace.json
+"""
+
+import argparse
+import json
+import sys
+
+WRAP = 1 << 32
+
+
+def parse(lines):
+    frequency = None
+    events = []
+
+    for line in lines:
+        parts = line.split()
+        if len(parts) == 3 and parts[0] == 'T':
+            frequency = int(parts[1])
+        elif len(parts) == 4 and parts[0] == 'E':
+            try:
+                events.append((parts[1], int(parts[2]), int(parts[3])))
+            except ValueError:
+                continue
+
+    if frequency is None:
+        raise ValueError('no "T <frequency>" header found')
+
+    return frequency, events
+
+
+def convert(frequency, events):
+    scale = 1e6 / frequency
+    result = []
+    offset = 0
+    previous = None
+
+    for zone, start, duration in events:
+        if previous is not None and start + offset < previous - WRAP // 2:
+            offset += WRAP
+        absolute = start + offset
+        previous = absolute
+
+        result.append({
+            'name': zone,
+            'ph': 'X',
+            'ts': absolute * scale,
+            'dur': duration * scale,
+            'pid': 0,
+            'tid': 0,
+        })
+
+    # Nested zones are recorded when they end, Chrome wants them by start time
+    result.sort(key=lambda e: (e['ts'], -e['dur']))
+    return {'traceEvents': result, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('input', help='dump file, - for stdin')
+    ap.add_argument('-o', '--output', help='output JSON, stdout by default')
+    args = ap.parse_args()
+
+    src = sys.stdin if args.input == '-' else open(args.input)
+    try:
+        frequency, events = parse(src)
+    except ValueError as e:
+        print('error: %s' % e, file=sys.stderr)
+        return 1
+
+    trace = convert(frequency, events)
+    out = open(args.output, 'w') if args.output else sys.stdout
+    json.dump(trace, out, indent=1)
+
+    print('%d events' % len(events), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())